@@ -0,0 +1,72 @@
+/*
+ * Copyright (C) 2020 by Xu Xing (xu.xing@outlook.com)
+ *
+ * This code is licensed under the MIT license (MIT)
+ * (http://opensource.org/licenses/MIT)
+ */
+#ifndef ALIGNED_ALLOCATOR_H_
+#define ALIGNED_ALLOCATOR_H_
+
+#include <cstddef>
+#include <new>
+#include <stdlib.h>
+#include <vector>
+#if defined(_WIN32)
+#include <malloc.h>
+#endif
+
+// Returns size bytes, rounded up to a multiple of alignment, at an address
+// aligned to alignment. alignment must be a power of two.
+inline void *alignedAlloc(size_t alignment, size_t size) {
+  size = (size + alignment - 1) & ~(alignment - 1);
+#if defined(_WIN32)
+  return _aligned_malloc(size, alignment);
+#else
+  void *ptr = nullptr;
+  return posix_memalign(&ptr, alignment, size) == 0 ? ptr : nullptr;
+#endif
+}
+
+inline void alignedFree(void *ptr) {
+#if defined(_WIN32)
+  _aligned_free(ptr);
+#else
+  free(ptr);
+#endif
+}
+
+// std::allocator replacement for host data that ops may import with
+// VK_EXT_external_memory_host instead of copying it. Both the address and
+// the size of each allocation are multiples of Alignment, which has to be a
+// multiple of ComputeContext::getMinImportedHostPointerAlignment(); the
+// default page size covers current drivers.
+template <typename T, size_t Alignment = 4096> class AlignedAllocator {
+public:
+  typedef T value_type;
+  template <typename U> struct rebind {
+    typedef AlignedAllocator<U, Alignment> other;
+  };
+
+  AlignedAllocator() {}
+  template <typename U>
+  AlignedAllocator(const AlignedAllocator<U, Alignment> &) {}
+
+  T *allocate(size_t n) {
+    void *ptr = alignedAlloc(Alignment, n * sizeof(T));
+    if (!ptr)
+      throw std::bad_alloc();
+    return static_cast<T *>(ptr);
+  }
+  void deallocate(T *ptr, size_t) { alignedFree(ptr); }
+
+  template <typename U>
+  bool operator==(const AlignedAllocator<U, Alignment> &) const {
+    return true;
+  }
+  template <typename U>
+  bool operator!=(const AlignedAllocator<U, Alignment> &) const {
+    return false;
+  }
+};
+
+#endif
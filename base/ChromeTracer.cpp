@@ -0,0 +1,281 @@
+/*
+ * Copyright (C) 2020 by Xu Xing (xu.xing@outlook.com)
+ *
+ * This code is licensed under the MIT license (MIT)
+ * (http://opensource.org/licenses/MIT)
+ */
+#include "ChromeTracer.h"
+#include "SkTraceEvent.h"
+#include "Utils.h"
+
+#include <fstream>
+#include <string.h>
+
+namespace {
+
+// Category groups arrive with this prefix (see SkTraceEvent.h).
+const char *CATEGORY_PREFIX = TRACE_CATEGORY_PREFIX;
+// Handed out once every category is taken.
+const uint8_t DISABLED_CATEGORY = 0;
+// Threads get tids from 1, the GPU track is 0.
+const uint32_t GPU_TID = 0;
+
+thread_local void *threadBuffer = nullptr;
+
+std::string escape(const char *text) {
+  std::string escaped;
+  for (const char *c = text; *c; c++) {
+    if (*c == '"' || *c == '\\') {
+      escaped += '\\';
+      escaped += *c;
+    } else if ((unsigned char)*c < 0x20) {
+      char code[7];
+      snprintf(code, sizeof(code), "\\u%04x", *c);
+      escaped += code;
+    } else {
+      escaped += *c;
+    }
+  }
+  return escaped;
+}
+
+void writeThreadName(std::ostream &out, uint32_t tid,
+                     const std::string &name) {
+  out << ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << tid
+      << ",\"args\":{\"name\":\"" << name << "\"}}";
+}
+
+} // namespace
+
+ChromeTracer *ChromeTracer::install() {
+  ChromeTracer *tracer = new ChromeTracer();
+  // SetInstance() deletes the tracer when it fails.
+  return SkEventTracer::SetInstance(tracer) ? tracer : nullptr;
+}
+
+ChromeTracer::ChromeTracer() {}
+
+ChromeTracer::~ChromeTracer() {
+  for (std::unique_ptr<ThreadBuffer> &buffer : threadBuffers_) {
+    Chunk *chunk = buffer->first;
+    while (chunk) {
+      Chunk *next = chunk->next.load();
+      delete chunk;
+      chunk = next;
+    }
+  }
+}
+
+uint64_t ChromeTracer::nowUs() {
+  return std::chrono::duration_cast<std::chrono::microseconds>(
+             Clock::now().time_since_epoch())
+      .count();
+}
+
+void ChromeTracer::setEnabled(bool enabled) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  enabled_ = enabled;
+  const uint8_t flag =
+      enabled ? SkEventTracer::kEnabledForRecording_CategoryGroupEnabledFlags
+              : 0;
+  for (uint32_t i = 0; i < categoryCount_; i++)
+    categoryFlags_[i] = flag;
+}
+
+void ChromeTracer::addGpuResults(
+    const std::vector<GpuProfiler::Result> &results, double offsetMs) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  for (const GpuProfiler::Result &result : results) {
+    GpuEvent event;
+    event.name = result.name;
+    event.beginUs = (result.beginMs + offsetMs) * 1000.0;
+    event.durationUs = result.ms * 1000.0;
+    gpuEvents_.push_back(event);
+  }
+}
+
+const uint8_t *ChromeTracer::getCategoryGroupEnabled(const char *name) {
+  const size_t prefixLength = strlen(CATEGORY_PREFIX);
+  if (strncmp(name, CATEGORY_PREFIX, prefixLength) == 0)
+    name += prefixLength;
+  std::lock_guard<std::mutex> lock(mutex_);
+  const uint32_t count = categoryCount_;
+  for (uint32_t i = 0; i < count; i++) {
+    if (categoryNames_[i] == name)
+      return &categoryFlags_[i];
+  }
+  if (count == MAX_CATEGORIES)
+    return &DISABLED_CATEGORY;
+  categoryNames_[count] = name;
+  categoryFlags_[count] =
+      enabled_ ? SkEventTracer::kEnabledForRecording_CategoryGroupEnabledFlags
+               : 0;
+  categoryCount_ = count + 1;
+  return &categoryFlags_[count];
+}
+
+const char *
+ChromeTracer::getCategoryGroupName(const uint8_t *categoryEnabledFlag) {
+  if (categoryEnabledFlag < categoryFlags_ ||
+      categoryEnabledFlag >= categoryFlags_ + categoryCount_)
+    return "";
+  return categoryNames_[categoryEnabledFlag - categoryFlags_].c_str();
+}
+
+ChromeTracer::ThreadBuffer &ChromeTracer::getThreadBuffer() {
+  // There is only one tracer (install()), so one buffer per thread.
+  if (!threadBuffer) {
+    std::unique_ptr<ThreadBuffer> buffer(new ThreadBuffer());
+    buffer->first = buffer->last = new Chunk();
+    threadBuffer = buffer.get();
+    std::lock_guard<std::mutex> lock(mutex_);
+    buffer->threadIndex = static_cast<uint32_t>(threadBuffers_.size());
+    threadBuffers_.push_back(std::move(buffer));
+  }
+  return *static_cast<ThreadBuffer *>(threadBuffer);
+}
+
+SkEventTracer::Handle ChromeTracer::addTraceEvent(
+    char phase, const uint8_t *categoryEnabledFlag, const char *name,
+    uint64_t id, int32_t numArgs, const char **argNames,
+    const uint8_t *argTypes, const uint64_t *argValues, uint8_t flags) {
+  if (!enabled_)
+    return 0;
+  ThreadBuffer &buffer = getThreadBuffer();
+  Chunk *chunk = buffer.last;
+  uint32_t index = chunk->count.load(std::memory_order_relaxed);
+  if (index == CHUNK_EVENTS) {
+    Chunk *next = new Chunk();
+    chunk->next.store(next, std::memory_order_release);
+    buffer.last = chunk = next;
+    index = 0;
+  }
+
+  Event &event = chunk->events[index];
+  event.phase = phase;
+  event.category =
+      static_cast<uint8_t>(categoryEnabledFlag - categoryFlags_);
+  event.flags = flags;
+  if (flags & TRACE_EVENT_FLAG_COPY)
+    event.copiedName = name;
+  else
+    event.name = name;
+  event.id = id;
+  event.beginUs = nowUs();
+  event.argCount = static_cast<uint8_t>(
+      numArgs < (int32_t)MAX_ARGS ? numArgs : (int32_t)MAX_ARGS);
+  for (uint32_t i = 0; i < event.argCount; i++) {
+    event.argNames[i] = argNames[i];
+    event.argTypes[i] = argTypes[i];
+    event.argValues[i] = argValues[i];
+    if (argTypes[i] == TRACE_VALUE_TYPE_COPY_STRING) {
+      skia::tracing_internals::TraceValueUnion value;
+      value.as_uint = argValues[i];
+      event.argStrings[i] = value.as_string;
+    }
+  }
+  // Publishes the event to write().
+  chunk->count.store(index + 1, std::memory_order_release);
+  return reinterpret_cast<SkEventTracer::Handle>(&event);
+}
+
+void ChromeTracer::updateTraceEventDuration(
+    const uint8_t * /*categoryEnabledFlag*/, const char * /*name*/,
+    SkEventTracer::Handle handle) {
+  if (!handle)
+    return;
+  reinterpret_cast<Event *>(handle)->endUs.store(nowUs(),
+                                                 std::memory_order_relaxed);
+}
+
+void ChromeTracer::writeEvent(std::ostream &out, const Event &event,
+                              uint32_t threadIndex, uint64_t nowUs) const {
+  const char *name =
+      (event.flags & TRACE_EVENT_FLAG_COPY) ? event.copiedName.c_str()
+                                            : event.name;
+  out << ",\n{\"name\":\"" << escape(name) << "\",\"cat\":\""
+      << escape(categoryNames_[event.category].c_str()) << "\",\"ph\":\""
+      << event.phase << "\",\"pid\":1,\"tid\":" << threadIndex + 1
+      << ",\"ts\":" << event.beginUs;
+  if (event.phase == TRACE_EVENT_PHASE_COMPLETE) {
+    const uint64_t endUs = event.endUs.load(std::memory_order_relaxed);
+    out << ",\"dur\":" << (endUs ? endUs : nowUs) - event.beginUs;
+  }
+  if (event.flags & TRACE_EVENT_FLAG_HAS_ID)
+    out << ",\"id\":\"0x" << std::hex << event.id << std::dec << "\"";
+  if (event.phase == TRACE_EVENT_PHASE_INSTANT) {
+    const uint8_t scope = event.flags & TRACE_EVENT_FLAG_SCOPE_MASK;
+    out << ",\"s\":\""
+        << (scope == TRACE_EVENT_SCOPE_GLOBAL
+                ? TRACE_EVENT_SCOPE_NAME_GLOBAL
+                : scope == TRACE_EVENT_SCOPE_PROCESS
+                      ? TRACE_EVENT_SCOPE_NAME_PROCESS
+                      : TRACE_EVENT_SCOPE_NAME_THREAD)
+        << "\"";
+  }
+  out << ",\"args\":{";
+  for (uint32_t i = 0; i < event.argCount; i++) {
+    skia::tracing_internals::TraceValueUnion value;
+    value.as_uint = event.argValues[i];
+    out << (i ? "," : "") << "\"" << escape(event.argNames[i]) << "\":";
+    switch (event.argTypes[i]) {
+    case TRACE_VALUE_TYPE_BOOL:
+      out << (value.as_bool ? "true" : "false");
+      break;
+    case TRACE_VALUE_TYPE_UINT:
+      out << value.as_uint;
+      break;
+    case TRACE_VALUE_TYPE_INT:
+      out << value.as_int;
+      break;
+    case TRACE_VALUE_TYPE_DOUBLE:
+      out << value.as_double;
+      break;
+    case TRACE_VALUE_TYPE_POINTER:
+      out << "\"" << value.as_pointer << "\"";
+      break;
+    case TRACE_VALUE_TYPE_STRING:
+      out << "\"" << escape(value.as_string) << "\"";
+      break;
+    case TRACE_VALUE_TYPE_COPY_STRING:
+      out << "\"" << escape(event.argStrings[i].c_str()) << "\"";
+      break;
+    default:
+      out << "null";
+      break;
+    }
+  }
+  out << "}}";
+}
+
+bool ChromeTracer::write(const std::string &path) {
+  std::ofstream out(path, std::ios::trunc);
+  if (!out)
+    return false;
+  const uint64_t now = nowUs();
+  std::lock_guard<std::mutex> lock(mutex_);
+  out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n"
+      << "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"args\":"
+         "{\"name\":\"VulkanCompute\"}}";
+  writeThreadName(out, GPU_TID, "GPU");
+  out.precision(3);
+  out << std::fixed;
+  for (const GpuEvent &event : gpuEvents_) {
+    out << ",\n{\"name\":\"" << escape(event.name.c_str())
+        << "\",\"cat\":\"gpu\",\"ph\":\"X\",\"pid\":1,\"tid\":" << GPU_TID
+        << ",\"ts\":" << event.beginUs << ",\"dur\":" << event.durationUs
+        << "}";
+  }
+  for (const std::unique_ptr<ThreadBuffer> &buffer : threadBuffers_) {
+    writeThreadName(out, buffer->threadIndex + 1,
+                    "thread " + std::to_string(buffer->threadIndex));
+    for (const Chunk *chunk = buffer->first; chunk;
+         chunk = chunk->next.load(std::memory_order_acquire)) {
+      const uint32_t count = chunk->count.load(std::memory_order_acquire);
+      for (uint32_t i = 0; i < count; i++)
+        writeEvent(out, chunk->events[i], buffer->threadIndex, now);
+    }
+  }
+  out << "\n]}\n";
+  return static_cast<bool>(out);
+}
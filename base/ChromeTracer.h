@@ -0,0 +1,128 @@
+/*
+ * Copyright (C) 2020 by Xu Xing (xu.xing@outlook.com)
+ *
+ * This code is licensed under the MIT license (MIT)
+ * (http://opensource.org/licenses/MIT)
+ */
+#ifndef CHROME_TRACER_H_
+#define CHROME_TRACER_H_
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "GpuProfiler.h"
+#include "SkEventTracer.h"
+
+// Records the TRACE_EVENT macros of SkTraceEvent.h and writes them as Chrome
+// trace JSON, for chrome://tracing or https://ui.perfetto.dev.
+//
+// Each thread appends to a buffer of its own, a list of fixed size chunks
+// that only it writes and that write() reads up to the count the thread last
+// published, so recording takes no lock. The lock is only taken the first
+// time a thread records, and the first time each trace macro checks its
+// category.
+//
+// The trace macros keep the category flag of the tracer installed when they
+// first run, so install() has to come before any traced code runs. GPU
+// ranges from GpuProfiler go on a track of their own through addGpuResults().
+class ChromeTracer : public SkEventTracer {
+public:
+  // Installs a tracer as the SkEventTracer instance and returns it, or
+  // returns null when another tracer is installed already. The tracer
+  // records nothing until setEnabled(true).
+  static ChromeTracer *install();
+
+  ~ChromeTracer() override;
+
+  void setEnabled(bool enabled);
+  bool isEnabled() const { return enabled_; }
+  // Puts GPU ranges on the GPU track. offsetMs takes their device times to
+  // Clock times, see ComputeContext::calibrateTimestamps().
+  void addGpuResults(const std::vector<GpuProfiler::Result> &results,
+                     double offsetMs);
+  // Writes everything recorded so far. Events of scopes still open are
+  // written as ending now.
+  bool write(const std::string &path);
+
+  const uint8_t *getCategoryGroupEnabled(const char *name) override;
+  const char *
+  getCategoryGroupName(const uint8_t *categoryEnabledFlag) override;
+  SkEventTracer::Handle addTraceEvent(char phase,
+                                      const uint8_t *categoryEnabledFlag,
+                                      const char *name, uint64_t id,
+                                      int32_t numArgs, const char **argNames,
+                                      const uint8_t *argTypes,
+                                      const uint64_t *argValues,
+                                      uint8_t flags) override;
+  void updateTraceEventDuration(const uint8_t *categoryEnabledFlag,
+                                const char *name,
+                                SkEventTracer::Handle handle) override;
+
+private:
+  static const uint32_t MAX_CATEGORIES = 64;
+  static const uint32_t MAX_ARGS = 2;
+  static const uint32_t CHUNK_EVENTS = 1024;
+
+  struct Event {
+    char phase = 0;
+    uint8_t category = 0;
+    uint8_t flags = 0;
+    uint8_t argCount = 0;
+    const char *name = nullptr;
+    // Set instead of name for TRACE_EVENT_FLAG_COPY.
+    std::string copiedName;
+    uint64_t id = 0;
+    uint64_t beginUs = 0;
+    // Complete events only. 0 while the scope is open.
+    std::atomic<uint64_t> endUs{0};
+    const char *argNames[MAX_ARGS] = {nullptr, nullptr};
+    uint8_t argTypes[MAX_ARGS] = {0, 0};
+    uint64_t argValues[MAX_ARGS] = {0, 0};
+    // TRACE_VALUE_TYPE_COPY_STRING values.
+    std::string argStrings[MAX_ARGS];
+  };
+
+  struct Chunk {
+    Event events[CHUNK_EVENTS];
+    // Events the owning thread has finished writing.
+    std::atomic<uint32_t> count{0};
+    std::atomic<Chunk *> next{nullptr};
+  };
+
+  struct ThreadBuffer {
+    uint32_t threadIndex = 0;
+    Chunk *first = nullptr;
+    // Only touched by the owning thread.
+    Chunk *last = nullptr;
+  };
+
+  struct GpuEvent {
+    std::string name;
+    double beginUs = 0.0;
+    double durationUs = 0.0;
+  };
+
+  ChromeTracer();
+  ChromeTracer(const ChromeTracer &) = delete;
+  ChromeTracer &operator=(const ChromeTracer &) = delete;
+
+  ThreadBuffer &getThreadBuffer();
+  static uint64_t nowUs();
+  void writeEvent(std::ostream &out, const Event &event,
+                  uint32_t threadIndex, uint64_t nowUs) const;
+
+  std::atomic<bool> enabled_{false};
+  // Category flags handed to the trace macros, so they never move.
+  uint8_t categoryFlags_[MAX_CATEGORIES] = {};
+  std::string categoryNames_[MAX_CATEGORIES];
+  std::atomic<uint32_t> categoryCount_{0};
+  std::mutex mutex_;
+  std::vector<std::unique_ptr<ThreadBuffer>> threadBuffers_;
+  std::vector<GpuEvent> gpuEvents_;
+};
+
+#endif
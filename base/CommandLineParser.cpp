@@ -26,6 +26,10 @@ CommandLineParser::CommandLineParser(int &argc, char **argv) {
   if (!paraName.empty()) {
     workgroup_size_z_ = (uint32_t)std::atoi(paraName.c_str());
   }
+  paraName = getCmdOption("-n");
+  if (!paraName.empty()) {
+    iterations_ = (uint32_t)std::atoi(paraName.c_str());
+  }
 }
 const std::string &
 CommandLineParser::getCmdOption(const std::string &option) const {
@@ -46,3 +50,4 @@ const uint32_t CommandLineParser::getHeight() { return height_; }
 const uint32_t CommandLineParser::getWorkgroupSizeX() { return workgroup_size_x_; }
 const uint32_t CommandLineParser::getWorkgroupSizeY() { return workgroup_size_y_; }
 const uint32_t CommandLineParser::getWorkgroupSizeZ() { return workgroup_size_z_; }
+const uint32_t CommandLineParser::getIterations() { return iterations_; }
\ No newline at end of file
@@ -15,12 +15,14 @@ public:
   const uint32_t getWorkgroupSizeX();
   const uint32_t getWorkgroupSizeY();
   const uint32_t getWorkgroupSizeZ();
+  const uint32_t getIterations();
 private:
   uint32_t width_ = 4;
   uint32_t height_ = 8;
   uint32_t workgroup_size_x_ = 1;
   uint32_t workgroup_size_y_ = 1;
   uint32_t workgroup_size_z_ = 1;
+  uint32_t iterations_ = 10;
   std::vector<std::string> tokens;
 };
 #endif
\ No newline at end of file
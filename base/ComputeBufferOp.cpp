@@ -15,51 +15,66 @@ ComputeBufferOp::~ComputeBufferOp() {}
 ComputeBufferOp::ComputeBufferOp(const InitParams &init_params)
     : ComputeOp(init_params) {}
 
-void ComputeBufferOp::execute() {
+ComputeBufferOp::ComputeBufferOp(const InitParams &init_params,
+                                 std::shared_ptr<ComputeContext> context)
+    : ComputeOp(init_params, context) {}
+
+void ComputeBufferOp::prepare() {
+  assert(tensorInput_ == VK_NULL_HANDLE);
   // Prepare storage buffers.
-  const VkDeviceSize bufferSize =
-      (params_.inputWidth * params_.inputHeight) * sizeof(uint32_t);
-  const VkDeviceSize filterBufferSize =
-      (params_.filterWidth * params_.filterHeight) * sizeof(uint32_t);
-  const VkDeviceSize outputBufferSize =
-      (params_.outputWidth * params_.outputHeight) * sizeof(uint32_t);
-
-  // Copy input data to VRAM using a staging buffer.
-  {
-    TIME("execute:createBufferWithData",
-         createBufferWithData(VK_BUFFER_USAGE_TRANSFER_SRC_BIT |
-                                  VK_BUFFER_USAGE_TRANSFER_DST_BIT,
-                              VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT, &hostBuffer_,
-                              &hostMemory_, bufferSize,
-                              params_.computeInput.data()));
+  const VkDeviceSize bufferSize = getInputBytes();
+  const VkDeviceSize filterBufferSize = getFilterBytes();
+  const VkDeviceSize outputBufferSize = getOutputBytes();
+  if (params_.executionMode == EXECUTION_MODE_ZERO_STAGING &&
+      !supportsZeroStaging(bufferSize + filterBufferSize + outputBufferSize)) {
+    LOG("No room in device local host visible memory, using single submit\n");
+    params_.executionMode = EXECUTION_MODE_SINGLE_SUBMIT;
+  }
+  const bool zeroStaging =
+      params_.executionMode == EXECUTION_MODE_ZERO_STAGING;
+  const VkMemoryPropertyFlags deviceLocal =
+      static_cast<VkMemoryPropertyFlags>(VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+  const VkMemoryPropertyFlags mappedDeviceLocal =
+      deviceLocal | VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT;
+  // Reading uncached memory from the CPU is slow, so the output is only read
+  // in place where device local memory is also host cached.
+  const bool outputInPlace =
+      zeroStaging &&
+      allocator_->selectMemoryType(UINT32_MAX,
+                                   mappedDeviceLocal |
+                                       VK_MEMORY_PROPERTY_HOST_CACHED_BIT) !=
+          UINT32_MAX;
 
-    TIME("execute:createBufferWithData",
+  // Input device buffer. Input data is uploaded by run().
+  {
+    TIME("prepare:createBufferWithData",
          createBufferWithData(VK_BUFFER_USAGE_STORAGE_BUFFER_BIT |
                                   VK_BUFFER_USAGE_TRANSFER_SRC_BIT |
                                   VK_BUFFER_USAGE_TRANSFER_DST_BIT,
-                              VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+                              zeroStaging ? mappedDeviceLocal : deviceLocal,
                               &deviceBuffer_, &deviceMemory_, bufferSize));
-
-    TIME("execute:copyHostBufferToDeviceBuffer",
-         copyHostBufferToDeviceBuffer(deviceBuffer_, hostBuffer_, bufferSize));
-#ifdef USE_READBACK_INPUT
-    // Debug only.
-    copyDeviceBufferToHostBuffer(deviceBuffer_, params_.computeInput.data(),
-                                 bufferSize, params_.inputWidth,
-                                 params_.inputHeight);
-#endif
+    // The single submit command buffer uploads from a host buffer of its own
+    // instead of the staging ring.
+    if (params_.executionMode == EXECUTION_MODE_SINGLE_SUBMIT) {
+      TIME("prepare:createBufferWithData",
+           createBufferWithData(VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+                                VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT,
+                                &hostBuffer_, &hostMemory_, bufferSize));
+    }
   }
 
-  // Copy filter data to VRAM using a staging buffer.
-  {
-    TIME("execute:createBufferWithData",
-         createBufferWithData(VK_BUFFER_USAGE_TRANSFER_SRC_BIT |
-                                  VK_BUFFER_USAGE_TRANSFER_DST_BIT,
-                              VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT,
-                              &filterHostBuffer_, &filterHostMemory_,
-                              filterBufferSize, params_.computeFilter.data()));
-
-    TIME("execute:createBufferWithData",
+  // Copy filter data to VRAM through the staging ring, or straight into
+  // mapped device memory. The filter is constant across runs, so it is
+  // uploaded only once.
+  if (zeroStaging) {
+    TIME("prepare:createBufferWithData",
+         createBufferWithData(VK_BUFFER_USAGE_STORAGE_BUFFER_BIT |
+                                  VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+                              mappedDeviceLocal, &filterDeviceBuffer_,
+                              &filterDeviceMemory_, filterBufferSize,
+                              const_cast<void *>(getFilterElements())));
+  } else {
+    TIME("prepare:createBufferWithData",
          createBufferWithData(VK_BUFFER_USAGE_STORAGE_BUFFER_BIT |
                                   VK_BUFFER_USAGE_TRANSFER_SRC_BIT |
                                   VK_BUFFER_USAGE_TRANSFER_DST_BIT,
@@ -67,48 +82,184 @@ void ComputeBufferOp::execute() {
                               &filterDeviceBuffer_, &filterDeviceMemory_,
                               filterBufferSize));
 
-    // Copy to staging buffer.
-    TIME("execute:copyHostBufferToDeviceBuffer",
-         copyHostBufferToDeviceBuffer(filterDeviceBuffer_, filterHostBuffer_,
-                                      filterBufferSize));
+    TIME("prepare:uploadToDeviceBuffer",
+         uploadToDeviceBuffer(filterDeviceBuffer_, getFilterElements(),
+                              filterBufferSize));
 #ifdef USE_READBACK_INPUT
-    // Debug only.
-    copyDeviceBufferToHostBuffer(filterDeviceBuffer_,
-                                 params_.computeFilter.data(), filterBufferSize,
-                                 params_.filterWidth, params_.filterHeight);
+    // Debug only. The buffer holds elements of params_.elementType.
+    std::vector<char> filterElements(filterBufferSize);
+    copyDeviceBufferToHostBuffer(filterDeviceBuffer_, filterElements.data(),
+                                 filterBufferSize, params_.filterWidth,
+                                 params_.filterHeight);
+    convertElements(filterElements.data(), params_.elementType,
+                    getFilterElementCount(),
+                    params_.computeFilter.getElementType(),
+                    params_.computeFilter.data());
 #endif
   }
 
   {
+    if (!outputInPlace) {
+      TIME("prepare:createBufferWithData",
+           createBufferWithData(VK_BUFFER_USAGE_TRANSFER_SRC_BIT |
+                                    VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                                VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT,
+                                &outputHostBuffer_, &outputHostMemory_,
+                                outputBufferSize));
+    }
 
-    TIME("execute:createBufferWithData",
-         createBufferWithData(VK_BUFFER_USAGE_TRANSFER_SRC_BIT |
-                                  VK_BUFFER_USAGE_TRANSFER_DST_BIT,
-                              VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT,
-                              &outputHostBuffer_, &outputHostMemory_,
-                              outputBufferSize));
-
-    TIME("execute:createBufferWithData",
+    TIME("prepare:createBufferWithData",
          createBufferWithData(VK_BUFFER_USAGE_STORAGE_BUFFER_BIT |
                                   VK_BUFFER_USAGE_TRANSFER_SRC_BIT |
                                   VK_BUFFER_USAGE_TRANSFER_DST_BIT,
-                              VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+                              outputInPlace
+                                  ? mappedDeviceLocal |
+                                        VK_MEMORY_PROPERTY_HOST_CACHED_BIT
+                                  : deviceLocal,
                               &outputDeviceBuffer_, &outputDeviceMemory_,
                               outputBufferSize));
   }
 
   // Prepare compute pipeline.
-  TIME("execute:prepareBufferToBufferPipeline",
+  TIME("prepare:prepareBufferToBufferPipeline",
        prepareBufferToBufferPipeline(deviceBuffer_, filterDeviceBuffer_,
                                      outputDeviceBuffer_));
 
-  // Command buffer creation (for compute work submission).
-  TIME("execute:prepareCommandBuffer",
-       prepareCommandBuffer(outputDeviceBuffer_, outputHostBuffer_,
-                            outputHostMemory_, outputBufferSize));
-  TIME("execute:copyDeviceBufferToHostBuffer",
-       copyDeviceBufferToHostBuffer(
-           outputDeviceBuffer_, params_.computeOutput.data(), outputBufferSize,
-           params_.outputWidth, params_.outputHeight));
-  vkQueueWaitIdle(queue_);
+  // Command buffer recording (for compute work submission).
+  TIME("prepare:recordCommandBuffer",
+       recordCommandBuffer(outputDeviceBuffer_, outputHostBuffer_,
+                           outputBufferSize));
+  prepared_ = true;
+}
+
+void ComputeBufferOp::run(const std::vector<DATA_TYPE> &input,
+                          std::vector<DATA_TYPE> &output) {
+  assert(input.size() >= getInputElementCount());
+  assert(output.size() >= getOutputElementCount());
+  run(input.data(), output.data());
+}
+
+void ComputeBufferOp::run(const Tensor &input, Tensor &output) {
+  if (tensorInput_ == VK_NULL_HANDLE) {
+    prepare(input, output);
+  } else if (input.getBuffer() != tensorInput_ ||
+             output.getBuffer() != tensorOutput_) {
+    assert(input.getBytes() == getInputBytes() &&
+           output.getBytes() == getOutputBytes());
+    bindTensors(input.getBuffer(), output.getBuffer(), tensorFilter_);
+    dispatchRecorded_ = false;
+  }
+  if (!dispatchRecorded_) {
+    recordDispatchCommandBuffer();
+    dispatchRecorded_ = true;
+  }
+  submitCommandBuffer();
+}
+
+void ComputeBufferOp::prepare(const Tensor &input, Tensor &output,
+                              const Tensor *operand) {
+  assert(!prepared_ && tensorInput_ == VK_NULL_HANDLE);
+  assert(input.getContext() == context_ && output.getContext() == context_);
+  assert(input.getElementType() == params_.elementType &&
+         output.getElementType() == params_.elementType);
+  assert(input.getBytes() == getInputBytes() &&
+         output.getBytes() == getOutputBytes());
+  if (operand) {
+    assert(operand->getContext() == context_ &&
+           operand->getElementType() == params_.elementType);
+    tensorFilter_ = operand->getBuffer();
+  } else {
+    // The filter is constant across runs, so it is uploaded only once.
+    TIME("prepare:createBufferWithData",
+         createBufferWithData(VK_BUFFER_USAGE_STORAGE_BUFFER_BIT |
+                                  VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                              VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+                              &filterDeviceBuffer_, &filterDeviceMemory_,
+                              getFilterBytes()));
+    uploadToDeviceBuffer(filterDeviceBuffer_, getFilterElements(),
+                         getFilterBytes());
+    tensorFilter_ = filterDeviceBuffer_;
+  }
+  tensorInput_ = input.getBuffer();
+  tensorOutput_ = output.getBuffer();
+  TIME("prepare:prepareBufferToBufferPipeline",
+       prepareBufferToBufferPipeline(tensorInput_, tensorFilter_,
+                                     tensorOutput_));
+}
+
+void ComputeBufferOp::bindTensors(VkBuffer input, VkBuffer output,
+                                  VkBuffer filter) {
+  tensorInput_ = input;
+  tensorOutput_ = output;
+  VkDescriptorBufferInfo outputBufferDescriptor = {output, 0, VK_WHOLE_SIZE};
+  VkDescriptorBufferInfo bufferDescriptor = {input, 0, VK_WHOLE_SIZE};
+  VkDescriptorBufferInfo filterBufferDescriptor = {filter, 0, VK_WHOLE_SIZE};
+  std::vector<VkWriteDescriptorSet> writes = {
+      vks::initializers::writeDescriptorSet(VK_NULL_HANDLE,
+                                            VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+                                            0, &outputBufferDescriptor),
+      vks::initializers::writeDescriptorSet(VK_NULL_HANDLE,
+                                            VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+                                            1, &bufferDescriptor),
+      vks::initializers::writeDescriptorSet(VK_NULL_HANDLE,
+                                            VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+                                            2, &filterBufferDescriptor),
+  };
+  VK_CHECK_RESULT(bindDescriptors(writes));
+}
+
+void ComputeBufferOp::runElements(const void *input, void *output) {
+  assert(prepared_);
+  const VkDeviceSize bufferSize = getInputBytes();
+  const VkDeviceSize outputBufferSize = getOutputBytes();
+  waitForAsync();
+
+  if (params_.executionMode != EXECUTION_MODE_STAGED) {
+    // commandBuffer_ already holds the upload, if any, and the readback.
+    copyToHostMemory(getInputHostMemory(), input, bufferSize);
+    submitCommandBuffer();
+    copyFromHostMemory(getOutputHostMemory(), output, outputBufferSize);
+    return;
+  }
+
+  // The upload is submitted together with the dispatch.
+  uploadToDeviceBuffer(deviceBuffer_, input, bufferSize);
+  submitCommandBuffer();
+  copyDeviceBufferToHostBuffer(outputDeviceBuffer_, outputHostBuffer_,
+                               outputHostMemory_, output, outputBufferSize);
+}
+
+std::shared_future<void> ComputeBufferOp::executeAsync() {
+  // The readback has to be recorded in the submitted command buffer, so an
+  // op not prepared yet is prepared in single submit mode unless it asked for
+  // zero staging.
+  if (!prepared_) {
+    if (params_.executionMode == EXECUTION_MODE_STAGED)
+      params_.executionMode = EXECUTION_MODE_SINGLE_SUBMIT;
+    TIME("executeAsync:prepare", prepare());
+  }
+  // The previous run may still be writing params_.computeOutput.
+  waitForAsync();
+  if (params_.executionMode == EXECUTION_MODE_STAGED) {
+    // Already prepared for staged runs by prepare() or execute(), whose
+    // readback is a submission of its own, so run before returning.
+    run(params_.computeInput, params_.computeOutput);
+    return readyFuture();
+  }
+  return submitAsync(params_.computeInput, params_.computeOutput);
+}
+
+void ComputeBufferOp::execute() {
+  TIME("execute:prepare", prepare());
+  TIME("execute:run", run(params_.computeInput, params_.computeOutput));
+#ifdef USE_READBACK_INPUT
+  // Debug only. The buffer holds elements of params_.elementType.
+  std::vector<char> inputElements(getInputBytes());
+  copyDeviceBufferToHostBuffer(deviceBuffer_, inputElements.data(),
+                               getInputBytes(), params_.inputWidth,
+                               params_.inputHeight);
+  convertElements(inputElements.data(), params_.elementType,
+                  getInputElementCount(), params_.computeInput.getElementType(),
+                  params_.computeInput.data());
+#endif
 }
@@ -12,7 +12,43 @@ class ComputeBufferOp : public ComputeOp {
 public:
   ComputeBufferOp();
   ComputeBufferOp(const InitParams &init_params);
+  ComputeBufferOp(const InitParams &init_params,
+                  std::shared_ptr<ComputeContext> context);
   void execute();
+  void prepare();
+  void run(const std::vector<DATA_TYPE> &input,
+           std::vector<DATA_TYPE> &output);
+  using ComputeOp::run;
+  // Runs on tensors of the op's context whose shapes, element type and
+  // layout match InitParams (see InitParams::setTensorShapes). They are
+  // bound in place of the op's own input and output buffers, so nothing is
+  // copied to or from the host; output can be the input of the next op.
+  // Builds the pipeline on first use with prepare(input, output) unless
+  // that was called already. prepare() must not be called on the same op.
+  void run(const Tensor &input, Tensor &output);
+  // Builds the pipeline on tensors without recording anything, for callers
+  // that record the op with recordDispatch() (see ComputeGraph). operand,
+  // when given, is bound in place of the op's own filter buffer, for ops
+  // with two tensor inputs; its shape is up to the shader.
+  void prepare(const Tensor &input, Tensor &output,
+               const Tensor *operand = nullptr);
+  std::shared_future<void> executeAsync();
   virtual ~ComputeBufferOp();
+
+protected:
+  // Staged runs import suitably aligned input (see AlignedVector) instead of
+  // copying it through the staging ring.
+  void runElements(const void *input, void *output);
+
+private:
+  void bindTensors(VkBuffer input, VkBuffer output, VkBuffer filter);
+
+  // Buffers last bound by prepare(Tensor) or run(Tensor). tensorFilter_ is
+  // the operand or filterDeviceBuffer_.
+  VkBuffer tensorInput_ = VK_NULL_HANDLE;
+  VkBuffer tensorOutput_ = VK_NULL_HANDLE;
+  VkBuffer tensorFilter_ = VK_NULL_HANDLE;
+  // Whether commandBuffer_ holds the dispatch on the bound tensors.
+  bool dispatchRecorded_ = false;
 };
 #endif
\ No newline at end of file
@@ -13,45 +13,41 @@ ComputeBufferToImageOp::~ComputeBufferToImageOp() {}
 ComputeBufferToImageOp::ComputeBufferToImageOp(const InitParams &init_params)
     : ComputeOp(init_params) {}
 
+ComputeBufferToImageOp::ComputeBufferToImageOp(
+    const InitParams &init_params, std::shared_ptr<ComputeContext> context)
+    : ComputeOp(init_params, context) {}
+
 void ComputeBufferToImageOp::execute() {
+  // Host data is uploaded as is, so it must be of the element type.
+  assert(params_.computeInput.getElementType() == params_.elementType &&
+         params_.computeFilter.getElementType() == params_.elementType);
   // Prepare storage buffers.
-  const VkDeviceSize bufferSize =
-      (params_.inputWidth * params_.inputHeight) * sizeof(uint32_t);
-  const VkDeviceSize filterBufferSize =
-      (params_.filterWidth * params_.filterHeight) * sizeof(uint32_t);
-  const VkDeviceSize outputBufferSize =
-      (params_.outputWidth * params_.outputHeight) * sizeof(uint32_t);
+  const VkDeviceSize bufferSize = getInputBytes();
+  const VkDeviceSize filterBufferSize = getFilterBytes();
+  const VkDeviceSize outputBufferSize = getOutputBytes();
 
-  // Copy input data to VRAM using a staging buffer.
+  // Copy input data to VRAM through the staging ring.
   {
-    createBufferWithData(VK_BUFFER_USAGE_TRANSFER_SRC_BIT |
-                             VK_BUFFER_USAGE_TRANSFER_DST_BIT,
-                         VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT, &hostBuffer_,
-                         &hostMemory_, bufferSize, params_.computeInput.data());
-
-    createDeviceImage(image_, params_.inputWidth, params_.inputHeight);
+    createDeviceImage(image_, imageMemory_, params_.inputWidth,
+                      params_.inputHeight);
     createSampler(image_, sampler_, view_);
 
-    copyHostBufferToDeviceImage(image_, hostBuffer_, params_.inputWidth,
-                                params_.inputHeight);
+    uploadToDeviceImage(image_, params_.computeInput.data(), bufferSize,
+                        params_.inputWidth, params_.inputHeight);
     // Debug only.
     copyDeviceImageToHostBuffer(image_, params_.computeInput.data(), bufferSize,
                                 params_.inputWidth, params_.inputHeight);
   }
 
-  // Copy filter data to VRAM using a staging buffer.
+  // Copy filter data to VRAM through the staging ring.
   {
-    createBufferWithData(
-        VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
-        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT, &filterHostBuffer_,
-        &filterHostMemory_, bufferSize, params_.computeFilter.data());
-
-    createDeviceImage(filterImage_, params_.filterWidth, params_.filterHeight);
+    createDeviceImage(filterImage_, filterImageMemory_, params_.filterWidth,
+                      params_.filterHeight);
     createSampler(filterImage_, filterSampler_, filterView_);
 
-    // Copy to staging buffer
-    copyHostBufferToDeviceImage(filterImage_, filterHostBuffer_,
-                                params_.filterWidth, params_.filterHeight);
+    uploadToDeviceImage(filterImage_, params_.computeFilter.data(),
+                        filterBufferSize, params_.filterWidth,
+                        params_.filterHeight);
     // Debug only.
     copyDeviceImageToHostBuffer(filterImage_, params_.computeFilter.data(),
                                 bufferSize, params_.filterWidth,
@@ -80,8 +76,6 @@ void ComputeBufferToImageOp::execute() {
   prepareCommandBuffer(outputDeviceBuffer_, outputHostBuffer_,
                        outputHostMemory_, outputBufferSize);
 
-  vkQueueWaitIdle(queue_);
-
   // Output buffer contents.
   // summary();
 }
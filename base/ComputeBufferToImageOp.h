@@ -12,6 +12,8 @@ class ComputeBufferToImageOp : public ComputeOp {
 public:
   ComputeBufferToImageOp();
   ComputeBufferToImageOp(const InitParams &init_params);
+  ComputeBufferToImageOp(const InitParams &init_params,
+                         std::shared_ptr<ComputeContext> context);
   void execute();
   virtual ~ComputeBufferToImageOp();
 };
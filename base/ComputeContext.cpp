@@ -0,0 +1,623 @@
+/*
+ * Copyright (C) 2020 by Xu Xing (xu.xing@outlook.com)
+ *
+ * This code is licensed under the MIT license (MIT)
+ * (http://opensource.org/licenses/MIT)
+ */
+#include "ComputeContext.h"
+#include "ComputeOp.h"
+#include "Utils.h"
+
+std::mutex ComputeContext::sharedMutex_;
+std::weak_ptr<ComputeContext> ComputeContext::shared_;
+
+std::shared_ptr<ComputeContext> ComputeContext::create() {
+  return create(DeviceSelection());
+}
+
+std::shared_ptr<ComputeContext>
+ComputeContext::create(const DeviceSelection &selection) {
+  if (selection.policy != DeviceSelection::POLICY_THROUGHPUT)
+    return std::shared_ptr<ComputeContext>(new ComputeContext(selection));
+
+  // Open each device in turn and keep the fastest; the device count is only
+  // known once the first instance exists.
+  DeviceSelection byIndex;
+  byIndex.policy = DeviceSelection::POLICY_INDEX;
+  std::shared_ptr<ComputeContext> best;
+  double bestThroughput = -1.0;
+  uint32_t deviceCount = 1;
+  for (uint32_t i = 0; i < deviceCount; i++) {
+    byIndex.index = i;
+    std::shared_ptr<ComputeContext> context(new ComputeContext(byIndex));
+    deviceCount = context->getPhysicalDeviceCount();
+    const double throughput = context->measureThroughput();
+    LOG("GPU %d (%s): %f GB/s\n", i, context->deviceProperties_.deviceName,
+        throughput);
+    if (throughput > bestThroughput) {
+      best = context;
+      bestThroughput = throughput;
+    }
+  }
+  return best;
+}
+
+std::shared_ptr<ComputeContext> ComputeContext::getShared() {
+  std::lock_guard<std::mutex> lock(sharedMutex_);
+  std::shared_ptr<ComputeContext> context = shared_.lock();
+  if (!context) {
+    context = create();
+    shared_ = context;
+  }
+  return context;
+}
+
+ComputeContext::ComputeContext(const DeviceSelection &selection)
+    : selection_(selection) {
+  prepareDebugLayer();
+  // Vulkan device creation.
+  prepareDevice();
+}
+
+ComputeContext::~ComputeContext() {
+  descriptorAllocator_.reset();
+  pipelineObjectCache_.reset();
+  tuningDatabase_.reset();
+  pipelineCache_.reset();
+  stagingRing_.reset();
+  profiler_.reset();
+  transferQueue_.reset();
+  transferTimeline_.reset();
+  queueTimeline_.reset();
+  allocator_.reset();
+  vkDestroyCommandPool(device_, commandPool_, nullptr);
+  vkDestroyDevice(device_, nullptr);
+#if DEBUG
+  if (debugReportCallback_) {
+    PFN_vkDestroyDebugReportCallbackEXT vkDestroyDebugReportCallback =
+        reinterpret_cast<PFN_vkDestroyDebugReportCallbackEXT>(
+            vkGetInstanceProcAddr(instance_,
+                                  "vkDestroyDebugReportCallbackEXT"));
+    assert(vkDestroyDebugReportCallback);
+    vkDestroyDebugReportCallback(instance_, debugReportCallback_, nullptr);
+  }
+#endif
+  vkDestroyInstance(instance_, nullptr);
+}
+
+VkResult ComputeContext::prepareDebugLayer() {
+
+#if defined(VK_USE_PLATFORM_ANDROID_KHR)
+  LOG("loading vulkan lib");
+  vks::android::loadVulkanLibrary();
+#endif
+
+  VkApplicationInfo appInfo = {};
+  appInfo.sType = VK_STRUCTURE_TYPE_APPLICATION_INFO;
+  appInfo.pApplicationName = "Vulkan add example";
+  appInfo.pEngineName = "ComputeOp";
+  appInfo.apiVersion = VK_API_VERSION_1_0;
+
+  // Vulkan instance creation (without surface extensions).
+  VkInstanceCreateInfo instanceCreateInfo = {};
+  instanceCreateInfo.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
+  instanceCreateInfo.pApplicationInfo = &appInfo;
+
+  // Needed to query the host pointer import alignment.
+  std::vector<const char *> instanceExtensions;
+  uint32_t extensionCount = 0;
+  vkEnumerateInstanceExtensionProperties(nullptr, &extensionCount, nullptr);
+  std::vector<VkExtensionProperties> extensions(extensionCount);
+  vkEnumerateInstanceExtensionProperties(nullptr, &extensionCount,
+                                         extensions.data());
+  bool hasProperties2 = false;
+  for (const auto &extension : extensions) {
+    if (strcmp(extension.extensionName,
+               VK_KHR_GET_PHYSICAL_DEVICE_PROPERTIES_2_EXTENSION_NAME) == 0) {
+      hasProperties2 = true;
+      instanceExtensions.push_back(
+          VK_KHR_GET_PHYSICAL_DEVICE_PROPERTIES_2_EXTENSION_NAME);
+    }
+  }
+
+  uint32_t layerCount = 0;
+#if defined(VK_USE_PLATFORM_ANDROID_KHR)
+  const char *validationLayers[] = {
+      "VK_LAYER_GOOGLE_threading",      "VK_LAYER_LUNARG_parameter_validation",
+      "VK_LAYER_LUNARG_object_tracker", "VK_LAYER_LUNARG_core_validation",
+      "VK_LAYER_LUNARG_swapchain",      "VK_LAYER_GOOGLE_unique_objects"};
+  layerCount = 6;
+#else
+  const char *validationLayers[] = {"VK_LAYER_LUNARG_standard_validation"};
+  layerCount = 1;
+#endif
+#if DEBUG
+  // Check if layers are available
+  uint32_t instanceLayerCount;
+  vkEnumerateInstanceLayerProperties(&instanceLayerCount, nullptr);
+  std::vector<VkLayerProperties> instanceLayers(instanceLayerCount);
+  vkEnumerateInstanceLayerProperties(&instanceLayerCount,
+                                     instanceLayers.data());
+
+  bool layersAvailable = true;
+  for (auto layerName : validationLayers) {
+    bool layerAvailable = false;
+    for (auto instanceLayer : instanceLayers) {
+      if (strcmp(instanceLayer.layerName, layerName) == 0) {
+        layerAvailable = true;
+        break;
+      }
+    }
+    if (!layerAvailable) {
+      layersAvailable = false;
+      break;
+    }
+  }
+
+  if (layersAvailable) {
+    instanceCreateInfo.ppEnabledLayerNames = validationLayers;
+    instanceCreateInfo.enabledLayerCount = layerCount;
+    instanceExtensions.push_back(VK_EXT_DEBUG_REPORT_EXTENSION_NAME);
+  }
+#endif
+  instanceCreateInfo.enabledExtensionCount =
+      static_cast<uint32_t>(instanceExtensions.size());
+  instanceCreateInfo.ppEnabledExtensionNames = instanceExtensions.data();
+  VK_CHECK_RESULT(vkCreateInstance(&instanceCreateInfo, nullptr, &instance_));
+  if (hasProperties2) {
+    getPhysicalDeviceProperties2_ =
+        reinterpret_cast<PFN_vkGetPhysicalDeviceProperties2KHR>(
+            vkGetInstanceProcAddr(instance_,
+                                  "vkGetPhysicalDeviceProperties2KHR"));
+    getPhysicalDeviceFeatures2_ =
+        reinterpret_cast<PFN_vkGetPhysicalDeviceFeatures2KHR>(
+            vkGetInstanceProcAddr(instance_,
+                                  "vkGetPhysicalDeviceFeatures2KHR"));
+  }
+
+#if defined(VK_USE_PLATFORM_ANDROID_KHR)
+  vks::android::loadVulkanFunctions(instance_);
+#endif
+#if DEBUG
+  if (layersAvailable) {
+    VkDebugReportCallbackCreateInfoEXT debugReportCreateInfo = {};
+    debugReportCreateInfo.sType =
+        VK_STRUCTURE_TYPE_DEBUG_REPORT_CALLBACK_CREATE_INFO_EXT;
+    debugReportCreateInfo.flags =
+        VK_DEBUG_REPORT_ERROR_BIT_EXT | VK_DEBUG_REPORT_WARNING_BIT_EXT;
+    debugReportCreateInfo.pfnCallback =
+        (PFN_vkDebugReportCallbackEXT)debugMessageCallback;
+
+    // We have to explicitly load this function.
+    PFN_vkCreateDebugReportCallbackEXT vkCreateDebugReportCallbackEXT =
+        reinterpret_cast<PFN_vkCreateDebugReportCallbackEXT>(
+            vkGetInstanceProcAddr(instance_, "vkCreateDebugReportCallbackEXT"));
+    assert(vkCreateDebugReportCallbackEXT);
+    VK_CHECK_RESULT(vkCreateDebugReportCallbackEXT(
+        instance_, &debugReportCreateInfo, nullptr, &debugReportCallback_));
+  }
+#endif
+  return VK_SUCCESS;
+}
+
+uint32_t ComputeContext::selectPhysicalDevice(
+    const std::vector<VkPhysicalDevice> &physicalDevices) const {
+  const uint32_t deviceCount = (uint32_t)physicalDevices.size();
+  if (selection_.policy == DeviceSelection::POLICY_INDEX)
+    return selection_.index % deviceCount;
+
+  uint32_t discreteIndex = UINT32_MAX;
+  uint32_t memoryIndex = 0;
+  VkDeviceSize largestHeap = 0;
+  for (uint32_t i = 0; i < deviceCount; i++) {
+    VkPhysicalDeviceProperties props;
+    vkGetPhysicalDeviceProperties(physicalDevices[i], &props);
+    if (selection_.policy == DeviceSelection::POLICY_NAME &&
+        strstr(props.deviceName, selection_.name.c_str()))
+      return i;
+    if (selection_.policy == DeviceSelection::POLICY_TYPE &&
+        props.deviceType == selection_.type)
+      return i;
+    if (props.deviceType == VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU &&
+        discreteIndex == UINT32_MAX)
+      discreteIndex = i;
+
+    VkPhysicalDeviceMemoryProperties memoryProperties;
+    vkGetPhysicalDeviceMemoryProperties(physicalDevices[i],
+                                        &memoryProperties);
+    for (uint32_t j = 0; j < memoryProperties.memoryHeapCount; j++) {
+      const VkMemoryHeap &heap = memoryProperties.memoryHeaps[j];
+      if ((heap.flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT) &&
+          heap.size > largestHeap) {
+        largestHeap = heap.size;
+        memoryIndex = i;
+      }
+    }
+  }
+  if (selection_.policy == DeviceSelection::POLICY_MEMORY)
+    return memoryIndex;
+  if (selection_.policy != DeviceSelection::POLICY_DEFAULT)
+    LOG("No device matches the selection, using the default\n");
+  return discreteIndex == UINT32_MAX ? 0 : discreteIndex;
+}
+
+VkResult ComputeContext::prepareDevice() {
+  uint32_t deviceCount = 0;
+  VK_CHECK_RESULT(vkEnumeratePhysicalDevices(instance_, &deviceCount, nullptr));
+  std::vector<VkPhysicalDevice> physicalDevices(deviceCount);
+  VK_CHECK_RESULT(vkEnumeratePhysicalDevices(instance_, &deviceCount,
+                                             physicalDevices.data()));
+
+  physicalDeviceCount_ = deviceCount;
+  physicalDeviceIndex_ = selectPhysicalDevice(physicalDevices);
+  physicalDevice_ = physicalDevices[physicalDeviceIndex_];
+
+  vkGetPhysicalDeviceProperties(physicalDevice_, &deviceProperties_);
+
+  LOG("***********: GPU INFO:\n");
+  LOG("deviceCount: %d\n", deviceCount);
+  LOG("%s (device %d)\n", deviceProperties_.deviceName, physicalDeviceIndex_);
+  LOG("vendorID: %d\n", deviceProperties_.vendorID);
+  LOG("deviceID: %d\n", deviceProperties_.deviceID);
+  LOG("deviceType: %d\n", deviceProperties_.deviceType);
+
+  LOG("GPU: maxComputeWorkGroupCount = %d, %d, %d\n",
+      deviceProperties_.limits.maxComputeWorkGroupCount[0],
+      deviceProperties_.limits.maxComputeWorkGroupCount[1],
+      deviceProperties_.limits.maxComputeWorkGroupCount[2]);
+  LOG("GPU: maxComputeWorkGroupSize = %d, %d, %d\n",
+      deviceProperties_.limits.maxComputeWorkGroupSize[0],
+      deviceProperties_.limits.maxComputeWorkGroupSize[1],
+      deviceProperties_.limits.maxComputeWorkGroupSize[2]);
+  LOG("GPU: maxComputeSharedMemorySize = %d\n",
+      deviceProperties_.limits.maxComputeSharedMemorySize);
+  LOG("GPU: timestampPeriod = %f\n", deviceProperties_.limits.timestampPeriod);
+  vkGetPhysicalDeviceMemoryProperties(physicalDevice_,
+                                      &deviceMemoryProperties_);
+
+  // Request a compute queue, and a transfer queue when there is a
+  // transfer-only family.
+  const float defaultQueuePriority(0.0f);
+  VkDeviceQueueCreateInfo queueCreateInfos[2] = {};
+  VkDeviceQueueCreateInfo &queueCreateInfo = queueCreateInfos[0];
+  uint32_t queueFamilyCount;
+  vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice_, &queueFamilyCount,
+                                           nullptr);
+  std::vector<VkQueueFamilyProperties> queueFamilyProperties(queueFamilyCount);
+  vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice_, &queueFamilyCount,
+                                           queueFamilyProperties.data());
+  for (uint32_t i = 0; i < static_cast<uint32_t>(queueFamilyProperties.size());
+       i++) {
+    LOG("GPU Queue type: %x\n", queueFamilyProperties[i].queueFlags);
+  }
+
+  for (uint32_t i = 0; i < static_cast<uint32_t>(queueFamilyProperties.size());
+       i++) {
+    if (queueFamilyProperties[i].queueFlags & VK_QUEUE_COMPUTE_BIT) {
+      queueFamilyIndex_ = i;
+      queueCreateInfo.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
+      queueCreateInfo.queueFamilyIndex = i;
+      queueCreateInfo.queueCount = 1;
+      queueCreateInfo.pQueuePriorities = &defaultQueuePriority;
+      break;
+    }
+  }
+  timestampValidBits_ =
+      queueFamilyProperties[queueFamilyIndex_].timestampValidBits;
+
+  // Transfer-only families are usually copy engines that run alongside the
+  // compute queue. Families with a coarse image transfer granularity are
+  // skipped, since row chunked image uploads need single texel offsets.
+  uint32_t transferFamilyIndex = UINT32_MAX;
+  for (uint32_t i = 0; i < static_cast<uint32_t>(queueFamilyProperties.size());
+       i++) {
+    const VkQueueFamilyProperties &props = queueFamilyProperties[i];
+    const VkExtent3D &granularity = props.minImageTransferGranularity;
+    if ((props.queueFlags & VK_QUEUE_TRANSFER_BIT) &&
+        !(props.queueFlags & (VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT)) &&
+        props.queueCount > 0 && granularity.width == 1 &&
+        granularity.height == 1 && granularity.depth == 1) {
+      transferFamilyIndex = i;
+      queueCreateInfos[1].sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
+      queueCreateInfos[1].queueFamilyIndex = i;
+      queueCreateInfos[1].queueCount = 1;
+      queueCreateInfos[1].pQueuePriorities = &defaultQueuePriority;
+      break;
+    }
+  }
+  LOG("GPU: transfer queue family = %d\n",
+      transferFamilyIndex == UINT32_MAX ? -1 : (int)transferFamilyIndex);
+  // Host pointer import needs VK_EXT_external_memory_host, which depends on
+  // VK_KHR_external_memory, and the alignment from
+  // vkGetPhysicalDeviceProperties2KHR.
+  std::vector<const char *> deviceExtensions;
+  uint32_t extensionCount = 0;
+  vkEnumerateDeviceExtensionProperties(physicalDevice_, nullptr,
+                                       &extensionCount, nullptr);
+  std::vector<VkExtensionProperties> extensions(extensionCount);
+  vkEnumerateDeviceExtensionProperties(physicalDevice_, nullptr,
+                                       &extensionCount, extensions.data());
+  bool hasExternalMemory = false, hasExternalMemoryHost = false;
+  bool hasPushDescriptor = false;
+  bool has16BitStorage = false, has8BitStorage = false;
+  bool hasStorageBufferStorageClass = false, hasFloat16Int8 = false;
+  for (const auto &extension : extensions) {
+    hasFloat16Int8 =
+        hasFloat16Int8 ||
+        strcmp(extension.extensionName,
+               VK_KHR_SHADER_FLOAT16_INT8_EXTENSION_NAME) == 0;
+    has16BitStorage =
+        has16BitStorage || strcmp(extension.extensionName,
+                                  VK_KHR_16BIT_STORAGE_EXTENSION_NAME) == 0;
+    has8BitStorage =
+        has8BitStorage || strcmp(extension.extensionName,
+                                 VK_KHR_8BIT_STORAGE_EXTENSION_NAME) == 0;
+    hasStorageBufferStorageClass =
+        hasStorageBufferStorageClass ||
+        strcmp(extension.extensionName,
+               VK_KHR_STORAGE_BUFFER_STORAGE_CLASS_EXTENSION_NAME) == 0;
+    hasPushDescriptor =
+        hasPushDescriptor || strcmp(extension.extensionName,
+                                    VK_KHR_PUSH_DESCRIPTOR_EXTENSION_NAME) == 0;
+    hasExternalMemory =
+        hasExternalMemory ||
+        strcmp(extension.extensionName,
+               VK_KHR_EXTERNAL_MEMORY_EXTENSION_NAME) == 0;
+    hasExternalMemoryHost =
+        hasExternalMemoryHost ||
+        strcmp(extension.extensionName,
+               VK_EXT_EXTERNAL_MEMORY_HOST_EXTENSION_NAME) == 0;
+  }
+  if (hasExternalMemory && hasExternalMemoryHost &&
+      getPhysicalDeviceProperties2_) {
+    VkPhysicalDeviceExternalMemoryHostPropertiesEXT hostProperties = {};
+    hostProperties.sType =
+        VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_EXTERNAL_MEMORY_HOST_PROPERTIES_EXT;
+    VkPhysicalDeviceProperties2 properties2 = {};
+    properties2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+    properties2.pNext = &hostProperties;
+    getPhysicalDeviceProperties2_(physicalDevice_, &properties2);
+    minImportedHostPointerAlignment_ =
+        hostProperties.minImportedHostPointerAlignment;
+    deviceExtensions.push_back(VK_KHR_EXTERNAL_MEMORY_EXTENSION_NAME);
+    deviceExtensions.push_back(VK_EXT_EXTERNAL_MEMORY_HOST_EXTENSION_NAME);
+  }
+  LOG("GPU: minImportedHostPointerAlignment = %llu\n",
+      (unsigned long long)minImportedHostPointerAlignment_);
+  // Push descriptors let ops record their bindings into the command buffer
+  // instead of allocating and updating a descriptor set. The extension
+  // depends on VK_KHR_get_physical_device_properties2.
+  hasPushDescriptor = hasPushDescriptor && getPhysicalDeviceProperties2_;
+  if (hasPushDescriptor)
+    deviceExtensions.push_back(VK_KHR_PUSH_DESCRIPTOR_EXTENSION_NAME);
+  LOG("GPU: push descriptors = %d\n", hasPushDescriptor ? 1 : 0);
+
+  // Half and int8 elements are loaded and stored as such in storage
+  // buffers. Both storage extensions depend on
+  // VK_KHR_storage_buffer_storage_class.
+  VkPhysicalDevice16BitStorageFeatures storage16Features = {};
+  storage16Features.sType =
+      VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_16BIT_STORAGE_FEATURES;
+  VkPhysicalDevice8BitStorageFeaturesKHR storage8Features = {};
+  storage8Features.sType =
+      VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_8BIT_STORAGE_FEATURES_KHR;
+  // Half kernels can also compute in float16 rather than widening to fp32.
+  VkPhysicalDeviceShaderFloat16Int8FeaturesKHR float16Int8Features = {};
+  float16Int8Features.sType =
+      VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SHADER_FLOAT16_INT8_FEATURES_KHR;
+  has16BitStorage = has16BitStorage && hasStorageBufferStorageClass &&
+                    getPhysicalDeviceFeatures2_;
+  has8BitStorage = has8BitStorage && hasStorageBufferStorageClass &&
+                   getPhysicalDeviceFeatures2_;
+  hasFloat16Int8 = hasFloat16Int8 && getPhysicalDeviceFeatures2_;
+  void *features = nullptr;
+  if (has16BitStorage) {
+    storage16Features.pNext = features;
+    features = &storage16Features;
+  }
+  if (has8BitStorage) {
+    storage8Features.pNext = features;
+    features = &storage8Features;
+  }
+  if (hasFloat16Int8) {
+    float16Int8Features.pNext = features;
+    features = &float16Int8Features;
+  }
+  if (features) {
+    VkPhysicalDeviceFeatures2 features2 = {};
+    features2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+    features2.pNext = features;
+    getPhysicalDeviceFeatures2_(physicalDevice_, &features2);
+    // Only ask for what the element types need.
+    storage16Features.uniformAndStorageBuffer16BitAccess = VK_FALSE;
+    storage16Features.storagePushConstant16 = VK_FALSE;
+    storage16Features.storageInputOutput16 = VK_FALSE;
+    storage8Features.uniformAndStorageBuffer8BitAccess = VK_FALSE;
+    storage8Features.storagePushConstant8 = VK_FALSE;
+    float16Int8Features.shaderInt8 = VK_FALSE;
+    storageBuffer16BitAccess_ = storage16Features.storageBuffer16BitAccess;
+    storageBuffer8BitAccess_ = storage8Features.storageBuffer8BitAccess;
+    // float16 arithmetic is only useful on half loaded from storage.
+    shaderFloat16_ =
+        float16Int8Features.shaderFloat16 && storageBuffer16BitAccess_;
+    float16Int8Features.shaderFloat16 = shaderFloat16_;
+    if (has16BitStorage || has8BitStorage)
+      deviceExtensions.push_back(
+          VK_KHR_STORAGE_BUFFER_STORAGE_CLASS_EXTENSION_NAME);
+    if (has16BitStorage)
+      deviceExtensions.push_back(VK_KHR_16BIT_STORAGE_EXTENSION_NAME);
+    if (has8BitStorage)
+      deviceExtensions.push_back(VK_KHR_8BIT_STORAGE_EXTENSION_NAME);
+    if (hasFloat16Int8)
+      deviceExtensions.push_back(VK_KHR_SHADER_FLOAT16_INT8_EXTENSION_NAME);
+  }
+  LOG("GPU: 16 bit storage = %d, 8 bit storage = %d, float16 arithmetic = "
+      "%d\n",
+      storageBuffer16BitAccess_ ? 1 : 0, storageBuffer8BitAccess_ ? 1 : 0,
+      shaderFloat16_ ? 1 : 0);
+
+  // Create logical device.
+  VkDeviceCreateInfo deviceCreateInfo = {};
+  deviceCreateInfo.pNext = features;
+  deviceCreateInfo.enabledExtensionCount =
+      static_cast<uint32_t>(deviceExtensions.size());
+  deviceCreateInfo.ppEnabledExtensionNames = deviceExtensions.data();
+  deviceCreateInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
+  deviceCreateInfo.queueCreateInfoCount =
+      transferFamilyIndex == UINT32_MAX ? 1 : 2;
+  deviceCreateInfo.pQueueCreateInfos = queueCreateInfos;
+  VK_CHECK_RESULT(
+      vkCreateDevice(physicalDevice_, &deviceCreateInfo, nullptr, &device_));
+
+  if (minImportedHostPointerAlignment_) {
+    getMemoryHostPointerProperties_ =
+        reinterpret_cast<PFN_vkGetMemoryHostPointerPropertiesEXT>(
+            vkGetDeviceProcAddr(device_,
+                                "vkGetMemoryHostPointerPropertiesEXT"));
+  }
+  if (hasPushDescriptor) {
+    cmdPushDescriptorSet_ = reinterpret_cast<PFN_vkCmdPushDescriptorSetKHR>(
+        vkGetDeviceProcAddr(device_, "vkCmdPushDescriptorSetKHR"));
+  }
+
+  // Get a compute queue.
+  vkGetDeviceQueue(device_, queueFamilyIndex_, 0, &queue_);
+
+  // Compute command pool.
+  VkCommandPoolCreateInfo cmdPoolInfo = {};
+  cmdPoolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+  cmdPoolInfo.queueFamilyIndex = queueFamilyIndex_;
+  cmdPoolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+  VK_CHECK_RESULT(
+      vkCreateCommandPool(device_, &cmdPoolInfo, nullptr, &commandPool_));
+
+  queueTimeline_.reset(new QueueTimeline(device_, queue_));
+  if (transferFamilyIndex != UINT32_MAX) {
+    VkQueue transferQueue;
+    vkGetDeviceQueue(device_, transferFamilyIndex, 0, &transferQueue);
+    transferTimeline_.reset(new QueueTimeline(device_, transferQueue));
+  }
+  transferQueue_.reset(new TransferQueue(device_, *queueTimeline_,
+                                         queueFamilyIndex_,
+                                         transferTimeline_.get(),
+                                         transferFamilyIndex));
+  allocator_.reset(new MemoryAllocator(device_, physicalDevice_));
+  profiler_.reset(
+      new GpuProfiler(device_, deviceProperties_.limits.timestampPeriod));
+  stagingRing_.reset(new StagingRing(device_, physicalDevice_,
+                                     *transferQueue_, *allocator_, *profiler_,
+                                     getTransferTimestampValidBits()));
+  pipelineCache_.reset(new PipelineCache(device_, deviceProperties_,
+                                         PipelineCache::getDefaultDirectory()));
+  tuningDatabase_.reset(new TuningDatabase(
+      deviceProperties_, PipelineCache::getDefaultDirectory()));
+  pipelineObjectCache_.reset(new PipelineObjectCache(
+      device_, pipelineCache_->get(), cmdPushDescriptorSet_ != nullptr));
+  descriptorAllocator_.reset(new DescriptorAllocator(device_));
+  return VK_SUCCESS;
+}
+
+bool ComputeContext::supportsElementType(ElementType type) const {
+  switch (type) {
+  case ELEMENT_TYPE_FLOAT16:
+    return storageBuffer16BitAccess_;
+  case ELEMENT_TYPE_INT8:
+  case ELEMENT_TYPE_UINT8:
+    return storageBuffer8BitAccess_;
+  default:
+    return true;
+  }
+}
+
+double ComputeContext::measureThroughput() {
+  // Large enough for the fill to be bandwidth bound on discrete GPUs.
+  const VkDeviceSize size = 64 * 1024 * 1024;
+  const int REPEATS = 4;
+  VkBuffer buffer;
+  VkBufferCreateInfo bufferCreateInfo = vks::initializers::bufferCreateInfo(
+      VK_BUFFER_USAGE_TRANSFER_DST_BIT, size);
+  VK_CHECK_RESULT(vkCreateBuffer(device_, &bufferCreateInfo, nullptr, &buffer));
+  VkMemoryRequirements memReqs;
+  vkGetBufferMemoryRequirements(device_, buffer, &memReqs);
+  MemoryAllocator::Allocation memory;
+  VK_CHECK_RESULT(allocator_->allocate(
+      memReqs,
+      allocator_->findMemoryType(memReqs.memoryTypeBits,
+                                 VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT),
+      MemoryAllocator::RESOURCE_LINEAR, &memory));
+  VK_CHECK_RESULT(allocator_->bindBuffer(buffer, memory));
+
+  VkCommandBuffer commandBuffer;
+  VkCommandBufferAllocateInfo allocateInfo =
+      vks::initializers::commandBufferAllocateInfo(
+          commandPool_, VK_COMMAND_BUFFER_LEVEL_PRIMARY, 1);
+  VK_CHECK_RESULT(
+      vkAllocateCommandBuffers(device_, &allocateInfo, &commandBuffer));
+  VkCommandBufferBeginInfo beginInfo =
+      vks::initializers::commandBufferBeginInfo();
+  VK_CHECK_RESULT(vkBeginCommandBuffer(commandBuffer, &beginInfo));
+  for (int i = 0; i < REPEATS; i++)
+    vkCmdFillBuffer(commandBuffer, buffer, 0, VK_WHOLE_SIZE, i);
+  VK_CHECK_RESULT(vkEndCommandBuffer(commandBuffer));
+  VkSubmitInfo submitInfo = vks::initializers::submitInfo();
+  submitInfo.commandBufferCount = 1;
+  submitInfo.pCommandBuffers = &commandBuffer;
+
+  // The first submit warms up the memory and the queue.
+  uint64_t value = 0;
+  VK_CHECK_RESULT(queueTimeline_->submit(1, &submitInfo, &value));
+  VK_CHECK_RESULT(queueTimeline_->wait(value));
+  auto begin = Clock::now();
+  VK_CHECK_RESULT(queueTimeline_->submit(1, &submitInfo, &value));
+  VK_CHECK_RESULT(queueTimeline_->wait(value));
+  auto end = Clock::now();
+
+  vkFreeCommandBuffers(device_, commandPool_, 1, &commandBuffer);
+  vkDestroyBuffer(device_, buffer, nullptr);
+  allocator_->free(memory);
+  const double seconds =
+      std::chrono::duration_cast<std::chrono::nanoseconds>(end - begin)
+          .count() /
+      1e9;
+  return seconds > 0.0 ? (double)(size * REPEATS) / seconds / 1e9 : 0.0;
+}
+
+double ComputeContext::calibrateTimestamps() {
+  GpuProfiler::Range range =
+      profiler_->allocate("context:calibrate", timestampValidBits_);
+  if (range == GpuProfiler::INVALID_RANGE)
+    return 0.0;
+  VkCommandBuffer commandBuffer;
+  VkCommandBufferAllocateInfo allocateInfo =
+      vks::initializers::commandBufferAllocateInfo(
+          commandPool_, VK_COMMAND_BUFFER_LEVEL_PRIMARY, 1);
+  VK_CHECK_RESULT(
+      vkAllocateCommandBuffers(device_, &allocateInfo, &commandBuffer));
+  VkCommandBufferBeginInfo beginInfo =
+      vks::initializers::commandBufferBeginInfo();
+  VK_CHECK_RESULT(vkBeginCommandBuffer(commandBuffer, &beginInfo));
+  profiler_->begin(commandBuffer, range);
+  profiler_->end(commandBuffer, range);
+  VK_CHECK_RESULT(vkEndCommandBuffer(commandBuffer));
+  VkSubmitInfo submitInfo = vks::initializers::submitInfo();
+  submitInfo.commandBufferCount = 1;
+  submitInfo.pCommandBuffers = &commandBuffer;
+
+  uint64_t value = 0;
+  auto begin = Clock::now();
+  VK_CHECK_RESULT(queueTimeline_->submit(1, &submitInfo, &value));
+  profiler_->submitted(range, *queueTimeline_, value);
+  VK_CHECK_RESULT(queueTimeline_->wait(value));
+  auto end = Clock::now();
+  profiler_->resolve();
+  const GpuProfiler::Result result = profiler_->getLastResult(range);
+  profiler_->release(range);
+  vkFreeCommandBuffers(device_, commandPool_, 1, &commandBuffer);
+
+  const double hostMs =
+      (double)std::chrono::duration_cast<std::chrono::nanoseconds>(
+          (begin + (end - begin) / 2).time_since_epoch())
+          .count() /
+      NS2MS;
+  return hostMs - result.beginMs;
+}
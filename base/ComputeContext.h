@@ -0,0 +1,203 @@
+/*
+ * Copyright (C) 2020 by Xu Xing (xu.xing@outlook.com)
+ *
+ * This code is licensed under the MIT license (MIT)
+ * (http://opensource.org/licenses/MIT)
+ */
+#ifndef COMPUTE_CONTEXT_H_
+#define COMPUTE_CONTEXT_H_
+
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "DescriptorAllocator.h"
+#include "ElementType.h"
+#include "GpuProfiler.h"
+#include "MemoryAllocator.h"
+#include "PipelineCache.h"
+#include "PipelineObjectCache.h"
+#include "QueueTimeline.h"
+#include "StagingRing.h"
+#include "TransferQueue.h"
+#include "TuningDatabase.h"
+#include "VulkanTools.h"
+#include <vulkan/vulkan.h>
+
+// Owns the Vulkan instance, the logical device, the compute queue (plus a
+// transfer queue when the device has a transfer-only family) and the command
+// pool. Creating these costs tens of milliseconds, so a context is
+// created once and shared by many ops through std::shared_ptr. The last op
+// (or caller) releasing its reference destroys the device.
+//
+// The command pool is not internally synchronized: ops sharing a context must
+// record and submit from one thread at a time.
+class ComputeContext {
+public:
+  // How create() picks the physical device.
+  struct DeviceSelection {
+    enum Policy {
+      // The first discrete GPU, else device 0.
+      POLICY_DEFAULT = 0,
+      // The device at index, modulo the device count. Contexts created with
+      // different indexes on a single device each get their own logical
+      // device.
+      POLICY_INDEX = 1,
+      // The first device whose name contains name.
+      POLICY_NAME = 2,
+      // The first device of type.
+      POLICY_TYPE = 3,
+      // The device with the largest device local heap.
+      POLICY_MEMORY = 4,
+      // The device with the highest measureThroughput(). Every device is
+      // opened once to measure it.
+      POLICY_THROUGHPUT = 5,
+    };
+    Policy policy = POLICY_DEFAULT;
+    uint32_t index = 0;
+    std::string name;
+    VkPhysicalDeviceType type = VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU;
+  };
+
+  // Creates a new context with its own instance and device.
+  static std::shared_ptr<ComputeContext> create();
+  // Devices that do not match the policy fall back to the default choice.
+  static std::shared_ptr<ComputeContext> create(
+      const DeviceSelection &selection);
+  // Returns the process-wide context. It is created on first use and kept
+  // alive as long as any op or caller holds a reference to it.
+  static std::shared_ptr<ComputeContext> getShared();
+
+  ~ComputeContext();
+
+  VkInstance getInstance() const { return instance_; }
+  VkPhysicalDevice getPhysicalDevice() const { return physicalDevice_; }
+  // Index of the physical device among those of the instance.
+  uint32_t getPhysicalDeviceIndex() const { return physicalDeviceIndex_; }
+  uint32_t getPhysicalDeviceCount() const { return physicalDeviceCount_; }
+  const VkPhysicalDeviceProperties &getDeviceProperties() const {
+    return deviceProperties_;
+  }
+  const VkPhysicalDeviceMemoryProperties &getDeviceMemoryProperties() const {
+    return deviceMemoryProperties_;
+  }
+  VkDevice getDevice() const { return device_; }
+  uint32_t getQueueFamilyIndex() const { return queueFamilyIndex_; }
+  VkQueue getQueue() const { return queue_; }
+  // Submissions to the queue go through the timeline.
+  QueueTimeline &getQueueTimeline() { return *queueTimeline_; }
+  VkCommandPool getCommandPool() const { return commandPool_; }
+  uint32_t getTimestampValidBits() const { return timestampValidBits_; }
+  // Valid timestamp bits of command buffers from TransferQueue::begin(). 0
+  // with a dedicated transfer queue: Vulkan 1.0 cannot reset queries on
+  // transfer-only queues, so their copies are not profiled.
+  uint32_t getTransferTimestampValidBits() const {
+    return transferQueue_->isDedicated() ? 0 : timestampValidBits_;
+  }
+  // Non-zero when host allocations can be imported as buffer memory with
+  // VK_EXT_external_memory_host. Imported pointers and sizes must be
+  // multiples of it.
+  VkDeviceSize getMinImportedHostPointerAlignment() const {
+    return minImportedHostPointerAlignment_;
+  }
+  PFN_vkGetMemoryHostPointerPropertiesEXT
+  getMemoryHostPointerPropertiesFunction() const {
+    return getMemoryHostPointerProperties_;
+  }
+  // Non-null when VK_KHR_push_descriptor is enabled; layouts from the
+  // pipeline object cache are then push descriptor layouts.
+  PFN_vkCmdPushDescriptorSetKHR getPushDescriptorSetFunction() const {
+    return cmdPushDescriptorSet_;
+  }
+  // Whether storage buffers of the type can be used: half needs
+  // storageBuffer16BitAccess, int8 and uint8 storageBuffer8BitAccess.
+  bool supportsElementType(ElementType type) const;
+  // Whether half kernels can compute in float16 (shaderFloat16) instead of
+  // widening to fp32. Implies half storage support.
+  bool supportsFloat16Arithmetic() const { return shaderFloat16_; }
+  // Uploads and readbacks go through here, on a dedicated transfer queue
+  // when there is one.
+  TransferQueue &getTransferQueue() { return *transferQueue_; }
+  // All buffer and image memory of ops on this context comes from here.
+  MemoryAllocator &getAllocator() { return *allocator_; }
+  // Host to device uploads of ops on this context go through this ring.
+  StagingRing &getStagingRing() { return *stagingRing_; }
+  // Pipelines of ops on this context are created through this cache, which
+  // is saved to disk when the context is destroyed.
+  PipelineCache &getPipelineCache() { return *pipelineCache_; }
+  // Tuned workgroup sizes for ops on this device, saved to disk when the
+  // context is destroyed.
+  TuningDatabase &getTuningDatabase() { return *tuningDatabase_; }
+  // GPU time ranges of the uploads, barriers, dispatches and readbacks of
+  // ops on this context.
+  GpuProfiler &getProfiler() { return *profiler_; }
+  // Pipelines and layouts already created for ops on this context.
+  PipelineObjectCache &getPipelineObjectCache() {
+    return *pipelineObjectCache_;
+  }
+  // Descriptor sets of ops on this context when there are no push
+  // descriptors.
+  DescriptorAllocator &getDescriptorAllocator() {
+    return *descriptorAllocator_;
+  }
+
+  // Device memory write bandwidth in GB/s, measured by filling a device local
+  // buffer on the compute queue.
+  double measureThroughput();
+  // Offset in ms from the device clock of GpuProfiler results to Clock
+  // (Utils.h) time since its epoch, 0 without timestamps. A timestamp is
+  // taken to run halfway between its submit and the end of the wait for it,
+  // so the offset is off by up to half that round trip.
+  double calibrateTimestamps();
+
+private:
+  ComputeContext(const DeviceSelection &selection);
+  ComputeContext(const ComputeContext &) = delete;
+  ComputeContext &operator=(const ComputeContext &) = delete;
+
+  VkResult prepareDebugLayer();
+  VkResult prepareDevice();
+  uint32_t selectPhysicalDevice(
+      const std::vector<VkPhysicalDevice> &physicalDevices) const;
+
+  DeviceSelection selection_;
+  VkInstance instance_ = VK_NULL_HANDLE;
+  VkPhysicalDevice physicalDevice_ = VK_NULL_HANDLE;
+  uint32_t physicalDeviceIndex_ = 0;
+  uint32_t physicalDeviceCount_ = 0;
+  VkPhysicalDeviceProperties deviceProperties_ = {};
+  VkPhysicalDeviceMemoryProperties deviceMemoryProperties_ = {};
+  VkDevice device_ = VK_NULL_HANDLE;
+  uint32_t queueFamilyIndex_ = 0;
+  VkQueue queue_ = VK_NULL_HANDLE;
+  VkCommandPool commandPool_ = VK_NULL_HANDLE;
+  uint32_t timestampValidBits_ = 0;
+  VkDeviceSize minImportedHostPointerAlignment_ = 0;
+  PFN_vkGetPhysicalDeviceProperties2KHR getPhysicalDeviceProperties2_ =
+      nullptr;
+  PFN_vkGetMemoryHostPointerPropertiesEXT getMemoryHostPointerProperties_ =
+      nullptr;
+  PFN_vkCmdPushDescriptorSetKHR cmdPushDescriptorSet_ = nullptr;
+  PFN_vkGetPhysicalDeviceFeatures2KHR getPhysicalDeviceFeatures2_ = nullptr;
+  bool storageBuffer16BitAccess_ = false;
+  bool storageBuffer8BitAccess_ = false;
+  bool shaderFloat16_ = false;
+  VkDebugReportCallbackEXT debugReportCallback_ = VK_NULL_HANDLE;
+  std::unique_ptr<QueueTimeline> queueTimeline_;
+  // Null without a transfer-only queue family.
+  std::unique_ptr<QueueTimeline> transferTimeline_;
+  std::unique_ptr<TransferQueue> transferQueue_;
+  std::unique_ptr<MemoryAllocator> allocator_;
+  std::unique_ptr<GpuProfiler> profiler_;
+  std::unique_ptr<StagingRing> stagingRing_;
+  std::unique_ptr<PipelineCache> pipelineCache_;
+  std::unique_ptr<TuningDatabase> tuningDatabase_;
+  std::unique_ptr<PipelineObjectCache> pipelineObjectCache_;
+  std::unique_ptr<DescriptorAllocator> descriptorAllocator_;
+
+  static std::mutex sharedMutex_;
+  static std::weak_ptr<ComputeContext> shared_;
+};
+
+#endif
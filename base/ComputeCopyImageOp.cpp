@@ -13,40 +13,29 @@ ComputeCopyImageOp::~ComputeCopyImageOp() {}
 ComputeCopyImageOp::ComputeCopyImageOp(const InitParams &init_params)
     : ComputeOp(init_params) {}
 
+ComputeCopyImageOp::ComputeCopyImageOp(const InitParams &init_params,
+                                       std::shared_ptr<ComputeContext> context)
+    : ComputeOp(init_params, context) {}
+
 void ComputeCopyImageOp::execute() {
+  // Host data is uploaded as is, so it must be of the element type.
+  assert(params_.computeInput.getElementType() == params_.elementType);
   // Prepare storage buffers.
-  const VkDeviceSize bufferSize =
-      (params_.inputWidth * params_.inputHeight) * sizeof(uint32_t);
-  const VkDeviceSize filterBufferSize =
-      (params_.filterWidth * params_.filterHeight) * sizeof(uint32_t);
-  const VkDeviceSize outputBufferSize =
-      (params_.outputWidth * params_.outputHeight) * sizeof(uint32_t);
+  const VkDeviceSize bufferSize = getInputBytes();
+  const VkDeviceSize filterBufferSize = getFilterBytes();
+  const VkDeviceSize outputBufferSize = getOutputBytes();
 
-  // Copy input data to VRAM using a staging buffer.
+  // Copy input data to VRAM through the staging ring.
   {
-    createBufferWithData(VK_BUFFER_USAGE_TRANSFER_SRC_BIT |
-                             VK_BUFFER_USAGE_TRANSFER_DST_BIT,
-                         VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT, &hostBuffer_,
-                         &hostMemory_, bufferSize, params_.computeInput.data());
-
-    createDeviceImage(image_, params_.inputWidth, params_.inputHeight);
+    createDeviceImage(image_, imageMemory_, params_.inputWidth,
+                      params_.inputHeight);
     createSampler(image_, sampler_, view_);
 
-    copyHostBufferToDeviceImage(image_, hostBuffer_, params_.inputWidth,
-                                params_.inputHeight);
-    VkDeviceMemory testMemory;
-    VkBuffer testBuffer;
-    createBufferWithData(VK_BUFFER_USAGE_TRANSFER_SRC_BIT |
-                             VK_BUFFER_USAGE_TRANSFER_DST_BIT,
-                         VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT, &testBuffer,
-                         &testMemory, bufferSize);
-
+    uploadToDeviceImage(image_, params_.computeInput.data(), bufferSize,
+                        params_.inputWidth, params_.inputHeight);
+    params_.computeOutput.reset(params_.elementType, getInputElementCount());
     copyDeviceImageToHostBuffer(image_, params_.computeOutput.data(),
                                 bufferSize, params_.inputWidth,
                                 params_.inputHeight);
   }
-
-  vkQueueWaitIdle(queue_);
-
-  // TODO: exit clean up.
 }
@@ -12,6 +12,8 @@ class ComputeCopyImageOp : public ComputeOp {
 public:
   ComputeCopyImageOp();
   ComputeCopyImageOp(const InitParams &init_params);
+  ComputeCopyImageOp(const InitParams &init_params,
+                     std::shared_ptr<ComputeContext> context);
   void execute();
   virtual ~ComputeCopyImageOp();
 };
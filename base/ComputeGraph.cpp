@@ -0,0 +1,209 @@
+/*
+ * Copyright (C) 2020 by Xu Xing (xu.xing@outlook.com)
+ *
+ * This code is licensed under the MIT license (MIT)
+ * (http://opensource.org/licenses/MIT)
+ */
+#include <algorithm>
+
+#include "ComputeGraph.h"
+#include "SkTraceEvent.h"
+#include "Utils.h"
+
+ComputeGraph::ComputeGraph(std::shared_ptr<ComputeContext> context)
+    : context_(context) {}
+
+ComputeGraph::~ComputeGraph() {
+  if (commandBuffer_ != VK_NULL_HANDLE)
+    vkFreeCommandBuffers(context_->getDevice(), context_->getCommandPool(), 1,
+                         &commandBuffer_);
+  GpuProfiler &profiler = context_->getProfiler();
+  for (const Node &node : nodes_)
+    profiler.release(node.range);
+  for (GpuProfiler::Range range : barrierRanges_)
+    profiler.release(range);
+}
+
+Tensor *ComputeGraph::addTensor(const std::vector<uint32_t> &shape,
+                                ElementType elementType,
+                                TensorLayout layout) {
+  tensors_.emplace_back(new Tensor(context_, shape, elementType, layout));
+  return tensors_.back().get();
+}
+
+ComputeBufferOp *ComputeGraph::addNode(ComputeOp::InitParams params,
+                                       Tensor *input, Tensor *output,
+                                       Tensor *operand) {
+  assert(!prepared_);
+  assert(input && output && input != output && operand != output);
+  params.setTensorShapes(*input, *output);
+  Node node;
+  node.op.reset(new ComputeBufferOp(params, context_));
+  node.input = input;
+  node.operand = operand;
+  node.output = output;
+  nodes_.push_back(std::move(node));
+  return nodes_.back().op.get();
+}
+
+std::vector<Tensor *> ComputeGraph::getInputs() const {
+  std::set<const Tensor *> written;
+  for (const Node &node : nodes_)
+    written.insert(node.output);
+  std::vector<Tensor *> inputs;
+  for (const Node &node : nodes_) {
+    for (Tensor *tensor : {node.input, node.operand}) {
+      if (tensor && !written.count(tensor) &&
+          std::find(inputs.begin(), inputs.end(), tensor) == inputs.end())
+        inputs.push_back(tensor);
+    }
+  }
+  return inputs;
+}
+
+std::vector<Tensor *> ComputeGraph::getOutputs() const {
+  std::set<const Tensor *> read;
+  for (const Node &node : nodes_) {
+    read.insert(node.input);
+    if (node.operand)
+      read.insert(node.operand);
+  }
+  std::vector<Tensor *> outputs;
+  for (const Node &node : nodes_) {
+    if (!read.count(node.output) &&
+        std::find(outputs.begin(), outputs.end(), node.output) ==
+            outputs.end())
+      outputs.push_back(node.output);
+  }
+  return outputs;
+}
+
+VkResult ComputeGraph::prepare() {
+  assert(!prepared_ && !nodes_.empty());
+  GpuProfiler &profiler = context_->getProfiler();
+  for (Node &node : nodes_) {
+    node.op->prepare(*node.input, *node.output, node.operand);
+    node.range = profiler.allocate(node.op->getProfileName() + ":" +
+                                       ComputeOp::getProfileStageName(
+                                           ComputeOp::PROFILE_STAGE_DISPATCH),
+                                   context_->getTimestampValidBits());
+  }
+
+  VkDevice device = context_->getDevice();
+  VkCommandBufferAllocateInfo cmdBufAllocateInfo =
+      vks::initializers::commandBufferAllocateInfo(
+          context_->getCommandPool(), VK_COMMAND_BUFFER_LEVEL_PRIMARY, 1);
+  VK_CHECK_RESULT(
+      vkAllocateCommandBuffers(device, &cmdBufAllocateInfo, &commandBuffer_));
+  VkCommandBufferBeginInfo cmdBufInfo =
+      vks::initializers::commandBufferBeginInfo();
+  VK_CHECK_RESULT(vkBeginCommandBuffer(commandBuffer_, &cmdBufInfo));
+
+  // The inputs may have been written by an upload or an earlier run, as in
+  // ComputeOp::recordDispatchCommandBuffer.
+  VkMemoryBarrier memoryBarrier = vks::initializers::memoryBarrier();
+  memoryBarrier.srcAccessMask =
+      VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_TRANSFER_WRITE_BIT;
+  memoryBarrier.dstAccessMask =
+      VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+  vkCmdPipelineBarrier(
+      commandBuffer_,
+      VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT,
+      VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_FLAGS_NONE, 1, &memoryBarrier,
+      0, nullptr, 0, nullptr);
+
+  std::set<const Tensor *> written, read;
+  for (const Node &node : nodes_)
+    recordNode(node, written, read);
+
+  // The outputs are downloaded, and the next run may overwrite any tensor.
+  memoryBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+  memoryBarrier.dstAccessMask =
+      VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_TRANSFER_READ_BIT;
+  vkCmdPipelineBarrier(
+      commandBuffer_, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+      VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT,
+      VK_FLAGS_NONE, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
+  VK_CHECK_RESULT(vkEndCommandBuffer(commandBuffer_));
+  LOG("ComputeGraph: %u nodes, %u barriers\n", getNodeCount(),
+      barrierCount_);
+  prepared_ = true;
+  return VK_SUCCESS;
+}
+
+void ComputeGraph::recordNode(const Node &node,
+                              std::set<const Tensor *> &written,
+                              std::set<const Tensor *> &read) {
+  // Read after write, then write after write or read.
+  std::vector<const Tensor *> conflicts;
+  for (const Tensor *tensor : {node.input, node.operand}) {
+    if (tensor && written.count(tensor))
+      conflicts.push_back(tensor);
+  }
+  if (written.count(node.output) || read.count(node.output))
+    conflicts.push_back(node.output);
+
+  GpuProfiler &profiler = context_->getProfiler();
+  if (!conflicts.empty()) {
+    barrierRanges_.push_back(profiler.allocate(
+        "graph:barrier", context_->getTimestampValidBits()));
+    profiler.begin(commandBuffer_, barrierRanges_.back());
+    std::vector<VkBufferMemoryBarrier> bufferBarriers;
+    for (const Tensor *tensor : conflicts) {
+      VkBufferMemoryBarrier bufferBarrier =
+          vks::initializers::bufferMemoryBarrier();
+      bufferBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+      bufferBarrier.dstAccessMask =
+          VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+      bufferBarrier.buffer = tensor->getBuffer();
+      bufferBarrier.size = VK_WHOLE_SIZE;
+      bufferBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+      bufferBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+      bufferBarriers.push_back(bufferBarrier);
+      written.erase(tensor);
+    }
+    vkCmdPipelineBarrier(commandBuffer_, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                         VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_FLAGS_NONE,
+                         0, nullptr,
+                         static_cast<uint32_t>(bufferBarriers.size()),
+                         bufferBarriers.data(), 0, nullptr);
+    profiler.end(commandBuffer_, barrierRanges_.back());
+    barrierCount_++;
+    // The barrier waits for every earlier dispatch, so earlier reads are
+    // done. Writes to other tensors are still not visible, though.
+    read.clear();
+  }
+
+  profiler.begin(commandBuffer_, node.range);
+  node.op->recordDispatch(commandBuffer_);
+  profiler.end(commandBuffer_, node.range);
+  read.insert(node.input);
+  if (node.operand)
+    read.insert(node.operand);
+  written.insert(node.output);
+}
+
+VkResult ComputeGraph::run() {
+  TRACE_EVENT0("compute", "ComputeGraph::run");
+  assert(prepared_);
+  // Op filters are uploaded in prepare() and go first on the queue.
+  VK_CHECK_RESULT(context_->getStagingRing().flush());
+  VkSubmitInfo submitInfo = vks::initializers::submitInfo();
+  submitInfo.commandBufferCount = 1;
+  submitInfo.pCommandBuffers = &commandBuffer_;
+  QueueTimeline &queueTimeline = context_->getQueueTimeline();
+  uint64_t value;
+  VK_CHECK_RESULT(queueTimeline.submit(1, &submitInfo, &value));
+  GpuProfiler &profiler = context_->getProfiler();
+  for (const Node &node : nodes_)
+    profiler.submitted(node.range, queueTimeline, value);
+  for (GpuProfiler::Range range : barrierRanges_)
+    profiler.submitted(range, queueTimeline, value);
+  return queueTimeline.wait(value);
+}
+
+double ComputeGraph::getNodeMs(uint32_t index) const {
+  GpuProfiler &profiler = context_->getProfiler();
+  profiler.resolve();
+  return profiler.getLastMs(nodes_[index].range);
+}
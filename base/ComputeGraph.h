@@ -0,0 +1,91 @@
+/*
+ * Copyright (C) 2020 by Xu Xing (xu.xing@outlook.com)
+ *
+ * This code is licensed under the MIT license (MIT)
+ * (http://opensource.org/licenses/MIT)
+ */
+#ifndef COMPUTE_GRAPH_H_
+#define COMPUTE_GRAPH_H_
+
+#include <memory>
+#include <set>
+#include <vector>
+
+#include "ComputeBufferOp.h"
+#include "Tensor.h"
+
+// Buffer ops on device resident tensors, recorded into one command buffer
+// and submitted at once. Nodes are ComputeBufferOps and edges are the
+// Tensors they read and write, so intermediates never leave the device: the
+// caller uploads getInputs() and downloads getOutputs(), nothing else.
+//
+// Nodes are recorded in the order they were added, which must therefore be
+// a topological order. A barrier goes before a node only when it reads a
+// tensor that a node since the last barrier wrote, or writes one that such a
+// node read or wrote, and it covers just those tensors. Independent nodes in
+// between have no barrier and may overlap on the GPU.
+//
+// Each node dispatch is a "<profile name>:dispatch" range of the context's
+// GpuProfiler and each barrier between nodes a "graph:barrier" range. A
+// range starts once all earlier commands are complete, so the ranges of
+// overlapping nodes include some of each other's time.
+class ComputeGraph {
+public:
+  explicit ComputeGraph(std::shared_ptr<ComputeContext> context);
+  ~ComputeGraph();
+
+  // A tensor owned by the graph, valid for its lifetime.
+  Tensor *addTensor(const std::vector<uint32_t> &shape,
+                    ElementType elementType = ELEMENT_TYPE_FLOAT32,
+                    TensorLayout layout = TENSOR_LAYOUT_NCHW);
+  // Adds an op from input to output. The shapes in params are set from the
+  // tensors (see InitParams::setTensorShapes). operand, when given, is a
+  // second input bound in place of the op's filter (see
+  // ComputeBufferOp::prepare). The graph owns the op.
+  ComputeBufferOp *addNode(ComputeOp::InitParams params, Tensor *input,
+                           Tensor *output, Tensor *operand = nullptr);
+  // Tensors read by some node and written by none, and tensors written by
+  // some node and read by none, in the order nodes use them.
+  std::vector<Tensor *> getInputs() const;
+  std::vector<Tensor *> getOutputs() const;
+
+  // Prepares every node and records the graph. Nodes cannot be added after.
+  VkResult prepare();
+  // Submits the recorded graph and waits for it. The inputs must have been
+  // uploaded; the outputs can be downloaded once it returns.
+  VkResult run();
+
+  uint32_t getNodeCount() const { return (uint32_t)nodes_.size(); }
+  // Barriers recorded between nodes, not counting the one on either side of
+  // the graph.
+  uint32_t getBarrierCount() const { return barrierCount_; }
+  // GPU time of the dispatch of node index in the last completed run.
+  double getNodeMs(uint32_t index) const;
+
+private:
+  ComputeGraph(const ComputeGraph &) = delete;
+  ComputeGraph &operator=(const ComputeGraph &) = delete;
+
+  struct Node {
+    std::unique_ptr<ComputeBufferOp> op;
+    Tensor *input = nullptr;
+    Tensor *operand = nullptr;
+    Tensor *output = nullptr;
+    GpuProfiler::Range range = GpuProfiler::INVALID_RANGE;
+  };
+
+  // Records node after a barrier on the tensors it conflicts on, if any.
+  // written and read hold the tensors accessed since the last barrier.
+  void recordNode(const Node &node, std::set<const Tensor *> &written,
+                  std::set<const Tensor *> &read);
+
+  std::shared_ptr<ComputeContext> context_;
+  // Declared before nodes_ so that the ops are destroyed first.
+  std::vector<std::unique_ptr<Tensor>> tensors_;
+  std::vector<Node> nodes_;
+  VkCommandBuffer commandBuffer_ = VK_NULL_HANDLE;
+  uint32_t barrierCount_ = 0;
+  std::vector<GpuProfiler::Range> barrierRanges_;
+  bool prepared_ = false;
+};
+#endif
@@ -21,77 +21,135 @@ ComputeImageOp::~ComputeImageOp() {}
 ComputeImageOp::ComputeImageOp(const InitParams &init_params)
     : ComputeOp(init_params) {}
 
-void ComputeImageOp::execute() {
+ComputeImageOp::ComputeImageOp(const InitParams &init_params,
+                               std::shared_ptr<ComputeContext> context)
+    : ComputeOp(init_params, context) {}
+
+void ComputeImageOp::prepare() {
   // Prepare storage buffers.
-  const VkDeviceSize bufferSize =
-      (params_.inputWidth * params_.inputHeight) * sizeof(uint32_t);
-  const VkDeviceSize filterBufferSize =
-      (params_.filterWidth * params_.filterHeight) * sizeof(uint32_t);
-  const VkDeviceSize outputBufferSize =
-      (params_.outputWidth * params_.outputHeight) * sizeof(uint32_t);
+  const VkDeviceSize bufferSize = getInputBytes();
+  const VkDeviceSize filterBufferSize = getFilterBytes();
+  // Images are optimally tiled and cannot be written in place.
+  if (params_.executionMode == EXECUTION_MODE_ZERO_STAGING)
+    params_.executionMode = EXECUTION_MODE_SINGLE_SUBMIT;
 
-  // Copy input data to VRAM using a staging buffer.
+  // Input image. Input data is uploaded by run().
   {
-    TIME("execute:createBufferWithData",
-         createBufferWithData(VK_BUFFER_USAGE_TRANSFER_SRC_BIT |
-                                  VK_BUFFER_USAGE_TRANSFER_DST_BIT,
-                              VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT, &hostBuffer_,
-                              &hostMemory_, bufferSize,
-                              params_.computeInput.data()));
-
-    TIME("execute:createDeviceImage",
-         createDeviceImage(image_, params_.inputWidth, params_.inputHeight));
-    TIME("execute:createSampler", createSampler(image_, sampler_, view_));
-
-    TIME("execute:copyHostBufferToDeviceImage",
-         copyHostBufferToDeviceImage(image_, hostBuffer_, params_.inputWidth,
-                                     params_.inputHeight));
-#ifdef USE_READBACK_INPUT
-    // Debug only.
-    copyDeviceImageToHostBuffer(image_, params_.computeInput.data(), bufferSize,
-                                params_.inputWidth, params_.inputHeight);
-#endif
+    TIME("prepare:createDeviceImage",
+         createDeviceImage(image_, imageMemory_, params_.inputWidth,
+                           params_.inputHeight));
+    TIME("prepare:createSampler", createSampler(image_, sampler_, view_));
+    // The single submit command buffer uploads from a host buffer of its own
+    // instead of the staging ring.
+    if (params_.executionMode == EXECUTION_MODE_SINGLE_SUBMIT) {
+      TIME("prepare:createBufferWithData",
+           createBufferWithData(VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+                                VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT,
+                                &hostBuffer_, &hostMemory_, bufferSize));
+    }
   }
-  // Copy filter data to VRAM using a staging buffer.
+  // Copy filter data to VRAM through the staging ring.
   {
-    TIME("execute:createBufferWithData",
-         createBufferWithData(VK_BUFFER_USAGE_TRANSFER_SRC_BIT |
-                                  VK_BUFFER_USAGE_TRANSFER_DST_BIT,
-                              VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT,
-                              &filterHostBuffer_, &filterHostMemory_,
-                              filterBufferSize, params_.computeFilter.data()));
-
-    TIME("execute:createDeviceImage",
-         createDeviceImage(filterImage_, params_.filterWidth,
-                           params_.filterHeight));
-    TIME("execute:createSampler",
+    TIME("prepare:createDeviceImage",
+         createDeviceImage(filterImage_, filterImageMemory_,
+                           params_.filterWidth, params_.filterHeight));
+    TIME("prepare:createSampler",
          createSampler(filterImage_, filterSampler_, filterView_));
 
-    // Copy to staging buffer
-    TIME("execute:copyHostBufferToDeviceImage",
-         copyHostBufferToDeviceImage(filterImage_, filterHostBuffer_,
-                                     params_.filterWidth,
-                                     params_.filterHeight));
+    TIME("prepare:uploadToDeviceImage",
+         uploadToDeviceImage(filterImage_, getFilterElements(),
+                             filterBufferSize, params_.filterWidth,
+                             params_.filterHeight));
 #ifdef USE_READBACK_INPUT
-    // Debug only.
-    copyDeviceImageToHostBuffer(filterImage_, params_.computeFilter.data(),
+    // Debug only. The image holds elements of params_.elementType.
+    std::vector<char> filterElements(filterBufferSize);
+    copyDeviceImageToHostBuffer(filterImage_, filterElements.data(),
                                 filterBufferSize, params_.filterWidth,
                                 params_.filterHeight);
+    convertElements(filterElements.data(), params_.elementType,
+                    getFilterElementCount(),
+                    params_.computeFilter.getElementType(),
+                    params_.computeFilter.data());
 #endif
   }
   {
-    TIME("execute:createTextureTarget",
+    TIME("prepare:createTextureTarget",
          createTextureTarget(params_.outputWidth, params_.outputHeight));
+    TIME("prepare:createBufferWithData",
+         createBufferWithData(VK_BUFFER_USAGE_TRANSFER_SRC_BIT |
+                                  VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                              VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT,
+                              &outputHostBuffer_, &outputHostMemory_,
+                              getOutputBytes()));
   }
   // Prepare compute pipeline.
-  TIME("execute:prepareImageToImagePipeline", prepareImageToImagePipeline());
+  TIME("prepare:prepareImageToImagePipeline", prepareImageToImagePipeline());
 
-  // Command buffer creation (for compute work submission).
-  TIME("execute:prepareImageToImageCommandBuffer",
-       prepareImageToImageCommandBuffer());
-  TIME("execute:copyDeviceImageToHostBuffer",
-       copyDeviceImageToHostBuffer(outputImage_, params_.computeOutput.data(),
-                                   outputBufferSize, params_.outputWidth,
-                                   params_.outputHeight));
-  vkQueueWaitIdle(queue_);
+  // Command buffer recording (for compute work submission).
+  TIME("prepare:recordImageToImageCommandBuffer",
+       recordImageToImageCommandBuffer());
+  prepared_ = true;
+}
+
+void ComputeImageOp::run(const std::vector<DATA_TYPE> &input,
+                         std::vector<DATA_TYPE> &output) {
+  assert(input.size() >= (size_t)(params_.inputWidth * params_.inputHeight));
+  assert(output.size() >=
+         (size_t)(params_.outputWidth * params_.outputHeight));
+  run(input.data(), output.data());
+}
+
+void ComputeImageOp::runElements(const void *input, void *output) {
+  assert(prepared_);
+  const VkDeviceSize bufferSize = getInputBytes();
+  const VkDeviceSize outputBufferSize = getOutputBytes();
+  waitForAsync();
+
+  if (params_.executionMode == EXECUTION_MODE_SINGLE_SUBMIT) {
+    // commandBuffer_ already holds the upload and the readback.
+    copyToHostMemory(hostMemory_, input, bufferSize);
+    submitCommandBuffer();
+    copyFromHostMemory(outputHostMemory_, output, outputBufferSize);
+    return;
+  }
+
+  // The upload is submitted together with the dispatch.
+  uploadToDeviceImage(image_, input, bufferSize, params_.inputWidth,
+                      params_.inputHeight);
+  submitCommandBuffer();
+  copyDeviceImageToHostBuffer(outputImage_, outputHostBuffer_,
+                              outputHostMemory_, output, outputBufferSize,
+                              params_.outputWidth, params_.outputHeight);
+}
+
+std::shared_future<void> ComputeImageOp::executeAsync() {
+  // The readback has to be recorded in the submitted command buffer, so an
+  // op not prepared yet is prepared in single submit mode.
+  if (!prepared_) {
+    params_.executionMode = EXECUTION_MODE_SINGLE_SUBMIT;
+    TIME("executeAsync:prepare", prepare());
+  }
+  // The previous run may still be writing params_.computeOutput.
+  waitForAsync();
+  if (params_.executionMode != EXECUTION_MODE_SINGLE_SUBMIT) {
+    // Already prepared for staged runs by prepare() or execute(), whose
+    // readback is a submission of its own, so run before returning.
+    run(params_.computeInput, params_.computeOutput);
+    return readyFuture();
+  }
+  return submitAsync(params_.computeInput, params_.computeOutput);
+}
+
+void ComputeImageOp::execute() {
+  TIME("execute:prepare", prepare());
+  TIME("execute:run", run(params_.computeInput, params_.computeOutput));
+#ifdef USE_READBACK_INPUT
+  // Debug only. The image holds elements of params_.elementType.
+  std::vector<char> inputElements(getInputBytes());
+  copyDeviceImageToHostBuffer(image_, inputElements.data(), getInputBytes(),
+                              params_.inputWidth, params_.inputHeight);
+  convertElements(inputElements.data(), params_.elementType,
+                  getInputElementCount(), params_.computeInput.getElementType(),
+                  params_.computeInput.data());
+#endif
 }
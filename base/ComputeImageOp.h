@@ -12,7 +12,17 @@ class ComputeImageOp : public ComputeOp {
 public:
   ComputeImageOp();
   ComputeImageOp(const InitParams &init_params);
+  ComputeImageOp(const InitParams &init_params,
+                 std::shared_ptr<ComputeContext> context);
   void execute();
+  void prepare();
+  void run(const std::vector<DATA_TYPE> &input,
+           std::vector<DATA_TYPE> &output);
+  using ComputeOp::run;
+  std::shared_future<void> executeAsync();
   virtual ~ComputeImageOp();
+
+protected:
+  void runElements(const void *input, void *output);
 };
 #endif
\ No newline at end of file
@@ -18,6 +18,7 @@
 
 #include <algorithm>
 #include <assert.h>
+#include <fstream>
 #include <iostream>
 #include <stdio.h>
 #include <stdlib.h>
@@ -26,6 +27,7 @@
 #include <vector>
 
 #include "ComputeOp.h"
+#include "SkTraceEvent.h"
 #include "Utils.h"
 #include "VulkanTools.h"
 #include "VulkanUtils.h"
@@ -37,10 +39,7 @@ android_app *androidapp;
 
 #define DEBUG (!NDEBUG)
 
-#define USE_TIMESTAMP_BARRIER
 #define USE_TIME
-#define TIMESTAMP_STAGE_BEGIN VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT
-#define TIMESTAMP_STAGE_END VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT
 
 #define USE_SPECIALIZATION_WGS
 struct SpecializationData {
@@ -55,6 +54,29 @@ struct SpecializationData {
   uint32_t filterHeight;
   uint32_t outputWidth;
   uint32_t outputHeight;
+  uint32_t batch;
+  uint32_t inputChannels;
+  uint32_t outputChannels;
+  uint32_t layout;
+};
+// Constant ID of SpecializationData::batch; the layout follows channels.
+#ifdef USE_SPECIALIZATION_WGS
+const uint32_t TENSOR_CONSTANT_ID = 9;
+#else
+const uint32_t TENSOR_CONSTANT_ID = 6;
+#endif
+// Constant ID of the first of InitParams::specializationConstants.
+const uint32_t EXTRA_CONSTANT_ID = TENSOR_CONSTANT_ID + 4;
+
+// Push constant block of the dynamic shape shaders, in the order of the
+// shape specialization constants.
+struct ShapeConstants {
+  uint32_t inputWidth;
+  uint32_t inputHeight;
+  uint32_t filterWidth;
+  uint32_t filterHeight;
+  uint32_t outputWidth;
+  uint32_t outputHeight;
 };
 
 struct DispatchSize {
@@ -63,12 +85,49 @@ struct DispatchSize {
   uint32_t dispatchZ;
 };
 
+// Returns the SPIR-V in path, or nothing if it cannot be read.
+static std::vector<char> readShaderCode(const std::string &path) {
+#if defined(VK_USE_PLATFORM_ANDROID_KHR)
+  // Android shaders are stored as assets in the apk.
+  AAsset *asset = AAssetManager_open(androidapp->activity->assetManager,
+                                     path.c_str(), AASSET_MODE_STREAMING);
+  if (!asset)
+    return std::vector<char>();
+  std::vector<char> code(AAsset_getLength(asset));
+  AAsset_read(asset, code.data(), code.size());
+  AAsset_close(asset);
+  return code;
+#else
+  std::ifstream is(path, std::ios::binary | std::ios::ate);
+  if (!is.is_open()) {
+    std::cerr << "Error: Could not open shader file \"" << path << "\""
+              << std::endl;
+    return std::vector<char>();
+  }
+  std::vector<char> code((size_t)is.tellg());
+  is.seekg(0, std::ios::beg);
+  is.read(code.data(), code.size());
+  return code;
+#endif
+}
+
+// ("shaders/add/add_float.comp.spv", "dynamic") ->
+// shaders/add/add_float_dynamic.comp.spv.
+static std::string getShaderVariantPath(const std::string &path,
+                                        const char *variant) {
+  const std::string suffix = ".comp.spv";
+  const size_t pos = path.rfind(suffix);
+  assert(pos != std::string::npos);
+  return path.substr(0, pos) + "_" + variant + path.substr(pos);
+}
+
 static DispatchSize getDispatchSize(const uint32_t dispatchX,
                                     const uint32_t dispatchY,
                                     const uint32_t dispatchZ,
                                     const VkFormat format, uint32_t vendorID) {
   DispatchSize dispatchSize = {dispatchX, dispatchY, dispatchZ};
-  if (format == VK_FORMAT_R32G32B32A32_SFLOAT && vendorID != 4318) {
+  // Four component texels hold four elements of a column.
+  if (getFormatComponentCount(format) == 4 && vendorID != 4318) {
     dispatchSize.dispatchX = dispatchX;
     dispatchSize.dispatchY = ceil((float)dispatchY / 4);
   } else if (format == VK_FORMAT_R32_SFLOAT) {
@@ -107,7 +166,7 @@ static VkExtent3D getExtentOfFormat(const uint32_t width, const uint32_t height,
   // buffer region specified by each element of pRegions must be a region that
   // is contained within srcBuffer'
   // (https://www.khronos.org/registry/vulkan/specs/1.0/html/vkspec.html#VUID-vkCmdCopyBufferToImage-pRegions-00171)
-  if (format == VK_FORMAT_R32G32B32A32_SFLOAT) {
+  if (getFormatComponentCount(format) == 4) {
     // NV ID 4318.
     if (vendorID != 4318) {
       extent.width = (width);
@@ -140,56 +199,112 @@ ComputeOp::InitParams::InitParams() = default;
 
 ComputeOp::InitParams::InitParams(const InitParams &other) = default;
 
+ComputeOp::InitParams &
+ComputeOp::InitParams::operator=(const InitParams &other) = default;
+
+void ComputeOp::InitParams::setTensorShapes(const Tensor &input,
+                                            const Tensor &output) {
+  assert(input.getRank() == 4 && output.getRank() == 4);
+  assert(input.getElementType() == output.getElementType());
+  assert(input.getLayout() == output.getLayout());
+  assert(input.getDim(0) == output.getDim(0));
+  batch = input.getDim(0);
+  inputChannels = input.getDim(1);
+  inputHeight = input.getDim(2);
+  inputWidth = input.getDim(3);
+  outputChannels = output.getDim(1);
+  outputHeight = output.getDim(2);
+  outputWidth = output.getDim(3);
+  elementType = input.getElementType();
+  layout = input.getLayout();
+}
+
+std::string ComputeOp::InitParams::getTuningKey() const {
+  char text[256];
+  snprintf(text, sizeof(text),
+           ":%s:%d:%d:%d:%dx%d:%dx%d:%dx%d:%dx%dx%dx%d:%d:%dx%dx%d",
+           getElementTypeName(elementType), format, shapeMode, float16Mode,
+           inputWidth, inputHeight, filterWidth, filterHeight, outputWidth,
+           outputHeight, batch, inputChannels, outputChannels, layout,
+           (int)specializationConstants.size(),
+           DISPATCH_X * WORKGROUPSIZE_X, DISPATCH_Y * WORKGROUPSIZE_Y,
+           DISPATCH_Z * WORKGROUPSIZE_Z);
+  std::string key = shader_path + text;
+  for (uint32_t constant : specializationConstants) {
+    snprintf(text, sizeof(text), ":%x", constant);
+    key += text;
+  }
+  // TuningDatabase separates fields with spaces.
+  std::replace(key.begin(), key.end(), ' ', '_');
+  return key;
+}
+
+uint64_t ComputeOp::InitParams::getFlopsPerOutput() const {
+  if (flopsPerOutput)
+    return flopsPerOutput;
+  if (filterWidth == inputWidth && filterHeight == inputHeight)
+    return 1;
+  return 2ULL * filterWidth * filterHeight * inputChannels;
+}
+
+size_t ComputeOp::getInputElementCount() const {
+  return Tensor::getStorageElementCount(
+      {(uint32_t)params_.batch, (uint32_t)params_.inputChannels,
+       (uint32_t)params_.inputHeight, (uint32_t)params_.inputWidth},
+      params_.layout);
+}
+
+size_t ComputeOp::getFilterElementCount() const {
+  return (size_t)params_.outputChannels * params_.inputChannels *
+         params_.filterHeight * params_.filterWidth;
+}
+
+size_t ComputeOp::getOutputElementCount() const {
+  return Tensor::getStorageElementCount(
+      {(uint32_t)params_.batch, (uint32_t)params_.outputChannels,
+       (uint32_t)params_.outputHeight, (uint32_t)params_.outputWidth},
+      params_.layout);
+}
+
 VkResult ComputeOp::createBufferWithData(
     VkBufferUsageFlags usageFlags, VkMemoryPropertyFlags memoryPropertyFlags,
-    VkBuffer *buffer, VkDeviceMemory *memory, VkDeviceSize size, void *data) {
+    VkBuffer *buffer, MemoryAllocator::Allocation *memory, VkDeviceSize size,
+    void *data) {
+  TRACE_EVENT1("compute", "ComputeOp::createBufferWithData", "bytes",
+               (uint64_t)size);
   // Create the buffer handle
   VkBufferCreateInfo bufferCreateInfo =
       vks::initializers::bufferCreateInfo(usageFlags, size);
   bufferCreateInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
   VK_CHECK_RESULT(vkCreateBuffer(device_, &bufferCreateInfo, nullptr, buffer));
 
-  // Create the memory backing up the buffer handle
+  // Sub-allocate the memory backing up the buffer handle
   VkMemoryRequirements memReqs;
-  VkMemoryAllocateInfo memAlloc = vks::initializers::memoryAllocateInfo();
   vkGetBufferMemoryRequirements(device_, *buffer, &memReqs);
-  memAlloc.allocationSize = memReqs.size;
-  // Find a memory type index that fits the properties of the buffer
-  bool memTypeFound = false;
-  for (uint32_t i = 0; i < deviceMemoryProperties_.memoryTypeCount; i++) {
-    if ((memReqs.memoryTypeBits & 1) == 1) {
-      if ((deviceMemoryProperties_.memoryTypes[i].propertyFlags &
-           memoryPropertyFlags) == memoryPropertyFlags) {
-        memAlloc.memoryTypeIndex = i;
-        memTypeFound = true;
-      }
-    }
-    memReqs.memoryTypeBits >>= 1;
-  }
-  assert(memTypeFound);
-  VK_CHECK_RESULT(vkAllocateMemory(device_, &memAlloc, nullptr, memory));
+  // Host visible buffers are mapped for memcpy, so avoid flushes if we can.
+  const uint32_t memoryTypeIndex = allocator_->selectMemoryType(
+      memReqs.memoryTypeBits, memoryPropertyFlags,
+      (memoryPropertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT)
+          ? VK_MEMORY_PROPERTY_HOST_COHERENT_BIT
+          : 0);
+  assert(memoryTypeIndex != UINT32_MAX);
+  VK_CHECK_RESULT(allocator_->allocate(memReqs, memoryTypeIndex,
+                                       MemoryAllocator::RESOURCE_LINEAR,
+                                       memory));
 
   if (data != nullptr) {
-    void *mapped;
-    VK_CHECK_RESULT(vkMapMemory(device_, *memory, 0, size, 0, &mapped));
+    assert(memory->mapped);
 #ifdef USE_TIME
     TIMEWITHSIZE("    createBufferWithData:memcpy CPU to HOST memory",
-                 memcpy(mapped, data, size), size);
+                 memcpy(memory->mapped, data, size), size);
 #else
-    memcpy(mapped, data, size);
+    memcpy(memory->mapped, data, size);
 #endif
-    if ((memoryPropertyFlags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT) == 0) {
-      // Flush writes to host visible buffer
-      VkMappedMemoryRange mappedRange = vks::initializers::mappedMemoryRange();
-      mappedRange.memory = *memory;
-      mappedRange.offset = 0;
-      mappedRange.size = VK_WHOLE_SIZE;
-      vkFlushMappedMemoryRanges(device_, 1, &mappedRange);
-    }
-    vkUnmapMemory(device_, *memory);
+    // Flush writes to host visible buffer
+    allocator_->flush(*memory);
   }
 
-  VK_CHECK_RESULT(vkBindBufferMemory(device_, *buffer, *memory, 0));
+  VK_CHECK_RESULT(allocator_->bindBuffer(*buffer, *memory));
 
   return VK_SUCCESS;
 }
@@ -198,6 +313,7 @@ VkResult ComputeOp::createBufferWithData(
 // createTextureTarget. Used for Image2Image.
 
 VkResult ComputeOp::createTextureTarget(uint32_t width, uint32_t height) {
+  TRACE_EVENT0("compute", "ComputeOp::createTextureTarget");
   VkFormat format = imageFormat_;
   VkFormatProperties formatProperties;
 
@@ -231,15 +347,14 @@ VkResult ComputeOp::createTextureTarget(uint32_t width, uint32_t height) {
 
   VkMemoryRequirements memReqs = {};
   vkGetImageMemoryRequirements(device_, outputImage_, &memReqs);
-  VkMemoryAllocateInfo memAllocInfo = vks::initializers::memoryAllocateInfo();
-  memAllocInfo.allocationSize = memReqs.size;
-  memAllocInfo.memoryTypeIndex =
-      getMemoryType(deviceMemoryProperties_, memReqs.memoryTypeBits,
-                    VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
-  VK_CHECK_RESULT(vkAllocateMemory(device_, &memAllocInfo, nullptr,
-                                   &outputImageDeviceMemory_));
+  const uint32_t memoryTypeIndex = allocator_->selectMemoryType(
+      memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+  assert(memoryTypeIndex != UINT32_MAX);
+  VK_CHECK_RESULT(allocator_->allocate(memReqs, memoryTypeIndex,
+                                       MemoryAllocator::RESOURCE_OPTIMAL,
+                                       &outputImageDeviceMemory_));
   VK_CHECK_RESULT(
-      vkBindImageMemory(device_, outputImage_, outputImageDeviceMemory_, 0));
+      allocator_->bindImage(outputImage_, outputImageDeviceMemory_));
 
   VkCommandBuffer layoutCmd = createCommandBuffer(
       device_, commandPool_, VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
@@ -249,7 +364,7 @@ VkResult ComputeOp::createTextureTarget(uint32_t width, uint32_t height) {
                              VK_IMAGE_LAYOUT_UNDEFINED, outputImageLayout_);
 
   // flushCommandBuffer(layoutCmd, queue, true);
-  flushCommandBuffer(device_, commandPool_, layoutCmd, queue_, true);
+  flushCommandBuffer(device_, commandPool_, layoutCmd, *queueTimeline_, true);
   createSampler(outputImage_, outputImageSampler_, outputImageView_);
 
 #if 0
@@ -307,22 +422,20 @@ ComputeOp::copyHostBufferToDeviceBuffer(VkBuffer &deviceBuffer,
   VkSubmitInfo submitInfo = vks::initializers::submitInfo();
   submitInfo.commandBufferCount = 1;
   submitInfo.pCommandBuffers = &copyCmd;
-  VkFenceCreateInfo fenceInfo =
-      vks::initializers::fenceCreateInfo(VK_FLAGS_NONE);
-  VkFence fence;
-  VK_CHECK_RESULT(vkCreateFence(device_, &fenceInfo, nullptr, &fence));
 
   // Submit to the queue.
-  VK_CHECK_RESULT(vkQueueSubmit(queue_, 1, &submitInfo, fence));
-  VK_CHECK_RESULT(vkWaitForFences(device_, 1, &fence, VK_TRUE, UINT64_MAX));
+  uint64_t value;
+  VK_CHECK_RESULT(queueTimeline_->submit(1, &submitInfo, &value));
+  VK_CHECK_RESULT(queueTimeline_->wait(value));
 
-  vkDestroyFence(device_, fence, nullptr);
   vkFreeCommandBuffers(device_, commandPool_, 1, &copyCmd);
   return VK_SUCCESS;
 }
 
-VkResult ComputeOp::createDeviceImage(VkImage &image, const int width,
-                                      const int height) {
+VkResult ComputeOp::createDeviceImage(VkImage &image,
+                                      MemoryAllocator::Allocation &memory,
+                                      const int width, const int height) {
+  TRACE_EVENT0("compute", "ComputeOp::createDeviceImage");
   VkFormat format = imageFormat_;
   VkFormatProperties formatProperties;
 
@@ -354,16 +467,13 @@ VkResult ComputeOp::createDeviceImage(VkImage &image, const int width,
 
   VkMemoryRequirements memReqs = {};
   vkGetImageMemoryRequirements(device_, image, &memReqs);
-  VkMemoryAllocateInfo memAllocInfo = vks::initializers::memoryAllocateInfo();
-  memAllocInfo.allocationSize = memReqs.size;
-  memAllocInfo.memoryTypeIndex =
-      getMemoryType(deviceMemoryProperties_, memReqs.memoryTypeBits,
-                    VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
-
-  VkDeviceMemory deviceMemory;
-  VK_CHECK_RESULT(
-      vkAllocateMemory(device_, &memAllocInfo, nullptr, &deviceMemory));
-  VK_CHECK_RESULT(vkBindImageMemory(device_, image, deviceMemory, 0));
+  const uint32_t memoryTypeIndex = allocator_->selectMemoryType(
+      memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+  assert(memoryTypeIndex != UINT32_MAX);
+  VK_CHECK_RESULT(allocator_->allocate(memReqs, memoryTypeIndex,
+                                       MemoryAllocator::RESOURCE_OPTIMAL,
+                                       &memory));
+  VK_CHECK_RESULT(allocator_->bindImage(image, memory));
   return VK_SUCCESS;
 }
 
@@ -511,7 +621,7 @@ VkResult ComputeOp::copyHostBufferToDeviceImage(VkImage &image,
   // Store current layout for later reuse
   // texture.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
 
-  flushCommandBuffer(device_, commandPool_, copyCmd, queue_, true);
+  flushCommandBuffer(device_, commandPool_, copyCmd, *queueTimeline_, true);
 
   // Clean up staging resources
   // vkFreeMemory(device, stagingMemory, nullptr);
@@ -519,114 +629,90 @@ VkResult ComputeOp::copyHostBufferToDeviceImage(VkImage &image,
   return VK_SUCCESS;
 }
 
-// TODO: Refine the barrier.
 VkResult ComputeOp::copyDeviceImageToHostBuffer(VkImage &image, void *dst,
                                                 const VkDeviceSize &bufferSize,
 
                                                 const uint32_t width,
                                                 const uint32_t height) {
+  TRACE_EVENT1("compute", "ComputeOp::copyDeviceImageToHostBuffer", "bytes",
+               (uint64_t)bufferSize);
 
   VkBuffer hostBuffer;
-  VkDeviceMemory hostMemory;
-  // TODO: check if vkQueueWaitIdle is required.
-  vkQueueWaitIdle(queue_);
-  // const int bufferSize = width*height*sizeof(DATA_TYPE);
+  MemoryAllocator::Allocation hostMemory;
   createBufferWithData(VK_BUFFER_USAGE_TRANSFER_SRC_BIT |
                            VK_BUFFER_USAGE_TRANSFER_DST_BIT,
                        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT, &hostBuffer,
-                       &hostMemory, width * height * sizeof(DATA_TYPE));
-
-  // Setup buffer copy regions for each mip level
-  std::vector<VkBufferImageCopy> bufferCopyRegions;
-  uint32_t offset = 0;
-  VkFormat format = imageFormat_;
-
-  for (uint32_t i = 0; i < mipLevels; i++) {
-    VkBufferImageCopy bufferCopyRegion = {};
-    bufferCopyRegion.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-    bufferCopyRegion.imageSubresource.mipLevel = i;
-    bufferCopyRegion.imageSubresource.baseArrayLayer = 0;
-    bufferCopyRegion.imageSubresource.layerCount = 1;
-    bufferCopyRegion.imageExtent =
-        getExtentOfFormat(width, height, format, deviceProperties_.vendorID);
-    bufferCopyRegion.bufferOffset = offset;
-
-    bufferCopyRegions.push_back(bufferCopyRegion);
-    // TODO: fix offset.
-  }
-
-  VkCommandBuffer copyCmd = createCommandBuffer(
-      device_, commandPool_, VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
-
-  // Image memory barriers for the texture image
-
-  // The sub resource range describes the regions of the image that will be
-  // transitioned using the memory barriers below
-  VkImageSubresourceRange subresourceRange = {};
-  // Image only contains color data
-  subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-  // Start at first mip level
-  subresourceRange.baseMipLevel = 0;
-  // We will transition on all mip levels
-  subresourceRange.levelCount = mipLevels;
-  // The 2D texture only has one layer
-  subresourceRange.layerCount = 1;
-
-  // Transition the texture image layout to transfer target, so we can
-  // safely copy our buffer data to it.
-  VkImageMemoryBarrier imageMemoryBarrier =
-      vks::initializers::imageMemoryBarrier();
-  imageMemoryBarrier.image = image;
-  imageMemoryBarrier.subresourceRange = subresourceRange;
-  imageMemoryBarrier.srcAccessMask = 0;
-  imageMemoryBarrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-  imageMemoryBarrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-  imageMemoryBarrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
-
-  // Insert a memory dependency at the proper pipeline stages that will
-  // execute the image layout transition Source pipeline stage is host
-  // write/read exection (VK_PIPELINE_STAGE_HOST_BIT) Destination pipeline
-  // stage is copy command exection (VK_PIPELINE_STAGE_TRANSFER_BIT)
-  vkCmdPipelineBarrier(copyCmd, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
-                       VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0, 0, nullptr, 0,
-                       nullptr, 1, &imageMemoryBarrier);
-
-  // Copy mip levels from staging buffer.
-  // vkCmdCopyBufferToImage
-  vkCmdCopyImageToBuffer(copyCmd, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-                         hostBuffer,
-                         static_cast<uint32_t>(bufferCopyRegions.size()),
-                         bufferCopyRegions.data());
-
-  // Once the data has been uploaded we transfer to the texture image to the
-  // shader read layout, so it can be sampled from
-  imageMemoryBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-  imageMemoryBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
-  imageMemoryBarrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
-  imageMemoryBarrier.newLayout = VK_IMAGE_LAYOUT_GENERAL;
-
-  // Insert a memory dependency at the proper pipeline stages that will
-  // execute the image layout transition Source pipeline stage stage is copy
-  // command exection (VK_PIPELINE_STAGE_TRANSFER_BIT) Destination pipeline
-  // stage fragment shader access (VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT)
-  vkCmdPipelineBarrier(copyCmd, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
-                       VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0, 0, nullptr, 0,
-                       nullptr, 1, &imageMemoryBarrier);
-
-  // Store current layout for later reuse
-  // texture.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-
-  flushCommandBuffer(device_, commandPool_, copyCmd, queue_, true);
+                       &hostMemory, bufferSize);
+  copyDeviceImageToHostBuffer(image, hostBuffer, hostMemory, dst, bufferSize,
+                              width, height);
 
-  VkMappedMemoryRange mappedRange = vks::initializers::mappedMemoryRange();
-  mappedRange.memory = hostMemory;
-  mappedRange.offset = 0;
-  mappedRange.size = VK_WHOLE_SIZE;
-  // vkInvalidateMappedMemoryRanges(device_, 1, &mappedRange);
+  vkDestroyBuffer(device_, hostBuffer, nullptr);
+  allocator_->free(hostMemory);
+  return VK_SUCCESS;
+}
 
-  // Map image memory so we can start copying from it
-  const DATA_TYPE *data;
-  vkMapMemory(device_, hostMemory, 0, VK_WHOLE_SIZE, 0, (void **)&data);
+VkResult ComputeOp::copyDeviceImageToHostBuffer(
+    VkImage &image, VkBuffer &hostBuffer,
+    MemoryAllocator::Allocation &hostMemory, void *dst,
+    const VkDeviceSize &bufferSize, const uint32_t width,
+    const uint32_t height) {
+  TRACE_EVENT1("compute", "ComputeOp::copyDeviceImageToHostBuffer", "bytes",
+               (uint64_t)bufferSize);
+  VK_CHECK_RESULT(stagingRing_->flush());
+  VkBufferImageCopy bufferCopyRegion = {};
+  bufferCopyRegion.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+  bufferCopyRegion.imageSubresource.mipLevel = 0;
+  bufferCopyRegion.imageSubresource.baseArrayLayer = 0;
+  bufferCopyRegion.imageSubresource.layerCount = 1;
+  bufferCopyRegion.imageExtent = getExtentOfFormat(
+      width, height, imageFormat_, deviceProperties_.vendorID);
+  bufferCopyRegion.bufferOffset = 0;
+
+  // The copy runs on the transfer queue, which takes the image over from
+  // compute and hands it back unchanged. The image stays in GENERAL, which
+  // transfers accept, so its contents are preserved.
+  TransferQueue::Ownership fromCompute;
+  fromCompute.addImage(image,
+                       VK_ACCESS_SHADER_WRITE_BIT |
+                           VK_ACCESS_TRANSFER_WRITE_BIT,
+                       VK_ACCESS_TRANSFER_READ_BIT);
+  VkCommandBuffer copyCmd = transferQueue_->begin(fromCompute);
+  const GpuProfiler::Range range = profiler_->allocate(
+      getProfileName() + ":" + getProfileStageName(PROFILE_STAGE_READBACK),
+      context_->getTransferTimestampValidBits());
+  profiler_->begin(copyCmd, range);
+  vkCmdCopyImageToBuffer(copyCmd, image, VK_IMAGE_LAYOUT_GENERAL, hostBuffer,
+                         1, &bufferCopyRegion);
+
+  // Barrier to ensure that the copy is finished before host reading from it.
+  VkBufferMemoryBarrier bufferBarrier =
+      vks::initializers::bufferMemoryBarrier();
+  bufferBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+  bufferBarrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+  bufferBarrier.buffer = hostBuffer;
+  bufferBarrier.size = VK_WHOLE_SIZE;
+  bufferBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  bufferBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  vkCmdPipelineBarrier(copyCmd, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                       VK_PIPELINE_STAGE_HOST_BIT, VK_FLAGS_NONE, 0, nullptr,
+                       1, &bufferBarrier, 0, nullptr);
+  profiler_->end(copyCmd, range);
+
+  TransferQueue::Ownership toCompute;
+  toCompute.addImage(image, 0,
+                     VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT);
+  uint64_t value;
+  VK_CHECK_RESULT(transferQueue_->submit(copyCmd, toCompute, &value));
+  profiler_->submitted(range, transferQueue_->getTimeline(), value);
+  VK_CHECK_RESULT(transferQueue_->getTimeline().wait(value));
+  // Complete, so resolving does not wait.
+  profiler_->resolve();
+  readbackMs_ = profiler_->getLastMs(range);
+  profiler_->release(range);
+
+  // Make device writes visible to the host. The memory stays mapped.
+  allocator_->invalidate(hostMemory);
+  const DATA_TYPE *data = static_cast<const DATA_TYPE *>(hostMemory.mapped);
   // Copy to output.
   uint32_t multiplier = 1;
   // if (format == VK_FORMAT_R32_SFLOAT) {
@@ -640,27 +726,21 @@ VkResult ComputeOp::copyDeviceImageToHostBuffer(VkImage &image, void *dst,
   memcpy(dst, data, bufferSize * multiplier);
 #endif
 #ifdef USE_READBACK_INPUT
-  if (width * height < MAX_LOG) {
-    // Fix msvc: expression did not evaluate to a constant
-    DATA_TYPE *tmpout = new DATA_TYPE[width * height * multiplier]();
-    memcpy(tmpout, data, width * height * sizeof(DATA_TYPE) * multiplier);
-    for (uint32_t y = 0; y < width * height * multiplier; y++) {
-      LOG("%f,", (DATA_TYPE) * (tmpout + y));
+  // Only the bufferSize bytes read back, which hold elements of
+  // params_.elementType.
+  const size_t count = bufferSize * multiplier / getElementSize();
+  if (count < MAX_LOG) {
+    std::vector<float> values(count);
+    convertToFloat(data, count, params_.elementType, values.data());
+    for (size_t y = 0; y < count; y++) {
+      LOG("%f,", values[y]);
       if (((y + 1) % height) == 0)
         LOG("\n");
     }
     LOG("\n");
-    delete tmpout;
   }
 #endif
 
-  vkFlushMappedMemoryRanges(device_, 1, &mappedRange);
-  vkUnmapMemory(device_, hostMemory);
-
-  // vkUnmapMemory(device_, hostMemory);
-  vkFreeMemory(device_, hostMemory, nullptr);
-  vkDestroyBuffer(device_, hostBuffer, nullptr);
-
   // Clean up staging resources
   // vkFreeMemory(device, stagingMemory, nullptr);
   // vkDestroyBuffer(device, stagingBuffer, nullptr);
@@ -671,8 +751,11 @@ VkResult ComputeOp::copyDeviceImageToHostBuffer2(VkImage &image, void *dst,
                                                  const VkDeviceSize &bufferSize,
                                                  const uint32_t width,
                                                  const uint32_t height) {
+  TRACE_EVENT1("compute", "ComputeOp::copyDeviceImageToHostBuffer2", "bytes",
+               (uint64_t)bufferSize);
 
   assert(dst);
+  VK_CHECK_RESULT(stagingRing_->flush());
   // Setup buffer copy regions for each mip level
   uint32_t offset = 0;
   VkFormat format = imageFormat_;
@@ -698,18 +781,21 @@ VkResult ComputeOp::copyDeviceImageToHostBuffer2(VkImage &image, void *dst,
   VK_CHECK_RESULT(vkCreateImage(device_, &imageCreateCI, nullptr, &dstImage));
   // Create memory to back up the image
   VkMemoryRequirements memRequirements;
-  VkMemoryAllocateInfo memAllocInfo(vks::initializers::memoryAllocateInfo());
-  VkDeviceMemory dstImageMemory;
+  MemoryAllocator::Allocation dstImageMemory;
   vkGetImageMemoryRequirements(device_, dstImage, &memRequirements);
-  memAllocInfo.allocationSize = memRequirements.size;
-  // Memory must be host visible to copy from
-  memAllocInfo.memoryTypeIndex =
-      getMemoryType(deviceMemoryProperties_, memRequirements.memoryTypeBits,
-                    VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
-                        VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
-  VK_CHECK_RESULT(
-      vkAllocateMemory(device_, &memAllocInfo, nullptr, &dstImageMemory));
-  VK_CHECK_RESULT(vkBindImageMemory(device_, dstImage, dstImageMemory, 0));
+  // Memory must be host visible to copy from, and is read by the CPU, so
+  // host cached if possible. Linear images share the granularity rules of
+  // buffers.
+  const uint32_t memoryTypeIndex = allocator_->selectMemoryType(
+      memRequirements.memoryTypeBits,
+      VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+          VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+      VK_MEMORY_PROPERTY_HOST_CACHED_BIT);
+  assert(memoryTypeIndex != UINT32_MAX);
+  VK_CHECK_RESULT(allocator_->allocate(memRequirements, memoryTypeIndex,
+                                       MemoryAllocator::RESOURCE_LINEAR,
+                                       &dstImageMemory));
+  VK_CHECK_RESULT(allocator_->bindImage(dstImage, dstImageMemory));
 
   VkCommandBuffer copyCmd = createCommandBuffer(
       device_, commandPool_, VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
@@ -751,7 +837,7 @@ VkResult ComputeOp::copyDeviceImageToHostBuffer2(VkImage &image, void *dst,
       VK_PIPELINE_STAGE_TRANSFER_BIT,
       VkImageSubresourceRange{VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1});
 
-  flushCommandBuffer(device_, commandPool_, copyCmd, queue_, true);
+  flushCommandBuffer(device_, commandPool_, copyCmd, *queueTimeline_, true);
 
   // Get layout of the image (including row pitch)
   VkImageSubresource subResource{VK_IMAGE_ASPECT_COLOR_BIT, 0, 0};
@@ -759,15 +845,11 @@ VkResult ComputeOp::copyDeviceImageToHostBuffer2(VkImage &image, void *dst,
   vkGetImageSubresourceLayout(device_, dstImage, &subResource,
                               &subResourceLayout);
 
-  VkMappedMemoryRange mappedRange = vks::initializers::mappedMemoryRange();
-  mappedRange.memory = dstImageMemory;
-  mappedRange.offset = 0;
-  mappedRange.size = VK_WHOLE_SIZE;
-  vkInvalidateMappedMemoryRanges(device_, 1, &mappedRange);
+  allocator_->invalidate(dstImageMemory);
 
-  // Map image memory so we can start copying from it
-  const DATA_TYPE *data;
-  vkMapMemory(device_, dstImageMemory, 0, VK_WHOLE_SIZE, 0, (void **)&data);
+  // Image memory is already mapped by the allocator.
+  const DATA_TYPE *data =
+      static_cast<const DATA_TYPE *>(dstImageMemory.mapped);
   // Copy to output.
   uint32_t multiplier = 1;
   if (format == VK_FORMAT_R32_SFLOAT) {
@@ -781,17 +863,18 @@ VkResult ComputeOp::copyDeviceImageToHostBuffer2(VkImage &image, void *dst,
   memcpy(dst, data, bufferSize * multiplier);
 #endif
 #ifdef USE_READBACK_INPUT
-  if (width * height < MAX_LOG) {
-    // Fix msvc: expression did not evaluate to a constant
-    DATA_TYPE *tmpout = new DATA_TYPE[width * height * multiplier]();
-    memcpy(tmpout, data, width * height * sizeof(DATA_TYPE) * multiplier);
-    for (uint32_t y = 0; y < width * height * multiplier; y++) {
-      LOG("%f,", (DATA_TYPE) * (tmpout + y));
+  // Only the bufferSize bytes read back, which hold elements of
+  // params_.elementType.
+  const size_t count = bufferSize * multiplier / getElementSize();
+  if (count < MAX_LOG) {
+    std::vector<float> values(count);
+    convertToFloat(data, count, params_.elementType, values.data());
+    for (size_t y = 0; y < count; y++) {
+      LOG("%f,", values[y]);
       if (((y + 1) % height) == 0)
         LOG("\n");
     }
     LOG("\n");
-    delete tmpout;
   }
 #endif
 #if 0
@@ -853,9 +936,8 @@ VkResult ComputeOp::copyDeviceImageToHostBuffer2(VkImage &image, void *dst,
 #endif
 
   // Clean up resources
-  vkUnmapMemory(device_, dstImageMemory);
-  vkFreeMemory(device_, dstImageMemory, nullptr);
   vkDestroyImage(device_, dstImage, nullptr);
+  allocator_->free(dstImageMemory);
   return VK_SUCCESS;
 }
 
@@ -864,73 +946,76 @@ VkResult ComputeOp::copyDeviceBufferToHostBuffer(VkBuffer &deviceBuffer,
                                                  const VkDeviceSize &bufferSize,
                                                  const uint32_t width,
                                                  const uint32_t height) {
+  TRACE_EVENT1("compute", "ComputeOp::copyDeviceBufferToHostBuffer", "bytes",
+               (uint64_t)bufferSize);
   assert(dst);
   VkBuffer hostBuffer;
-  VkDeviceMemory hostMemory;
-  // TODO: check if vkQueueWaitIdle is required.
-  vkQueueWaitIdle(queue_);
+  MemoryAllocator::Allocation hostMemory;
   createBufferWithData(VK_BUFFER_USAGE_TRANSFER_SRC_BIT |
                            VK_BUFFER_USAGE_TRANSFER_DST_BIT,
                        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT, &hostBuffer,
                        &hostMemory, bufferSize);
+  copyDeviceBufferToHostBuffer(deviceBuffer, hostBuffer, hostMemory, dst,
+                               bufferSize);
+  vkDestroyBuffer(device_, hostBuffer, nullptr);
+  allocator_->free(hostMemory);
+  return VK_SUCCESS;
+}
 
-  // Copy to staging buffer
-  VkCommandBufferAllocateInfo cmdBufAllocateInfo =
-      vks::initializers::commandBufferAllocateInfo(
-          commandPool_, VK_COMMAND_BUFFER_LEVEL_PRIMARY, 1);
-  VkCommandBuffer copyCmd;
-  VK_CHECK_RESULT(
-      vkAllocateCommandBuffers(device_, &cmdBufAllocateInfo, &copyCmd));
-  VkCommandBufferBeginInfo cmdBufInfo =
-      vks::initializers::commandBufferBeginInfo();
-  VK_CHECK_RESULT(vkBeginCommandBuffer(copyCmd, &cmdBufInfo));
-
-  VkBufferMemoryBarrier bufferBarrier =
-      vks::initializers::bufferMemoryBarrier();
-
-  // Barrier to ensure that shader writes are finished before buffer is read
-  // back from GPU
-  bufferBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
-  bufferBarrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
-  bufferBarrier.buffer = deviceBuffer;
-  bufferBarrier.size = VK_WHOLE_SIZE;
-  bufferBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-  bufferBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-
-  vkCmdPipelineBarrier(
-      copyCmd,
-      VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, // VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
-      VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, // VK_PIPELINE_STAGE_TRANSFER_BIT,
-      VK_FLAGS_NONE, 0, nullptr, 1, &bufferBarrier, 0, nullptr);
+VkResult ComputeOp::copyDeviceBufferToHostBuffer(
+    VkBuffer &deviceBuffer, VkBuffer &hostBuffer,
+    MemoryAllocator::Allocation &hostMemory, void *dst,
+    const VkDeviceSize &bufferSize) {
+  TRACE_EVENT1("compute", "ComputeOp::copyDeviceBufferToHostBuffer", "bytes",
+               (uint64_t)bufferSize);
+  assert(dst);
+  VK_CHECK_RESULT(stagingRing_->flush());
+  // The copy runs on the transfer queue, which takes the buffer over from
+  // compute (after the shader writes are finished) and hands it back.
+  TransferQueue::Ownership fromCompute;
+  fromCompute.addBuffer(deviceBuffer,
+                        VK_ACCESS_SHADER_WRITE_BIT |
+                            VK_ACCESS_TRANSFER_WRITE_BIT,
+                        VK_ACCESS_TRANSFER_READ_BIT);
+  VkCommandBuffer copyCmd = transferQueue_->begin(fromCompute);
+  const GpuProfiler::Range range = profiler_->allocate(
+      getProfileName() + ":" + getProfileStageName(PROFILE_STAGE_READBACK),
+      context_->getTransferTimestampValidBits());
+  profiler_->begin(copyCmd, range);
 
   VkBufferCopy copyRegion = {};
   copyRegion.size = bufferSize;
   vkCmdCopyBuffer(copyCmd, deviceBuffer, hostBuffer, 1, &copyRegion);
 
   // Barrier to ensure that buffer copy is finished before host reading from it
+  VkBufferMemoryBarrier bufferBarrier =
+      vks::initializers::bufferMemoryBarrier();
   bufferBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
   bufferBarrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
   bufferBarrier.buffer = hostBuffer;
   bufferBarrier.size = VK_WHOLE_SIZE;
   bufferBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
   bufferBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-
-  vkCmdPipelineBarrier(
-      copyCmd,
-      VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, // VK_PIPELINE_STAGE_TRANSFER_BIT,
-      VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, // VK_PIPELINE_STAGE_HOST_BIT,
-      VK_FLAGS_NONE, 0, nullptr, 1, &bufferBarrier, 0, nullptr);
-
-  flushCommandBuffer(device_, commandPool_, copyCmd, queue_, true);
-
-  // Make device writes visible to the host.
-  void *mapped;
-  vkMapMemory(device_, hostMemory, 0, VK_WHOLE_SIZE, 0, &mapped);
-  VkMappedMemoryRange mappedRange = vks::initializers::mappedMemoryRange();
-  mappedRange.memory = hostMemory;
-  mappedRange.offset = 0;
-  mappedRange.size = VK_WHOLE_SIZE;
-  vkInvalidateMappedMemoryRanges(device_, 1, &mappedRange);
+  vkCmdPipelineBarrier(copyCmd, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                       VK_PIPELINE_STAGE_HOST_BIT, VK_FLAGS_NONE, 0, nullptr,
+                       1, &bufferBarrier, 0, nullptr);
+  profiler_->end(copyCmd, range);
+
+  TransferQueue::Ownership toCompute;
+  toCompute.addBuffer(deviceBuffer, 0,
+                      VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT);
+  uint64_t value;
+  VK_CHECK_RESULT(transferQueue_->submit(copyCmd, toCompute, &value));
+  profiler_->submitted(range, transferQueue_->getTimeline(), value);
+  VK_CHECK_RESULT(transferQueue_->getTimeline().wait(value));
+  // Complete, so resolving does not wait.
+  profiler_->resolve();
+  readbackMs_ = profiler_->getLastMs(range);
+  profiler_->release(range);
+
+  // Make device writes visible to the host. The memory stays mapped.
+  allocator_->invalidate(hostMemory);
+  void *mapped = hostMemory.mapped;
 
   // Copy to output.
 #ifdef USE_TIME
@@ -951,26 +1036,302 @@ VkResult ComputeOp::copyDeviceBufferToHostBuffer(VkBuffer &deviceBuffer,
   }
   printf("\n");
 #endif
-  vkUnmapMemory(device_, hostMemory);
-  vkFreeMemory(device_, hostMemory, nullptr);
-  vkDestroyBuffer(device_, hostBuffer, nullptr);
   return VK_SUCCESS;
 }
 
-VkResult ComputeOp::prepareCommandBuffer(VkBuffer &outputDeviceBuffer,
-                                         VkBuffer &outputHostBuffer,
-                                         VkDeviceMemory &outputHostMemory,
+VkResult ComputeOp::uploadToDeviceBuffer(VkBuffer &deviceBuffer,
+                                         const void *src,
                                          const VkDeviceSize &bufferSize) {
+  TRACE_EVENT1("compute", "ComputeOp::uploadToDeviceBuffer", "bytes",
+               (uint64_t)bufferSize);
+  releaseImports(false);
+  if (uploadFromImportedHostPointer(deviceBuffer, src, bufferSize))
+    return VK_SUCCESS;
+  return stagingRing_->uploadToBuffer(deviceBuffer, 0, src, bufferSize);
+}
+
+bool ComputeOp::uploadFromImportedHostPointer(VkBuffer &deviceBuffer,
+                                              const void *src,
+                                              const VkDeviceSize &bufferSize) {
+  const VkDeviceSize alignment =
+      context_->getMinImportedHostPointerAlignment();
+  if (alignment == 0 || reinterpret_cast<uintptr_t>(src) % alignment != 0)
+    return false;
+  // The import covers whole alignment units. Only bufferSize bytes are read,
+  // and memory from AlignedAllocator is padded to cover the rest.
+  const VkDeviceSize importSize =
+      (bufferSize + alignment - 1) / alignment * alignment;
+  VkMemoryHostPointerPropertiesEXT hostPointerProperties = {};
+  hostPointerProperties.sType =
+      VK_STRUCTURE_TYPE_MEMORY_HOST_POINTER_PROPERTIES_EXT;
+  if (context_->getMemoryHostPointerPropertiesFunction()(
+          device_, VK_EXTERNAL_MEMORY_HANDLE_TYPE_HOST_ALLOCATION_BIT_EXT, src,
+          &hostPointerProperties) != VK_SUCCESS)
+    return false;
+
+  VkExternalMemoryBufferCreateInfo externalCreateInfo = {};
+  externalCreateInfo.sType =
+      VK_STRUCTURE_TYPE_EXTERNAL_MEMORY_BUFFER_CREATE_INFO;
+  externalCreateInfo.handleTypes =
+      VK_EXTERNAL_MEMORY_HANDLE_TYPE_HOST_ALLOCATION_BIT_EXT;
+  VkBufferCreateInfo bufferCreateInfo = vks::initializers::bufferCreateInfo(
+      VK_BUFFER_USAGE_TRANSFER_SRC_BIT, importSize);
+  bufferCreateInfo.pNext = &externalCreateInfo;
+  ImportedBuffer imported = {};
+  VK_CHECK_RESULT(
+      vkCreateBuffer(device_, &bufferCreateInfo, nullptr, &imported.buffer));
+  VkMemoryRequirements memReqs;
+  vkGetBufferMemoryRequirements(device_, imported.buffer, &memReqs);
+  // Host writes are only visible to the copy without a flush on coherent
+  // memory, and imported memory is never mapped here.
+  const uint32_t memoryTypeIndex = allocator_->selectMemoryType(
+      memReqs.memoryTypeBits & hostPointerProperties.memoryTypeBits,
+      VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+  VkImportMemoryHostPointerInfoEXT importInfo = {};
+  importInfo.sType = VK_STRUCTURE_TYPE_IMPORT_MEMORY_HOST_POINTER_INFO_EXT;
+  importInfo.handleType =
+      VK_EXTERNAL_MEMORY_HANDLE_TYPE_HOST_ALLOCATION_BIT_EXT;
+  importInfo.pHostPointer = const_cast<void *>(src);
+  VkMemoryAllocateInfo memAlloc = vks::initializers::memoryAllocateInfo();
+  memAlloc.pNext = &importInfo;
+  memAlloc.allocationSize = importSize;
+  memAlloc.memoryTypeIndex = memoryTypeIndex;
+  // The pointer may still be rejected, e.g. when the padding is not mapped.
+  if (memoryTypeIndex == UINT32_MAX ||
+      vkAllocateMemory(device_, &memAlloc, nullptr, &imported.memory) !=
+          VK_SUCCESS) {
+    vkDestroyBuffer(device_, imported.buffer, nullptr);
+    return false;
+  }
+  VK_CHECK_RESULT(
+      vkBindBufferMemory(device_, imported.buffer, imported.memory, 0));
+
+  VkCommandBuffer commandBuffer = transferQueue_->begin();
+  VkBufferCopy copyRegion = {};
+  copyRegion.size = bufferSize;
+  vkCmdCopyBuffer(commandBuffer, imported.buffer, deviceBuffer, 1,
+                  &copyRegion);
+  TransferQueue::Ownership toCompute;
+  toCompute.addBuffer(deviceBuffer, VK_ACCESS_TRANSFER_WRITE_BIT,
+                      VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT |
+                          VK_ACCESS_TRANSFER_READ_BIT,
+                      0, bufferSize);
+  VK_CHECK_RESULT(
+      transferQueue_->submit(commandBuffer, toCompute, &imported.value));
+  imports_.push_back(imported);
+  importedUploadCount_++;
+  return true;
+}
+
+void ComputeOp::releaseImports(bool wait) {
+  QueueTimeline &timeline = transferQueue_->getTimeline();
+  while (!imports_.empty()) {
+    const ImportedBuffer &imported = imports_.front();
+    if (wait) {
+      VK_CHECK_RESULT(timeline.wait(imported.value));
+    } else if (!timeline.isComplete(imported.value)) {
+      break;
+    }
+    vkDestroyBuffer(device_, imported.buffer, nullptr);
+    vkFreeMemory(device_, imported.memory, nullptr);
+    imports_.pop_front();
+  }
+}
+
+VkResult ComputeOp::uploadToDeviceImage(VkImage &image, const void *src,
+                                        const VkDeviceSize &bufferSize,
+                                        const uint32_t width,
+                                        const uint32_t height) {
+  TRACE_EVENT1("compute", "ComputeOp::uploadToDeviceImage", "bytes",
+               (uint64_t)bufferSize);
+  return stagingRing_->uploadToImage(
+      image,
+      getExtentOfFormat(width, height, imageFormat_,
+                        deviceProperties_.vendorID),
+      src, bufferSize);
+}
+
+VkResult ComputeOp::copyToHostMemory(MemoryAllocator::Allocation &hostMemory,
+                                     const void *src,
+                                     const VkDeviceSize &bufferSize) {
+  TRACE_EVENT1("compute", "ComputeOp::copyToHostMemory", "bytes",
+               (uint64_t)bufferSize);
+  assert(src);
+  void *mapped = hostMemory.mapped;
+  assert(mapped);
+#ifdef USE_TIME
+  TIMEWITHSIZE("    copyToHostMemory:memcpy CPU to HOST memory",
+               memcpy(mapped, src, bufferSize), bufferSize);
+#else
+  memcpy(mapped, src, bufferSize);
+#endif
+  // Flush writes in case the memory is not host coherent.
+  allocator_->flush(hostMemory);
+  return VK_SUCCESS;
+}
+
+VkResult ComputeOp::copyFromHostMemory(MemoryAllocator::Allocation &hostMemory,
+                                       void *dst,
+                                       const VkDeviceSize &bufferSize) {
+  TRACE_EVENT1("compute", "ComputeOp::copyFromHostMemory", "bytes",
+               (uint64_t)bufferSize);
+  assert(dst);
+  // Make device writes visible to the host. The memory stays mapped.
+  allocator_->invalidate(hostMemory);
+  void *mapped = hostMemory.mapped;
+  assert(mapped);
+#ifdef USE_TIME
+  TIMEWITHSIZE("    copyFromHostMemory:memcpy HOST memory to CPU",
+               memcpy(dst, mapped, bufferSize), bufferSize);
+#else
+  memcpy(dst, mapped, bufferSize);
+#endif
+  return VK_SUCCESS;
+}
+
+void ComputeOp::recordBufferUpload(VkBuffer &hostBuffer,
+                                   VkBuffer &deviceBuffer,
+                                   const VkDeviceSize &bufferSize) {
+  // The previous run may still read the buffer when runs overlap. Host writes
+  // to hostBuffer are made visible by the submit itself.
+  vkCmdPipelineBarrier(commandBuffer_, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                       VK_PIPELINE_STAGE_TRANSFER_BIT, VK_FLAGS_NONE, 0,
+                       nullptr, 0, nullptr, 0, nullptr);
+
+  VkBufferCopy copyRegion = {};
+  copyRegion.size = bufferSize;
+  vkCmdCopyBuffer(commandBuffer_, hostBuffer, deviceBuffer, 1, &copyRegion);
+
+  // Barrier to ensure that the upload is finished before the compute shader
+  // reads from it.
+  VkBufferMemoryBarrier bufferBarrier =
+      vks::initializers::bufferMemoryBarrier();
+  bufferBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+  bufferBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+  bufferBarrier.buffer = deviceBuffer;
+  bufferBarrier.size = VK_WHOLE_SIZE;
+  bufferBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  bufferBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  vkCmdPipelineBarrier(commandBuffer_, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                       VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_FLAGS_NONE, 0,
+                       nullptr, 1, &bufferBarrier, 0, nullptr);
+}
+
+void ComputeOp::recordImageUpload(VkBuffer &hostBuffer, VkImage &image,
+                                  const uint32_t width,
+                                  const uint32_t height) {
+  VkBufferImageCopy bufferCopyRegion = {};
+  bufferCopyRegion.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+  bufferCopyRegion.imageSubresource.mipLevel = 0;
+  bufferCopyRegion.imageSubresource.baseArrayLayer = 0;
+  bufferCopyRegion.imageSubresource.layerCount = 1;
+  bufferCopyRegion.imageExtent = getExtentOfFormat(
+      width, height, imageFormat_, deviceProperties_.vendorID);
+  bufferCopyRegion.bufferOffset = 0;
+
+  // The whole image is overwritten, so its previous contents are discarded.
+  VkImageMemoryBarrier imageMemoryBarrier =
+      vks::initializers::imageMemoryBarrier();
+  imageMemoryBarrier.image = image;
+  imageMemoryBarrier.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, 0,
+                                         mipLevels, 0, 1};
+  imageMemoryBarrier.srcAccessMask = 0;
+  imageMemoryBarrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+  imageMemoryBarrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+  imageMemoryBarrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+  vkCmdPipelineBarrier(commandBuffer_, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                       VK_PIPELINE_STAGE_TRANSFER_BIT, VK_FLAGS_NONE, 0,
+                       nullptr, 0, nullptr, 1, &imageMemoryBarrier);
+
+  vkCmdCopyBufferToImage(commandBuffer_, hostBuffer, image,
+                         VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1,
+                         &bufferCopyRegion);
+
+  // Back to the layout the descriptors use, readable by the compute shader.
+  imageMemoryBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+  imageMemoryBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+  imageMemoryBarrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+  imageMemoryBarrier.newLayout = VK_IMAGE_LAYOUT_GENERAL;
+  vkCmdPipelineBarrier(commandBuffer_, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                       VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_FLAGS_NONE, 0,
+                       nullptr, 0, nullptr, 1, &imageMemoryBarrier);
+}
+
+void ComputeOp::recordBufferReadback(VkBuffer &deviceBuffer,
+                                     VkBuffer &hostBuffer,
+                                     const VkDeviceSize &bufferSize) {
+  VkBufferCopy copyRegion = {};
+  copyRegion.size = bufferSize;
+  vkCmdCopyBuffer(commandBuffer_, deviceBuffer, hostBuffer, 1, &copyRegion);
+
+  // Barrier to ensure that buffer copy is finished before host reading from
+  // it.
+  VkBufferMemoryBarrier bufferBarrier =
+      vks::initializers::bufferMemoryBarrier();
+  bufferBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+  bufferBarrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+  bufferBarrier.buffer = hostBuffer;
+  bufferBarrier.size = VK_WHOLE_SIZE;
+  bufferBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  bufferBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  vkCmdPipelineBarrier(commandBuffer_, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                       VK_PIPELINE_STAGE_HOST_BIT, VK_FLAGS_NONE, 0, nullptr,
+                       1, &bufferBarrier, 0, nullptr);
+}
+
+void ComputeOp::recordImageReadback(VkImage &image, VkBuffer &hostBuffer,
+                                    const uint32_t width,
+                                    const uint32_t height) {
+  VkBufferImageCopy bufferCopyRegion = {};
+  bufferCopyRegion.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+  bufferCopyRegion.imageSubresource.mipLevel = 0;
+  bufferCopyRegion.imageSubresource.baseArrayLayer = 0;
+  bufferCopyRegion.imageSubresource.layerCount = 1;
+  bufferCopyRegion.imageExtent = getExtentOfFormat(
+      width, height, imageFormat_, deviceProperties_.vendorID);
+  bufferCopyRegion.bufferOffset = 0;
+
+  // The image stays in GENERAL, which transfers accept, so there is no layout
+  // transition to undo afterwards.
+  vkCmdCopyImageToBuffer(commandBuffer_, image, VK_IMAGE_LAYOUT_GENERAL,
+                         hostBuffer, 1, &bufferCopyRegion);
+
+  VkBufferMemoryBarrier bufferBarrier =
+      vks::initializers::bufferMemoryBarrier();
+  bufferBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+  bufferBarrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+  bufferBarrier.buffer = hostBuffer;
+  bufferBarrier.size = VK_WHOLE_SIZE;
+  bufferBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  bufferBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  vkCmdPipelineBarrier(commandBuffer_, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                       VK_PIPELINE_STAGE_HOST_BIT, VK_FLAGS_NONE, 0, nullptr,
+                       1, &bufferBarrier, 0, nullptr);
+}
+
+VkResult ComputeOp::prepareCommandBuffer(
+    VkBuffer &outputDeviceBuffer, VkBuffer &outputHostBuffer,
+    MemoryAllocator::Allocation &outputHostMemory,
+    const VkDeviceSize &bufferSize) {
+  recordCommandBuffer(outputDeviceBuffer, outputHostBuffer, bufferSize);
+  return submitCommandBuffer();
+}
+
+VkResult ComputeOp::recordCommandBuffer(VkBuffer &outputDeviceBuffer,
+                                        VkBuffer &outputHostBuffer,
+                                        const VkDeviceSize &bufferSize) {
+  TRACE_EVENT0("compute", "ComputeOp::recordCommandBuffer");
   VkCommandBufferBeginInfo cmdBufInfo =
       vks::initializers::commandBufferBeginInfo();
 
   VK_CHECK_RESULT(vkBeginCommandBuffer(commandBuffer_, &cmdBufInfo));
-#if defined(USE_TIMESTAMP) || defined(USE_TIMESTAMP_BARRIER)
-  vkCmdResetQueryPool(commandBuffer_, queryPool_, 0, 2);
-#endif
-#ifdef USE_TIMESTAMP_BARRIER
-  vkCmdWriteTimestamp(commandBuffer_, TIMESTAMP_STAGE_BEGIN, queryPool_, 0);
-#endif
+  clearStages();
+  if (params_.executionMode == EXECUTION_MODE_SINGLE_SUBMIT) {
+    beginStage(PROFILE_STAGE_UPLOAD);
+    recordBufferUpload(hostBuffer_, deviceBuffer_, getInputBytes());
+    endStage(PROFILE_STAGE_UPLOAD);
+  }
+  beginStage(PROFILE_STAGE_BARRIER);
   // Barrier to ensure that input buffer transfer is finished before compute
   // shader reads from it.
   VkBufferMemoryBarrier bufferBarrier =
@@ -985,13 +1346,12 @@ VkResult ComputeOp::prepareCommandBuffer(VkBuffer &outputDeviceBuffer,
   vkCmdPipelineBarrier(commandBuffer_, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
                        VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_FLAGS_NONE, 0,
                        nullptr, 1, &bufferBarrier, 0, nullptr);
+  endStage(PROFILE_STAGE_BARRIER);
 
+  beginStage(PROFILE_STAGE_DISPATCH);
   vkCmdBindPipeline(commandBuffer_, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline_);
-  vkCmdBindDescriptorSets(commandBuffer_, VK_PIPELINE_BIND_POINT_COMPUTE,
-                          pipelineLayout_, 0, 1, &descriptorSet_, 0, 0);
-#ifdef USE_TIMESTAMP
-  vkCmdWriteTimestamp(commandBuffer_, TIMESTAMP_STAGE_BEGIN, queryPool_, 0);
-#endif
+  recordDescriptors(commandBuffer_);
+  recordShapeConstants(commandBuffer_);
   DispatchSize dispatchSize;
 
 #if defined(USE_FLAT_INPUT)
@@ -1002,17 +1362,18 @@ VkResult ComputeOp::prepareCommandBuffer(VkBuffer &outputDeviceBuffer,
         params_.inputWidth, params_.inputHeight, params_.WORKGROUPSIZE_X,
         imageFormat_, deviceProperties_.vendorID);
   } else
-    dispatchSize =
-        getDispatchSizeForBuffer(params_.DISPATCH_X, params_.DISPATCH_Y, 1,
-                                 imageFormat_, deviceProperties_.vendorID);
+    dispatchSize = getDispatchSizeForBuffer(
+        params_.DISPATCH_X, params_.DISPATCH_Y, params_.DISPATCH_Z,
+        imageFormat_, deviceProperties_.vendorID);
 #else
-  dispatchSize =
-      getDispatchSizeForBuffer(params_.DISPATCH_X, params_.DISPATCH_Y, 1,
-                               imageFormat_, deviceProperties_.vendorID);
+  dispatchSize = getDispatchSizeForBuffer(
+      params_.DISPATCH_X, params_.DISPATCH_Y, params_.DISPATCH_Z, imageFormat_,
+      deviceProperties_.vendorID);
 #endif
 
   vkCmdDispatch(commandBuffer_, dispatchSize.dispatchX, dispatchSize.dispatchY,
-                1);
+                dispatchSize.dispatchZ);
+  endStage(PROFILE_STAGE_DISPATCH);
 
   bufferBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
   bufferBarrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
@@ -1025,106 +1386,377 @@ VkResult ComputeOp::prepareCommandBuffer(VkBuffer &outputDeviceBuffer,
                        VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_FLAGS_NONE, 0,
                        nullptr, 1, &bufferBarrier, 0, nullptr);
 
-#if defined(USE_TIMESTAMP) || defined(USE_TIMESTAMP_BARRIER)
-  vkCmdWriteTimestamp(commandBuffer_, TIMESTAMP_STAGE_END, queryPool_, 1);
-#endif
+  // The barrier above makes the output readable by the copy, so the
+  // readback shares the dispatch submission. Output read in place only has
+  // to be made visible to the host.
+  if (params_.executionMode != EXECUTION_MODE_STAGED) {
+    if (outputHostBuffer != VK_NULL_HANDLE) {
+      beginStage(PROFILE_STAGE_READBACK);
+      recordBufferReadback(outputDeviceBuffer, outputHostBuffer, bufferSize);
+      endStage(PROFILE_STAGE_READBACK);
+    } else {
+      bufferBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+      bufferBarrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+      vkCmdPipelineBarrier(commandBuffer_,
+                           VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                           VK_PIPELINE_STAGE_HOST_BIT, VK_FLAGS_NONE, 0,
+                           nullptr, 1, &bufferBarrier, 0, nullptr);
+    }
+  }
 
-  // Below merges the dispatch and copy.
-#if 0
-  // Barrier to ensure that shader writes are finished before buffer is read
-  // back from GPU.
-  bufferBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
-  bufferBarrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
-  bufferBarrier.buffer = outputDeviceBuffer;
-  bufferBarrier.size = VK_WHOLE_SIZE;
-  bufferBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-  bufferBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  VK_CHECK_RESULT(vkEndCommandBuffer(commandBuffer_));
+  return VK_SUCCESS;
+}
 
-  vkCmdPipelineBarrier(commandBuffer_, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
-                       VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_FLAGS_NONE, 0,
-                       nullptr, 1, &bufferBarrier, 0, nullptr);
+VkResult ComputeOp::recordDispatchCommandBuffer() {
+  VkCommandBufferBeginInfo cmdBufInfo =
+      vks::initializers::commandBufferBeginInfo();
+  VK_CHECK_RESULT(vkBeginCommandBuffer(commandBuffer_, &cmdBufInfo));
+  clearStages();
+  beginStage(PROFILE_STAGE_BARRIER);
+  // The input may have been written by an earlier op or an upload, and the
+  // output may still be read by one.
+  VkMemoryBarrier memoryBarrier = vks::initializers::memoryBarrier();
+  memoryBarrier.srcAccessMask =
+      VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_TRANSFER_WRITE_BIT;
+  memoryBarrier.dstAccessMask =
+      VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+  vkCmdPipelineBarrier(
+      commandBuffer_,
+      VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT,
+      VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_FLAGS_NONE, 1, &memoryBarrier,
+      0, nullptr, 0, nullptr);
+  endStage(PROFILE_STAGE_BARRIER);
+
+  beginStage(PROFILE_STAGE_DISPATCH);
+  recordDispatch(commandBuffer_);
+  endStage(PROFILE_STAGE_DISPATCH);
+
+  memoryBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+  memoryBarrier.dstAccessMask =
+      VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_TRANSFER_READ_BIT;
+  vkCmdPipelineBarrier(
+      commandBuffer_, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+      VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT,
+      VK_FLAGS_NONE, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
+  VK_CHECK_RESULT(vkEndCommandBuffer(commandBuffer_));
+  return VK_SUCCESS;
+}
 
-  // Read back to host visible buffer.
-  VkBufferCopy copyRegion = {};
-  copyRegion.size = bufferSize;
-  vkCmdCopyBuffer(commandBuffer_, outputDeviceBuffer, outputHostBuffer, 1,
-                  &copyRegion);
+void ComputeOp::recordDispatch(VkCommandBuffer commandBuffer) {
+  vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline_);
+  recordDescriptors(commandBuffer);
+  recordShapeConstants(commandBuffer);
+  vkCmdDispatch(commandBuffer, params_.DISPATCH_X, params_.DISPATCH_Y,
+                params_.DISPATCH_Z);
+}
 
-  // Barrier to ensure that buffer copy is finished before host reading from
-  // it.
-  bufferBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-  bufferBarrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
-  bufferBarrier.buffer = outputHostBuffer;
-  bufferBarrier.size = VK_WHOLE_SIZE;
-  bufferBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-  bufferBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+const char *ComputeOp::getProfileStageName(ProfileStage stage) {
+  switch (stage) {
+  case PROFILE_STAGE_UPLOAD:
+    return "upload";
+  case PROFILE_STAGE_BARRIER:
+    return "barrier";
+  case PROFILE_STAGE_DISPATCH:
+    return "dispatch";
+  case PROFILE_STAGE_READBACK:
+    return "readback";
+  default:
+    return "unknown";
+  }
+}
 
-  vkCmdPipelineBarrier(commandBuffer_, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
-                       VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_FLAGS_NONE, 0,
-                       nullptr, 1, &bufferBarrier, 0, nullptr);
-#endif
-  VK_CHECK_RESULT(vkEndCommandBuffer(commandBuffer_));
-  VkFence fence;
-  VkFenceCreateInfo fenceInfo =
-      vks::initializers::fenceCreateInfo(VK_FLAGS_NONE);
-  VK_CHECK_RESULT(vkCreateFence(device_, &fenceInfo, nullptr, &fence));
+std::string ComputeOp::getProfileName() const {
+  std::string name = params_.shader_path;
+  name = name.substr(name.find_last_of("/\\") + 1);
+  return name.substr(0, name.find('.'));
+}
+
+uint64_t ComputeOp::getBytesMoved() const {
+  return getInputBytes() + getFilterBytes() + getOutputBytes();
+}
+
+uint64_t ComputeOp::getFlops() const {
+  // Padding channels of NC4HW4 are moved but not computed.
+  const uint64_t outputCount = (uint64_t)params_.batch *
+                               params_.outputChannels * params_.outputHeight *
+                               params_.outputWidth;
+  return outputCount * params_.getFlopsPerOutput();
+}
+
+double ComputeOp::getStageMs(ProfileStage stage) const {
+  if (!profiler_)
+    return 0.0;
+  profiler_->resolve();
+  if (stage == PROFILE_STAGE_READBACK &&
+      params_.executionMode == EXECUTION_MODE_STAGED)
+    return readbackMs_;
+  return profiler_->getLastMs(stageRanges_[stage]);
+}
+
+void ComputeOp::clearStages() { recordedStages_.clear(); }
+
+void ComputeOp::beginStage(ProfileStage stage) {
+  if (stageRanges_[stage] == GpuProfiler::INVALID_RANGE) {
+    stageRanges_[stage] = profiler_->allocate(
+        getProfileName() + ":" + getProfileStageName(stage),
+        context_->getTimestampValidBits());
+  }
+  profiler_->begin(commandBuffer_, stageRanges_[stage]);
+  recordedStages_.push_back(stage);
+}
+
+void ComputeOp::endStage(ProfileStage stage) {
+  profiler_->end(commandBuffer_, stageRanges_[stage]);
+}
+
+VkResult ComputeOp::submitCommandBufferAsync(uint64_t *value) {
+  TRACE_EVENT0("compute", "ComputeOp::submitCommandBufferAsync");
+  // Pending uploads go first on the queue.
+  VK_CHECK_RESULT(stagingRing_->flush());
 
   // Submit compute work.
-  // vkResetFences(device_, 1, &fence);
   const VkPipelineStageFlags waitStageMask = VK_PIPELINE_STAGE_TRANSFER_BIT;
   VkSubmitInfo computeSubmitInfo = vks::initializers::submitInfo();
   computeSubmitInfo.pWaitDstStageMask = &waitStageMask;
   computeSubmitInfo.commandBufferCount = 1;
   computeSubmitInfo.pCommandBuffers = &commandBuffer_;
-  VK_CHECK_RESULT(vkQueueSubmit(queue_, 1, &computeSubmitInfo, fence));
-  VK_CHECK_RESULT(vkWaitForFences(device_, 1, &fence, VK_TRUE, UINT64_MAX));
-  vkDestroyFence(device_, fence, nullptr);
-#if 0
-  // Make device writes visible to the host.
-  void *mapped;
-  vkMapMemory(device_, outputHostMemory, 0, VK_WHOLE_SIZE, 0, &mapped);
-  VkMappedMemoryRange mappedRange = vks::initializers::mappedMemoryRange();
-  mappedRange.memory = outputHostMemory;
-  mappedRange.offset = 0;
-  mappedRange.size = VK_WHOLE_SIZE;
-  vkInvalidateMappedMemoryRanges(device_, 1, &mappedRange);
+  VK_CHECK_RESULT(queueTimeline_->submit(1, &computeSubmitInfo, value));
+  for (ProfileStage stage : recordedStages_)
+    profiler_->submitted(stageRanges_[stage], *queueTimeline_, *value);
+  return VK_SUCCESS;
+}
 
-  // Copy to output.
-  memcpy(params_.computeOutput.data(), mapped, bufferSize);
+VkResult ComputeOp::submitCommandBuffer() {
+  TRACE_EVENT0("compute", "ComputeOp::submitCommandBuffer");
+  uint64_t value;
+  VK_CHECK_RESULT(submitCommandBufferAsync(&value));
+  VK_CHECK_RESULT(queueTimeline_->wait(value));
+  // The dispatch waited for imported uploads, so their sources are free.
+  releaseImports(true);
+  LOG("Time for dispatch = %fms\n", getDispatchMs());
+  return VK_SUCCESS;
+}
 
-  DATA_TYPE out[32];
-  memcpy(out, mapped, 32 * sizeof(DATA_TYPE));
-  for (uint32_t y = 0; y < 32; y++)
-  {
-    printf("%f", (DATA_TYPE) * (out + y));
-    if (y != 31)
-      printf(",");
-  }
-  printf("\n");
+std::shared_future<void> ComputeOp::submitAsync(const ElementVector &input,
+                                                ElementVector &output) {
+  assert(params_.executionMode != EXECUTION_MODE_STAGED);
+  // commandBuffer_ and the host buffers are reused, so a previous run of
+  // this op must have completed.
+  waitForAsync();
+  copyToHostMemory(getInputHostMemory(),
+                   toElements(input, getInputElementCount(), inputElements_),
+                   getInputBytes());
+  output.reset(params_.elementType, getOutputElementCount());
+  void *outputData = output.data();
+  uint64_t value;
+  VK_CHECK_RESULT(submitCommandBufferAsync(&value));
+
+  std::shared_ptr<std::promise<void>> promise =
+      std::make_shared<std::promise<void>>();
+  inFlight_ = promise->get_future().share();
+  // The readback is part of commandBuffer_, so only the copy out of host
+  // memory is left once it completes.
+  queueTimeline_->onComplete(value, [this, promise, outputData]() {
+    copyFromHostMemory(getOutputHostMemory(), outputData, getOutputBytes());
+    promise->set_value();
+  });
+  return inFlight_;
+}
 
+VkResult ComputeOp::prepareLayout(
+    const std::vector<VkDescriptorSetLayoutBinding> &setLayoutBindings) {
+  const uint32_t pushConstantSize =
+      params_.shapeMode == SHAPE_MODE_DYNAMIC ? sizeof(ShapeConstants) : 0;
+  layout_ = context_->getPipelineObjectCache().getLayout(setLayoutBindings,
+                                                         pushConstantSize);
+  descriptorSetLayout_ = layout_->descriptorSetLayout;
+  pipelineLayout_ = layout_->pipelineLayout;
+  return VK_SUCCESS;
+}
 
-  vkUnmapMemory(device_, outputHostMemory);
-#endif
+void ComputeOp::applyTunedWorkgroupSize() {
+  if (!params_.useTunedWorkgroupSize)
+    return;
+  TuningDatabase::Entry entry;
+  if (!context_->getTuningDatabase().find(params_.getTuningKey(), &entry))
+    return;
+  const int invocationsX = params_.DISPATCH_X * params_.WORKGROUPSIZE_X;
+  const int invocationsY = params_.DISPATCH_Y * params_.WORKGROUPSIZE_Y;
+  const int invocationsZ = params_.DISPATCH_Z * params_.WORKGROUPSIZE_Z;
+  // The tuner only keeps sizes that divide the invocations, so this only
+  // fails on a hand edited database.
+  if (invocationsX % entry.workgroupSizeX ||
+      invocationsY % entry.workgroupSizeY ||
+      invocationsZ % entry.workgroupSizeZ)
+    return;
+  params_.WORKGROUPSIZE_X = entry.workgroupSizeX;
+  params_.WORKGROUPSIZE_Y = entry.workgroupSizeY;
+  params_.WORKGROUPSIZE_Z = entry.workgroupSizeZ;
+  params_.DISPATCH_X = invocationsX / entry.workgroupSizeX;
+  params_.DISPATCH_Y = invocationsY / entry.workgroupSizeY;
+  params_.DISPATCH_Z = invocationsZ / entry.workgroupSizeZ;
+  LOG("Tuned workgroup size %ux%ux%u\n", entry.workgroupSizeX,
+      entry.workgroupSizeY, entry.workgroupSizeZ);
+}
 
-#if defined(USE_TIMESTAMP) || defined(USE_TIMESTAMP_BARRIER)
-  timeOfDispatch(device_, queryPool_, deviceProperties_.limits.timestampPeriod,
-                 timestampValidBits_);
+VkResult
+ComputeOp::preparePipeline(const VkSpecializationInfo &specializationInfo) {
+  TRACE_EVENT0("compute", "ComputeOp::preparePipeline");
+  std::string shaderPath = params_.shader_path;
+  VkSpecializationInfo shaderSpecializationInfo = specializationInfo;
+  if (params_.elementType == ELEMENT_TYPE_FLOAT16 &&
+      params_.float16Mode == FLOAT16_MODE_NATIVE) {
+    if (context_->supportsFloat16Arithmetic()) {
+      shaderPath = getShaderVariantPath(shaderPath, "native");
+    } else {
+      LOG("No shaderFloat16, %s accumulates in fp32\n", shaderPath.c_str());
+      params_.float16Mode = FLOAT16_MODE_FP32_ACCUMULATE;
+    }
+  }
+  if (params_.shapeMode == SHAPE_MODE_DYNAMIC) {
+    shaderPath = getShaderVariantPath(shaderPath, "dynamic");
+    // Leave the shapes out of the specialization data, which comes after
+    // the workgroup size, so that every shape maps to the same pipeline.
+#ifdef USE_SPECIALIZATION_WGS
+    shaderSpecializationInfo.mapEntryCount = 3;
+    shaderSpecializationInfo.dataSize = 3 * sizeof(uint32_t);
+#else
+    shaderSpecializationInfo.mapEntryCount = 0;
+    shaderSpecializationInfo.dataSize = 0;
 #endif
+  }
+  auto begin = Clock::now();
+  const std::vector<char> code = readShaderCode(getAssetPath() + shaderPath);
+  cachedPipeline_ = context_->getPipelineObjectCache().getPipeline(
+      code, shaderSpecializationInfo, layout_);
+  pipelineCreationMs_ =
+      (double)(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                   Clock::now() - begin)
+                   .count()) /
+      NS2MS;
+  if (!cachedPipeline_)
+    return VK_ERROR_INITIALIZATION_FAILED;
+  pipeline_ = cachedPipeline_->pipeline;
   return VK_SUCCESS;
 }
 
+VkResult
+ComputeOp::bindDescriptors(const std::vector<VkWriteDescriptorSet> &writes) {
+  // Push descriptors are recorded later, so keep the resources the writes
+  // point to. Reserving first keeps the pointers into them stable.
+  descriptorWrites_ = writes;
+  descriptorBufferInfos_.clear();
+  descriptorBufferInfos_.reserve(writes.size());
+  descriptorImageInfos_.clear();
+  descriptorImageInfos_.reserve(writes.size());
+  for (auto &write : descriptorWrites_) {
+    assert(write.descriptorCount == 1);
+    if (write.pBufferInfo) {
+      descriptorBufferInfos_.push_back(*write.pBufferInfo);
+      write.pBufferInfo = &descriptorBufferInfos_.back();
+    }
+    if (write.pImageInfo) {
+      descriptorImageInfos_.push_back(*write.pImageInfo);
+      write.pImageInfo = &descriptorImageInfos_.back();
+    }
+  }
+  if (layout_->pushDescriptor)
+    return VK_SUCCESS;
+  // Rebinding rewrites the set this op already has.
+  if (descriptorSet_ == VK_NULL_HANDLE) {
+    VK_CHECK_RESULT(context_->getDescriptorAllocator().allocate(
+        *layout_, &descriptorSet_));
+  }
+  for (auto &write : descriptorWrites_)
+    write.dstSet = descriptorSet_;
+  vkUpdateDescriptorSets(device_,
+                         static_cast<uint32_t>(descriptorWrites_.size()),
+                         descriptorWrites_.data(), 0, nullptr);
+  return VK_SUCCESS;
+}
+
+void ComputeOp::recordDescriptors(VkCommandBuffer commandBuffer) {
+  if (layout_->pushDescriptor) {
+    context_->getPushDescriptorSetFunction()(
+        commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelineLayout_, 0,
+        static_cast<uint32_t>(descriptorWrites_.size()),
+        descriptorWrites_.data());
+  } else {
+    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE,
+                            pipelineLayout_, 0, 1, &descriptorSet_, 0, 0);
+  }
+}
+
+void ComputeOp::recordShapeConstants(VkCommandBuffer commandBuffer) {
+  if (params_.shapeMode != SHAPE_MODE_DYNAMIC)
+    return;
+  ShapeConstants shapeConstants;
+  shapeConstants.inputWidth = params_.inputWidth;
+#if defined(USE_FLAT_INPUT)
+  // Must match the specialized inputHeight in prepareBufferToBufferPipeline.
+  if (params_.WORKGROUPSIZE_Y == 1 && params_.WORKGROUPSIZE_Z == 1)
+    shapeConstants.inputHeight = 1;
+  else
+    shapeConstants.inputHeight = params_.inputHeight;
+#else
+  shapeConstants.inputHeight = params_.inputHeight;
+#endif
+  shapeConstants.filterWidth = params_.filterWidth;
+  shapeConstants.filterHeight = params_.filterHeight;
+  shapeConstants.outputWidth = params_.outputWidth;
+  shapeConstants.outputHeight = params_.outputHeight;
+  vkCmdPushConstants(commandBuffer, pipelineLayout_,
+                     VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(ShapeConstants),
+                     &shapeConstants);
+}
+
+void ComputeOp::waitForAsync() {
+  if (inFlight_.valid())
+    inFlight_.wait();
+}
+
+bool ComputeOp::supportsZeroStaging(VkDeviceSize size) const {
+  const uint32_t memoryTypeIndex =
+      allocator_->selectMemoryType(UINT32_MAX,
+                                   VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT |
+                                       VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT);
+  // Without resizable BAR the heap is typically 256MB and shared with the
+  // driver, so only take up to half of it.
+  return memoryTypeIndex != UINT32_MAX &&
+         size <= allocator_->getHeapSize(memoryTypeIndex) / 2;
+}
+
+MemoryAllocator::Allocation &ComputeOp::getInputHostMemory() {
+  return params_.executionMode == EXECUTION_MODE_ZERO_STAGING ? deviceMemory_
+                                                              : hostMemory_;
+}
+
+MemoryAllocator::Allocation &ComputeOp::getOutputHostMemory() {
+  // A zero staging op without an output host buffer reads in place.
+  return outputHostBuffer_ == VK_NULL_HANDLE ? outputDeviceMemory_
+                                             : outputHostMemory_;
+}
+
 VkResult ComputeOp::prepareImageToImageCommandBuffer() {
+  recordImageToImageCommandBuffer();
+  return submitCommandBuffer();
+}
+
+VkResult ComputeOp::recordImageToImageCommandBuffer() {
   // vkQueueWaitIdle(queue_);
   VkCommandBufferBeginInfo cmdBufInfo =
       vks::initializers::commandBufferBeginInfo();
 
   VK_CHECK_RESULT(vkBeginCommandBuffer(commandBuffer_, &cmdBufInfo));
-#if defined(USE_TIMESTAMP) || defined(USE_TIMESTAMP_BARRIER)
-  vkCmdResetQueryPool(commandBuffer_, queryPool_, 0, 2);
-#endif
-#ifdef USE_TIMESTAMP_BARRIER
-  vkCmdWriteTimestamp(commandBuffer_, TIMESTAMP_STAGE_BEGIN, queryPool_, 0);
-#endif
+  clearStages();
+  if (params_.executionMode == EXECUTION_MODE_SINGLE_SUBMIT) {
+    beginStage(PROFILE_STAGE_UPLOAD);
+    recordImageUpload(hostBuffer_, image_, params_.inputWidth,
+                      params_.inputHeight);
+    endStage(PROFILE_STAGE_UPLOAD);
+  }
+  beginStage(PROFILE_STAGE_BARRIER);
 
   // Image memory barrier to make sure that compute shader writes are finished
   // before sampling from the texture
@@ -1148,21 +1780,18 @@ VkResult ComputeOp::prepareImageToImageCommandBuffer() {
   vkCmdPipelineBarrier(commandBuffer_, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
                        VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_FLAGS_NONE, 0,
                        nullptr, 0, nullptr, 1, &imageMemoryBarrier);
+  endStage(PROFILE_STAGE_BARRIER);
 
+  beginStage(PROFILE_STAGE_DISPATCH);
   vkCmdBindPipeline(commandBuffer_, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline_);
-  vkCmdBindDescriptorSets(commandBuffer_, VK_PIPELINE_BIND_POINT_COMPUTE,
-                          pipelineLayout_, 0, 1, &descriptorSet_, 0, 0);
-#ifdef USE_TIMESTAMP
-  vkCmdWriteTimestamp(commandBuffer_, TIMESTAMP_STAGE_BEGIN, queryPool_, 0);
-#endif
+  recordDescriptors(commandBuffer_);
+  recordShapeConstants(commandBuffer_);
   DispatchSize dispatchSize =
       getDispatchSize(params_.DISPATCH_X, params_.DISPATCH_Y, 1, imageFormat_,
                       deviceProperties_.vendorID);
   vkCmdDispatch(commandBuffer_, dispatchSize.dispatchX, dispatchSize.dispatchY,
                 1);
-#ifdef USE_TIMESTAMP
-  vkCmdWriteTimestamp(commandBuffer_, TIMESTAMP_STAGE_END, queryPool_, 1);
-#endif
+  endStage(PROFILE_STAGE_DISPATCH);
 
   imageMemoryBarrier.image = outputImage_;
   imageMemoryBarrier.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1};
@@ -1172,224 +1801,14 @@ VkResult ComputeOp::prepareImageToImageCommandBuffer() {
                        VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_FLAGS_NONE, 0,
                        nullptr, 0, nullptr, 1, &imageMemoryBarrier);
 
-#ifdef USE_TIMESTAMP_BARRIER
-  vkCmdWriteTimestamp(commandBuffer_, TIMESTAMP_STAGE_END, queryPool_, 1);
-#endif
-
-  VK_CHECK_RESULT(vkEndCommandBuffer(commandBuffer_));
-  VkFence fence;
-  VkFenceCreateInfo fenceCreateInfo =
-      vks::initializers::fenceCreateInfo(VK_FENCE_CREATE_SIGNALED_BIT);
-  VK_CHECK_RESULT(vkCreateFence(device_, &fenceCreateInfo, nullptr, &fence));
-
-  // Submit compute work.
-  vkResetFences(device_, 1, &fence);
-  const VkPipelineStageFlags waitStageMask = VK_PIPELINE_STAGE_TRANSFER_BIT;
-  VkSubmitInfo computeSubmitInfo = vks::initializers::submitInfo();
-  computeSubmitInfo.pWaitDstStageMask = &waitStageMask;
-  computeSubmitInfo.commandBufferCount = 1;
-  computeSubmitInfo.pCommandBuffers = &commandBuffer_;
-  VK_CHECK_RESULT(vkQueueSubmit(queue_, 1, &computeSubmitInfo, fence));
-  VK_CHECK_RESULT(vkWaitForFences(device_, 1, &fence, VK_TRUE, UINT64_MAX));
-  vkDestroyFence(device_, fence, nullptr);
-
-#if defined(USE_TIMESTAMP) || defined(USE_TIMESTAMP_BARRIER)
-  // nanoseconds.
-  timeOfDispatch(device_, queryPool_, deviceProperties_.limits.timestampPeriod,
-                 timestampValidBits_);
-#endif
-  return VK_SUCCESS;
-}
-
-VkResult ComputeOp::prepareDebugLayer() {
-
-#if defined(VK_USE_PLATFORM_ANDROID_KHR)
-  LOG("loading vulkan lib");
-  vks::android::loadVulkanLibrary();
-#endif
-
-  VkApplicationInfo appInfo = {};
-  appInfo.sType = VK_STRUCTURE_TYPE_APPLICATION_INFO;
-  appInfo.pApplicationName = "Vulkan add example";
-  appInfo.pEngineName = "ComputeOp";
-  appInfo.apiVersion = VK_API_VERSION_1_0;
-
-  // Vulkan instance creation (without surface extensions).
-  VkInstanceCreateInfo instanceCreateInfo = {};
-  instanceCreateInfo.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
-  instanceCreateInfo.pApplicationInfo = &appInfo;
-
-  uint32_t layerCount = 0;
-#if defined(VK_USE_PLATFORM_ANDROID_KHR)
-  const char *validationLayers[] = {
-      "VK_LAYER_GOOGLE_threading",      "VK_LAYER_LUNARG_parameter_validation",
-      "VK_LAYER_LUNARG_object_tracker", "VK_LAYER_LUNARG_core_validation",
-      "VK_LAYER_LUNARG_swapchain",      "VK_LAYER_GOOGLE_unique_objects"};
-  layerCount = 6;
-#else
-  const char *validationLayers[] = {"VK_LAYER_LUNARG_standard_validation"};
-  layerCount = 1;
-#endif
-#if DEBUG
-  // Check if layers are available
-  uint32_t instanceLayerCount;
-  vkEnumerateInstanceLayerProperties(&instanceLayerCount, nullptr);
-  std::vector<VkLayerProperties> instanceLayers(instanceLayerCount);
-  vkEnumerateInstanceLayerProperties(&instanceLayerCount,
-                                     instanceLayers.data());
-
-  bool layersAvailable = true;
-  for (auto layerName : validationLayers) {
-    bool layerAvailable = false;
-    for (auto instanceLayer : instanceLayers) {
-      if (strcmp(instanceLayer.layerName, layerName) == 0) {
-        layerAvailable = true;
-        break;
-      }
-    }
-    if (!layerAvailable) {
-      layersAvailable = false;
-      break;
-    }
-  }
-
-  if (layersAvailable) {
-    instanceCreateInfo.ppEnabledLayerNames = validationLayers;
-    const char *validationExt = VK_EXT_DEBUG_REPORT_EXTENSION_NAME;
-    instanceCreateInfo.enabledLayerCount = layerCount;
-    instanceCreateInfo.enabledExtensionCount = 1;
-    instanceCreateInfo.ppEnabledExtensionNames = &validationExt;
-  }
-#endif
-  VK_CHECK_RESULT(vkCreateInstance(&instanceCreateInfo, nullptr, &instance_));
-
-#if defined(VK_USE_PLATFORM_ANDROID_KHR)
-  vks::android::loadVulkanFunctions(instance);
-#endif
-#if DEBUG
-  if (layersAvailable) {
-    VkDebugReportCallbackCreateInfoEXT debugReportCreateInfo = {};
-    debugReportCreateInfo.sType =
-        VK_STRUCTURE_TYPE_DEBUG_REPORT_CALLBACK_CREATE_INFO_EXT;
-    debugReportCreateInfo.flags =
-        VK_DEBUG_REPORT_ERROR_BIT_EXT | VK_DEBUG_REPORT_WARNING_BIT_EXT;
-    debugReportCreateInfo.pfnCallback =
-        (PFN_vkDebugReportCallbackEXT)debugMessageCallback;
-
-    // We have to explicitly load this function.
-    PFN_vkCreateDebugReportCallbackEXT vkCreateDebugReportCallbackEXT =
-        reinterpret_cast<PFN_vkCreateDebugReportCallbackEXT>(
-            vkGetInstanceProcAddr(instance_, "vkCreateDebugReportCallbackEXT"));
-    assert(vkCreateDebugReportCallbackEXT);
-    VK_CHECK_RESULT(vkCreateDebugReportCallbackEXT(
-        instance_, &debugReportCreateInfo, nullptr, &debugReportCallback));
-  }
-#endif
-  return VK_SUCCESS;
-}
-
-VkResult ComputeOp::prepareDevice() {
-  // Physical device (always use first).
-  uint32_t deviceCount = 0;
-  VK_CHECK_RESULT(vkEnumeratePhysicalDevices(instance_, &deviceCount, nullptr));
-  std::vector<VkPhysicalDevice> physicalDevices(deviceCount);
-  VK_CHECK_RESULT(vkEnumeratePhysicalDevices(instance_, &deviceCount,
-                                             physicalDevices.data()));
-
-  bool foundDiscreteGPU = false;
-  for (const auto &device : physicalDevices) {
-    auto props = VkPhysicalDeviceProperties{};
-    vkGetPhysicalDeviceProperties(device, &props);
-
-    // Determine the type of the physical device
-    if (props.deviceType ==
-        VkPhysicalDeviceType::VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU) {
-      foundDiscreteGPU = true;
-      physicalDevice_ = device;
-      break;
-    }
-  }
-  if (!foundDiscreteGPU)
-    physicalDevice_ = physicalDevices[0];
-
-  vkGetPhysicalDeviceProperties(physicalDevice_, &deviceProperties_);
-
-  LOG("***********: GPU INFO:\n");
-  LOG("deviceCount: %d\n", deviceCount);
-  LOG("%s\n", deviceProperties_.deviceName);
-  LOG("vendorID: %d\n", deviceProperties_.vendorID);
-  LOG("deviceID: %d\n", deviceProperties_.deviceID);
-  LOG("deviceType: %d\n", deviceProperties_.deviceType);
-
-  LOG("GPU: maxComputeWorkGroupCount = %d, %d, %d\n",
-      deviceProperties_.limits.maxComputeWorkGroupCount[0],
-      deviceProperties_.limits.maxComputeWorkGroupCount[1],
-      deviceProperties_.limits.maxComputeWorkGroupCount[2]);
-  LOG("GPU: maxComputeWorkGroupSize = %d, %d, %d\n",
-      deviceProperties_.limits.maxComputeWorkGroupSize[0],
-      deviceProperties_.limits.maxComputeWorkGroupSize[1],
-      deviceProperties_.limits.maxComputeWorkGroupSize[2]);
-  LOG("GPU: maxComputeSharedMemorySize = %d\n",
-      deviceProperties_.limits.maxComputeSharedMemorySize);
-  LOG("GPU: timestampPeriod = %f\n", deviceProperties_.limits.timestampPeriod);
-  vkGetPhysicalDeviceMemoryProperties(physicalDevice_,
-                                      &deviceMemoryProperties_);
-
-  // Request a single compute queue.
-  const float defaultQueuePriority(0.0f);
-  VkDeviceQueueCreateInfo queueCreateInfo = {};
-  uint32_t queueFamilyCount;
-  vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice_, &queueFamilyCount,
-                                           nullptr);
-  std::vector<VkQueueFamilyProperties> queueFamilyProperties(queueFamilyCount);
-  vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice_, &queueFamilyCount,
-                                           queueFamilyProperties.data());
-  for (uint32_t i = 0; i < static_cast<uint32_t>(queueFamilyProperties.size());
-       i++) {
-    LOG("GPU Queue type: %x\n", queueFamilyProperties[i].queueFlags);
-  }
-
-  for (uint32_t i = 0; i < static_cast<uint32_t>(queueFamilyProperties.size());
-       i++) {
-    if (queueFamilyProperties[i].queueFlags & VK_QUEUE_COMPUTE_BIT) {
-      queueFamilyIndex_ = i;
-      queueCreateInfo.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
-      queueCreateInfo.queueFamilyIndex = i;
-      queueCreateInfo.queueCount = 1;
-      queueCreateInfo.pQueuePriorities = &defaultQueuePriority;
-      break;
-    }
+  if (params_.executionMode == EXECUTION_MODE_SINGLE_SUBMIT) {
+    beginStage(PROFILE_STAGE_READBACK);
+    recordImageReadback(outputImage_, outputHostBuffer_, params_.outputWidth,
+                        params_.outputHeight);
+    endStage(PROFILE_STAGE_READBACK);
   }
-  timestampValidBits_ =
-      queueFamilyProperties[queueFamilyIndex_].timestampValidBits;
-  // Create logical device.
-  VkDeviceCreateInfo deviceCreateInfo = {};
-  deviceCreateInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
-  deviceCreateInfo.queueCreateInfoCount = 1;
-  deviceCreateInfo.pQueueCreateInfos = &queueCreateInfo;
-  VK_CHECK_RESULT(
-      vkCreateDevice(physicalDevice_, &deviceCreateInfo, nullptr, &device_));
-
-  // Get a compute queue.
-  vkGetDeviceQueue(device_, queueFamilyIndex_, 0, &queue_);
-
-  // Compute command pool.
-  VkCommandPoolCreateInfo cmdPoolInfo = {};
-  cmdPoolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
-  cmdPoolInfo.queueFamilyIndex = queueFamilyIndex_;
-  cmdPoolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
-  VK_CHECK_RESULT(
-      vkCreateCommandPool(device_, &cmdPoolInfo, nullptr, &commandPool_));
-
-  VkQueryPoolCreateInfo createInfo = {};
-  createInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
-  createInfo.pNext = nullptr;
-  createInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
-  createInfo.queryCount = 2;
-
-  VK_CHECK_RESULT(
-      vkCreateQueryPool(device_, &createInfo, nullptr, &queryPool_));
 
+  VK_CHECK_RESULT(vkEndCommandBuffer(commandBuffer_));
   return VK_SUCCESS;
 }
 
@@ -1397,18 +1816,7 @@ VkResult
 ComputeOp::prepareBufferToBufferPipeline(VkBuffer &deviceBuffer,
                                          VkBuffer &filterDeviceBuffer,
                                          VkBuffer &outputDeviceBuffer) {
-  // SIZE.
-  std::vector<VkDescriptorPoolSize> poolSizes = {
-      vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
-                                            BUFFER_NUMBER),
-  };
-
-  VkDescriptorPoolCreateInfo descriptorPoolInfo =
-      vks::initializers::descriptorPoolCreateInfo(
-          static_cast<uint32_t>(poolSizes.size()), poolSizes.data(), 1);
-  VK_CHECK_RESULT(vkCreateDescriptorPool(device_, &descriptorPoolInfo, nullptr,
-                                         &descriptorPool_));
-
+  applyTunedWorkgroupSize();
   std::vector<VkDescriptorSetLayoutBinding> setLayoutBindings = {
       vks::initializers::descriptorSetLayoutBinding(
           VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 0),
@@ -1417,21 +1825,7 @@ ComputeOp::prepareBufferToBufferPipeline(VkBuffer &deviceBuffer,
       vks::initializers::descriptorSetLayoutBinding(
           VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 2),
   };
-  VkDescriptorSetLayoutCreateInfo descriptorLayout =
-      vks::initializers::descriptorSetLayoutCreateInfo(setLayoutBindings);
-  VK_CHECK_RESULT(vkCreateDescriptorSetLayout(device_, &descriptorLayout,
-                                              nullptr, &descriptorSetLayout_));
-
-  VkPipelineLayoutCreateInfo pipelineLayoutCreateInfo =
-      vks::initializers::pipelineLayoutCreateInfo(&descriptorSetLayout_, 1);
-  VK_CHECK_RESULT(vkCreatePipelineLayout(device_, &pipelineLayoutCreateInfo,
-                                         nullptr, &pipelineLayout_));
-
-  VkDescriptorSetAllocateInfo allocInfo =
-      vks::initializers::descriptorSetAllocateInfo(descriptorPool_,
-                                                   &descriptorSetLayout_, 1);
-  VK_CHECK_RESULT(
-      vkAllocateDescriptorSets(device_, &allocInfo, &descriptorSet_));
+  VK_CHECK_RESULT(prepareLayout(setLayoutBindings));
 
   VkDescriptorBufferInfo outputBufferDescriptor = {outputDeviceBuffer, 0,
                                                    VK_WHOLE_SIZE};
@@ -1441,33 +1835,23 @@ ComputeOp::prepareBufferToBufferPipeline(VkBuffer &deviceBuffer,
                                                    VK_WHOLE_SIZE};
 
   std::vector<VkWriteDescriptorSet> computeWriteDescriptorSets = {
-      vks::initializers::writeDescriptorSet(descriptorSet_,
+      vks::initializers::writeDescriptorSet(VK_NULL_HANDLE,
                                             VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
                                             0, &outputBufferDescriptor),
 
-      vks::initializers::writeDescriptorSet(descriptorSet_,
+      vks::initializers::writeDescriptorSet(VK_NULL_HANDLE,
                                             VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
                                             1, &bufferDescriptor),
 
-      vks::initializers::writeDescriptorSet(descriptorSet_,
+      vks::initializers::writeDescriptorSet(VK_NULL_HANDLE,
                                             VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
                                             2, &filterBufferDescriptor),
   };
-  vkUpdateDescriptorSets(
-      device_, static_cast<uint32_t>(computeWriteDescriptorSets.size()),
-      computeWriteDescriptorSets.data(), 0, NULL);
-
-  VkPipelineCacheCreateInfo pipelineCacheCreateInfo = {};
-  pipelineCacheCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
-  VK_CHECK_RESULT(vkCreatePipelineCache(device_, &pipelineCacheCreateInfo,
-                                        nullptr, &pipelineCache_));
+  VK_CHECK_RESULT(bindDescriptors(computeWriteDescriptorSets));
 
   // Create pipeline
-  VkComputePipelineCreateInfo computePipelineCreateInfo =
-      vks::initializers::computePipelineCreateInfo(pipelineLayout_, 0);
-
   // Pass SSBO size via specialization constant
-  SpecializationData specializationData;
+  SpecializationData specializationData = {};
 #ifdef USE_SPECIALIZATION_WGS
   specializationData.workgroupSizeX = params_.WORKGROUPSIZE_X;
   specializationData.workgroupSizeY = params_.WORKGROUPSIZE_Y;
@@ -1489,6 +1873,10 @@ ComputeOp::prepareBufferToBufferPipeline(VkBuffer &deviceBuffer,
   specializationData.filterHeight = params_.filterHeight;
   specializationData.outputWidth = params_.outputWidth;
   specializationData.outputHeight = params_.outputHeight;
+  specializationData.batch = params_.batch;
+  specializationData.inputChannels = params_.inputChannels;
+  specializationData.outputChannels = params_.outputChannels;
+  specializationData.layout = params_.layout;
 
   VkSpecializationMapEntry specializationMapEntry[] = {
       vks::initializers::specializationMapEntry(0, 0 * sizeof(uint32_t),
@@ -1511,40 +1899,39 @@ ComputeOp::prepareBufferToBufferPipeline(VkBuffer &deviceBuffer,
       vks::initializers::specializationMapEntry(8, 8 * sizeof(uint32_t),
                                                 sizeof(uint32_t)),
 #endif
+      // Batch, channels and layout, which shaders without them ignore.
+      vks::initializers::specializationMapEntry(
+          TENSOR_CONSTANT_ID, TENSOR_CONSTANT_ID * sizeof(uint32_t),
+          sizeof(uint32_t)),
+      vks::initializers::specializationMapEntry(
+          TENSOR_CONSTANT_ID + 1, (TENSOR_CONSTANT_ID + 1) * sizeof(uint32_t),
+          sizeof(uint32_t)),
+      vks::initializers::specializationMapEntry(
+          TENSOR_CONSTANT_ID + 2, (TENSOR_CONSTANT_ID + 2) * sizeof(uint32_t),
+          sizeof(uint32_t)),
+      vks::initializers::specializationMapEntry(
+          TENSOR_CONSTANT_ID + 3, (TENSOR_CONSTANT_ID + 3) * sizeof(uint32_t),
+          sizeof(uint32_t)),
   };
-#ifdef USE_SPECIALIZATION_WGS
-  VkSpecializationInfo specializationInfo =
-      vks::initializers::specializationInfo(9, specializationMapEntry,
-                                            sizeof(SpecializationData),
-                                            &specializationData);
-#else
+  // Op specific constants follow SpecializationData.
+  std::vector<VkSpecializationMapEntry> mapEntries(
+      specializationMapEntry, specializationMapEntry + EXTRA_CONSTANT_ID);
+  std::vector<uint32_t> data(sizeof(SpecializationData) / sizeof(uint32_t));
+  memcpy(data.data(), &specializationData, sizeof(SpecializationData));
+  assert(params_.specializationConstants.empty() ||
+         params_.shapeMode == SHAPE_MODE_SPECIALIZED);
+  for (size_t i = 0; i < params_.specializationConstants.size(); i++) {
+    mapEntries.push_back(vks::initializers::specializationMapEntry(
+        EXTRA_CONSTANT_ID + (uint32_t)i,
+        (uint32_t)(data.size() * sizeof(uint32_t)), sizeof(uint32_t)));
+    data.push_back(params_.specializationConstants[i]);
+  }
   VkSpecializationInfo specializationInfo =
-      vks::initializers::specializationInfo(6, specializationMapEntry,
-                                            sizeof(SpecializationData),
-                                            &specializationData);
+      vks::initializers::specializationInfo(
+          (uint32_t)mapEntries.size(), mapEntries.data(),
+          data.size() * sizeof(uint32_t), data.data());
 
-#endif
-
-  VkPipelineShaderStageCreateInfo shaderStage = {};
-  shaderStage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-  shaderStage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
-#if defined(VK_USE_PLATFORM_ANDROID_KHR)
-  shaderStage.module = vks::tools::loadShader(
-      androidapp->activity->assetManager,
-      (getAssetPath() + params_.shader_path).c_str(), device_);
-#else
-  shaderStage.module = vks::tools::loadShader(
-      (getAssetPath() + params_.shader_path).c_str(), device_);
-#endif
-  shaderStage.pName = "main";
-  shaderStage.pSpecializationInfo = &specializationInfo;
-  shaderModule_ = shaderStage.module;
-
-  assert(shaderStage.module != VK_NULL_HANDLE);
-  computePipelineCreateInfo.stage = shaderStage;
-  VK_CHECK_RESULT(vkCreateComputePipelines(device_, pipelineCache_, 1,
-                                           &computePipelineCreateInfo, nullptr,
-                                           &pipeline_));
+  VK_CHECK_RESULT(preparePipeline(specializationInfo));
 
   // Create a command buffer for compute operations
   VkCommandBufferAllocateInfo cmdBufAllocateInfo =
@@ -1558,25 +1945,7 @@ ComputeOp::prepareBufferToBufferPipeline(VkBuffer &deviceBuffer,
 VkResult ComputeOp::prepareImageToBufferPipeline(VkBuffer &deviceBuffer,
                                                  VkBuffer &filterDeviceBuffer,
                                                  VkBuffer &outputDeviceBuffer) {
-  // SIZE.
-  std::vector<VkDescriptorPoolSize> poolSizes = {
-      // Compute UBO
-      vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
-                                            2),
-      // TODO: check if this is required.
-      vks::initializers::descriptorPoolSize(
-          VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 2),
-      // Storage buffer for the scene primitives
-      vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
-                                            2),
-  };
-
-  VkDescriptorPoolCreateInfo descriptorPoolInfo =
-      vks::initializers::descriptorPoolCreateInfo(
-          static_cast<uint32_t>(poolSizes.size()), poolSizes.data(), 3);
-  VK_CHECK_RESULT(vkCreateDescriptorPool(device_, &descriptorPoolInfo, nullptr,
-                                         &descriptorPool_));
-
+  applyTunedWorkgroupSize();
   std::vector<VkDescriptorSetLayoutBinding> setLayoutBindings = {
       // Binding 0: Storage image (raytraced output)
       vks::initializers::descriptorSetLayoutBinding(
@@ -1589,21 +1958,7 @@ VkResult ComputeOp::prepareImageToBufferPipeline(VkBuffer &deviceBuffer,
           VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, VK_SHADER_STAGE_COMPUTE_BIT, 2),
   };
 
-  VkDescriptorSetLayoutCreateInfo descriptorLayout =
-      vks::initializers::descriptorSetLayoutCreateInfo(setLayoutBindings);
-  VK_CHECK_RESULT(vkCreateDescriptorSetLayout(device_, &descriptorLayout,
-                                              nullptr, &descriptorSetLayout_));
-
-  VkPipelineLayoutCreateInfo pipelineLayoutCreateInfo =
-      vks::initializers::pipelineLayoutCreateInfo(&descriptorSetLayout_, 1);
-  VK_CHECK_RESULT(vkCreatePipelineLayout(device_, &pipelineLayoutCreateInfo,
-                                         nullptr, &pipelineLayout_));
-
-  VkDescriptorSetAllocateInfo allocInfo =
-      vks::initializers::descriptorSetAllocateInfo(descriptorPool_,
-                                                   &descriptorSetLayout_, 1);
-  VK_CHECK_RESULT(
-      vkAllocateDescriptorSets(device_, &allocInfo, &descriptorSet_));
+  VK_CHECK_RESULT(prepareLayout(setLayoutBindings));
 
   // Setup a descriptor image info for the current texture to be used as a
   // combined image sampler
@@ -1621,32 +1976,22 @@ VkResult ComputeOp::prepareImageToBufferPipeline(VkBuffer &deviceBuffer,
                                                    VK_WHOLE_SIZE};
 
   std::vector<VkWriteDescriptorSet> computeWriteDescriptorSets = {
-      vks::initializers::writeDescriptorSet(descriptorSet_,
+      vks::initializers::writeDescriptorSet(VK_NULL_HANDLE,
                                             VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
                                             0, &outputBufferDescriptor),
-      vks::initializers::writeDescriptorSet(descriptorSet_,
+      vks::initializers::writeDescriptorSet(VK_NULL_HANDLE,
                                             VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1,
                                             &imageDescriptor),
-      vks::initializers::writeDescriptorSet(descriptorSet_,
+      vks::initializers::writeDescriptorSet(VK_NULL_HANDLE,
                                             VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 2,
                                             &filterImageDescriptor),
   };
 
-  vkUpdateDescriptorSets(
-      device_, static_cast<uint32_t>(computeWriteDescriptorSets.size()),
-      computeWriteDescriptorSets.data(), 0, NULL);
-
-  VkPipelineCacheCreateInfo pipelineCacheCreateInfo = {};
-  pipelineCacheCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
-  VK_CHECK_RESULT(vkCreatePipelineCache(device_, &pipelineCacheCreateInfo,
-                                        nullptr, &pipelineCache_));
+  VK_CHECK_RESULT(bindDescriptors(computeWriteDescriptorSets));
 
   // Create pipeline
-  VkComputePipelineCreateInfo computePipelineCreateInfo =
-      vks::initializers::computePipelineCreateInfo(pipelineLayout_, 0);
-
   // Pass SSBO size via specialization constant
-  SpecializationData specializationData;
+  SpecializationData specializationData = {};
 #ifdef USE_SPECIALIZATION_WGS
   specializationData.workgroupSizeX = params_.WORKGROUPSIZE_X;
   specializationData.workgroupSizeY = params_.WORKGROUPSIZE_Y;
@@ -1693,26 +2038,7 @@ VkResult ComputeOp::prepareImageToBufferPipeline(VkBuffer &deviceBuffer,
 
 #endif
 
-  VkPipelineShaderStageCreateInfo shaderStage = {};
-  shaderStage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-  shaderStage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
-#if defined(VK_USE_PLATFORM_ANDROID_KHR)
-  shaderStage.module = vks::tools::loadShader(
-      androidapp->activity->assetManager,
-      (getAssetPath() + params_.shader_path).c_str(), device_);
-#else
-  shaderStage.module = vks::tools::loadShader(
-      (getAssetPath() + params_.shader_path).c_str(), device_);
-#endif
-  shaderStage.pName = "main";
-  shaderStage.pSpecializationInfo = &specializationInfo;
-  shaderModule_ = shaderStage.module;
-
-  assert(shaderStage.module != VK_NULL_HANDLE);
-  computePipelineCreateInfo.stage = shaderStage;
-  VK_CHECK_RESULT(vkCreateComputePipelines(device_, pipelineCache_, 1,
-                                           &computePipelineCreateInfo, nullptr,
-                                           &pipeline_));
+  VK_CHECK_RESULT(preparePipeline(specializationInfo));
 
   // Create a command buffer for compute operations
   VkCommandBufferAllocateInfo cmdBufAllocateInfo =
@@ -1725,22 +2051,7 @@ VkResult ComputeOp::prepareImageToBufferPipeline(VkBuffer &deviceBuffer,
 }
 
 VkResult ComputeOp::prepareImageToImagePipeline() {
-  // SIZE.
-  std::vector<VkDescriptorPoolSize> poolSizes = {
-      // Compute UBO
-      vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
-                                            6),
-      // Graphics image samplers
-      vks::initializers::descriptorPoolSize(
-          VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 6),
-  };
-
-  VkDescriptorPoolCreateInfo descriptorPoolInfo =
-      vks::initializers::descriptorPoolCreateInfo(
-          static_cast<uint32_t>(poolSizes.size()), poolSizes.data(), 3);
-  VK_CHECK_RESULT(vkCreateDescriptorPool(device_, &descriptorPoolInfo, nullptr,
-                                         &descriptorPool_));
-
+  applyTunedWorkgroupSize();
   std::vector<VkDescriptorSetLayoutBinding> setLayoutBindings = {
       // Binding 0: Storage image (raytraced output)
       vks::initializers::descriptorSetLayoutBinding(
@@ -1753,21 +2064,7 @@ VkResult ComputeOp::prepareImageToImagePipeline() {
           VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, VK_SHADER_STAGE_COMPUTE_BIT, 2),
   };
 
-  VkDescriptorSetLayoutCreateInfo descriptorLayout =
-      vks::initializers::descriptorSetLayoutCreateInfo(setLayoutBindings);
-  VK_CHECK_RESULT(vkCreateDescriptorSetLayout(device_, &descriptorLayout,
-                                              nullptr, &descriptorSetLayout_));
-
-  VkPipelineLayoutCreateInfo pipelineLayoutCreateInfo =
-      vks::initializers::pipelineLayoutCreateInfo(&descriptorSetLayout_, 1);
-  VK_CHECK_RESULT(vkCreatePipelineLayout(device_, &pipelineLayoutCreateInfo,
-                                         nullptr, &pipelineLayout_));
-
-  VkDescriptorSetAllocateInfo allocInfo =
-      vks::initializers::descriptorSetAllocateInfo(descriptorPool_,
-                                                   &descriptorSetLayout_, 1);
-  VK_CHECK_RESULT(
-      vkAllocateDescriptorSets(device_, &allocInfo, &descriptorSet_));
+  VK_CHECK_RESULT(prepareLayout(setLayoutBindings));
 
   // Setup a descriptor image info for the current texture to be used as a
   // combined image sampler
@@ -1787,31 +2084,21 @@ VkResult ComputeOp::prepareImageToImagePipeline() {
   outputImageDescriptor.imageLayout = outputImageLayout_;
 
   std::vector<VkWriteDescriptorSet> computeWriteDescriptorSets = {
-      vks::initializers::writeDescriptorSet(descriptorSet_,
+      vks::initializers::writeDescriptorSet(VK_NULL_HANDLE,
                                             VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 0,
                                             &outputImageDescriptor),
-      vks::initializers::writeDescriptorSet(descriptorSet_,
+      vks::initializers::writeDescriptorSet(VK_NULL_HANDLE,
                                             VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1,
                                             &imageDescriptor),
-      vks::initializers::writeDescriptorSet(descriptorSet_,
+      vks::initializers::writeDescriptorSet(VK_NULL_HANDLE,
                                             VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 2,
                                             &filterImageDescriptor),
   };
-  vkUpdateDescriptorSets(
-      device_, static_cast<uint32_t>(computeWriteDescriptorSets.size()),
-      computeWriteDescriptorSets.data(), 0, NULL);
-
-  VkPipelineCacheCreateInfo pipelineCacheCreateInfo = {};
-  pipelineCacheCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
-  VK_CHECK_RESULT(vkCreatePipelineCache(device_, &pipelineCacheCreateInfo,
-                                        nullptr, &pipelineCache_));
+  VK_CHECK_RESULT(bindDescriptors(computeWriteDescriptorSets));
 
   // Create pipeline
-  VkComputePipelineCreateInfo computePipelineCreateInfo =
-      vks::initializers::computePipelineCreateInfo(pipelineLayout_, 0);
-
   // Pass SSBO size via specialization constant
-  SpecializationData specializationData;
+  SpecializationData specializationData = {};
 #ifdef USE_SPECIALIZATION_WGS
   specializationData.workgroupSizeX = params_.WORKGROUPSIZE_X;
   specializationData.workgroupSizeY = params_.WORKGROUPSIZE_Y;
@@ -1858,26 +2145,7 @@ VkResult ComputeOp::prepareImageToImagePipeline() {
 
 #endif
 
-  VkPipelineShaderStageCreateInfo shaderStage = {};
-  shaderStage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-  shaderStage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
-#if defined(VK_USE_PLATFORM_ANDROID_KHR)
-  shaderStage.module = vks::tools::loadShader(
-      androidapp->activity->assetManager,
-      (getAssetPath() + params_.shader_path).c_str(), device_);
-#else
-  shaderStage.module = vks::tools::loadShader(
-      (getAssetPath() + params_.shader_path).c_str(), device_);
-#endif
-  shaderStage.pName = "main";
-  shaderStage.pSpecializationInfo = &specializationInfo;
-  shaderModule_ = shaderStage.module;
-
-  assert(shaderStage.module != VK_NULL_HANDLE);
-  computePipelineCreateInfo.stage = shaderStage;
-  VK_CHECK_RESULT(vkCreateComputePipelines(device_, pipelineCache_, 1,
-                                           &computePipelineCreateInfo, nullptr,
-                                           &pipeline_));
+  VK_CHECK_RESULT(preparePipeline(specializationInfo));
 
   // Create a command buffer for compute operations
   VkCommandBufferAllocateInfo cmdBufAllocateInfo =
@@ -1891,6 +2159,76 @@ VkResult ComputeOp::prepareImageToImagePipeline() {
 
 ComputeOp::ComputeOp() {}
 
+void ComputeOp::prepare() {}
+
+std::shared_future<void> ComputeOp::executeAsync() {
+  execute();
+  return readyFuture();
+}
+
+std::shared_future<void> ComputeOp::readyFuture() {
+  std::promise<void> promise;
+  promise.set_value();
+  return promise.get_future().share();
+}
+
+void ComputeOp::run(const std::vector<DATA_TYPE> &input,
+                    std::vector<DATA_TYPE> &output) {
+  // Ops without a split implementation rebuild everything on each run.
+  params_.computeInput = input;
+  execute();
+  output = params_.computeOutput.toFloat();
+}
+
+void ComputeOp::run(const DATA_TYPE *input, DATA_TYPE *output) {
+  if (params_.elementType == ELEMENT_TYPE_FLOAT32) {
+    runElements(input, output);
+    return;
+  }
+  const size_t inputCount = getInputElementCount();
+  const size_t outputCount = getOutputElementCount();
+  inputElements_.resize(getInputBytes());
+  convertFromFloat(input, inputCount, params_.elementType,
+                   inputElements_.data());
+  outputElements_.resize(getOutputBytes());
+  runElements(inputElements_.data(), outputElements_.data());
+  convertToFloat(outputElements_.data(), outputCount, params_.elementType,
+                 output);
+}
+
+void ComputeOp::run(const ElementVector &input, ElementVector &output) {
+  assert(input.size() >= getInputElementCount());
+  output.reset(params_.elementType, getOutputElementCount());
+  runElements(toElements(input, getInputElementCount(), inputElements_),
+              output.data());
+}
+
+void ComputeOp::runElements(const void *input, void *output) {
+  assert(params_.elementType == ELEMENT_TYPE_FLOAT32);
+  const DATA_TYPE *values = static_cast<const DATA_TYPE *>(input);
+  std::vector<DATA_TYPE> inputVector(values, values + getInputElementCount());
+  std::vector<DATA_TYPE> outputVector(getOutputElementCount());
+  run(inputVector, outputVector);
+  std::copy(outputVector.begin(), outputVector.end(),
+            static_cast<DATA_TYPE *>(output));
+}
+
+const void *ComputeOp::toElements(const ElementVector &values, size_t count,
+                                  std::vector<char> &scratch) const {
+  assert(values.size() >= count);
+  if (values.getElementType() == params_.elementType)
+    return values.data();
+  scratch.resize(count * getElementSize());
+  convertElements(values.data(), values.getElementType(), count,
+                  params_.elementType, scratch.data());
+  return scratch.data();
+}
+
+const void *ComputeOp::getFilterElements() {
+  return toElements(params_.computeFilter, getFilterElementCount(),
+                    filterElements_);
+}
+
 void ComputeOp::summaryOfInput() const {
   LOG("***********: INPUT INFO:\n");
   LOG(" Input: width x height = %dx%d\n", params_.inputWidth,
@@ -1907,96 +2245,107 @@ void ComputeOp::summaryOfInput() const {
 }
 
 void ComputeOp::summary() const {
-  const int lastInput =
-      (int)params_.computeInput[params_.inputWidth * params_.inputHeight - 1];
-  const int lastFilter =
-      (int)params_.computeFilter[params_.inputWidth * params_.inputHeight - 1];
-  const int lastOutput =
-      (int)
-          params_.computeOutput[params_.outputWidth * params_.outputHeight - 1];
-
-  if (lastInput + lastFilter != lastOutput)
+  const DATA_TYPE lastInput = params_.computeInput.getFloat(
+      params_.inputWidth * params_.inputHeight - 1);
+  const DATA_TYPE lastFilter = params_.computeFilter.getFloat(
+      params_.inputWidth * params_.inputHeight - 1);
+  const DATA_TYPE lastOutput = params_.computeOutput.getFloat(
+      params_.outputWidth * params_.outputHeight - 1);
+  // The sum as the device stores it, e.g. rounded to half.
+  char element[4];
+  DATA_TYPE expected = lastInput + lastFilter;
+  convertFromFloat(&expected, 1, params_.elementType, element);
+  convertToFloat(element, 1, params_.elementType, &expected);
+
+  if (expected != lastOutput)
     LOG("ADD ERROR!!!!!!!!\n");
 
-  LOG("summary: %f + %f = %f\n",
-      params_.computeInput[params_.inputWidth * params_.inputHeight - 1],
-      params_.computeFilter[params_.inputWidth * params_.inputHeight - 1],
-      params_.computeOutput[params_.outputWidth * params_.outputHeight - 1]);
+  LOG("summary (%s): %f + %f = %f\n", getElementTypeName(params_.elementType),
+      lastInput, lastFilter, lastOutput);
 
   if (params_.inputWidth * params_.inputHeight > MAX_LOG) {
     return;
   }
   LOG("\nCompute input:\n");
-  for (auto v : params_.computeInput) {
-    if (DATA_TYPE_ID == 0)
-      LOG("%f \t", v);
-    if (DATA_TYPE_ID == 1)
-      LOG("%d \t", v);
-  }
+  for (auto v : params_.computeInput.toFloat())
+    LOG("%f \t", v);
   std::cout << std::endl;
 
   LOG("\nCompute filter:\n");
-  for (auto v : params_.computeFilter) {
-    if (DATA_TYPE_ID == 0)
-      LOG("%f \t", v);
-    if (DATA_TYPE_ID == 1)
-      LOG("%d \t", v);
-  }
+  for (auto v : params_.computeFilter.toFloat())
+    LOG("%f \t", v);
   std::cout << std::endl;
 
   LOG("\nCompute output:\n");
-  for (auto v : params_.computeOutput) {
-    if (DATA_TYPE_ID == 0)
-      LOG("%f \t", v);
-    if (DATA_TYPE_ID == 1)
-      LOG("%d \t", v);
-  }
+  for (auto v : params_.computeOutput.toFloat())
+    LOG("%f \t", v);
   std::cout << std::endl;
 }
 
-ComputeOp::ComputeOp(const InitParams &init_params) : params_(init_params) {
+ComputeOp::ComputeOp(const InitParams &init_params)
+    : ComputeOp(init_params, ComputeContext::getShared()) {}
+
+ComputeOp::ComputeOp(const InitParams &init_params,
+                     std::shared_ptr<ComputeContext> context)
+    : context_(context), params_(init_params) {
   imageFormat_ = init_params.format;
-  prepareDebugLayer();
-  // Vulkan device creation.
-  prepareDevice();
+  instance_ = context_->getInstance();
+  physicalDevice_ = context_->getPhysicalDevice();
+  deviceProperties_ = context_->getDeviceProperties();
+  deviceMemoryProperties_ = context_->getDeviceMemoryProperties();
+  device_ = context_->getDevice();
+  queueFamilyIndex_ = context_->getQueueFamilyIndex();
+  queue_ = context_->getQueue();
+  commandPool_ = context_->getCommandPool();
+  allocator_ = &context_->getAllocator();
+  stagingRing_ = &context_->getStagingRing();
+  transferQueue_ = &context_->getTransferQueue();
+  queueTimeline_ = &context_->getQueueTimeline();
+  profiler_ = &context_->getProfiler();
 }
 
 ComputeOp::~ComputeOp() {
-  // Clean up.
+  if (device_ == VK_NULL_HANDLE)
+    return;
+  // The completion callback of an async run still writes to the output.
+  waitForAsync();
+  releaseImports(true);
+  // Clean up. The device, queue and command pool belong to the context.
   vkDestroyBuffer(device_, deviceBuffer_, nullptr);
-  vkFreeMemory(device_, deviceMemory_, nullptr);
+  allocator_->free(deviceMemory_);
   vkDestroyBuffer(device_, hostBuffer_, nullptr);
-  vkFreeMemory(device_, hostMemory_, nullptr);
+  allocator_->free(hostMemory_);
 
   vkDestroyBuffer(device_, filterDeviceBuffer_, nullptr);
-  vkFreeMemory(device_, filterDeviceMemory_, nullptr);
+  allocator_->free(filterDeviceMemory_);
   vkDestroyBuffer(device_, filterHostBuffer_, nullptr);
-  vkFreeMemory(device_, filterHostMemory_, nullptr);
+  allocator_->free(filterHostMemory_);
 
   vkDestroyBuffer(device_, outputDeviceBuffer_, nullptr);
-  vkFreeMemory(device_, outputDeviceMemory_, nullptr);
+  allocator_->free(outputDeviceMemory_);
 
   vkDestroyBuffer(device_, outputHostBuffer_, nullptr);
-  vkFreeMemory(device_, outputHostMemory_, nullptr);
-
-  vkDestroyPipelineLayout(device_, pipelineLayout_, nullptr);
-  vkDestroyDescriptorSetLayout(device_, descriptorSetLayout_, nullptr);
-  vkDestroyDescriptorPool(device_, descriptorPool_, nullptr);
-  vkDestroyPipeline(device_, pipeline_, nullptr);
-  vkDestroyPipelineCache(device_, pipelineCache_, nullptr);
-  vkDestroyCommandPool(device_, commandPool_, nullptr);
-  vkDestroyShaderModule(device_, shaderModule_, nullptr);
-  vkDestroyQueryPool(device_, queryPool_, nullptr);
-  vkDestroyDevice(device_, nullptr);
-#if DEBUG
-  if (debugReportCallback) {
-    PFN_vkDestroyDebugReportCallbackEXT vkDestroyDebugReportCallback =
-        reinterpret_cast<PFN_vkDestroyDebugReportCallbackEXT>(
-            vkGetInstanceProcAddr(instance_,
-                                  "vkDestroyDebugReportCallbackEXT"));
-    assert(vkDestroyDebugReportCallback);
-    vkDestroyDebugReportCallback(instance_, debugReportCallback, nullptr);
-  }
-#endif
-  vkDestroyInstance(instance_, nullptr);
+  allocator_->free(outputHostMemory_);
+
+  vkDestroySampler(device_, sampler_, nullptr);
+  vkDestroyImageView(device_, view_, nullptr);
+  vkDestroyImage(device_, image_, nullptr);
+  allocator_->free(imageMemory_);
+
+  vkDestroySampler(device_, filterSampler_, nullptr);
+  vkDestroyImageView(device_, filterView_, nullptr);
+  vkDestroyImage(device_, filterImage_, nullptr);
+  allocator_->free(filterImageMemory_);
+
+  vkDestroySampler(device_, outputImageSampler_, nullptr);
+  vkDestroyImageView(device_, outputImageView_, nullptr);
+  vkDestroyImage(device_, outputImage_, nullptr);
+  allocator_->free(outputImageDeviceMemory_);
+
+  if (descriptorSet_ != VK_NULL_HANDLE)
+    context_->getDescriptorAllocator().free(*layout_, descriptorSet_);
+  if (commandBuffer_ != VK_NULL_HANDLE)
+    vkFreeCommandBuffers(device_, commandPool_, 1, &commandBuffer_);
+  for (GpuProfiler::Range range : stageRanges_)
+    profiler_->release(range);
 }
@@ -20,12 +20,19 @@
 
 #include <algorithm>
 #include <assert.h>
+#include <deque>
+#include <future>
 #include <iostream>
 #include <stdio.h>
 #include <stdlib.h>
+#include <memory>
 #include <string.h>
 #include <vector>
 
+#include "AlignedAllocator.h"
+#include "ComputeContext.h"
+#include "ElementType.h"
+#include "Tensor.h"
 #include "VulkanTools.h"
 #include <vulkan/vulkan.h>
 #define USE_READBACK_INPUT
@@ -54,19 +61,76 @@ static VKAPI_ATTR VkBool32 VKAPI_CALL debugMessageCallback(
 
 const int mipLevels = 1;
 
-// TODO:
-// 1. Template the input and output.
+// Host data type of the float run() overloads, converted to and from
+// InitParams::elementType. InitParams holds ElementVector data of any type.
 typedef float DATA_TYPE;
-const int DATA_TYPE_ID = 0;
+// Host data the staged run() can import instead of copying.
+typedef std::vector<DATA_TYPE, AlignedAllocator<DATA_TYPE>> AlignedVector;
 
 class ComputeOp {
 public:
+  // How run() moves input and output between host and device.
+  enum ExecutionMode {
+    // Input goes through the staging ring and is submitted with the dispatch.
+    // The output is read back by a second submission once the dispatch has
+    // completed.
+    EXECUTION_MODE_STAGED = 0,
+    // The input upload, the dispatch and the output readback are recorded in
+    // commandBuffer_ against persistent per-op host buffers, so run() is one
+    // submit and one wait.
+    EXECUTION_MODE_SINGLE_SUBMIT = 1,
+    // Buffer ops only. Like single submit, but input and filter live in
+    // device local, host visible memory (UMA, or a discrete GPU with
+    // resizable BAR) and are written in place, with no upload copy. The
+    // output is read in place too when that memory is host cached, and
+    // otherwise read back as in single submit. Falls back to single submit
+    // when the device has no such memory or its heap is too small.
+    EXECUTION_MODE_ZERO_STAGING = 2,
+  };
+  // How the shader gets the input, filter and output shapes.
+  enum ShapeMode {
+    // Specialization constants: each shape gets its own pipeline, compiled
+    // for exactly that size.
+    SHAPE_MODE_SPECIALIZED = 0,
+    // Push constants read by the "_dynamic" variant of shader_path (e.g.
+    // shaders/add/add_float_dynamic.comp.spv): one pipeline per workgroup
+    // size serves every shape, so new sizes skip pipeline creation.
+    SHAPE_MODE_DYNAMIC = 1,
+  };
+  // How ELEMENT_TYPE_FLOAT16 kernels compute.
+  enum Float16Mode {
+    // The "_native" variant of shader_path (e.g.
+    // shaders/add/add_half_native.comp.spv) computes and accumulates in
+    // float16. Needs shaderFloat16; falls back to FLOAT16_MODE_FP32_ACCUMULATE
+    // without it.
+    FLOAT16_MODE_NATIVE = 0,
+    // shader_path widens loads to fp32, accumulates in fp32 and rounds once
+    // on store. Needs only 16 bit storage, and keeps long reductions (e.g.
+    // conv2d) from losing precision.
+    FLOAT16_MODE_FP32_ACCUMULATE = 1,
+  };
+  // Stages of a run profiled as GPU timestamp ranges.
+  enum ProfileStage {
+    // Host to device copies recorded in commandBuffer_.
+    PROFILE_STAGE_UPLOAD = 0,
+    // Barriers ordering the dispatch after the upload or earlier writes.
+    PROFILE_STAGE_BARRIER = 1,
+    PROFILE_STAGE_DISPATCH = 2,
+    // Device to host copies, in commandBuffer_ or submitted after it.
+    PROFILE_STAGE_READBACK = 3,
+    PROFILE_STAGE_COUNT = 4,
+  };
+  static const char *getProfileStageName(ProfileStage stage);
   struct InitParams {
     InitParams();
     InitParams(const InitParams &other);
-    std::vector<DATA_TYPE> computeInput;
-    std::vector<DATA_TYPE> computeFilter;
-    std::vector<DATA_TYPE> computeOutput;
+    InitParams &operator=(const InitParams &other);
+    // Host data of any element type; input and filter are converted at
+    // upload only when their type differs from elementType. execute() and
+    // executeAsync() leave computeOutput of elementType.
+    ElementVector computeInput;
+    ElementVector computeFilter;
+    ElementVector computeOutput;
     int inputWidth = 32;
     int inputHeight = 1;
     int filterWidth = 32;
@@ -81,21 +145,160 @@ public:
     int DISPATCH_Z = 1;
     std::string shader_path;
     VkFormat format = VK_FORMAT_R32_SFLOAT;
+    ExecutionMode executionMode = EXECUTION_MODE_STAGED;
+    ShapeMode shapeMode = SHAPE_MODE_SPECIALIZED;
+    // Type of the input, filter and output on the device. shader_path and,
+    // for image ops, format must match it, e.g.
+    // ElementTraits<Half>::shaderPath("shaders/add/add") and
+    // ElementTraits<Half>::format(4), or
+    // ElementTraits<uint8_t>::shaderPath("shaders/add_image/add_image") and
+    // ElementTraits<uint8_t>::format(4).
+    ElementType elementType = ELEMENT_TYPE_FLOAT32;
+    Float16Mode float16Mode = FLOAT16_MODE_NATIVE;
+    // Buffer ops only. The input is batch x inputChannels x inputHeight x
+    // inputWidth and the output batch x outputChannels x outputHeight x
+    // outputWidth, both stored in layout; host data passed to run() is
+    // already in that layout. The filter is outputChannels x inputChannels x
+    // filterHeight x filterWidth, row major. Shaders that read them (e.g.
+    // shaders/conv2d_tensor.comp.spv) get them as specialization constants.
+    int batch = 1;
+    int inputChannels = 1;
+    int outputChannels = 1;
+    TensorLayout layout = TENSOR_LAYOUT_NCHW;
+    // Takes the shapes, element type and layout above from 4-d tensors;
+    // the filter size and dispatch are left to the caller.
+    void setTensorShapes(const Tensor &input, const Tensor &output);
+    // Buffer ops with specialized shapes only. Constants for shaders that
+    // take more than their shapes, passed with IDs from 13 on (e.g. the
+    // stages of shaders/elementwise/elementwise.comp.spv, see
+    // ElementwiseChain). Float constants are given as their bit patterns.
+    std::vector<uint32_t> specializationConstants;
+    // Arithmetic operations per output element, see getFlopsPerOutput().
+    // 0 derives them from the shapes.
+    uint32_t flopsPerOutput = 0;
+    // Take the workgroup size from the context's TuningDatabase at prepare
+    // time when WorkgroupTuner has an entry for getTuningKey(). The dispatch
+    // is scaled to cover the same invocations.
+    bool useTunedWorkgroupSize = true;
+    // Everything besides the workgroup size that selects the kernel and its
+    // work: shader, element type, format, shapes and the invocation count
+    // (DISPATCH_* x WORKGROUPSIZE_*) along each axis.
+    std::string getTuningKey() const;
+    // flopsPerOutput, or when it is 0: 1 if the filter has the input's shape
+    // (an elementwise kernel such as add), else 2 x filterWidth x
+    // filterHeight x inputChannels, a multiply and an add per tap of a 2-d
+    // convolution.
+    uint64_t getFlopsPerOutput() const;
   };
   void summaryOfInput() const;
   void summary() const;
   virtual void execute() = 0;
+  // Builds buffers, pipeline and command buffer once for the shape in
+  // InitParams. Ops without a split implementation do nothing here.
+  virtual void prepare();
+  // Uploads input, re-submits the recorded command buffer and downloads the
+  // result into output. Requires prepare() for ops that implement it.
+  virtual void run(const std::vector<DATA_TYPE> &input,
+                   std::vector<DATA_TYPE> &output);
+  // Same as above for caller owned arrays of inputWidth x inputHeight and
+  // outputWidth x outputHeight elements, e.g. AlignedVector data.
+  virtual void run(const DATA_TYPE *input, DATA_TYPE *output);
+  // Same as above for data of any type, converted only when it differs from
+  // InitParams::elementType. output is resized to the output element count
+  // of elementType.
+  void run(const ElementVector &input, ElementVector &output);
+  // Same as above for data already of InitParams::elementType, which is
+  // moved as is, without conversion.
+  template <typename T> void runTyped(const T *input, T *output) {
+    assert(ElementTraits<T>::type == params_.elementType);
+    runElements(input, output);
+  }
+  template <typename T>
+  void runTyped(const std::vector<T> &input, std::vector<T> &output) {
+    assert(input.size() >= getInputElementCount());
+    output.resize(getOutputElementCount());
+    runTyped(input.data(), output.data());
+  }
+  // Submits params_.computeInput and returns without waiting for the GPU.
+  // The future becomes ready once the result has been copied into
+  // params_.computeOutput, which must not be touched until then. Different
+  // ops may be in flight at once; an op that is still in flight waits for
+  // its previous result before it is submitted again. Ops without a single
+  // submit implementation, or already prepared for staged runs, run before
+  // returning a ready future.
+  virtual std::shared_future<void> executeAsync();
+  const ElementVector &getOutput() const { return params_.computeOutput; }
+  // Time prepare() took to get its pipeline: near zero when the context
+  // already had it, otherwise the time to create it through the context
+  // pipeline cache.
+  double getPipelineCreationMs() const { return pipelineCreationMs_; }
+  // GPU time of the stage in the last run that had it, from the context's
+  // GpuProfiler, or 0. Staged runs upload through the shared staging ring,
+  // whose batches are profiled as "staging_ring:upload" instead. Results are
+  // read when asked for, so an executeAsync() run shows once it completed.
+  double getStageMs(ProfileStage stage) const;
+  double getDispatchMs() const { return getStageMs(PROFILE_STAGE_DISPATCH); }
+  // The shader file name without extension, e.g. "add_float". Ranges of the
+  // op are named "<profile name>:<stage name>".
+  std::string getProfileName() const;
+  // Work of one dispatch, for roofline reporting: the input and filter read
+  // and the output written once each (3 x W x H x element size for add),
+  // and InitParams::getFlopsPerOutput() for every output element of the
+  // logical shape, not counting NC4HW4 padding.
+  uint64_t getBytesMoved() const;
+  uint64_t getFlops() const;
+  // The mode half kernels ran in, after any fallback in prepare().
+  Float16Mode getFloat16Mode() const { return params_.float16Mode; }
+  // Uploads that imported the caller's memory instead of copying it.
+  uint32_t getImportedUploadCount() const { return importedUploadCount_; }
+  // Records the pipeline, descriptors and dispatch of a prepared op into a
+  // command buffer owned by the caller, with no barriers around them (see
+  // ComputeGraph).
+  void recordDispatch(VkCommandBuffer commandBuffer);
   ComputeOp();
+  // Runs on the process-wide shared context.
   ComputeOp(const InitParams &init_params);
+  ComputeOp(const InitParams &init_params,
+            std::shared_ptr<ComputeContext> context);
 
   virtual ~ComputeOp();
 
 protected:
+  // run() on input and output of params_.elementType. Ops without a split
+  // implementation only take float elements.
+  virtual void runElements(const void *input, void *output);
+  size_t getElementSize() const {
+    return ::getElementSize(params_.elementType);
+  }
+  // Elements of the input, filter and output on the device, including
+  // batch, channels and layout padding.
+  size_t getInputElementCount() const;
+  size_t getFilterElementCount() const;
+  size_t getOutputElementCount() const;
+  // Sizes in bytes of the same.
+  VkDeviceSize getInputBytes() const {
+    return (VkDeviceSize)getInputElementCount() * getElementSize();
+  }
+  VkDeviceSize getFilterBytes() const {
+    return (VkDeviceSize)getFilterElementCount() * getElementSize();
+  }
+  VkDeviceSize getOutputBytes() const {
+    return (VkDeviceSize)getOutputElementCount() * getElementSize();
+  }
+  // values as count elements of params_.elementType: values itself when of
+  // that type, otherwise converted into scratch.
+  const void *toElements(const ElementVector &values, size_t count,
+                         std::vector<char> &scratch) const;
+  // params_.computeFilter as elements, converted once.
+  const void *getFilterElements();
   VkResult createBufferWithData(VkBufferUsageFlags usageFlags,
                                 VkMemoryPropertyFlags memoryPropertyFlags,
-                                VkBuffer *buffer, VkDeviceMemory *memory,
+                                VkBuffer *buffer,
+                                MemoryAllocator::Allocation *memory,
                                 VkDeviceSize size, void *data = nullptr);
-  VkResult createDeviceImage(VkImage &image, const int width, const int height);
+  VkResult createDeviceImage(VkImage &image,
+                             MemoryAllocator::Allocation &memory,
+                             const int width, const int height);
   VkResult createSampler(VkImage &image, VkSampler &sampler, VkImageView &view);
   VkResult copyHostBufferToDeviceBuffer(VkBuffer &deviceBuffer,
                                         VkBuffer &hostBuffer,
@@ -108,6 +311,12 @@ protected:
                                         const VkDeviceSize &bufferSize,
                                         const uint32_t width,
                                         const uint32_t height);
+  VkResult copyDeviceImageToHostBuffer(VkImage &image, VkBuffer &hostBuffer,
+                                       MemoryAllocator::Allocation &hostMemory,
+                                       void *dst,
+                                       const VkDeviceSize &bufferSize,
+                                       const uint32_t width,
+                                       const uint32_t height);
   VkResult copyDeviceImageToHostBuffer2(VkImage &image, void *dst,
                                        const VkDeviceSize &bufferSize,
                                        const uint32_t width,
@@ -116,11 +325,84 @@ protected:
                                         const VkDeviceSize &bufferSize,
                                         const uint32_t width,
                                         const uint32_t height);
+  VkResult copyDeviceBufferToHostBuffer(VkBuffer &deviceBuffer,
+                                        VkBuffer &hostBuffer,
+                                        MemoryAllocator::Allocation &hostMemory,
+                                        void *dst,
+                                        const VkDeviceSize &bufferSize);
+  // Queue uploads through the context staging ring. They are submitted in one
+  // batch by the next submitCommandBuffer() or device to host copy. A buffer
+  // source aligned for VK_EXT_external_memory_host is imported and copied
+  // from directly instead, and must stay valid until the next
+  // submitCommandBuffer() returns.
+  VkResult uploadToDeviceBuffer(VkBuffer &deviceBuffer, const void *src,
+                                const VkDeviceSize &bufferSize);
+  // Returns false, having done nothing, when src cannot be imported.
+  bool uploadFromImportedHostPointer(VkBuffer &deviceBuffer, const void *src,
+                                     const VkDeviceSize &bufferSize);
+  // Frees imports whose copies have completed, or all of them with wait.
+  void releaseImports(bool wait);
+  VkResult uploadToDeviceImage(VkImage &image, const void *src,
+                               const VkDeviceSize &bufferSize,
+                               const uint32_t width, const uint32_t height);
+  VkResult copyToHostMemory(MemoryAllocator::Allocation &hostMemory,
+                            const void *src, const VkDeviceSize &bufferSize);
+  VkResult copyFromHostMemory(MemoryAllocator::Allocation &hostMemory,
+                              void *dst, const VkDeviceSize &bufferSize);
+  // Record transfers between persistent host buffers and device resources
+  // into commandBuffer_, for EXECUTION_MODE_SINGLE_SUBMIT. Uploads leave the
+  // destination readable by the compute shader. Readbacks expect the source
+  // to be readable by transfer and leave the host buffer readable by the host
+  // once the submission completes.
+  void recordBufferUpload(VkBuffer &hostBuffer, VkBuffer &deviceBuffer,
+                          const VkDeviceSize &bufferSize);
+  void recordImageUpload(VkBuffer &hostBuffer, VkImage &image,
+                         const uint32_t width, const uint32_t height);
+  void recordBufferReadback(VkBuffer &deviceBuffer, VkBuffer &hostBuffer,
+                            const VkDeviceSize &bufferSize);
+  void recordImageReadback(VkImage &image, VkBuffer &hostBuffer,
+                           const uint32_t width, const uint32_t height);
+  // Records and submits commandBuffer_ once.
   VkResult prepareCommandBuffer(VkBuffer &outputDeviceBuffer,
                                 VkBuffer &outputHostBuffer,
-                                VkDeviceMemory &outputHostMemory,
+                                MemoryAllocator::Allocation &outputHostMemory,
                                 const VkDeviceSize &bufferSize);
   VkResult prepareImageToImageCommandBuffer();
+  // Recording and submission are split so that a recorded commandBuffer_ can
+  // be re-submitted without re-recording.
+  VkResult recordCommandBuffer(VkBuffer &outputDeviceBuffer,
+                               VkBuffer &outputHostBuffer,
+                               const VkDeviceSize &bufferSize);
+  VkResult recordImageToImageCommandBuffer();
+  // Records only the dispatch, for inputs and outputs that stay on the
+  // device (see Tensor). Barriers on both sides order it after whatever
+  // wrote the input and before whatever reads the output.
+  VkResult recordDispatchCommandBuffer();
+  // Record the begin and end timestamps of stage in commandBuffer_. Every
+  // record*CommandBuffer function calls clearStages() first.
+  void clearStages();
+  void beginStage(ProfileStage stage);
+  void endStage(ProfileStage stage);
+  VkResult submitCommandBuffer();
+  // Submits commandBuffer_ without waiting and returns its timeline value.
+  VkResult submitCommandBufferAsync(uint64_t *value);
+  // Copies input into getInputHostMemory(), converted only if it is not of
+  // params_.elementType, submits the single submit commandBuffer_ and copies
+  // getOutputHostMemory() into output, resized to elements of
+  // params_.elementType, once it completes.
+  std::shared_future<void> submitAsync(const ElementVector &input,
+                                       ElementVector &output);
+  // Blocks until the last executeAsync() of this op has completed.
+  void waitForAsync();
+  // An already completed future, for executeAsync() of ops that ran before
+  // returning.
+  static std::shared_future<void> readyFuture();
+  // Whether size bytes of buffers fit in device local, host visible memory.
+  bool supportsZeroStaging(VkDeviceSize size) const;
+  // Mapped memory run() writes input to and reads output from, outside of
+  // EXECUTION_MODE_STAGED.
+  MemoryAllocator::Allocation &getInputHostMemory();
+  MemoryAllocator::Allocation &getOutputHostMemory();
 
   VkResult prepareBufferToBufferPipeline(VkBuffer &deviceBuffer,
                                          VkBuffer &filterDeviceBuffer,
@@ -129,30 +411,66 @@ protected:
                                         VkBuffer &filterDeviceBuffer,
                                         VkBuffer &outputDeviceBuffer);
   VkResult prepareImageToImagePipeline();
+  // Switches params_ to the tuned workgroup size, if enabled and known.
+  // Called by the prepare*Pipeline functions before anything depends on it.
+  void applyTunedWorkgroupSize();
+  // Take descriptorSetLayout_, pipelineLayout_ and pipeline_ from the
+  // context pipeline object cache, creating them on a miss. preparePipeline
+  // loads params_.shader_path and times the lookup.
+  VkResult prepareLayout(
+      const std::vector<VkDescriptorSetLayoutBinding> &setLayoutBindings);
+  VkResult preparePipeline(const VkSpecializationInfo &specializationInfo);
+  // Points the op's bindings at the resources in writes, whose dstSet is
+  // ignored. Without push descriptors this writes descriptorSet_, which is
+  // taken from the context descriptor allocator the first time; calling it
+  // again to rebind allocates nothing. With push descriptors the writes are
+  // kept for recordDescriptors(), so the command buffer must be recorded
+  // again.
+  VkResult bindDescriptors(const std::vector<VkWriteDescriptorSet> &writes);
+  // Binds descriptorSet_ or pushes the bound writes.
+  void recordDescriptors(VkCommandBuffer commandBuffer);
+  // Pushes the shapes for the dynamic shape shaders after the pipeline is
+  // bound. Does nothing for specialized shapes.
+  void recordShapeConstants(VkCommandBuffer commandBuffer);
 
   VkResult createTextureTarget(uint32_t width, uint32_t height);
-  VkResult prepareDebugLayer();
-  VkResult prepareDevice();
-
-  VkInstance instance_;
-  VkPhysicalDevice physicalDevice_;
-  VkPhysicalDeviceProperties deviceProperties_;
-  VkPhysicalDeviceMemoryProperties deviceMemoryProperties_;
-  VkDevice device_;
-  uint32_t queueFamilyIndex_;
-  VkPipelineCache pipelineCache_;
-  VkQueue queue_;
-  VkCommandPool commandPool_;
-  VkCommandBuffer commandBuffer_;
-  VkDescriptorPool descriptorPool_;
-  VkDescriptorSetLayout descriptorSetLayout_;
-  VkDescriptorSet descriptorSet_;
-  VkPipelineLayout pipelineLayout_;
-  VkPipeline pipeline_;
-  VkShaderModule shaderModule_;
+
+  std::shared_ptr<ComputeContext> context_;
+  // Handles below are borrowed from context_ and must not be destroyed here.
+  VkInstance instance_ = VK_NULL_HANDLE;
+  VkPhysicalDevice physicalDevice_ = VK_NULL_HANDLE;
+  VkPhysicalDeviceProperties deviceProperties_ = {};
+  VkPhysicalDeviceMemoryProperties deviceMemoryProperties_ = {};
+  VkDevice device_ = VK_NULL_HANDLE;
+  uint32_t queueFamilyIndex_ = 0;
+  VkQueue queue_ = VK_NULL_HANDLE;
+  VkCommandPool commandPool_ = VK_NULL_HANDLE;
+  MemoryAllocator *allocator_ = nullptr;
+  StagingRing *stagingRing_ = nullptr;
+  TransferQueue *transferQueue_ = nullptr;
+  QueueTimeline *queueTimeline_ = nullptr;
+
+  VkCommandBuffer commandBuffer_ = VK_NULL_HANDLE;
+  VkDescriptorSetLayout descriptorSetLayout_ = VK_NULL_HANDLE;
+  // Null with push descriptors.
+  VkDescriptorSet descriptorSet_ = VK_NULL_HANDLE;
+  std::vector<VkWriteDescriptorSet> descriptorWrites_;
+  std::vector<VkDescriptorBufferInfo> descriptorBufferInfos_;
+  std::vector<VkDescriptorImageInfo> descriptorImageInfos_;
+  VkPipelineLayout pipelineLayout_ = VK_NULL_HANDLE;
+  VkPipeline pipeline_ = VK_NULL_HANDLE;
+  // Own the layouts and pipeline above, which are shared through the
+  // context pipeline object cache.
+  std::shared_ptr<const PipelineObjectCache::Layout> layout_;
+  std::shared_ptr<const PipelineObjectCache::Pipeline> cachedPipeline_;
   InitParams params_;
-  VkBuffer deviceBuffer_, hostBuffer_;
-  VkDeviceMemory deviceMemory_, hostMemory_;
+  // Elements of params_.elementType, converted from or to host data of
+  // another type.
+  std::vector<char> inputElements_;
+  std::vector<char> filterElements_;
+  std::vector<char> outputElements_;
+  VkBuffer deviceBuffer_ = VK_NULL_HANDLE, hostBuffer_ = VK_NULL_HANDLE;
+  MemoryAllocator::Allocation deviceMemory_, hostMemory_;
   VkFormat imageFormat_;
   // VK_FORMAT_R32_SFLOAT;
   // VK_FORMAT_R32G32B32A32_SFLOAT;
@@ -161,32 +479,56 @@ protected:
   // VK_FORMAT_R8G8B8_UINT;
   // VK_FORMAT_R8G8B8A8_UNORM;
 
-  VkImage image_;
-  VkImage filterImage_;
-  VkSampler sampler_;
-  VkSampler filterSampler_;
-  VkImageView view_;
-  VkImageView filterView_;
+  VkImage image_ = VK_NULL_HANDLE;
+  VkImage filterImage_ = VK_NULL_HANDLE;
+  MemoryAllocator::Allocation imageMemory_;
+  MemoryAllocator::Allocation filterImageMemory_;
+  VkSampler sampler_ = VK_NULL_HANDLE;
+  VkSampler filterSampler_ = VK_NULL_HANDLE;
+  VkImageView view_ = VK_NULL_HANDLE;
+  VkImageView filterView_ = VK_NULL_HANDLE;
   VkImageLayout imageLayout_ = VK_IMAGE_LAYOUT_GENERAL;
   VkImageLayout filterImageLayout_ = VK_IMAGE_LAYOUT_GENERAL;
 
-  VkBuffer filterDeviceBuffer_, filterHostBuffer_;
-  VkDeviceMemory filterDeviceMemory_, filterHostMemory_;
+  VkBuffer filterDeviceBuffer_ = VK_NULL_HANDLE;
+  VkBuffer filterHostBuffer_ = VK_NULL_HANDLE;
+  MemoryAllocator::Allocation filterDeviceMemory_;
+  MemoryAllocator::Allocation filterHostMemory_;
 
-  VkBuffer outputDeviceBuffer_, outputHostBuffer_;
-  VkDeviceMemory outputDeviceMemory_, outputHostMemory_;
+  VkBuffer outputDeviceBuffer_ = VK_NULL_HANDLE;
+  VkBuffer outputHostBuffer_ = VK_NULL_HANDLE;
+  MemoryAllocator::Allocation outputDeviceMemory_;
+  MemoryAllocator::Allocation outputHostMemory_;
 
-  VkImage outputImage_;
-  VkSampler outputImageSampler_;
-  VkImageView outputImageView_;
+  VkImage outputImage_ = VK_NULL_HANDLE;
+  VkSampler outputImageSampler_ = VK_NULL_HANDLE;
+  VkImageView outputImageView_ = VK_NULL_HANDLE;
   VkImageLayout outputImageLayout_ = VK_IMAGE_LAYOUT_GENERAL;
-  VkDeviceMemory outputImageDeviceMemory_;
+  MemoryAllocator::Allocation outputImageDeviceMemory_;
 
-  VkQueryPool queryPool_;
+  GpuProfiler *profiler_ = nullptr;
+  // Ranges of the stages, allocated when first recorded.
+  GpuProfiler::Range stageRanges_[PROFILE_STAGE_COUNT] = {
+      GpuProfiler::INVALID_RANGE, GpuProfiler::INVALID_RANGE,
+      GpuProfiler::INVALID_RANGE, GpuProfiler::INVALID_RANGE};
+  // Stages recorded in commandBuffer_, reported to the profiler with each
+  // submission.
+  std::vector<ProfileStage> recordedStages_;
+  // GPU time of the last readback submitted on its own, in staged mode.
+  double readbackMs_ = 0.0;
+  bool prepared_ = false;
+  std::shared_future<void> inFlight_;
 
-  VkDebugReportCallbackEXT debugReportCallback{};
-private:
-  uint32_t timestampValidBits_;
+  // Caller memory imported as the source of a copy, freed once the copy on
+  // the transfer timeline has completed.
+  struct ImportedBuffer {
+    VkBuffer buffer;
+    VkDeviceMemory memory;
+    uint64_t value;
+  };
+  std::deque<ImportedBuffer> imports_;
+  uint32_t importedUploadCount_ = 0;
+  double pipelineCreationMs_ = 0.0;
 };
 
 #if defined(VK_USE_PLATFORM_ANDROID_KHR)
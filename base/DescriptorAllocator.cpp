@@ -0,0 +1,83 @@
+/*
+ * Copyright (C) 2020 by Xu Xing (xu.xing@outlook.com)
+ *
+ * This code is licensed under the MIT license (MIT)
+ * (http://opensource.org/licenses/MIT)
+ */
+#include "DescriptorAllocator.h"
+#include "ComputeOp.h"
+
+DescriptorAllocator::DescriptorAllocator(VkDevice device) : device_(device) {}
+
+DescriptorAllocator::~DescriptorAllocator() {
+  // Destroying a pool frees its sets.
+  for (const auto &layout : layouts_) {
+    for (VkDescriptorPool pool : layout.second.pools)
+      vkDestroyDescriptorPool(device_, pool, nullptr);
+  }
+}
+
+VkResult
+DescriptorAllocator::createPool(const PipelineObjectCache::Layout &layout,
+                                VkDescriptorPool *pool) {
+  std::map<VkDescriptorType, uint32_t> counts;
+  for (const auto &binding : layout.bindings)
+    counts[binding.descriptorType] += binding.descriptorCount;
+  std::vector<VkDescriptorPoolSize> poolSizes;
+  for (const auto &count : counts)
+    poolSizes.push_back(vks::initializers::descriptorPoolSize(
+        count.first, count.second * SETS_PER_POOL));
+  VkDescriptorPoolCreateInfo descriptorPoolInfo =
+      vks::initializers::descriptorPoolCreateInfo(
+          static_cast<uint32_t>(poolSizes.size()), poolSizes.data(),
+          SETS_PER_POOL);
+  VK_CHECK_RESULT(
+      vkCreateDescriptorPool(device_, &descriptorPoolInfo, nullptr, pool));
+  return VK_SUCCESS;
+}
+
+VkResult
+DescriptorAllocator::allocate(const PipelineObjectCache::Layout &layout,
+                              VkDescriptorSet *set) {
+  assert(!layout.pushDescriptor);
+  std::lock_guard<std::mutex> lock(mutex_);
+  LayoutPools &layoutPools = layouts_[layout.descriptorSetLayout];
+  if (!layoutPools.freeSets.empty()) {
+    *set = layoutPools.freeSets.back();
+    layoutPools.freeSets.pop_back();
+    stats_.reuses++;
+    return VK_SUCCESS;
+  }
+  if (layoutPools.remaining == 0) {
+    VkDescriptorPool pool;
+    VK_CHECK_RESULT(createPool(layout, &pool));
+    layoutPools.pools.push_back(pool);
+    layoutPools.remaining = SETS_PER_POOL;
+    stats_.pools++;
+  }
+  VkDescriptorSetAllocateInfo allocInfo =
+      vks::initializers::descriptorSetAllocateInfo(
+          layoutPools.pools.back(), &layout.descriptorSetLayout, 1);
+  VK_CHECK_RESULT(vkAllocateDescriptorSets(device_, &allocInfo, set));
+  layoutPools.remaining--;
+  stats_.allocations++;
+  return VK_SUCCESS;
+}
+
+void DescriptorAllocator::free(const PipelineObjectCache::Layout &layout,
+                               VkDescriptorSet set) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  layouts_[layout.descriptorSetLayout].freeSets.push_back(set);
+}
+
+DescriptorAllocator::Stats DescriptorAllocator::getStats() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return stats_;
+}
+
+void DescriptorAllocator::logStats() {
+  const Stats stats = getStats();
+  LOG("Descriptor allocator: %d pools, %llu sets allocated, %llu reused\n",
+      (int)stats.pools, (unsigned long long)stats.allocations,
+      (unsigned long long)stats.reuses);
+}
@@ -0,0 +1,66 @@
+/*
+ * Copyright (C) 2020 by Xu Xing (xu.xing@outlook.com)
+ *
+ * This code is licensed under the MIT license (MIT)
+ * (http://opensource.org/licenses/MIT)
+ */
+#ifndef DESCRIPTOR_ALLOCATOR_H_
+#define DESCRIPTOR_ALLOCATOR_H_
+
+#include <map>
+#include <mutex>
+#include <vector>
+
+#include "PipelineObjectCache.h"
+#include "VulkanTools.h"
+#include <vulkan/vulkan.h>
+
+// Descriptor sets of a device, handed out from pools of SETS_PER_POOL sets
+// per layout. Sets given back are kept for the next op with the same layout
+// and rewritten by it with vkUpdateDescriptorSets, so ops that are rebuilt
+// or rebound allocate nothing once the pools are warm. Pools are only
+// destroyed with the allocator.
+class DescriptorAllocator {
+public:
+  struct Stats {
+    uint32_t pools = 0;
+    // Sets taken from a pool, and sets handed out again after free().
+    uint64_t allocations = 0;
+    uint64_t reuses = 0;
+  };
+
+  static const uint32_t SETS_PER_POOL = 32;
+
+  explicit DescriptorAllocator(VkDevice device);
+  ~DescriptorAllocator();
+
+  // layout must not be a push descriptor layout.
+  VkResult allocate(const PipelineObjectCache::Layout &layout,
+                    VkDescriptorSet *set);
+  // set must no longer be in use by the device.
+  void free(const PipelineObjectCache::Layout &layout, VkDescriptorSet set);
+
+  Stats getStats();
+  void logStats();
+
+private:
+  struct LayoutPools {
+    std::vector<VkDescriptorPool> pools;
+    // Sets left in pools.back().
+    uint32_t remaining = 0;
+    std::vector<VkDescriptorSet> freeSets;
+  };
+
+  DescriptorAllocator(const DescriptorAllocator &) = delete;
+  DescriptorAllocator &operator=(const DescriptorAllocator &) = delete;
+
+  VkResult createPool(const PipelineObjectCache::Layout &layout,
+                      VkDescriptorPool *pool);
+
+  VkDevice device_ = VK_NULL_HANDLE;
+  std::map<VkDescriptorSetLayout, LayoutPools> layouts_;
+  Stats stats_;
+  std::mutex mutex_;
+};
+
+#endif
@@ -0,0 +1,264 @@
+/*
+ * Copyright (C) 2020 by Xu Xing (xu.xing@outlook.com)
+ *
+ * This code is licensed under the MIT license (MIT)
+ * (http://opensource.org/licenses/MIT)
+ */
+#include "ElementType.h"
+
+#include <algorithm>
+#include <assert.h>
+#include <limits>
+#include <math.h>
+#include <string.h>
+
+static uint16_t floatToHalfBits(float value) {
+  uint32_t bits;
+  memcpy(&bits, &value, sizeof(bits));
+  const uint32_t sign = (bits >> 16) & 0x8000;
+  const uint32_t floatExponent = (bits >> 23) & 0xff;
+  uint32_t mantissa = bits & 0x7fffff;
+  // Inf stays inf; NaN stays a quiet NaN.
+  if (floatExponent == 0xff)
+    return sign | 0x7c00 | (mantissa ? 0x200 : 0);
+  const int32_t exponent = (int32_t)floatExponent - 127 + 15;
+  if (exponent >= 31)
+    return sign | 0x7c00;
+  if (exponent <= 0) {
+    // Subnormal, or too small for one.
+    if (exponent < -10)
+      return sign;
+    mantissa |= 0x800000;
+    const uint32_t shift = 14 - exponent;
+    uint32_t half = mantissa >> shift;
+    const uint32_t rest = mantissa & ((1u << shift) - 1);
+    const uint32_t halfway = 1u << (shift - 1);
+    if (rest > halfway || (rest == halfway && (half & 1)))
+      half++;
+    return sign | half;
+  }
+  // A carry out of the mantissa rounds up into the exponent, or to inf.
+  uint32_t half = ((uint32_t)exponent << 10) | (mantissa >> 13);
+  const uint32_t rest = mantissa & 0x1fff;
+  if (rest > 0x1000 || (rest == 0x1000 && (half & 1)))
+    half++;
+  return sign | half;
+}
+
+// Casting NaN or a float out of the range of T is undefined, so those
+// saturate first. NaN converts to 0.
+template <typename T> static T saturate(float value) {
+  if (value != value)
+    return 0;
+  if (value <= (float)std::numeric_limits<T>::min())
+    return std::numeric_limits<T>::min();
+  // The float bound rounds up to a power of two for 32 bit types.
+  if (value >= (float)std::numeric_limits<T>::max())
+    return std::numeric_limits<T>::max();
+  return static_cast<T>(value);
+}
+
+static float halfBitsToFloat(uint16_t half) {
+  const uint32_t sign = (uint32_t)(half & 0x8000) << 16;
+  uint32_t exponent = (half >> 10) & 0x1f;
+  uint32_t mantissa = half & 0x3ff;
+  uint32_t bits;
+  if (exponent == 0x1f) {
+    bits = sign | 0x7f800000 | (mantissa << 13);
+  } else if (exponent != 0) {
+    bits = sign | ((exponent + 112) << 23) | (mantissa << 13);
+  } else if (mantissa == 0) {
+    bits = sign;
+  } else {
+    // Subnormal: normalize it.
+    exponent = 113;
+    while (!(mantissa & 0x400)) {
+      mantissa <<= 1;
+      exponent--;
+    }
+    bits = sign | (exponent << 23) | ((mantissa & 0x3ff) << 13);
+  }
+  float value;
+  memcpy(&value, &bits, sizeof(value));
+  return value;
+}
+
+Half::Half(float value) : bits(floatToHalfBits(value)) {}
+
+Half::operator float() const { return halfBitsToFloat(bits); }
+
+size_t getElementSize(ElementType type) {
+  switch (type) {
+  case ELEMENT_TYPE_FLOAT16:
+    return 2;
+  case ELEMENT_TYPE_INT8:
+  case ELEMENT_TYPE_UINT8:
+    return 1;
+  default:
+    return 4;
+  }
+}
+
+const char *getElementTypeName(ElementType type) {
+  switch (type) {
+  case ELEMENT_TYPE_INT32:
+    return "int";
+  case ELEMENT_TYPE_UINT32:
+    return "uint";
+  case ELEMENT_TYPE_FLOAT16:
+    return "half";
+  case ELEMENT_TYPE_INT8:
+    return "int8";
+  case ELEMENT_TYPE_UINT8:
+    return "uint8";
+  default:
+    return "float";
+  }
+}
+
+VkFormat getElementFormat(ElementType type, uint32_t components) {
+  assert(components == 1 || components == 4);
+  const bool vec4 = components == 4;
+  switch (type) {
+  case ELEMENT_TYPE_INT32:
+    return vec4 ? VK_FORMAT_R32G32B32A32_SINT : VK_FORMAT_R32_SINT;
+  case ELEMENT_TYPE_UINT32:
+    return vec4 ? VK_FORMAT_R32G32B32A32_UINT : VK_FORMAT_R32_UINT;
+  case ELEMENT_TYPE_FLOAT16:
+    return vec4 ? VK_FORMAT_R16G16B16A16_SFLOAT : VK_FORMAT_R16_SFLOAT;
+  case ELEMENT_TYPE_INT8:
+    return vec4 ? VK_FORMAT_R8G8B8A8_SINT : VK_FORMAT_R8_SINT;
+  case ELEMENT_TYPE_UINT8:
+    return vec4 ? VK_FORMAT_R8G8B8A8_UINT : VK_FORMAT_R8_UINT;
+  default:
+    return vec4 ? VK_FORMAT_R32G32B32A32_SFLOAT : VK_FORMAT_R32_SFLOAT;
+  }
+}
+
+uint32_t getFormatComponentCount(VkFormat format) {
+  switch (format) {
+  case VK_FORMAT_R32G32B32A32_SFLOAT:
+  case VK_FORMAT_R32G32B32A32_SINT:
+  case VK_FORMAT_R32G32B32A32_UINT:
+  case VK_FORMAT_R16G16B16A16_SFLOAT:
+  case VK_FORMAT_R8G8B8A8_SINT:
+  case VK_FORMAT_R8G8B8A8_UINT:
+    return 4;
+  default:
+    return 1;
+  }
+}
+
+void convertFromFloat(const float *src, size_t count, ElementType type,
+                      void *dst) {
+  switch (type) {
+  case ELEMENT_TYPE_FLOAT32:
+    memcpy(dst, src, count * sizeof(float));
+    break;
+  case ELEMENT_TYPE_INT32:
+    for (size_t i = 0; i < count; i++)
+      static_cast<int32_t *>(dst)[i] = saturate<int32_t>(src[i]);
+    break;
+  case ELEMENT_TYPE_UINT32:
+    for (size_t i = 0; i < count; i++)
+      static_cast<uint32_t *>(dst)[i] = saturate<uint32_t>(src[i]);
+    break;
+  case ELEMENT_TYPE_FLOAT16:
+    for (size_t i = 0; i < count; i++)
+      static_cast<Half *>(dst)[i] = Half(src[i]);
+    break;
+  case ELEMENT_TYPE_INT8:
+    for (size_t i = 0; i < count; i++)
+      static_cast<int8_t *>(dst)[i] = saturate<int8_t>(roundf(src[i]));
+    break;
+  case ELEMENT_TYPE_UINT8:
+    for (size_t i = 0; i < count; i++)
+      static_cast<uint8_t *>(dst)[i] = saturate<uint8_t>(roundf(src[i]));
+    break;
+  }
+}
+
+void convertToFloat(const void *src, size_t count, ElementType type,
+                    float *dst) {
+  switch (type) {
+  case ELEMENT_TYPE_FLOAT32:
+    memcpy(dst, src, count * sizeof(float));
+    break;
+  case ELEMENT_TYPE_INT32:
+    for (size_t i = 0; i < count; i++)
+      dst[i] = (float)static_cast<const int32_t *>(src)[i];
+    break;
+  case ELEMENT_TYPE_UINT32:
+    for (size_t i = 0; i < count; i++)
+      dst[i] = (float)static_cast<const uint32_t *>(src)[i];
+    break;
+  case ELEMENT_TYPE_FLOAT16:
+    for (size_t i = 0; i < count; i++)
+      dst[i] = static_cast<const Half *>(src)[i];
+    break;
+  case ELEMENT_TYPE_INT8:
+    for (size_t i = 0; i < count; i++)
+      dst[i] = (float)static_cast<const int8_t *>(src)[i];
+    break;
+  case ELEMENT_TYPE_UINT8:
+    for (size_t i = 0; i < count; i++)
+      dst[i] = (float)static_cast<const uint8_t *>(src)[i];
+    break;
+  }
+}
+
+void convertElements(const void *src, ElementType srcType, size_t count,
+                     ElementType dstType, void *dst) {
+  if (srcType == dstType) {
+    memcpy(dst, src, count * getElementSize(srcType));
+  } else if (srcType == ELEMENT_TYPE_FLOAT32) {
+    convertFromFloat(static_cast<const float *>(src), count, dstType, dst);
+  } else if (dstType == ELEMENT_TYPE_FLOAT32) {
+    convertToFloat(src, count, srcType, static_cast<float *>(dst));
+  } else {
+    std::vector<float> values(count);
+    convertToFloat(src, count, srcType, values.data());
+    convertFromFloat(values.data(), count, dstType, dst);
+  }
+}
+
+ElementVector::ElementVector(ElementType type, size_t count)
+    : type_(type), bytes_(count * getElementSize(type)) {}
+
+ElementVector::ElementVector(const std::vector<float> &values,
+                             ElementType type)
+    : ElementVector(type, values.size()) {
+  convertFromFloat(values.data(), values.size(), type, bytes_.data());
+}
+
+void ElementVector::reset(ElementType type, size_t count) {
+  type_ = type;
+  resize(count);
+}
+
+void ElementVector::assign(size_t count, float value) {
+  const size_t elementSize = getElementSize(type_);
+  char element[4];
+  convertFromFloat(&value, 1, type_, element);
+  bytes_.resize(count * elementSize);
+  for (size_t i = 0; i < count; i++)
+    memcpy(&bytes_[i * elementSize], element, elementSize);
+}
+
+float ElementVector::getFloat(size_t index) const {
+  assert(index < size());
+  float value;
+  convertToFloat(&bytes_[index * getElementSize(type_)], 1, type_, &value);
+  return value;
+}
+
+void ElementVector::setFloat(size_t index, float value) {
+  assert(index < size());
+  convertFromFloat(&value, 1, type_, &bytes_[index * getElementSize(type_)]);
+}
+
+std::vector<float> ElementVector::toFloat() const {
+  std::vector<float> values(size());
+  convertToFloat(bytes_.data(), values.size(), type_, values.data());
+  return values;
+}
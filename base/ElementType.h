@@ -0,0 +1,136 @@
+/*
+ * Copyright (C) 2020 by Xu Xing (xu.xing@outlook.com)
+ *
+ * This code is licensed under the MIT license (MIT)
+ * (http://opensource.org/licenses/MIT)
+ */
+#ifndef ELEMENT_TYPE_H_
+#define ELEMENT_TYPE_H_
+
+#include <assert.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include <vulkan/vulkan.h>
+
+// Types of the elements ops keep on the device. Host data in InitParams is
+// an ElementVector of any type, converted at upload only when it differs;
+// runTyped() takes data that is already of the element type.
+enum ElementType {
+  ELEMENT_TYPE_FLOAT32 = 0,
+  ELEMENT_TYPE_INT32 = 1,
+  ELEMENT_TYPE_UINT32 = 2,
+  // Needs storageBuffer16BitAccess, see ComputeContext::supportsElementType.
+  ELEMENT_TYPE_FLOAT16 = 3,
+  // Needs storageBuffer8BitAccess.
+  ELEMENT_TYPE_INT8 = 4,
+  // Needs storageBuffer8BitAccess in buffers; images of its formats need
+  // nothing beyond core Vulkan.
+  ELEMENT_TYPE_UINT8 = 5,
+};
+
+// IEEE 754 binary16, stored as its bits. Conversions round to nearest even.
+struct Half {
+  uint16_t bits = 0;
+  Half() = default;
+  explicit Half(float value);
+  operator float() const;
+};
+
+size_t getElementSize(ElementType type);
+// Also the suffix of the shader variant for the type, e.g. "half" for
+// shaders/add/add_half.comp.spv.
+const char *getElementTypeName(ElementType type);
+// The format with components (1 or 4) elements of type per texel.
+VkFormat getElementFormat(ElementType type, uint32_t components = 1);
+// Elements per texel of a format from getElementFormat; 1 for others.
+uint32_t getFormatComponentCount(VkFormat format);
+
+// Conversions between float host data and count elements of type. Integer
+// types saturate to their range and take NaN to 0. int32 and uint32
+// truncate toward zero; int8 and uint8 round to nearest, halfway away from
+// zero.
+void convertFromFloat(const float *src, size_t count, ElementType type,
+                      void *dst);
+void convertToFloat(const void *src, size_t count, ElementType type,
+                    float *dst);
+// count elements of srcType to dstType, through float unless either is
+// float. Elements of the same type are copied as is.
+void convertElements(const void *src, ElementType srcType, size_t count,
+                     ElementType dstType, void *dst);
+
+// Maps a C++ element type to its ElementType, VkFormat and shader variant.
+template <typename T> struct ElementTraits;
+
+#define ELEMENT_TRAITS(T, TYPE)                                                \
+  template <> struct ElementTraits<T> {                                        \
+    static const ElementType type = TYPE;                                      \
+    static VkFormat format(uint32_t components = 1) {                          \
+      return getElementFormat(TYPE, components);                               \
+    }                                                                          \
+    /* e.g. "shaders/add/add" -> "shaders/add/add_float.comp.spv". */          \
+    static std::string shaderPath(const std::string &prefix) {                 \
+      return prefix + "_" + getElementTypeName(TYPE) + ".comp.spv";            \
+    }                                                                          \
+  };
+ELEMENT_TRAITS(float, ELEMENT_TYPE_FLOAT32)
+ELEMENT_TRAITS(int32_t, ELEMENT_TYPE_INT32)
+ELEMENT_TRAITS(uint32_t, ELEMENT_TYPE_UINT32)
+ELEMENT_TRAITS(Half, ELEMENT_TYPE_FLOAT16)
+ELEMENT_TRAITS(int8_t, ELEMENT_TYPE_INT8)
+ELEMENT_TRAITS(uint8_t, ELEMENT_TYPE_UINT8)
+#undef ELEMENT_TRAITS
+
+// Host elements of a type chosen at run time, stored as bytes. InitParams
+// keeps its input, filter and output in these, so data already of the op's
+// element type is uploaded and read back without a float copy. Vectors of an
+// element type with ElementTraits convert implicitly, e.g. a
+// std::vector<float> to ELEMENT_TYPE_FLOAT32 elements.
+class ElementVector {
+public:
+  ElementVector() = default;
+  // count elements of type, all 0.
+  explicit ElementVector(ElementType type, size_t count = 0);
+  template <typename T>
+  ElementVector(const std::vector<T> &values)
+      : type_(ElementTraits<T>::type),
+        bytes_((const char *)values.data(),
+               (const char *)(values.data() + values.size())) {}
+  // values converted to type.
+  ElementVector(const std::vector<float> &values, ElementType type);
+
+  ElementType getElementType() const { return type_; }
+  size_t size() const { return bytes_.size() / getElementSize(type_); }
+  bool empty() const { return bytes_.empty(); }
+  size_t getBytes() const { return bytes_.size(); }
+  void *data() { return bytes_.data(); }
+  const void *data() const { return bytes_.data(); }
+  template <typename T> T *getData() {
+    assert(ElementTraits<T>::type == type_);
+    return reinterpret_cast<T *>(bytes_.data());
+  }
+  template <typename T> const T *getData() const {
+    assert(ElementTraits<T>::type == type_);
+    return reinterpret_cast<const T *>(bytes_.data());
+  }
+  // Keeps the type; new elements are 0.
+  void resize(size_t count) { bytes_.resize(count * getElementSize(type_)); }
+  // Resizes to count elements of type, reusing the allocation. Contents are
+  // unspecified after a change of type.
+  void reset(ElementType type, size_t count);
+  // count elements of value, converted to the vector's type.
+  void assign(size_t count, float value);
+  void clear() { bytes_.clear(); }
+  // Single elements converted from and to float, for checks and logs.
+  float getFloat(size_t index) const;
+  void setFloat(size_t index, float value);
+  std::vector<float> toFloat() const;
+
+private:
+  ElementType type_ = ELEMENT_TYPE_FLOAT32;
+  std::vector<char> bytes_;
+};
+
+#endif
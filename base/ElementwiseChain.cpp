@@ -0,0 +1,125 @@
+/*
+ * Copyright (C) 2020 by Xu Xing (xu.xing@outlook.com)
+ *
+ * This code is licensed under the MIT license (MIT)
+ * (http://opensource.org/licenses/MIT)
+ */
+#include "ElementwiseChain.h"
+
+const char *getElementwiseOpName(ElementwiseOpType type) {
+  switch (type) {
+  case ELEMENTWISE_ADD:
+    return "add";
+  case ELEMENTWISE_BIAS:
+    return "bias";
+  case ELEMENTWISE_SCALE:
+    return "scale";
+  default:
+    return "relu";
+  }
+}
+
+ElementwiseChain &ElementwiseChain::add() {
+  append(ELEMENTWISE_ADD, 0.0f);
+  return *this;
+}
+
+ElementwiseChain &ElementwiseChain::bias(float value) {
+  append(ELEMENTWISE_BIAS, value);
+  return *this;
+}
+
+ElementwiseChain &ElementwiseChain::scale(float value) {
+  append(ELEMENTWISE_SCALE, value);
+  return *this;
+}
+
+ElementwiseChain &ElementwiseChain::relu() {
+  append(ELEMENTWISE_RELU, 0.0f);
+  return *this;
+}
+
+void ElementwiseChain::append(ElementwiseOpType type, float value) {
+  if (!stages_.empty() && stages_.back().type == type) {
+    Stage &last = stages_.back();
+    if (type == ELEMENTWISE_BIAS) {
+      last.value += value;
+      return;
+    }
+    if (type == ELEMENTWISE_SCALE) {
+      last.value *= value;
+      return;
+    }
+    if (type == ELEMENTWISE_RELU)
+      return;
+  }
+  assert(stages_.size() < MAX_STAGES);
+  Stage stage;
+  stage.type = type;
+  stage.value = value;
+  stages_.push_back(stage);
+}
+
+bool ElementwiseChain::readsOperand() const {
+  for (const Stage &stage : stages_) {
+    if (stage.type == ELEMENTWISE_ADD)
+      return true;
+  }
+  return false;
+}
+
+uint32_t ElementwiseChain::getUnfusedAccesses() const {
+  uint32_t accesses = 0;
+  for (const Stage &stage : stages_)
+    accesses += stage.type == ELEMENTWISE_ADD ? 3 : 2;
+  return accesses;
+}
+
+void ElementwiseChain::apply(ComputeOp::InitParams &params) const {
+  assert(!stages_.empty());
+  params.shader_path = "shaders/elementwise/elementwise.comp.spv";
+  params.outputWidth = params.inputWidth;
+  params.outputHeight = params.inputHeight;
+  if (readsOperand()) {
+    params.filterWidth = params.inputWidth;
+    params.filterHeight = params.inputHeight;
+  } else {
+    params.filterWidth = 1;
+    params.filterHeight = 1;
+    params.computeFilter.assign(1, 0.0f);
+  }
+
+  // One add, multiply or max per step.
+  params.flopsPerOutput = (uint32_t)stages_.size();
+
+  // Count, then the op of every stage, then its value, as the kernel
+  // declares them.
+  std::vector<uint32_t> &constants = params.specializationConstants;
+  constants.assign(1 + 2 * MAX_STAGES, 0);
+  constants[0] = (uint32_t)stages_.size();
+  for (size_t i = 0; i < stages_.size(); i++) {
+    constants[1 + i] = stages_[i].type;
+    memcpy(&constants[1 + MAX_STAGES + i], &stages_[i].value, sizeof(float));
+  }
+}
+
+float ElementwiseChain::evaluate(float input, float operand) const {
+  float value = input;
+  for (const Stage &stage : stages_) {
+    switch (stage.type) {
+    case ELEMENTWISE_ADD:
+      value += operand;
+      break;
+    case ELEMENTWISE_BIAS:
+      value += stage.value;
+      break;
+    case ELEMENTWISE_SCALE:
+      value *= stage.value;
+      break;
+    default:
+      value = std::max(value, 0.0f);
+      break;
+    }
+  }
+  return value;
+}
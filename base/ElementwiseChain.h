@@ -0,0 +1,75 @@
+/*
+ * Copyright (C) 2020 by Xu Xing (xu.xing@outlook.com)
+ *
+ * This code is licensed under the MIT license (MIT)
+ * (http://opensource.org/licenses/MIT)
+ */
+#ifndef ELEMENTWISE_CHAIN_H_
+#define ELEMENTWISE_CHAIN_H_
+
+#include <vector>
+
+#include "ComputeOp.h"
+
+// Steps of an elementwise chain. The values match
+// shaders/elementwise/elementwise.comp.
+enum ElementwiseOpType {
+  // Adds the operand, the op's filter, at the same index.
+  ELEMENTWISE_ADD = 0,
+  // Adds a constant.
+  ELEMENTWISE_BIAS = 1,
+  // Multiplies by a constant.
+  ELEMENTWISE_SCALE = 2,
+  ELEMENTWISE_RELU = 3,
+};
+
+const char *getElementwiseOpName(ElementwiseOpType type);
+
+// A sequence of elementwise ops fused into one dispatch. Run separately,
+// every op reads and writes the whole buffer; fused, the input and operand
+// are read once and the output written once, with the steps applied in
+// registers in between.
+//
+// The fused kernel is shaders/elementwise/elementwise.comp, which takes the
+// steps as specialization constants: each chain gets a pipeline compiled
+// for exactly its steps, with no branching on them at run time, and equal
+// chains share it through the pipeline object cache.
+class ElementwiseChain {
+public:
+  // Steps the kernel has room for.
+  static const uint32_t MAX_STAGES = 8;
+
+  struct Stage {
+    ElementwiseOpType type;
+    float value;
+  };
+
+  // Appending folds the step into the last one where that gives the same
+  // result: biases are summed, scales multiplied and repeated ReLUs
+  // dropped.
+  ElementwiseChain &add();
+  ElementwiseChain &bias(float value);
+  ElementwiseChain &scale(float value);
+  ElementwiseChain &relu();
+
+  const std::vector<Stage> &getStages() const { return stages_; }
+  bool readsOperand() const;
+  // Buffer reads and writes per element when run fused, and when every
+  // step runs as its own op.
+  uint32_t getFusedAccesses() const { return readsOperand() ? 3 : 2; }
+  uint32_t getUnfusedAccesses() const;
+
+  // Points params at the fused kernel for this chain, on input and output
+  // of params' input shape. Without an ELEMENTWISE_ADD step, the filter is
+  // never read and becomes a single element placeholder.
+  void apply(ComputeOp::InitParams &params) const;
+
+  // The chain applied on the host, for checking results.
+  float evaluate(float input, float operand) const;
+
+private:
+  void append(ElementwiseOpType type, float value);
+
+  std::vector<Stage> stages_;
+};
+#endif
@@ -0,0 +1,205 @@
+/*
+ * Copyright (C) 2020 by Xu Xing (xu.xing@outlook.com)
+ *
+ * This code is licensed under the MIT license (MIT)
+ * (http://opensource.org/licenses/MIT)
+ */
+#include "GpuProfiler.h"
+#include "VulkanTools.h"
+
+#include <algorithm>
+
+GpuProfiler::GpuProfiler(VkDevice device, float timestampPeriod,
+                         uint32_t rangeCount)
+    : device_(device), msPerTick_((double)timestampPeriod / 1e6),
+      slots_(rangeCount) {
+  VkQueryPoolCreateInfo createInfo = {};
+  createInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+  createInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+  createInfo.queryCount = rangeCount * 2;
+  VK_CHECK_RESULT(
+      vkCreateQueryPool(device_, &createInfo, nullptr, &queryPool_));
+}
+
+GpuProfiler::~GpuProfiler() {
+  vkDestroyQueryPool(device_, queryPool_, nullptr);
+}
+
+GpuProfiler::Range GpuProfiler::findFreeSlot() {
+  const Range count = static_cast<Range>(slots_.size());
+  for (Range i = 0; i < count; i++) {
+    const Range range = (head_ + i) % count;
+    if (slots_[range].state == SLOT_FREE) {
+      head_ = (range + 1) % count;
+      return range;
+    }
+  }
+  return INVALID_RANGE;
+}
+
+GpuProfiler::Range GpuProfiler::allocate(const std::string &name,
+                                         uint32_t timestampValidBits) {
+  if (timestampValidBits == 0)
+    return INVALID_RANGE;
+  std::lock_guard<std::mutex> lock(mutex_);
+  Range range = findFreeSlot();
+  if (range == INVALID_RANGE) {
+    // Released ranges are only freed once read.
+    resolveLocked();
+    range = findFreeSlot();
+  }
+  if (range == INVALID_RANGE) {
+    droppedCount_++;
+    return INVALID_RANGE;
+  }
+  Slot &slot = slots_[range];
+  slot = Slot();
+  slot.state = SLOT_ALLOCATED;
+  slot.name = name;
+  slot.timestampMask = timestampValidBits >= 64
+                           ? UINT64_MAX
+                           : ((1ULL << timestampValidBits) - 1);
+  return range;
+}
+
+void GpuProfiler::release(Range range) {
+  if (range == INVALID_RANGE)
+    return;
+  std::lock_guard<std::mutex> lock(mutex_);
+  Slot &slot = slots_[range];
+  if (slot.state == SLOT_PENDING)
+    slot.released = true;
+  else
+    slot.state = SLOT_FREE;
+}
+
+void GpuProfiler::begin(VkCommandBuffer commandBuffer, Range range) {
+  if (range == INVALID_RANGE)
+    return;
+  vkCmdResetQueryPool(commandBuffer, queryPool_, range * 2, 2);
+  vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+                      queryPool_, range * 2);
+}
+
+void GpuProfiler::end(VkCommandBuffer commandBuffer, Range range) {
+  if (range == INVALID_RANGE)
+    return;
+  vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+                      queryPool_, range * 2 + 1);
+}
+
+void GpuProfiler::submitted(Range range, QueueTimeline &timeline,
+                            uint64_t value) {
+  if (range == INVALID_RANGE)
+    return;
+  std::lock_guard<std::mutex> lock(mutex_);
+  Slot &slot = slots_[range];
+  assert(slot.state != SLOT_FREE);
+  if (slot.state == SLOT_PENDING) {
+    if (slot.timeline->isComplete(slot.value))
+      readSlot(range);
+    pending_.erase(std::find(pending_.begin(), pending_.end(), range));
+  }
+  slot.state = SLOT_PENDING;
+  slot.timeline = &timeline;
+  slot.value = value;
+  pending_.push_back(range);
+}
+
+void GpuProfiler::resolve() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  resolveLocked();
+}
+
+void GpuProfiler::resolveLocked() {
+  std::vector<Range> stillPending;
+  for (Range range : pending_) {
+    Slot &slot = slots_[range];
+    if (!slot.timeline->isComplete(slot.value)) {
+      stillPending.push_back(range);
+      continue;
+    }
+    readSlot(range);
+    slot.state = slot.released ? SLOT_FREE : SLOT_ALLOCATED;
+  }
+  pending_.swap(stillPending);
+}
+
+void GpuProfiler::readSlot(Range range) {
+  Slot &slot = slots_[range];
+  // Timestamp and availability of the begin and end queries.
+  uint64_t data[4] = {0, 0, 0, 0};
+  const VkResult result = vkGetQueryPoolResults(
+      device_, queryPool_, range * 2, 2, sizeof(data), data,
+      2 * sizeof(uint64_t),
+      VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WITH_AVAILABILITY_BIT);
+  // The submission completed, so both are available unless the command
+  // buffer skipped the range.
+  if ((result != VK_SUCCESS && result != VK_NOT_READY) || !data[1] ||
+      !data[3])
+    return;
+  const uint64_t begin = data[0] & slot.timestampMask;
+  const uint64_t end = data[2] & slot.timestampMask;
+  // Unsigned wraparound within the valid bits.
+  const uint64_t ticks = (end - begin) & slot.timestampMask;
+
+  Result entry;
+  entry.name = slot.name;
+  entry.beginMs = begin * msPerTick_;
+  entry.ms = ticks * msPerTick_;
+  entry.endMs = entry.beginMs + entry.ms;
+  slot.last = entry;
+
+  Stats &stats = stats_[slot.name];
+  stats.minMs = stats.count ? std::min(stats.minMs, entry.ms) : entry.ms;
+  stats.maxMs = stats.count ? std::max(stats.maxMs, entry.ms) : entry.ms;
+  stats.count++;
+  stats.totalMs += entry.ms;
+  stats.lastMs = entry.ms;
+  results_.push_back(entry);
+  if (results_.size() > MAX_RESULTS)
+    results_.pop_front();
+}
+
+double GpuProfiler::getLastMs(Range range) const {
+  if (range == INVALID_RANGE)
+    return 0.0;
+  std::lock_guard<std::mutex> lock(mutex_);
+  return slots_[range].last.ms;
+}
+
+GpuProfiler::Result GpuProfiler::getLastResult(Range range) const {
+  if (range == INVALID_RANGE)
+    return Result();
+  std::lock_guard<std::mutex> lock(mutex_);
+  return slots_[range].last;
+}
+
+GpuProfiler::Stats GpuProfiler::getStats(const std::string &name) const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto it = stats_.find(name);
+  return it == stats_.end() ? Stats() : it->second;
+}
+
+std::map<std::string, GpuProfiler::Stats> GpuProfiler::getAllStats() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return stats_;
+}
+
+std::vector<GpuProfiler::Result> GpuProfiler::takeResults() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  std::vector<Result> results(results_.begin(), results_.end());
+  results_.clear();
+  return results;
+}
+
+void GpuProfiler::resetStats() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  stats_.clear();
+  results_.clear();
+}
+
+uint32_t GpuProfiler::getDroppedCount() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return droppedCount_;
+}
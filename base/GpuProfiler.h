@@ -0,0 +1,133 @@
+/*
+ * Copyright (C) 2020 by Xu Xing (xu.xing@outlook.com)
+ *
+ * This code is licensed under the MIT license (MIT)
+ * (http://opensource.org/licenses/MIT)
+ */
+#ifndef GPU_PROFILER_H_
+#define GPU_PROFILER_H_
+
+#include <deque>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "QueueTimeline.h"
+#include <vulkan/vulkan.h>
+
+// Named GPU time ranges from timestamp queries. Each range is a pair of
+// queries in one large pool, handed out round robin from the slot after the
+// last one taken, skipping slots still in use. A range recorded in a command
+// buffer that is submitted many times (e.g. ComputeOp::commandBuffer_) keeps
+// its slot until released; one-off ranges are released right after their
+// submission and freed once read.
+//
+// Results are read without VK_QUERY_RESULT_WAIT_BIT: submitted() ties a range
+// to a QueueTimeline value, and resolve() only reads ranges whose value has
+// completed, so it never stalls. Timestamps are masked to the valid bits of
+// the queue family they ran on, which also makes the difference of a range
+// that straddles a counter wraparound come out right.
+//
+// Per-name statistics cover every resolved range. The individual results are
+// kept in a bounded history for exporters (see takeResults).
+class GpuProfiler {
+public:
+  typedef uint32_t Range;
+  static const Range INVALID_RANGE = UINT32_MAX;
+  static const uint32_t DEFAULT_RANGE_COUNT = 512;
+  // Results kept for takeResults(); older ones are dropped.
+  static const size_t MAX_RESULTS = 4096;
+
+  struct Result {
+    std::string name;
+    // Device timestamps, in ms of the device clock.
+    double beginMs = 0.0;
+    double endMs = 0.0;
+    double ms = 0.0;
+  };
+
+  struct Stats {
+    uint64_t count = 0;
+    double totalMs = 0.0;
+    double minMs = 0.0;
+    double maxMs = 0.0;
+    double lastMs = 0.0;
+    double getAverageMs() const { return count ? totalMs / count : 0.0; }
+  };
+
+  GpuProfiler(VkDevice device, float timestampPeriod,
+              uint32_t rangeCount = DEFAULT_RANGE_COUNT);
+  ~GpuProfiler();
+
+  // Takes a range for commands on a queue family with timestampValidBits
+  // valid bits. Returns INVALID_RANGE when the family has no timestamps or
+  // every range is in use even after resolve(); the other functions ignore
+  // INVALID_RANGE, so callers need not check.
+  Range allocate(const std::string &name, uint32_t timestampValidBits);
+  // Frees range, or marks it to be freed once its pending result is read.
+  void release(Range range);
+  // Record resetting the queries of range and its begin timestamp, and its
+  // end timestamp. Both are taken once all earlier commands are complete.
+  void begin(VkCommandBuffer commandBuffer, Range range);
+  void end(VkCommandBuffer commandBuffer, Range range);
+  // A command buffer holding range was submitted and completes with value on
+  // timeline. Submitting it again replaces a result not yet resolved.
+  void submitted(Range range, QueueTimeline &timeline, uint64_t value);
+  // Reads every submitted range whose value has completed. Never waits.
+  void resolve();
+
+  // Duration of the last resolved run of range, 0 if none.
+  double getLastMs(Range range) const;
+  // The last resolved run of range, all zero if none.
+  Result getLastResult(Range range) const;
+  // Statistics of ranges named name, zero if there are none.
+  Stats getStats(const std::string &name) const;
+  std::map<std::string, Stats> getAllStats() const;
+  // Returns and clears the results resolved since the last call, oldest
+  // first.
+  std::vector<Result> takeResults();
+  void resetStats();
+  // Ranges not profiled because the pool was full.
+  uint32_t getDroppedCount() const;
+
+private:
+  enum SlotState {
+    SLOT_FREE = 0,
+    SLOT_ALLOCATED = 1,
+    SLOT_PENDING = 2,
+  };
+
+  struct Slot {
+    SlotState state = SLOT_FREE;
+    std::string name;
+    uint64_t timestampMask = 0;
+    // Free after the pending result is read.
+    bool released = false;
+    QueueTimeline *timeline = nullptr;
+    uint64_t value = 0;
+    Result last;
+  };
+
+  GpuProfiler(const GpuProfiler &) = delete;
+  GpuProfiler &operator=(const GpuProfiler &) = delete;
+
+  Range findFreeSlot();
+  void resolveLocked();
+  void readSlot(Range range);
+
+  VkDevice device_ = VK_NULL_HANDLE;
+  VkQueryPool queryPool_ = VK_NULL_HANDLE;
+  double msPerTick_ = 0.0;
+  std::vector<Slot> slots_;
+  // Where the next search for a free slot starts.
+  Range head_ = 0;
+  // Pending slots in submission order.
+  std::vector<Range> pending_;
+  std::map<std::string, Stats> stats_;
+  std::deque<Result> results_;
+  uint32_t droppedCount_ = 0;
+  mutable std::mutex mutex_;
+};
+
+#endif
@@ -0,0 +1,358 @@
+/*
+ * Copyright (C) 2020 by Xu Xing (xu.xing@outlook.com)
+ *
+ * This code is licensed under the MIT license (MIT)
+ * (http://opensource.org/licenses/MIT)
+ */
+#include "MemoryAllocator.h"
+#include "ComputeOp.h"
+
+// A block is split into ranges that cover it without gaps, sorted by offset.
+// Adjacent free ranges are always merged.
+struct MemoryAllocator::Block {
+  struct Range {
+    VkDeviceSize offset;
+    VkDeviceSize size;
+    bool free;
+    ResourceKind kind;
+  };
+  VkDeviceMemory memory = VK_NULL_HANDLE;
+  VkDeviceSize size = 0;
+  uint32_t memoryTypeIndex = 0;
+  void *mapped = nullptr;
+  bool dedicated = false;
+  std::vector<Range> ranges;
+};
+
+static VkDeviceSize alignUp(VkDeviceSize value, VkDeviceSize alignment) {
+  return (value + alignment - 1) & ~(alignment - 1);
+}
+
+static VkDeviceSize alignDown(VkDeviceSize value, VkDeviceSize alignment) {
+  return value & ~(alignment - 1);
+}
+
+// True if the last byte of one resource and the first byte of the next fall
+// on the same bufferImageGranularity "page".
+static bool onSamePage(VkDeviceSize lastByte, VkDeviceSize firstByte,
+                       VkDeviceSize granularity) {
+  return alignDown(lastByte, granularity) == alignDown(firstByte, granularity);
+}
+
+MemoryAllocator::MemoryAllocator(VkDevice device,
+                                 VkPhysicalDevice physicalDevice,
+                                 VkDeviceSize blockSize)
+    : device_(device), blockSize_(blockSize) {
+  VkPhysicalDeviceProperties deviceProperties;
+  vkGetPhysicalDeviceProperties(physicalDevice, &deviceProperties);
+  vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memoryProperties_);
+  bufferImageGranularity_ =
+      std::max<VkDeviceSize>(1, deviceProperties.limits.bufferImageGranularity);
+  nonCoherentAtomSize_ =
+      std::max<VkDeviceSize>(1, deviceProperties.limits.nonCoherentAtomSize);
+  blocks_.resize(memoryProperties_.memoryTypeCount);
+}
+
+MemoryAllocator::~MemoryAllocator() {
+  for (auto &typeBlocks : blocks_) {
+    for (auto block : typeBlocks) {
+      if (block->ranges.size() != 1 || !block->ranges[0].free)
+        LOG("MemoryAllocator: block of type %d destroyed with live "
+            "allocations\n",
+            block->memoryTypeIndex);
+      destroyBlock(block);
+    }
+  }
+}
+
+bool MemoryAllocator::isCoherent(uint32_t memoryTypeIndex) const {
+  return (memoryProperties_.memoryTypes[memoryTypeIndex].propertyFlags &
+          VK_MEMORY_PROPERTY_HOST_COHERENT_BIT) != 0;
+}
+
+MemoryAllocator::Block *MemoryAllocator::createBlock(uint32_t memoryTypeIndex,
+                                                     VkDeviceSize size) {
+  VkMemoryAllocateInfo memAlloc = vks::initializers::memoryAllocateInfo();
+  memAlloc.allocationSize = size;
+  memAlloc.memoryTypeIndex = memoryTypeIndex;
+  VkDeviceMemory memory;
+  if (vkAllocateMemory(device_, &memAlloc, nullptr, &memory) != VK_SUCCESS)
+    return nullptr;
+  deviceAllocationCount_++;
+
+  Block *block = new Block();
+  block->memory = memory;
+  block->size = size;
+  block->memoryTypeIndex = memoryTypeIndex;
+  block->ranges.push_back({0, size, true, RESOURCE_LINEAR});
+  if (memoryProperties_.memoryTypes[memoryTypeIndex].propertyFlags &
+      VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) {
+    VK_CHECK_RESULT(
+        vkMapMemory(device_, memory, 0, VK_WHOLE_SIZE, 0, &block->mapped));
+  }
+  blocks_[memoryTypeIndex].push_back(block);
+  return block;
+}
+
+void MemoryAllocator::destroyBlock(Block *block) {
+  if (block->mapped)
+    vkUnmapMemory(device_, block->memory);
+  vkFreeMemory(device_, block->memory, nullptr);
+  delete block;
+}
+
+bool MemoryAllocator::allocateFromBlock(Block *block, VkDeviceSize size,
+                                        VkDeviceSize alignment,
+                                        ResourceKind kind,
+                                        Allocation *allocation) {
+  auto &ranges = block->ranges;
+  for (size_t i = 0; i < ranges.size(); i++) {
+    const Block::Range range = ranges[i];
+    if (!range.free || range.size < size)
+      continue;
+    VkDeviceSize start = alignUp(range.offset, alignment);
+    if (i > 0) {
+      const Block::Range &prev = ranges[i - 1];
+      if (!prev.free && prev.kind != kind &&
+          onSamePage(prev.offset + prev.size - 1, start,
+                     bufferImageGranularity_))
+        start = alignUp(start, bufferImageGranularity_);
+    }
+    const VkDeviceSize end = start + size;
+    if (end > range.offset + range.size)
+      continue;
+    if (i + 1 < ranges.size()) {
+      const Block::Range &next = ranges[i + 1];
+      if (!next.free && next.kind != kind &&
+          onSamePage(end - 1, next.offset, bufferImageGranularity_))
+        continue;
+    }
+
+    // Split the free range into [padding][allocation][tail].
+    std::vector<Block::Range> split;
+    if (start > range.offset)
+      split.push_back({range.offset, start - range.offset, true, kind});
+    split.push_back({start, size, false, kind});
+    if (range.offset + range.size > end)
+      split.push_back({end, range.offset + range.size - end, true, kind});
+    ranges.erase(ranges.begin() + i);
+    ranges.insert(ranges.begin() + i, split.begin(), split.end());
+
+    allocation->memory = block->memory;
+    allocation->offset = start;
+    allocation->size = size;
+    allocation->memoryTypeIndex = block->memoryTypeIndex;
+    allocation->mapped =
+        block->mapped ? static_cast<char *>(block->mapped) + start : nullptr;
+    allocation->block = block;
+    return true;
+  }
+  return false;
+}
+
+VkResult MemoryAllocator::allocate(const VkMemoryRequirements &memReqs,
+                                   uint32_t memoryTypeIndex, ResourceKind kind,
+                                   Allocation *allocation) {
+  assert(memoryTypeIndex < memoryProperties_.memoryTypeCount);
+  assert(memReqs.memoryTypeBits & (1u << memoryTypeIndex));
+  std::lock_guard<std::mutex> lock(mutex_);
+
+  VkDeviceSize alignment = std::max<VkDeviceSize>(1, memReqs.alignment);
+  const bool hostVisible =
+      (memoryProperties_.memoryTypes[memoryTypeIndex].propertyFlags &
+       VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) != 0;
+  if (hostVisible && !isCoherent(memoryTypeIndex))
+    alignment = std::max(alignment, nonCoherentAtomSize_);
+
+  // Keep blocks small relative to the heap, so small heaps (e.g. the 256MB
+  // device local + host visible heap on discrete GPUs) are not exhausted.
+  const uint32_t heapIndex =
+      memoryProperties_.memoryTypes[memoryTypeIndex].heapIndex;
+  const VkDeviceSize blockSize = std::min(
+      blockSize_, memoryProperties_.memoryHeaps[heapIndex].size / 8);
+
+  if (memReqs.size > blockSize / 2) {
+    Block *block = createBlock(memoryTypeIndex, memReqs.size);
+    if (!block)
+      return VK_ERROR_OUT_OF_DEVICE_MEMORY;
+    block->dedicated = true;
+    allocateFromBlock(block, memReqs.size, alignment, kind, allocation);
+    return VK_SUCCESS;
+  }
+
+  for (auto block : blocks_[memoryTypeIndex]) {
+    if (!block->dedicated &&
+        allocateFromBlock(block, memReqs.size, alignment, kind, allocation))
+      return VK_SUCCESS;
+  }
+  Block *block = createBlock(memoryTypeIndex, blockSize);
+  if (!block)
+    return VK_ERROR_OUT_OF_DEVICE_MEMORY;
+  if (!allocateFromBlock(block, memReqs.size, alignment, kind, allocation))
+    return VK_ERROR_OUT_OF_DEVICE_MEMORY;
+  return VK_SUCCESS;
+}
+
+void MemoryAllocator::free(Allocation &allocation) {
+  if (allocation.block == nullptr)
+    return;
+  std::lock_guard<std::mutex> lock(mutex_);
+  Block *block = allocation.block;
+  auto &ranges = block->ranges;
+  size_t i = 0;
+  while (i < ranges.size() && ranges[i].offset != allocation.offset)
+    i++;
+  assert(i < ranges.size() && !ranges[i].free);
+  ranges[i].free = true;
+  // Merge with the following and the preceding free range.
+  if (i + 1 < ranges.size() && ranges[i + 1].free) {
+    ranges[i].size += ranges[i + 1].size;
+    ranges.erase(ranges.begin() + i + 1);
+  }
+  if (i > 0 && ranges[i - 1].free) {
+    ranges[i - 1].size += ranges[i].size;
+    ranges.erase(ranges.begin() + i);
+  }
+  allocation = Allocation();
+
+  if (ranges.size() != 1)
+    return;
+  // Release empty blocks, but keep one shared block per memory type so that
+  // ops created and destroyed in a loop do not hit vkAllocateMemory each time.
+  auto &typeBlocks = blocks_[block->memoryTypeIndex];
+  bool keep = !block->dedicated;
+  for (auto other : typeBlocks) {
+    if (other != block && !other->dedicated && other->ranges.size() == 1 &&
+        other->ranges[0].free)
+      keep = false;
+  }
+  if (keep)
+    return;
+  typeBlocks.erase(std::find(typeBlocks.begin(), typeBlocks.end(), block));
+  destroyBlock(block);
+}
+
+uint32_t MemoryAllocator::findMemoryType(
+    uint32_t typeBits, VkMemoryPropertyFlags properties) const {
+  for (uint32_t i = 0; i < memoryProperties_.memoryTypeCount; i++) {
+    if ((typeBits & (1u << i)) &&
+        (memoryProperties_.memoryTypes[i].propertyFlags & properties) ==
+            properties)
+      return i;
+  }
+  return UINT32_MAX;
+}
+
+static int countBits(VkMemoryPropertyFlags flags) {
+  int count = 0;
+  for (; flags; flags &= flags - 1)
+    count++;
+  return count;
+}
+
+uint32_t MemoryAllocator::selectMemoryType(
+    uint32_t typeBits, VkMemoryPropertyFlags required,
+    VkMemoryPropertyFlags preferred) const {
+  const VkMemoryPropertyFlags costly = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT |
+                                       VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+                                       VK_MEMORY_PROPERTY_HOST_CACHED_BIT;
+  const VkMemoryPropertyFlags excluded =
+      VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT |
+      VK_MEMORY_PROPERTY_PROTECTED_BIT;
+  uint32_t best = UINT32_MAX;
+  int bestScore = 0;
+  for (uint32_t i = 0; i < memoryProperties_.memoryTypeCount; i++) {
+    const VkMemoryPropertyFlags flags =
+        memoryProperties_.memoryTypes[i].propertyFlags;
+    if (!(typeBits & (1u << i)) || (flags & required) != required ||
+        (flags & excluded & ~required))
+      continue;
+    const int score = 2 * countBits(flags & preferred) -
+                      countBits(flags & costly & ~(required | preferred));
+    if (best == UINT32_MAX || score > bestScore ||
+        (score == bestScore && getHeapSize(i) > getHeapSize(best))) {
+      best = i;
+      bestScore = score;
+    }
+  }
+  return best;
+}
+
+VkResult MemoryAllocator::bindBuffer(VkBuffer buffer,
+                                     const Allocation &allocation) {
+  return vkBindBufferMemory(device_, buffer, allocation.memory,
+                            allocation.offset);
+}
+
+VkResult MemoryAllocator::bindImage(VkImage image,
+                                    const Allocation &allocation) {
+  return vkBindImageMemory(device_, image, allocation.memory,
+                           allocation.offset);
+}
+
+VkMappedMemoryRange
+MemoryAllocator::getMappedRange(const Allocation &allocation) const {
+  VkMappedMemoryRange mappedRange = vks::initializers::mappedMemoryRange();
+  mappedRange.memory = allocation.memory;
+  mappedRange.offset = alignDown(allocation.offset, nonCoherentAtomSize_);
+  const VkDeviceSize end =
+      alignUp(allocation.offset + allocation.size, nonCoherentAtomSize_);
+  if (end >= allocation.block->size)
+    mappedRange.size = VK_WHOLE_SIZE;
+  else
+    mappedRange.size = end - mappedRange.offset;
+  return mappedRange;
+}
+
+void MemoryAllocator::flush(const Allocation &allocation) {
+  if (allocation.block == nullptr || isCoherent(allocation.memoryTypeIndex))
+    return;
+  VkMappedMemoryRange mappedRange = getMappedRange(allocation);
+  vkFlushMappedMemoryRanges(device_, 1, &mappedRange);
+}
+
+void MemoryAllocator::invalidate(const Allocation &allocation) {
+  if (allocation.block == nullptr || isCoherent(allocation.memoryTypeIndex))
+    return;
+  VkMappedMemoryRange mappedRange = getMappedRange(allocation);
+  vkInvalidateMappedMemoryRanges(device_, 1, &mappedRange);
+}
+
+MemoryAllocator::Stats MemoryAllocator::getStats() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  Stats stats;
+  stats.deviceAllocationCount = deviceAllocationCount_;
+  for (auto &typeBlocks : blocks_) {
+    for (auto block : typeBlocks) {
+      stats.blockCount++;
+      stats.reservedBytes += block->size;
+      for (auto &range : block->ranges) {
+        if (range.free) {
+          stats.freeBytes += range.size;
+          stats.largestFreeRange =
+              std::max(stats.largestFreeRange, range.size);
+        } else {
+          stats.allocationCount++;
+          stats.liveBytes += range.size;
+        }
+      }
+    }
+  }
+  if (stats.freeBytes > 0)
+    stats.fragmentation =
+        1.0f - (float)stats.largestFreeRange / (float)stats.freeBytes;
+  return stats;
+}
+
+void MemoryAllocator::logStats() {
+  const Stats stats = getStats();
+  LOG("***********: MEMORY INFO:\n");
+  LOG("blocks: %d, allocations: %d, vkAllocateMemory calls: %d\n",
+      stats.blockCount, stats.allocationCount, stats.deviceAllocationCount);
+  LOG("reserved: %llu bytes, live: %llu bytes, free: %llu bytes\n",
+      (unsigned long long)stats.reservedBytes,
+      (unsigned long long)stats.liveBytes,
+      (unsigned long long)stats.freeBytes);
+  LOG("largest free range: %llu bytes, fragmentation: %f\n",
+      (unsigned long long)stats.largestFreeRange, stats.fragmentation);
+}
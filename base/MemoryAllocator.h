@@ -0,0 +1,125 @@
+/*
+ * Copyright (C) 2020 by Xu Xing (xu.xing@outlook.com)
+ *
+ * This code is licensed under the MIT license (MIT)
+ * (http://opensource.org/licenses/MIT)
+ */
+#ifndef MEMORY_ALLOCATOR_H_
+#define MEMORY_ALLOCATOR_H_
+
+#include <mutex>
+#include <vector>
+
+#include "VulkanTools.h"
+#include <vulkan/vulkan.h>
+
+// Sub-allocates buffers and images out of large VkDeviceMemory blocks, one
+// list of blocks per memory type. Drivers cap the number of live
+// vkAllocateMemory objects (maxMemoryAllocationCount can be as low as 4096)
+// and each call is slow, so ops should never allocate memory directly.
+//
+// Host visible blocks are mapped once when created and stay mapped: a
+// VkDeviceMemory can only be mapped once at a time, so callers use
+// Allocation::mapped instead of vkMapMemory.
+class MemoryAllocator {
+public:
+  // Linear resources (buffers, linear images) and optimal images placed next
+  // to each other must be bufferImageGranularity apart.
+  enum ResourceKind { RESOURCE_LINEAR = 0, RESOURCE_OPTIMAL = 1 };
+
+  struct Block;
+  struct Allocation {
+    VkDeviceMemory memory = VK_NULL_HANDLE;
+    VkDeviceSize offset = 0;
+    VkDeviceSize size = 0;
+    uint32_t memoryTypeIndex = 0;
+    // Null unless the memory type is host visible.
+    void *mapped = nullptr;
+    Block *block = nullptr;
+  };
+
+  struct Stats {
+    uint32_t blockCount = 0;
+    uint32_t allocationCount = 0;
+    // vkAllocateMemory calls made over the allocator lifetime.
+    uint32_t deviceAllocationCount = 0;
+    VkDeviceSize reservedBytes = 0;
+    VkDeviceSize liveBytes = 0;
+    VkDeviceSize freeBytes = 0;
+    VkDeviceSize largestFreeRange = 0;
+    // 0 when all free space is one contiguous range, close to 1 when it is
+    // split into many small ranges.
+    float fragmentation = 0.0f;
+  };
+
+  static const VkDeviceSize DEFAULT_BLOCK_SIZE = 64 * 1024 * 1024;
+
+  MemoryAllocator(VkDevice device, VkPhysicalDevice physicalDevice,
+                  VkDeviceSize blockSize = DEFAULT_BLOCK_SIZE);
+  ~MemoryAllocator();
+
+  // Finds a range that fits memReqs in a block of memoryTypeIndex, creating
+  // a new block when none has room. Requests larger than half a block get a
+  // dedicated block.
+  VkResult allocate(const VkMemoryRequirements &memReqs,
+                    uint32_t memoryTypeIndex, ResourceKind kind,
+                    Allocation *allocation);
+  void free(Allocation &allocation);
+
+  // Returns the first memory type in typeBits with all of properties, or
+  // UINT32_MAX if there is none.
+  uint32_t findMemoryType(uint32_t typeBits,
+                          VkMemoryPropertyFlags properties) const;
+  // Scores the memory types in typeBits that have all of required and
+  // returns the best one, or UINT32_MAX if there is none. Each preferred
+  // property a type has counts for it; each DEVICE_LOCAL, HOST_VISIBLE or
+  // HOST_CACHED property it has that was neither required nor preferred
+  // counts against it, so device only buffers stay out of a small
+  // host-visible (BAR) heap. Lazily allocated and protected types are only
+  // picked when required. Ties go to the type with the larger heap.
+  uint32_t selectMemoryType(uint32_t typeBits, VkMemoryPropertyFlags required,
+                            VkMemoryPropertyFlags preferred = 0) const;
+  VkMemoryPropertyFlags getMemoryTypeFlags(uint32_t memoryTypeIndex) const {
+    return memoryProperties_.memoryTypes[memoryTypeIndex].propertyFlags;
+  }
+  VkDeviceSize getHeapSize(uint32_t memoryTypeIndex) const {
+    return memoryProperties_
+        .memoryHeaps[memoryProperties_.memoryTypes[memoryTypeIndex].heapIndex]
+        .size;
+  }
+
+  VkResult bindBuffer(VkBuffer buffer, const Allocation &allocation);
+  VkResult bindImage(VkImage image, const Allocation &allocation);
+
+  // Flush host writes / invalidate host caches for one allocation. No-ops on
+  // host coherent memory. Ranges are rounded to nonCoherentAtomSize, which
+  // allocations in non-coherent types are aligned to.
+  void flush(const Allocation &allocation);
+  void invalidate(const Allocation &allocation);
+
+  Stats getStats();
+  void logStats();
+
+private:
+  MemoryAllocator(const MemoryAllocator &) = delete;
+  MemoryAllocator &operator=(const MemoryAllocator &) = delete;
+
+  Block *createBlock(uint32_t memoryTypeIndex, VkDeviceSize size);
+  void destroyBlock(Block *block);
+  bool allocateFromBlock(Block *block, VkDeviceSize size,
+                         VkDeviceSize alignment, ResourceKind kind,
+                         Allocation *allocation);
+  bool isCoherent(uint32_t memoryTypeIndex) const;
+  VkMappedMemoryRange getMappedRange(const Allocation &allocation) const;
+
+  VkDevice device_ = VK_NULL_HANDLE;
+  VkPhysicalDeviceMemoryProperties memoryProperties_ = {};
+  VkDeviceSize blockSize_ = DEFAULT_BLOCK_SIZE;
+  VkDeviceSize bufferImageGranularity_ = 1;
+  VkDeviceSize nonCoherentAtomSize_ = 1;
+  std::vector<std::vector<Block *>> blocks_;
+  uint32_t deviceAllocationCount_ = 0;
+  std::mutex mutex_;
+};
+
+#endif
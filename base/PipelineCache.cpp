@@ -0,0 +1,200 @@
+/*
+ * Copyright (C) 2020 by Xu Xing (xu.xing@outlook.com)
+ *
+ * This code is licensed under the MIT license (MIT)
+ * (http://opensource.org/licenses/MIT)
+ */
+#include "PipelineCache.h"
+#include "ComputeOp.h"
+
+#include <fstream>
+#include <sys/stat.h>
+#if defined(_WIN32)
+#include <direct.h>
+#include <process.h>
+#define getpid _getpid
+#else
+#include <unistd.h>
+#endif
+
+namespace {
+
+const uint32_t FILE_MAGIC = 0x43504b56; // "VKPC"
+const uint32_t FILE_VERSION = 1;
+
+struct FileHeader {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t driverVersion;
+  uint32_t dataSize;
+  uint32_t checksum;
+};
+
+// FNV-1a. Never 0, which marks "no file".
+uint32_t checksumOf(const std::vector<char> &data) {
+  uint32_t hash = 2166136261u;
+  for (char c : data)
+    hash = (hash ^ (uint8_t)c) * 16777619u;
+  return hash ? hash : 1;
+}
+
+std::string hex(uint32_t value) {
+  char text[9];
+  snprintf(text, sizeof(text), "%08x", value);
+  return text;
+}
+
+} // namespace
+
+std::string PipelineCache::getDefaultDirectory() {
+  const char *directory = getenv("VULKAN_COMPUTE_PIPELINE_CACHE_DIR");
+  if (directory)
+    return directory;
+#if defined(_WIN32)
+  const char *base = getenv("LOCALAPPDATA");
+  return base ? std::string(base) + "\\vulkan_compute" : "";
+#else
+  const char *base = getenv("XDG_CACHE_HOME");
+  if (base)
+    return std::string(base) + "/vulkan_compute";
+  base = getenv("HOME");
+  return base ? std::string(base) + "/.cache/vulkan_compute" : "";
+#endif
+}
+
+PipelineCache::PipelineCache(VkDevice device,
+                             const VkPhysicalDeviceProperties &properties,
+                             const std::string &directory)
+    : device_(device), properties_(properties) {
+  std::vector<char> data;
+  if (!directory.empty()) {
+#if defined(_WIN32)
+    _mkdir(directory.c_str());
+#else
+    mkdir(directory.c_str(), 0755);
+#endif
+    std::string name = "pipeline_cache_" + hex(properties_.vendorID) + "_" +
+                       hex(properties_.deviceID) + "_";
+    for (uint32_t i = 0; i < VK_UUID_SIZE; i += 4) {
+      uint32_t word;
+      memcpy(&word, properties_.pipelineCacheUUID + i, sizeof(word));
+      name += hex(word);
+    }
+    path_ = directory + "/" + name + "_" + hex(properties_.driverVersion) +
+            ".bin";
+    data = readFile(&loadedChecksum_);
+    warm_ = !data.empty();
+  }
+  VkPipelineCacheCreateInfo pipelineCacheCreateInfo = {};
+  pipelineCacheCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+  pipelineCacheCreateInfo.initialDataSize = data.size();
+  pipelineCacheCreateInfo.pInitialData = data.empty() ? nullptr : data.data();
+  VK_CHECK_RESULT(vkCreatePipelineCache(device_, &pipelineCacheCreateInfo,
+                                        nullptr, &cache_));
+  LOG("Pipeline cache: %s, %s\n", path_.empty() ? "in memory" : path_.c_str(),
+      isWarm() ? "warm" : "cold");
+}
+
+PipelineCache::~PipelineCache() {
+  save();
+  vkDestroyPipelineCache(device_, cache_, nullptr);
+}
+
+bool PipelineCache::isCompatible(const std::vector<char> &data) const {
+  // Header of vkGetPipelineCacheData, version one.
+  const size_t headerSize = 16 + VK_UUID_SIZE;
+  if (data.size() < headerSize)
+    return false;
+  uint32_t header[4];
+  memcpy(header, data.data(), sizeof(header));
+  return header[0] >= headerSize &&
+         header[1] == VK_PIPELINE_CACHE_HEADER_VERSION_ONE &&
+         header[2] == properties_.vendorID &&
+         header[3] == properties_.deviceID &&
+         memcmp(data.data() + 16, properties_.pipelineCacheUUID,
+                VK_UUID_SIZE) == 0;
+}
+
+std::vector<char> PipelineCache::readFile(uint32_t *checksum) const {
+  *checksum = 0;
+  std::ifstream file(path_, std::ios::binary | std::ios::ate);
+  if (!file)
+    return std::vector<char>();
+  const std::streamoff fileSize = file.tellg();
+  FileHeader header;
+  // Check our header, and that the blob is exactly the rest of the file,
+  // before sizing anything by it.
+  if (!file.seekg(0) ||
+      !file.read(reinterpret_cast<char *>(&header), sizeof(header)) ||
+      header.magic != FILE_MAGIC || header.version != FILE_VERSION ||
+      header.driverVersion != properties_.driverVersion ||
+      (std::streamoff)header.dataSize !=
+          fileSize - (std::streamoff)sizeof(header)) {
+    LOG("Pipeline cache: ignoring invalid %s\n", path_.c_str());
+    return std::vector<char>();
+  }
+  std::vector<char> data(header.dataSize);
+  if (!file.read(data.data(), data.size()) ||
+      checksumOf(data) != header.checksum || !isCompatible(data)) {
+    LOG("Pipeline cache: ignoring invalid %s\n", path_.c_str());
+    return std::vector<char>();
+  }
+  *checksum = header.checksum;
+  return data;
+}
+
+VkResult PipelineCache::save() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (path_.empty())
+    return VK_SUCCESS;
+
+  // Take in what other processes saved since we loaded or last saved.
+  uint32_t diskChecksum;
+  std::vector<char> disk = readFile(&diskChecksum);
+  if (diskChecksum != 0 && diskChecksum != loadedChecksum_) {
+    VkPipelineCacheCreateInfo pipelineCacheCreateInfo = {};
+    pipelineCacheCreateInfo.sType =
+        VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+    pipelineCacheCreateInfo.initialDataSize = disk.size();
+    pipelineCacheCreateInfo.pInitialData = disk.data();
+    VkPipelineCache diskCache;
+    VK_CHECK_RESULT(vkCreatePipelineCache(device_, &pipelineCacheCreateInfo,
+                                          nullptr, &diskCache));
+    VK_CHECK_RESULT(vkMergePipelineCaches(device_, cache_, 1, &diskCache));
+    vkDestroyPipelineCache(device_, diskCache, nullptr);
+  }
+
+  size_t dataSize = 0;
+  VK_CHECK_RESULT(vkGetPipelineCacheData(device_, cache_, &dataSize, nullptr));
+  std::vector<char> data(dataSize);
+  VK_CHECK_RESULT(
+      vkGetPipelineCacheData(device_, cache_, &dataSize, data.data()));
+  data.resize(dataSize);
+  FileHeader header = {FILE_MAGIC, FILE_VERSION, properties_.driverVersion,
+                       (uint32_t)data.size(), checksumOf(data)};
+  if (header.checksum == diskChecksum)
+    return VK_SUCCESS;
+
+  // Write a file of our own, then rename it over the shared one.
+  const std::string tempPath = path_ + "." + std::to_string(getpid());
+  {
+    std::ofstream file(tempPath, std::ios::binary | std::ios::trunc);
+    file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    file.write(data.data(), data.size());
+    if (!file) {
+      LOG("Pipeline cache: cannot write %s\n", tempPath.c_str());
+      return VK_ERROR_INITIALIZATION_FAILED;
+    }
+  }
+#if defined(_WIN32)
+  // rename() does not replace existing files on Windows.
+  remove(path_.c_str());
+#endif
+  if (rename(tempPath.c_str(), path_.c_str()) != 0) {
+    LOG("Pipeline cache: cannot replace %s\n", path_.c_str());
+    remove(tempPath.c_str());
+    return VK_ERROR_INITIALIZATION_FAILED;
+  }
+  loadedChecksum_ = header.checksum;
+  return VK_SUCCESS;
+}
@@ -0,0 +1,70 @@
+/*
+ * Copyright (C) 2020 by Xu Xing (xu.xing@outlook.com)
+ *
+ * This code is licensed under the MIT license (MIT)
+ * (http://opensource.org/licenses/MIT)
+ */
+#ifndef PIPELINE_CACHE_H_
+#define PIPELINE_CACHE_H_
+
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "VulkanTools.h"
+#include <vulkan/vulkan.h>
+
+// A VkPipelineCache shared by the ops of a context and persisted across
+// process runs, so only the first run on a device pays for shader
+// compilation.
+//
+// The file name has the vendor, device, pipeline cache UUID and driver
+// version in it, and the file starts with a small header of ours (magic,
+// driver version, size, checksum) followed by the vkGetPipelineCacheData
+// blob. Loading checks both headers and starts empty on any mismatch, so
+// stale or truncated files are never handed to the driver.
+//
+// save() first merges in whatever is on disk by then, so processes that ran
+// at the same time keep each other's pipelines. The file is replaced by a
+// rename, so readers never see a partial file. Two processes saving at the
+// same instant can still drop the other's additions; they come back on the
+// next run.
+class PipelineCache {
+public:
+  // An empty directory keeps the cache in memory only.
+  PipelineCache(VkDevice device, const VkPhysicalDeviceProperties &properties,
+                const std::string &directory);
+  // Saves the cache.
+  ~PipelineCache();
+
+  VkPipelineCache get() const { return cache_; }
+  // Returns VK_ERROR_INITIALIZATION_FAILED if the file cannot be written.
+  VkResult save();
+  // Whether a valid file was loaded at startup.
+  bool isWarm() const { return warm_; }
+  const std::string &getPath() const { return path_; }
+
+  // $VULKAN_COMPUTE_PIPELINE_CACHE_DIR if set (empty disables the cache),
+  // otherwise a vulkan_compute directory in the user cache directory.
+  static std::string getDefaultDirectory();
+
+private:
+  PipelineCache(const PipelineCache &) = delete;
+  PipelineCache &operator=(const PipelineCache &) = delete;
+
+  // Reads the file and returns the validated vkGetPipelineCacheData blob, or
+  // an empty vector.
+  std::vector<char> readFile(uint32_t *checksum) const;
+  bool isCompatible(const std::vector<char> &data) const;
+
+  VkDevice device_ = VK_NULL_HANDLE;
+  VkPhysicalDeviceProperties properties_ = {};
+  std::string path_;
+  VkPipelineCache cache_ = VK_NULL_HANDLE;
+  // Checksum of the file contents loaded or last saved; 0 if none.
+  uint32_t loadedChecksum_ = 0;
+  bool warm_ = false;
+  std::mutex mutex_;
+};
+
+#endif
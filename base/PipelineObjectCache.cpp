@@ -0,0 +1,178 @@
+/*
+ * Copyright (C) 2020 by Xu Xing (xu.xing@outlook.com)
+ *
+ * This code is licensed under the MIT license (MIT)
+ * (http://opensource.org/licenses/MIT)
+ */
+#include "PipelineObjectCache.h"
+#include "ComputeOp.h"
+
+// FNV-1a, 64 bit.
+static uint64_t hashOf(const char *data, size_t size) {
+  uint64_t hash = 14695981039346656037ull;
+  for (size_t i = 0; i < size; i++)
+    hash = (hash ^ (uint8_t)data[i]) * 1099511628211ull;
+  return hash;
+}
+
+PipelineObjectCache::Layout::~Layout() {
+  vkDestroyPipelineLayout(device, pipelineLayout, nullptr);
+  vkDestroyDescriptorSetLayout(device, descriptorSetLayout, nullptr);
+}
+
+PipelineObjectCache::Pipeline::~Pipeline() {
+  vkDestroyPipeline(device, pipeline, nullptr);
+}
+
+bool PipelineObjectCache::Key::operator<(const Key &other) const {
+  if (shaderHash != other.shaderHash)
+    return shaderHash < other.shaderHash;
+  if (shaderSize != other.shaderSize)
+    return shaderSize < other.shaderSize;
+  if (pipelineLayout != other.pipelineLayout)
+    return pipelineLayout < other.pipelineLayout;
+  return specialization < other.specialization;
+}
+
+PipelineObjectCache::PipelineObjectCache(VkDevice device,
+                                         VkPipelineCache pipelineCache,
+                                         bool pushDescriptors, size_t capacity)
+    : device_(device), pipelineCache_(pipelineCache),
+      pushDescriptors_(pushDescriptors), capacity_(capacity) {
+  stats_.capacity = capacity_;
+}
+
+PipelineObjectCache::~PipelineObjectCache() {
+  // Anything still referenced belongs to an op that outlived its context.
+  pipelines_.clear();
+  lru_.clear();
+  layouts_.clear();
+}
+
+std::shared_ptr<const PipelineObjectCache::Layout>
+PipelineObjectCache::getLayout(
+    const std::vector<VkDescriptorSetLayoutBinding> &bindings,
+    uint32_t pushConstantSize) {
+  std::vector<uint32_t> key(1, pushConstantSize);
+  for (const auto &binding : bindings) {
+    key.push_back(binding.binding);
+    key.push_back(binding.descriptorType);
+    key.push_back(binding.descriptorCount);
+    key.push_back(binding.stageFlags);
+  }
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto found = layouts_.find(key);
+  if (found != layouts_.end())
+    return found->second;
+
+  std::shared_ptr<Layout> layout = std::make_shared<Layout>();
+  layout->device = device_;
+  layout->bindings = bindings;
+  // Every device with push descriptors allows at least 32 per set, far more
+  // than any op binds.
+  layout->pushDescriptor = pushDescriptors_;
+  VkDescriptorSetLayoutCreateInfo descriptorLayout =
+      vks::initializers::descriptorSetLayoutCreateInfo(bindings);
+  if (layout->pushDescriptor)
+    descriptorLayout.flags =
+        VK_DESCRIPTOR_SET_LAYOUT_CREATE_PUSH_DESCRIPTOR_BIT_KHR;
+  VK_CHECK_RESULT(vkCreateDescriptorSetLayout(
+      device_, &descriptorLayout, nullptr, &layout->descriptorSetLayout));
+  VkPipelineLayoutCreateInfo pipelineLayoutCreateInfo =
+      vks::initializers::pipelineLayoutCreateInfo(
+          &layout->descriptorSetLayout, 1);
+  VkPushConstantRange pushConstantRange = vks::initializers::pushConstantRange(
+      VK_SHADER_STAGE_COMPUTE_BIT, pushConstantSize, 0);
+  if (pushConstantSize > 0) {
+    pipelineLayoutCreateInfo.pushConstantRangeCount = 1;
+    pipelineLayoutCreateInfo.pPushConstantRanges = &pushConstantRange;
+  }
+  VK_CHECK_RESULT(vkCreatePipelineLayout(device_, &pipelineLayoutCreateInfo,
+                                         nullptr, &layout->pipelineLayout));
+  layouts_[key] = layout;
+  return layout;
+}
+
+std::shared_ptr<const PipelineObjectCache::Pipeline>
+PipelineObjectCache::getPipeline(
+    const std::vector<char> &code,
+    const VkSpecializationInfo &specializationInfo,
+    const std::shared_ptr<const Layout> &layout) {
+  Key key;
+  key.shaderHash = hashOf(code.data(), code.size());
+  key.shaderSize = code.size();
+  key.pipelineLayout = layout->pipelineLayout;
+  const char *entries =
+      reinterpret_cast<const char *>(specializationInfo.pMapEntries);
+  key.specialization.assign(entries,
+                            entries + specializationInfo.mapEntryCount *
+                                          sizeof(VkSpecializationMapEntry));
+  const char *data = static_cast<const char *>(specializationInfo.pData);
+  key.specialization.insert(key.specialization.end(), data,
+                            data + specializationInfo.dataSize);
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto found = pipelines_.find(key);
+  if (found != pipelines_.end()) {
+    stats_.hits++;
+    lru_.splice(lru_.begin(), lru_, found->second);
+    return found->second->second;
+  }
+  stats_.misses++;
+  if (code.empty())
+    return nullptr;
+
+  VkShaderModuleCreateInfo moduleCreateInfo = {};
+  moduleCreateInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+  moduleCreateInfo.codeSize = code.size();
+  moduleCreateInfo.pCode = reinterpret_cast<const uint32_t *>(code.data());
+  VkShaderModule shaderModule;
+  VK_CHECK_RESULT(
+      vkCreateShaderModule(device_, &moduleCreateInfo, nullptr, &shaderModule));
+
+  VkPipelineShaderStageCreateInfo shaderStage = {};
+  shaderStage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+  shaderStage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+  shaderStage.module = shaderModule;
+  shaderStage.pName = "main";
+  shaderStage.pSpecializationInfo = &specializationInfo;
+  VkComputePipelineCreateInfo computePipelineCreateInfo =
+      vks::initializers::computePipelineCreateInfo(layout->pipelineLayout, 0);
+  computePipelineCreateInfo.stage = shaderStage;
+
+  std::shared_ptr<Pipeline> pipeline = std::make_shared<Pipeline>();
+  pipeline->device = device_;
+  pipeline->layout = layout;
+  const VkResult result =
+      vkCreateComputePipelines(device_, pipelineCache_, 1,
+                               &computePipelineCreateInfo, nullptr,
+                               &pipeline->pipeline);
+  // The pipeline does not need the module once it is created.
+  vkDestroyShaderModule(device_, shaderModule, nullptr);
+  VK_CHECK_RESULT(result);
+
+  lru_.emplace_front(key, pipeline);
+  pipelines_[key] = lru_.begin();
+  while (lru_.size() > capacity_) {
+    pipelines_.erase(lru_.back().first);
+    lru_.pop_back();
+    stats_.evictions++;
+  }
+  return pipeline;
+}
+
+PipelineObjectCache::Stats PipelineObjectCache::getStats() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  Stats stats = stats_;
+  stats.size = lru_.size();
+  return stats;
+}
+
+void PipelineObjectCache::logStats() {
+  const Stats stats = getStats();
+  LOG("Pipeline object cache: %llu hits, %llu misses, %llu evictions, "
+      "%d/%d pipelines\n",
+      (unsigned long long)stats.hits, (unsigned long long)stats.misses,
+      (unsigned long long)stats.evictions, (int)stats.size,
+      (int)stats.capacity);
+}
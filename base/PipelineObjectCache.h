@@ -0,0 +1,103 @@
+/*
+ * Copyright (C) 2020 by Xu Xing (xu.xing@outlook.com)
+ *
+ * This code is licensed under the MIT license (MIT)
+ * (http://opensource.org/licenses/MIT)
+ */
+#ifndef PIPELINE_OBJECT_CACHE_H_
+#define PIPELINE_OBJECT_CACHE_H_
+
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "VulkanTools.h"
+#include <vulkan/vulkan.h>
+
+// Ready to use pipelines and layouts of a device, shared by the ops of a
+// context. Ops with the same shader, specialization constants and bindings
+// get the same VkPipeline and skip shader module and pipeline creation.
+//
+// Pipelines are keyed by a hash of the SPIR-V, the specialization data and
+// map entries, and the layout. The least recently used ones are dropped
+// once there are more than the capacity; ops holding one keep it alive until
+// they are destroyed. Layouts are keyed by their bindings and push constant
+// size and never dropped, as there are only a few. With push descriptors,
+// set layouts are created for vkCmdPushDescriptorSetKHR and ops record their
+// bindings into the command buffer instead of allocating a set.
+class PipelineObjectCache {
+public:
+  struct Layout {
+    VkDevice device = VK_NULL_HANDLE;
+    VkDescriptorSetLayout descriptorSetLayout = VK_NULL_HANDLE;
+    VkPipelineLayout pipelineLayout = VK_NULL_HANDLE;
+    std::vector<VkDescriptorSetLayoutBinding> bindings;
+    bool pushDescriptor = false;
+    ~Layout();
+  };
+  struct Pipeline {
+    VkDevice device = VK_NULL_HANDLE;
+    std::shared_ptr<const Layout> layout;
+    VkPipeline pipeline = VK_NULL_HANDLE;
+    ~Pipeline();
+  };
+  struct Stats {
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+    uint64_t evictions = 0;
+    size_t size = 0;
+    size_t capacity = 0;
+  };
+
+  static const size_t DEFAULT_CAPACITY = 64;
+
+  // Pipelines are created through pipelineCache. pushDescriptors requires
+  // VK_KHR_push_descriptor on the device.
+  PipelineObjectCache(VkDevice device, VkPipelineCache pipelineCache,
+                      bool pushDescriptors = false,
+                      size_t capacity = DEFAULT_CAPACITY);
+  ~PipelineObjectCache();
+
+  // pushConstantSize bytes of push constants at offset 0 are visible to the
+  // compute stage.
+  std::shared_ptr<const Layout>
+  getLayout(const std::vector<VkDescriptorSetLayoutBinding> &bindings,
+            uint32_t pushConstantSize = 0);
+  // code is SPIR-V; the entry point is "main". Returns null if the pipeline
+  // cannot be created.
+  std::shared_ptr<const Pipeline>
+  getPipeline(const std::vector<char> &code,
+              const VkSpecializationInfo &specializationInfo,
+              const std::shared_ptr<const Layout> &layout);
+
+  Stats getStats();
+  void logStats();
+
+private:
+  struct Key {
+    uint64_t shaderHash;
+    size_t shaderSize;
+    std::vector<char> specialization;
+    VkPipelineLayout pipelineLayout;
+    bool operator<(const Key &other) const;
+  };
+  typedef std::list<std::pair<Key, std::shared_ptr<const Pipeline>>> LruList;
+
+  PipelineObjectCache(const PipelineObjectCache &) = delete;
+  PipelineObjectCache &operator=(const PipelineObjectCache &) = delete;
+
+  VkDevice device_ = VK_NULL_HANDLE;
+  VkPipelineCache pipelineCache_ = VK_NULL_HANDLE;
+  bool pushDescriptors_ = false;
+  size_t capacity_ = DEFAULT_CAPACITY;
+  std::map<std::vector<uint32_t>, std::shared_ptr<const Layout>> layouts_;
+  // Most recently used first.
+  LruList lru_;
+  std::map<Key, LruList::iterator> pipelines_;
+  Stats stats_;
+  std::mutex mutex_;
+};
+
+#endif
@@ -0,0 +1,144 @@
+/*
+ * Copyright (C) 2020 by Xu Xing (xu.xing@outlook.com)
+ *
+ * This code is licensed under the MIT license (MIT)
+ * (http://opensource.org/licenses/MIT)
+ */
+#include "QueueTimeline.h"
+
+QueueTimeline::QueueTimeline(VkDevice device, VkQueue queue)
+    : device_(device), queue_(queue) {}
+
+QueueTimeline::~QueueTimeline() {
+  {
+    std::lock_guard<std::mutex> lock(callbackMutex_);
+    stopping_ = true;
+  }
+  callbackCondition_.notify_one();
+  // Pending callbacks still run before the thread exits.
+  if (completionThread_.joinable())
+    completionThread_.join();
+  waitIdle();
+  for (auto fence : freeFences_)
+    vkDestroyFence(device_, fence, nullptr);
+}
+
+VkFence QueueTimeline::acquireFence() {
+  if (!freeFences_.empty()) {
+    VkFence fence = freeFences_.back();
+    freeFences_.pop_back();
+    return fence;
+  }
+  VkFenceCreateInfo fenceInfo =
+      vks::initializers::fenceCreateInfo(VK_FLAGS_NONE);
+  VkFence fence;
+  VK_CHECK_RESULT(vkCreateFence(device_, &fenceInfo, nullptr, &fence));
+  fenceCount_++;
+  return fence;
+}
+
+// Moves signaled fences back to the free list. Called with mutex_ held.
+void QueueTimeline::retire() {
+  while (!pending_.empty()) {
+    const Pending &pending = pending_.front();
+    if (pending.value > completed_ &&
+        vkGetFenceStatus(device_, pending.fence) != VK_SUCCESS)
+      break;
+    completed_ = std::max(completed_, pending.value);
+    if (waiters_ > 0)
+      break;
+    VK_CHECK_RESULT(vkResetFences(device_, 1, &pending.fence));
+    freeFences_.push_back(pending.fence);
+    pending_.pop_front();
+  }
+}
+
+VkResult QueueTimeline::submit(uint32_t submitCount,
+                               const VkSubmitInfo *submits, uint64_t *value) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  retire();
+  VkFence fence = acquireFence();
+  VkResult result = vkQueueSubmit(queue_, submitCount, submits, fence);
+  if (result != VK_SUCCESS) {
+    freeFences_.push_back(fence);
+    return result;
+  }
+  lastSubmitted_++;
+  pending_.push_back({lastSubmitted_, fence});
+  if (value)
+    *value = lastSubmitted_;
+  return VK_SUCCESS;
+}
+
+bool QueueTimeline::isComplete(uint64_t value) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (value <= completed_)
+    return true;
+  retire();
+  return value <= completed_;
+}
+
+VkResult QueueTimeline::wait(uint64_t value) {
+  VkFence fence = VK_NULL_HANDLE;
+  uint64_t fenceValue = 0;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    assert(value <= lastSubmitted_);
+    if (value <= completed_)
+      return VK_SUCCESS;
+    // The first submission at or after value covers it.
+    for (auto &pending : pending_) {
+      if (pending.value >= value) {
+        fence = pending.fence;
+        fenceValue = pending.value;
+        break;
+      }
+    }
+    assert(fence != VK_NULL_HANDLE);
+    waiters_++;
+  }
+  VkResult result = vkWaitForFences(device_, 1, &fence, VK_TRUE, UINT64_MAX);
+  std::lock_guard<std::mutex> lock(mutex_);
+  waiters_--;
+  if (result == VK_SUCCESS)
+    completed_ = std::max(completed_, fenceValue);
+  retire();
+  return result;
+}
+
+VkResult QueueTimeline::waitIdle() {
+  return wait(getLastSubmitted());
+}
+
+uint64_t QueueTimeline::getLastSubmitted() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return lastSubmitted_;
+}
+
+void QueueTimeline::onComplete(uint64_t value,
+                               std::function<void()> callback) {
+  {
+    std::lock_guard<std::mutex> lock(callbackMutex_);
+    assert(!stopping_);
+    callbacks_.push_back({value, std::move(callback)});
+    if (!completionThread_.joinable())
+      completionThread_ = std::thread(&QueueTimeline::completionLoop, this);
+  }
+  callbackCondition_.notify_one();
+}
+
+void QueueTimeline::completionLoop() {
+  std::unique_lock<std::mutex> lock(callbackMutex_);
+  while (true) {
+    callbackCondition_.wait(
+        lock, [this] { return stopping_ || !callbacks_.empty(); });
+    if (callbacks_.empty())
+      break;
+    Callback callback = std::move(callbacks_.front());
+    callbacks_.pop_front();
+    lock.unlock();
+    VK_CHECK_RESULT(wait(callback.value));
+    callback.function();
+    lock.lock();
+  }
+}
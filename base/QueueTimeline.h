@@ -0,0 +1,96 @@
+/*
+ * Copyright (C) 2020 by Xu Xing (xu.xing@outlook.com)
+ *
+ * This code is licensed under the MIT license (MIT)
+ * (http://opensource.org/licenses/MIT)
+ */
+#ifndef QUEUE_TIMELINE_H_
+#define QUEUE_TIMELINE_H_
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "VulkanTools.h"
+#include <vulkan/vulkan.h>
+
+// Gives every submission to a queue a monotonically increasing value, so
+// callers wait for specific work instead of the whole queue. Value N is
+// complete once submission N and everything submitted before it finished.
+//
+// This follows timeline semaphore semantics but is backed by a pool of
+// recycled fences, since the target drivers are Vulkan 1.0 and mostly lack
+// VK_KHR_timeline_semaphore. A fence signal covers all earlier submissions
+// on the queue, so one fence per submission is enough.
+//
+// All submissions to the queue must go through submit(), which also provides
+// the external synchronization vkQueueSubmit requires.
+//
+// onComplete() runs a callback once a value completes, on a completion thread
+// the timeline starts on first use. Callbacks run one at a time, in the order
+// they were added, and must not submit to the timeline or wait on it.
+class QueueTimeline {
+public:
+  QueueTimeline(VkDevice device, VkQueue queue);
+  ~QueueTimeline();
+
+  // Submits the batches and returns, in value, the timeline value they
+  // complete. value may be null.
+  VkResult submit(uint32_t submitCount, const VkSubmitInfo *submits,
+                  uint64_t *value = nullptr);
+  // Returns without blocking.
+  bool isComplete(uint64_t value);
+  VkResult wait(uint64_t value);
+  // Waits for everything submitted so far.
+  VkResult waitIdle();
+  // Calls callback on the completion thread once value is complete.
+  void onComplete(uint64_t value, std::function<void()> callback);
+
+  VkQueue getQueue() const { return queue_; }
+  uint64_t getLastSubmitted();
+  // Fences created over the timeline lifetime. This stays small in steady
+  // state because fences are recycled.
+  uint32_t getFenceCount() const { return fenceCount_; }
+
+private:
+  struct Pending {
+    uint64_t value;
+    VkFence fence;
+  };
+
+  QueueTimeline(const QueueTimeline &) = delete;
+  QueueTimeline &operator=(const QueueTimeline &) = delete;
+
+  struct Callback {
+    uint64_t value;
+    std::function<void()> function;
+  };
+
+  VkFence acquireFence();
+  void retire();
+  void completionLoop();
+
+  VkDevice device_ = VK_NULL_HANDLE;
+  VkQueue queue_ = VK_NULL_HANDLE;
+  std::deque<Pending> pending_;
+  std::vector<VkFence> freeFences_;
+  uint64_t lastSubmitted_ = 0;
+  uint64_t completed_ = 0;
+  // Fences are not recycled while a thread waits on one without the lock.
+  uint32_t waiters_ = 0;
+  uint32_t fenceCount_ = 0;
+  std::mutex mutex_;
+
+  // Guarded by callbackMutex_, not mutex_, so callbacks never hold up
+  // submissions.
+  std::deque<Callback> callbacks_;
+  bool stopping_ = false;
+  std::thread completionThread_;
+  std::mutex callbackMutex_;
+  std::condition_variable callbackCondition_;
+};
+
+#endif
@@ -0,0 +1,133 @@
+/*
+ * Copyright (C) 2020 by Xu Xing (xu.xing@outlook.com)
+ *
+ * This code is licensed under the MIT license (MIT)
+ * (http://opensource.org/licenses/MIT)
+ */
+#include "ShardedBufferOp.h"
+#include "Utils.h"
+
+ShardedBufferOp::ShardedBufferOp(
+    const InitParams &init_params,
+    const std::vector<std::shared_ptr<ComputeContext>> &contexts,
+    const std::vector<double> &weights) {
+  params_ = init_params;
+  assert(!contexts.empty());
+  assert(weights.empty() || weights.size() == contexts.size());
+  assert(params_.outputWidth == params_.inputWidth &&
+         params_.outputHeight == params_.inputHeight);
+  // Shards split rows of a single plane.
+  assert(params_.batch == 1 && params_.inputChannels == 1 &&
+         params_.outputChannels == 1);
+  const bool splitFilter = params_.filterWidth == params_.inputWidth &&
+                           params_.filterHeight == params_.inputHeight;
+
+  // Split in whole workgroup rows so no shard dispatches past its end.
+  const int rowsPerGroup = params_.WORKGROUPSIZE_Y;
+  const int groups = (params_.inputHeight + rowsPerGroup - 1) / rowsPerGroup;
+  double totalWeight = 0.0;
+  for (size_t i = 0; i < contexts.size(); i++)
+    totalWeight += weights.empty() ? 1.0 : weights[i];
+
+  int y = 0;
+  double weightSoFar = 0.0;
+  for (size_t i = 0; i < contexts.size() && y < params_.inputHeight; i++) {
+    weightSoFar += weights.empty() ? 1.0 : weights[i];
+    const int endGroup =
+        i + 1 == contexts.size()
+            ? groups
+            : (int)(groups * weightSoFar / totalWeight + 0.5);
+    const int end = std::min(endGroup * rowsPerGroup, params_.inputHeight);
+    if (end <= y)
+      continue;
+
+    Shard shard;
+    shard.y = y;
+    shard.height = end - y;
+    InitParams shardParams = params_;
+    shardParams.inputHeight = shard.height;
+    shardParams.outputHeight = shard.height;
+    shardParams.DISPATCH_Y =
+        (shard.height + rowsPerGroup - 1) / rowsPerGroup;
+    if (splitFilter) {
+      const ElementVector &filter = params_.computeFilter;
+      shardParams.filterHeight = shard.height;
+      shardParams.computeFilter.reset(filter.getElementType(),
+                                      params_.filterWidth * shard.height);
+      gather(static_cast<const char *>(filter.data()),
+             ::getElementSize(filter.getElementType()), params_.filterWidth,
+             params_.filterHeight, y, shard.height,
+             static_cast<char *>(shardParams.computeFilter.data()));
+    }
+    shardParams.computeInput.clear();
+    shardParams.computeOutput.clear();
+    shard.context = contexts[i];
+    shard.op.reset(new ComputeBufferOp(shardParams, shard.context));
+    shards_.push_back(std::move(shard));
+    y = end;
+  }
+}
+
+ShardedBufferOp::~ShardedBufferOp() {}
+
+void ShardedBufferOp::gather(const char *src, size_t elementSize, int width,
+                             int height, int y, int rows, char *dst) {
+  for (int x = 0; x < width; x++)
+    memcpy(dst + (size_t)x * rows * elementSize,
+           src + ((size_t)x * height + y) * elementSize, rows * elementSize);
+}
+
+void ShardedBufferOp::scatter(const char *src, size_t elementSize, int width,
+                              int height, int y, int rows, char *dst) {
+  for (int x = 0; x < width; x++)
+    memcpy(dst + ((size_t)x * height + y) * elementSize,
+           src + (size_t)x * rows * elementSize, rows * elementSize);
+}
+
+void ShardedBufferOp::prepare() {
+  // Each shard records into its own context, so they can prepare at once.
+  std::vector<std::future<void>> prepared;
+  for (auto &shard : shards_) {
+    ComputeBufferOp *op = shard.op.get();
+    prepared.push_back(
+        std::async(std::launch::async, [op] { op->prepare(); }));
+  }
+  for (auto &future : prepared)
+    future.get();
+  prepared_ = true;
+}
+
+void ShardedBufferOp::run(const std::vector<DATA_TYPE> &input,
+                          std::vector<DATA_TYPE> &output) {
+  assert(input.size() >= (size_t)(params_.inputWidth * params_.inputHeight));
+  output.resize(params_.outputWidth * params_.outputHeight);
+  run(input.data(), output.data());
+}
+
+void ShardedBufferOp::runElements(const void *input, void *output) {
+  assert(prepared_);
+  const int width = params_.inputWidth;
+  const int height = params_.inputHeight;
+  const size_t elementSize = getElementSize();
+
+  std::vector<std::future<void>> done;
+  for (auto &shard : shards_) {
+    shard.input.reset(params_.elementType, width * shard.height);
+    gather(static_cast<const char *>(input), elementSize, width, height,
+           shard.y, shard.height, static_cast<char *>(shard.input.data()));
+    Shard *s = &shard;
+    done.push_back(std::async(std::launch::async,
+                              [s] { s->op->run(s->input, s->output); }));
+  }
+  for (auto &future : done)
+    future.get();
+  for (auto &shard : shards_)
+    scatter(static_cast<const char *>(shard.output.data()), elementSize,
+            width, height, shard.y, shard.height,
+            static_cast<char *>(output));
+}
+
+void ShardedBufferOp::execute() {
+  TIME("execute:prepare", prepare());
+  TIME("execute:run", run(params_.computeInput, params_.computeOutput));
+}
@@ -0,0 +1,66 @@
+/*
+ * Copyright (C) 2020 by Xu Xing (xu.xing@outlook.com)
+ *
+ * This code is licensed under the MIT license (MIT)
+ * (http://opensource.org/licenses/MIT)
+ */
+#ifndef SHARDED_BUFFER_OP_H_
+#define SHARDED_BUFFER_OP_H_
+#include "ComputeBufferOp.h"
+
+// Splits a buffer op along the height across several contexts, usually one
+// per device, and merges the outputs. Each shard is a ComputeBufferOp over a
+// band of rows; shards are prepared and run in parallel, one thread each.
+//
+// A shard only sees its own rows, so this is for ops whose output at a
+// position depends on the input and filter at that position only (like add).
+// A filter with the input's shape is split with it, any other filter is
+// given whole to every shard.
+//
+// Shard heights are multiples of WORKGROUPSIZE_Y except for the last one, and
+// follow weights (e.g. measured device throughput) when given, otherwise they
+// are equal.
+class ShardedBufferOp : public ComputeOp {
+public:
+  ShardedBufferOp(const InitParams &init_params,
+                  const std::vector<std::shared_ptr<ComputeContext>> &contexts,
+                  const std::vector<double> &weights = std::vector<double>());
+  void execute();
+  void prepare();
+  void run(const std::vector<DATA_TYPE> &input,
+           std::vector<DATA_TYPE> &output);
+  using ComputeOp::run;
+  virtual ~ShardedBufferOp();
+
+  uint32_t getShardCount() const { return (uint32_t)shards_.size(); }
+  // First row and height of a shard.
+  int getShardY(uint32_t shard) const { return shards_[shard].y; }
+  int getShardHeight(uint32_t shard) const { return shards_[shard].height; }
+  std::shared_ptr<ComputeContext> getShardContext(uint32_t shard) const {
+    return shards_[shard].context;
+  }
+
+protected:
+  // Shards get their rows already of InitParams::elementType.
+  void runElements(const void *input, void *output);
+
+private:
+  struct Shard {
+    std::shared_ptr<ComputeContext> context;
+    std::unique_ptr<ComputeBufferOp> op;
+    int y = 0;
+    int height = 0;
+    ElementVector input;
+    ElementVector output;
+  };
+
+  // Elements of elementSize bytes are stored at y + height * x, so a band of
+  // rows is a strided run of height elements per column.
+  static void gather(const char *src, size_t elementSize, int width,
+                     int height, int y, int rows, char *dst);
+  static void scatter(const char *src, size_t elementSize, int width,
+                      int height, int y, int rows, char *dst);
+
+  std::vector<Shard> shards_;
+};
+#endif
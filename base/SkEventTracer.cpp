@@ -0,0 +1,60 @@
+/*
+ * Copyright (C) 2020 by Xu Xing (xu.xing@outlook.com)
+ *
+ * This code is licensed under the MIT license (MIT)
+ * (http://opensource.org/licenses/MIT)
+ */
+#include "SkEventTracer.h"
+
+#include <atomic>
+#include <stdlib.h>
+
+namespace {
+
+// Installed when nothing else was: every category is disabled, so the trace
+// macros stop at the flag check.
+class DefaultEventTracer : public SkEventTracer {
+public:
+  const uint8_t *getCategoryGroupEnabled(const char * /*name*/) override {
+    static const uint8_t disabled = 0;
+    return &disabled;
+  }
+  const char *
+  getCategoryGroupName(const uint8_t * /*categoryEnabledFlag*/) override {
+    return "";
+  }
+  SkEventTracer::Handle
+  addTraceEvent(char /*phase*/, const uint8_t * /*categoryEnabledFlag*/,
+                const char * /*name*/, uint64_t /*id*/, int32_t /*numArgs*/,
+                const char ** /*argNames*/, const uint8_t * /*argTypes*/,
+                const uint64_t * /*argValues*/, uint8_t /*flags*/) override {
+    return 0;
+  }
+  void updateTraceEventDuration(const uint8_t * /*categoryEnabledFlag*/,
+                                const char * /*name*/,
+                                SkEventTracer::Handle /*handle*/) override {}
+};
+
+std::atomic<SkEventTracer *> instance{nullptr};
+
+void deleteInstance() { delete instance.exchange(nullptr); }
+
+} // namespace
+
+bool SkEventTracer::SetInstance(SkEventTracer *tracer) {
+  SkEventTracer *expected = nullptr;
+  if (!instance.compare_exchange_strong(expected, tracer)) {
+    delete tracer;
+    return false;
+  }
+  atexit(deleteInstance);
+  return true;
+}
+
+SkEventTracer *SkEventTracer::GetInstance() {
+  SkEventTracer *tracer = instance.load(std::memory_order_acquire);
+  if (tracer)
+    return tracer;
+  SetInstance(new DefaultEventTracer());
+  return instance.load(std::memory_order_acquire);
+}
@@ -8,6 +8,8 @@
 #ifndef SkEventTracer_DEFINED
 #define SkEventTracer_DEFINED
 
+#include <stdint.h>
+
 // The class in this header defines the interface between Skia's internal
 // tracing macros and an external entity (e.g., Chrome) that will consume them.
 // Such an entity should subclass SkEventTracer and provide an instance of
@@ -0,0 +1,250 @@
+/*
+ * Copyright (C) 2020 by Xu Xing (xu.xing@outlook.com)
+ *
+ * This code is licensed under the MIT license (MIT)
+ * (http://opensource.org/licenses/MIT)
+ */
+#include "StagingRing.h"
+#include "ComputeOp.h"
+
+static VkDeviceSize alignUp(VkDeviceSize value, VkDeviceSize alignment) {
+  return (value + alignment - 1) / alignment * alignment;
+}
+
+StagingRing::StagingRing(VkDevice device, VkPhysicalDevice physicalDevice,
+                         TransferQueue &transferQueue,
+                         MemoryAllocator &allocator, GpuProfiler &profiler,
+                         uint32_t timestampValidBits, VkDeviceSize size)
+    : device_(device), transferQueue_(transferQueue), allocator_(allocator),
+      profiler_(profiler), timestampValidBits_(timestampValidBits),
+      size_(size) {
+  VkPhysicalDeviceProperties deviceProperties;
+  vkGetPhysicalDeviceProperties(physicalDevice, &deviceProperties);
+  // Offsets must be a multiple of 4 and of the texel size for image copies;
+  // 16 covers every format used here.
+  alignment_ = std::max<VkDeviceSize>(
+      16, deviceProperties.limits.optimalBufferCopyOffsetAlignment);
+
+  VkBufferCreateInfo bufferCreateInfo = vks::initializers::bufferCreateInfo(
+      VK_BUFFER_USAGE_TRANSFER_SRC_BIT, size_);
+  bufferCreateInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+  VK_CHECK_RESULT(
+      vkCreateBuffer(device_, &bufferCreateInfo, nullptr, &buffer_));
+  VkMemoryRequirements memReqs;
+  vkGetBufferMemoryRequirements(device_, buffer_, &memReqs);
+  // Prefer coherent memory so uploads need no flush, and keep out of a
+  // device local (BAR) heap: the ring only feeds copies.
+  const uint32_t memoryTypeIndex = allocator_.selectMemoryType(
+      memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT,
+      VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+  assert(memoryTypeIndex != UINT32_MAX);
+  VK_CHECK_RESULT(allocator_.allocate(memReqs, memoryTypeIndex,
+                                      MemoryAllocator::RESOURCE_LINEAR,
+                                      &memory_));
+  VK_CHECK_RESULT(allocator_.bindBuffer(buffer_, memory_));
+  mapped_ = static_cast<char *>(memory_.mapped);
+}
+
+StagingRing::~StagingRing() {
+  finish();
+  vkDestroyBuffer(device_, buffer_, nullptr);
+  allocator_.free(memory_);
+}
+
+bool StagingRing::tryAllocate(VkDeviceSize size, VkDeviceSize *offset) {
+  if (used_ == 0)
+    head_ = tail_ = 0;
+  const VkDeviceSize start = alignUp(head_, alignment_);
+  // In use is [tail_, head_) when head_ > tail_, otherwise it wraps around.
+  if (used_ == 0 || head_ > tail_) {
+    if (start + size <= size_) {
+      used_ += start - head_ + size;
+      current_.bytes += start - head_ + size;
+      head_ = start + size;
+      *offset = start;
+      return true;
+    }
+    // Wrap to the front; the tail of the ring is wasted until reclaimed.
+    if (used_ > 0 && size <= tail_) {
+      used_ += size_ - head_ + size;
+      current_.bytes += size_ - head_ + size;
+      head_ = size;
+      *offset = 0;
+      return true;
+    }
+    return false;
+  }
+  if (start + size <= tail_) {
+    used_ += start - head_ + size;
+    current_.bytes += start - head_ + size;
+    head_ = start + size;
+    *offset = start;
+    return true;
+  }
+  return false;
+}
+
+VkDeviceSize StagingRing::allocate(VkDeviceSize size) {
+  assert(size <= size_);
+  VkDeviceSize offset = 0;
+  while (!tryAllocate(size, &offset)) {
+    reclaim(false);
+    if (tryAllocate(size, &offset))
+      break;
+    // Only the pending batch holds the space: submit it so it can retire.
+    if (inFlight_.empty())
+      submitBatch();
+    stallCount_++;
+    reclaim(true);
+  }
+  return offset;
+}
+
+VkCommandBuffer StagingRing::getCommandBuffer() {
+  if (recording_)
+    return current_.commandBuffer;
+  // Space may already have been taken for the first copy of this batch.
+  const VkDeviceSize bytes = current_.bytes;
+  current_ = Batch();
+  current_.bytes = bytes;
+  current_.commandBuffer = transferQueue_.begin();
+  current_.range =
+      profiler_.allocate("staging_ring:upload", timestampValidBits_);
+  profiler_.begin(current_.commandBuffer, current_.range);
+  recording_ = true;
+  return current_.commandBuffer;
+}
+
+VkResult StagingRing::submitBatch() {
+  if (!recording_)
+    return VK_SUCCESS;
+  profiler_.end(current_.commandBuffer, current_.range);
+  VK_CHECK_RESULT(transferQueue_.submit(current_.commandBuffer,
+                                        current_.toCompute, &current_.value));
+  profiler_.submitted(current_.range, transferQueue_.getTimeline(),
+                      current_.value);
+  profiler_.release(current_.range);
+  lastValue_ = current_.value;
+  current_.end = head_;
+  inFlight_.push_back(current_);
+  current_ = Batch();
+  recording_ = false;
+  submitCount_++;
+  return VK_SUCCESS;
+}
+
+void StagingRing::reclaim(bool wait) {
+  QueueTimeline &timeline = transferQueue_.getTimeline();
+  if (wait && !inFlight_.empty())
+    VK_CHECK_RESULT(timeline.wait(inFlight_.front().value));
+  while (!inFlight_.empty() &&
+         timeline.isComplete(inFlight_.front().value)) {
+    tail_ = inFlight_.front().end;
+    used_ -= inFlight_.front().bytes;
+    inFlight_.pop_front();
+  }
+}
+
+VkResult StagingRing::uploadToBuffer(VkBuffer dstBuffer,
+                                     VkDeviceSize dstOffset, const void *src,
+                                     VkDeviceSize size) {
+  assert(src);
+  std::lock_guard<std::mutex> lock(mutex_);
+  const VkDeviceSize maxChunk = size_ / 2;
+  const char *bytes = static_cast<const char *>(src);
+  for (VkDeviceSize done = 0; done < size;) {
+    const VkDeviceSize chunk = std::min(maxChunk, size - done);
+    const VkDeviceSize offset = allocate(chunk);
+    memcpy(mapped_ + offset, bytes + done, chunk);
+    VkBufferCopy copyRegion = {};
+    copyRegion.srcOffset = offset;
+    copyRegion.dstOffset = dstOffset + done;
+    copyRegion.size = chunk;
+    vkCmdCopyBuffer(getCommandBuffer(), buffer_, dstBuffer, 1, &copyRegion);
+    // A chunk may land in a later batch than the previous one, so each batch
+    // hands over the ranges it wrote.
+    current_.toCompute.addBuffer(
+        dstBuffer, VK_ACCESS_TRANSFER_WRITE_BIT,
+        VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT |
+            VK_ACCESS_TRANSFER_READ_BIT,
+        dstOffset + done, chunk);
+    done += chunk;
+  }
+  allocator_.flush(memory_);
+  uploadedBytes_ += size;
+  return VK_SUCCESS;
+}
+
+VkResult StagingRing::uploadToImage(VkImage image, const VkExtent3D &extent,
+                                    const void *src, VkDeviceSize size) {
+  assert(src);
+  assert(extent.depth == 1 && extent.height > 0);
+  std::lock_guard<std::mutex> lock(mutex_);
+  const VkDeviceSize rowBytes = size / extent.height;
+  const uint32_t rowsPerChunk =
+      (uint32_t)std::max<VkDeviceSize>(1, (size_ / 2) / rowBytes);
+  assert(rowBytes <= size_);
+
+  VkImageMemoryBarrier imageMemoryBarrier =
+      vks::initializers::imageMemoryBarrier();
+  imageMemoryBarrier.image = image;
+  imageMemoryBarrier.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0,
+                                         1};
+  imageMemoryBarrier.srcAccessMask = 0;
+  imageMemoryBarrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+  imageMemoryBarrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+  imageMemoryBarrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+  vkCmdPipelineBarrier(getCommandBuffer(), VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
+                       VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0,
+                       nullptr, 1, &imageMemoryBarrier);
+
+  const char *bytes = static_cast<const char *>(src);
+  for (uint32_t row = 0; row < extent.height; row += rowsPerChunk) {
+    const uint32_t rows = std::min(rowsPerChunk, extent.height - row);
+    const VkDeviceSize offset = allocate(rows * rowBytes);
+    memcpy(mapped_ + offset, bytes + row * rowBytes, rows * rowBytes);
+    VkBufferImageCopy bufferCopyRegion = {};
+    bufferCopyRegion.bufferOffset = offset;
+    bufferCopyRegion.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    bufferCopyRegion.imageSubresource.mipLevel = 0;
+    bufferCopyRegion.imageSubresource.baseArrayLayer = 0;
+    bufferCopyRegion.imageSubresource.layerCount = 1;
+    bufferCopyRegion.imageOffset = {0, (int32_t)row, 0};
+    bufferCopyRegion.imageExtent = {extent.width, rows, 1};
+    vkCmdCopyBufferToImage(getCommandBuffer(), buffer_, image,
+                           VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1,
+                           &bufferCopyRegion);
+  }
+
+  // The transition back to GENERAL is part of the handoff at the end of the
+  // batch. Earlier batches keep the image in TRANSFER_DST_OPTIMAL, which is
+  // what their copies used.
+  bool pending = false;
+  for (const auto &barrier : current_.toCompute.images)
+    pending = pending || barrier.image == image;
+  if (!pending)
+    current_.toCompute.addImage(
+        image, VK_ACCESS_TRANSFER_WRITE_BIT,
+        VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT,
+        VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_GENERAL);
+  allocator_.flush(memory_);
+  uploadedBytes_ += size;
+  return VK_SUCCESS;
+}
+
+VkResult StagingRing::flush(uint64_t *value) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  reclaim(false);
+  VK_CHECK_RESULT(submitBatch());
+  if (value)
+    *value = lastValue_;
+  return VK_SUCCESS;
+}
+
+VkResult StagingRing::finish() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  VK_CHECK_RESULT(submitBatch());
+  while (!inFlight_.empty())
+    reclaim(true);
+  return VK_SUCCESS;
+}
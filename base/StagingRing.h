@@ -0,0 +1,111 @@
+/*
+ * Copyright (C) 2020 by Xu Xing (xu.xing@outlook.com)
+ *
+ * This code is licensed under the MIT license (MIT)
+ * (http://opensource.org/licenses/MIT)
+ */
+#ifndef STAGING_RING_H_
+#define STAGING_RING_H_
+
+#include <deque>
+#include <mutex>
+#include <vector>
+
+#include "GpuProfiler.h"
+#include "MemoryAllocator.h"
+#include "TransferQueue.h"
+#include "VulkanTools.h"
+#include <vulkan/vulkan.h>
+
+// A persistently mapped host visible buffer used as a ring for host to device
+// uploads. Each upload memcpys into the ring and records a copy into the
+// current batch command buffer; nothing is submitted until flush(), so many
+// uploads share one submission. Every submitted batch gets a transfer
+// timeline value, and its ring space is reclaimed once that value completes.
+// Uploads only block when the ring is full.
+//
+// Batches run on the transfer queue, which hands the destinations over to
+// the compute queue, so a dispatch submitted after flush() sees the uploaded
+// data without any extra wait. Uploads replace the destination contents and
+// must not target resources a pending dispatch still reads. Each batch is a
+// "staging_ring:upload" range of the profiler.
+class StagingRing {
+public:
+  static const VkDeviceSize DEFAULT_SIZE = 32 * 1024 * 1024;
+
+  StagingRing(VkDevice device, VkPhysicalDevice physicalDevice,
+              TransferQueue &transferQueue, MemoryAllocator &allocator,
+              GpuProfiler &profiler, uint32_t timestampValidBits,
+              VkDeviceSize size = DEFAULT_SIZE);
+  ~StagingRing();
+
+  // Queues a copy of size bytes from src into dstBuffer at dstOffset.
+  // Uploads larger than the ring are split.
+  VkResult uploadToBuffer(VkBuffer dstBuffer, VkDeviceSize dstOffset,
+                          const void *src, VkDeviceSize size);
+  // Queues a tightly packed upload of src into mip 0 of image. The image is
+  // left in VK_IMAGE_LAYOUT_GENERAL. Uploads larger than the ring are split
+  // by rows.
+  VkResult uploadToImage(VkImage image, const VkExtent3D &extent,
+                         const void *src, VkDeviceSize size);
+
+  // Submits the pending batch, if any, without waiting. Returns the transfer
+  // timeline value of the last upload submission (0 if there was none).
+  VkResult flush(uint64_t *value = nullptr);
+  // Submits the pending batch and waits for all uploads to complete.
+  VkResult finish();
+
+  VkDeviceSize getSize() const { return size_; }
+  uint64_t getUploadedBytes() const { return uploadedBytes_; }
+  uint32_t getSubmitCount() const { return submitCount_; }
+  // Number of times an upload had to wait for the GPU to free ring space.
+  uint32_t getStallCount() const { return stallCount_; }
+
+private:
+  struct Batch {
+    VkCommandBuffer commandBuffer = VK_NULL_HANDLE;
+    GpuProfiler::Range range = GpuProfiler::INVALID_RANGE;
+    uint64_t value = 0;
+    // Ring bytes (including alignment and wrap padding) owned by the batch,
+    // and the head position when it was submitted.
+    VkDeviceSize bytes = 0;
+    VkDeviceSize end = 0;
+    // Destinations written by the batch, handed to the compute queue.
+    TransferQueue::Ownership toCompute;
+  };
+
+  StagingRing(const StagingRing &) = delete;
+  StagingRing &operator=(const StagingRing &) = delete;
+
+  VkDeviceSize allocate(VkDeviceSize size);
+  bool tryAllocate(VkDeviceSize size, VkDeviceSize *offset);
+  VkCommandBuffer getCommandBuffer();
+  VkResult submitBatch();
+  void reclaim(bool wait);
+
+  VkDevice device_ = VK_NULL_HANDLE;
+  TransferQueue &transferQueue_;
+  MemoryAllocator &allocator_;
+  GpuProfiler &profiler_;
+  uint32_t timestampValidBits_ = 0;
+  VkBuffer buffer_ = VK_NULL_HANDLE;
+  MemoryAllocator::Allocation memory_;
+  char *mapped_ = nullptr;
+  VkDeviceSize size_ = 0;
+  VkDeviceSize alignment_ = 16;
+
+  VkDeviceSize head_ = 0;
+  VkDeviceSize tail_ = 0;
+  VkDeviceSize used_ = 0;
+  Batch current_;
+  bool recording_ = false;
+  uint64_t lastValue_ = 0;
+  std::deque<Batch> inFlight_;
+
+  uint64_t uploadedBytes_ = 0;
+  uint32_t submitCount_ = 0;
+  uint32_t stallCount_ = 0;
+  std::mutex mutex_;
+};
+
+#endif
@@ -0,0 +1,206 @@
+/*
+ * Copyright (C) 2020 by Xu Xing (xu.xing@outlook.com)
+ *
+ * This code is licensed under the MIT license (MIT)
+ * (http://opensource.org/licenses/MIT)
+ */
+#include "Tensor.h"
+#include "ComputeOp.h"
+
+const char *getTensorLayoutName(TensorLayout layout) {
+  switch (layout) {
+  case TENSOR_LAYOUT_NHWC:
+    return "NHWC";
+  case TENSOR_LAYOUT_NC4HW4:
+    return "NC4HW4";
+  default:
+    return "NCHW";
+  }
+}
+
+static std::vector<uint32_t> getStrides(const std::vector<uint32_t> &shape,
+                                        TensorLayout layout) {
+  std::vector<uint32_t> strides(shape.size());
+  if (layout == TENSOR_LAYOUT_NHWC) {
+    const uint32_t c = shape[1], h = shape[2], w = shape[3];
+    strides = {h * w * c, 1, w * c, c};
+  } else if (layout == TENSOR_LAYOUT_NC4HW4) {
+    const uint32_t c4 = (shape[1] + 3) / 4, h = shape[2], w = shape[3];
+    strides = {c4 * h * w * 4, h * w * 4, w * 4, 4};
+  } else {
+    uint32_t stride = 1;
+    for (size_t i = shape.size(); i-- > 0;) {
+      strides[i] = stride;
+      stride *= shape[i];
+    }
+  }
+  return strides;
+}
+
+Tensor::Tensor(std::shared_ptr<ComputeContext> context,
+               const std::vector<uint32_t> &shape, ElementType elementType,
+               TensorLayout layout)
+    : context_(context), shape_(shape), elementType_(elementType),
+      layout_(layout) {
+  assert(!shape_.empty());
+  assert(layout_ == TENSOR_LAYOUT_NCHW || shape_.size() == 4);
+  assert(context_->supportsElementType(elementType_));
+  strides_ = ::getStrides(shape_, layout_);
+  assert(getElementCount() > 0);
+
+  VkDevice device = context_->getDevice();
+  MemoryAllocator &allocator = context_->getAllocator();
+  VkBufferCreateInfo bufferCreateInfo = vks::initializers::bufferCreateInfo(
+      VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT |
+          VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+      getBytes());
+  bufferCreateInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+  VK_CHECK_RESULT(vkCreateBuffer(device, &bufferCreateInfo, nullptr, &buffer_));
+  VkMemoryRequirements memReqs;
+  vkGetBufferMemoryRequirements(device, buffer_, &memReqs);
+  const uint32_t memoryTypeIndex = allocator.selectMemoryType(
+      memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+  assert(memoryTypeIndex != UINT32_MAX);
+  VK_CHECK_RESULT(allocator.allocate(memReqs, memoryTypeIndex,
+                                     MemoryAllocator::RESOURCE_LINEAR,
+                                     &memory_));
+  VK_CHECK_RESULT(allocator.bindBuffer(buffer_, memory_));
+}
+
+Tensor::~Tensor() {
+  // Pending uploads may still copy into the buffer.
+  context_->getStagingRing().finish();
+  vkDestroyBuffer(context_->getDevice(), buffer_, nullptr);
+  context_->getAllocator().free(memory_);
+}
+
+size_t Tensor::getStorageElementCount(const std::vector<uint32_t> &shape,
+                                      TensorLayout layout) {
+  size_t count = 1;
+  for (size_t i = 0; i < shape.size(); i++) {
+    if (i == 1 && layout == TENSOR_LAYOUT_NC4HW4)
+      count *= (shape[i] + 3) / 4 * 4;
+    else
+      count *= shape[i];
+  }
+  return count;
+}
+
+size_t Tensor::getElementCount() const {
+  size_t count = 1;
+  for (uint32_t dim : shape_)
+    count *= dim;
+  return count;
+}
+
+size_t Tensor::getOffset(const std::vector<uint32_t> &index) const {
+  assert(index.size() == shape_.size());
+  size_t offset = 0;
+  for (size_t i = 0; i < index.size(); i++) {
+    if (i == 1 && layout_ == TENSOR_LAYOUT_NC4HW4)
+      offset += (size_t)(index[i] / 4) * strides_[i] + index[i] % 4;
+    else
+      offset += (size_t)index[i] * strides_[i];
+  }
+  return offset;
+}
+
+template <typename F> void Tensor::forEachElement(F f) const {
+  std::vector<uint32_t> index(shape_.size(), 0);
+  const size_t count = getElementCount();
+  for (size_t i = 0; i < count; i++) {
+    f(i, getOffset(index));
+    for (size_t d = index.size(); d-- > 0;) {
+      if (++index[d] < shape_[d])
+        break;
+      index[d] = 0;
+    }
+  }
+}
+
+VkResult Tensor::upload(const float *data) {
+  assert(data);
+  StagingRing &stagingRing = context_->getStagingRing();
+  if (elementType_ == ELEMENT_TYPE_FLOAT32 && layout_ == TENSOR_LAYOUT_NCHW) {
+    VK_CHECK_RESULT(stagingRing.uploadToBuffer(buffer_, 0, data, getBytes()));
+    return stagingRing.flush();
+  }
+  std::vector<float> ordered(getStorageElementCount(), 0.0f);
+  forEachElement(
+      [&](size_t i, size_t offset) { ordered[offset] = data[i]; });
+  std::vector<char> elements(getBytes());
+  convertFromFloat(ordered.data(), ordered.size(), elementType_,
+                   elements.data());
+  VK_CHECK_RESULT(
+      stagingRing.uploadToBuffer(buffer_, 0, elements.data(), getBytes()));
+  return stagingRing.flush();
+}
+
+VkResult Tensor::download(float *data) {
+  assert(data);
+  VkDevice device = context_->getDevice();
+  MemoryAllocator &allocator = context_->getAllocator();
+  TransferQueue &transferQueue = context_->getTransferQueue();
+  VK_CHECK_RESULT(context_->getStagingRing().flush());
+
+  VkBuffer hostBuffer;
+  MemoryAllocator::Allocation hostMemory;
+  VkBufferCreateInfo bufferCreateInfo = vks::initializers::bufferCreateInfo(
+      VK_BUFFER_USAGE_TRANSFER_DST_BIT, getBytes());
+  bufferCreateInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+  VK_CHECK_RESULT(
+      vkCreateBuffer(device, &bufferCreateInfo, nullptr, &hostBuffer));
+  VkMemoryRequirements memReqs;
+  vkGetBufferMemoryRequirements(device, hostBuffer, &memReqs);
+  const uint32_t memoryTypeIndex = allocator.selectMemoryType(
+      memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT,
+      VK_MEMORY_PROPERTY_HOST_CACHED_BIT);
+  assert(memoryTypeIndex != UINT32_MAX);
+  VK_CHECK_RESULT(allocator.allocate(memReqs, memoryTypeIndex,
+                                     MemoryAllocator::RESOURCE_LINEAR,
+                                     &hostMemory));
+  VK_CHECK_RESULT(allocator.bindBuffer(hostBuffer, hostMemory));
+
+  // The tensor belongs to the compute queue between ops, as in
+  // ComputeOp::copyDeviceBufferToHostBuffer.
+  TransferQueue::Ownership fromCompute;
+  fromCompute.addBuffer(buffer_,
+                        VK_ACCESS_SHADER_WRITE_BIT |
+                            VK_ACCESS_TRANSFER_WRITE_BIT,
+                        VK_ACCESS_TRANSFER_READ_BIT);
+  VkCommandBuffer copyCmd = transferQueue.begin(fromCompute);
+  VkBufferCopy copyRegion = {};
+  copyRegion.size = getBytes();
+  vkCmdCopyBuffer(copyCmd, buffer_, hostBuffer, 1, &copyRegion);
+  VkBufferMemoryBarrier bufferBarrier =
+      vks::initializers::bufferMemoryBarrier();
+  bufferBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+  bufferBarrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+  bufferBarrier.buffer = hostBuffer;
+  bufferBarrier.size = VK_WHOLE_SIZE;
+  bufferBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  bufferBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  vkCmdPipelineBarrier(copyCmd, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                       VK_PIPELINE_STAGE_HOST_BIT, VK_FLAGS_NONE, 0, nullptr,
+                       1, &bufferBarrier, 0, nullptr);
+  TransferQueue::Ownership toCompute;
+  toCompute.addBuffer(buffer_, 0,
+                      VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT);
+  uint64_t value;
+  VK_CHECK_RESULT(transferQueue.submit(copyCmd, toCompute, &value));
+  VK_CHECK_RESULT(transferQueue.getTimeline().wait(value));
+  allocator.invalidate(hostMemory);
+
+  if (elementType_ == ELEMENT_TYPE_FLOAT32 && layout_ == TENSOR_LAYOUT_NCHW) {
+    memcpy(data, hostMemory.mapped, getBytes());
+  } else {
+    std::vector<float> ordered(getStorageElementCount());
+    convertToFloat(hostMemory.mapped, ordered.size(), elementType_,
+                   ordered.data());
+    forEachElement(
+        [&](size_t i, size_t offset) { data[i] = ordered[offset]; });
+  }
+  vkDestroyBuffer(device, hostBuffer, nullptr);
+  allocator.free(hostMemory);
+  return VK_SUCCESS;
+}
@@ -0,0 +1,92 @@
+/*
+ * Copyright (C) 2020 by Xu Xing (xu.xing@outlook.com)
+ *
+ * This code is licensed under the MIT license (MIT)
+ * (http://opensource.org/licenses/MIT)
+ */
+#ifndef TENSOR_H_
+#define TENSOR_H_
+
+#include <memory>
+#include <vector>
+
+#include "ComputeContext.h"
+#include "ElementType.h"
+#include <vulkan/vulkan.h>
+
+// How the elements of a 4-d NCHW tensor are ordered in memory. Tensors of
+// other ranks are always row major, which is what TENSOR_LAYOUT_NCHW is.
+enum TensorLayout {
+  TENSOR_LAYOUT_NCHW = 0,
+  TENSOR_LAYOUT_NHWC = 1,
+  // Channels in blocks of four, each block stored as NHWC with C = 4. The
+  // last block is zero padded when C is not a multiple of four.
+  TENSOR_LAYOUT_NC4HW4 = 2,
+};
+
+const char *getTensorLayoutName(TensorLayout layout);
+
+// An N-d array of ElementType elements in a device local storage buffer on
+// one context. Ops bind the buffer directly, so chaining ops on tensors
+// keeps the data on the device; only upload() and download() touch the
+// host.
+class Tensor {
+public:
+  // shape is in logical order, i.e. N, C, H, W for a 4-d tensor whatever
+  // its layout.
+  Tensor(std::shared_ptr<ComputeContext> context,
+         const std::vector<uint32_t> &shape,
+         ElementType elementType = ELEMENT_TYPE_FLOAT32,
+         TensorLayout layout = TENSOR_LAYOUT_NCHW);
+  ~Tensor();
+
+  // Elements the buffer holds for shape in layout, padding included.
+  static size_t getStorageElementCount(const std::vector<uint32_t> &shape,
+                                       TensorLayout layout);
+
+  const std::vector<uint32_t> &getShape() const { return shape_; }
+  size_t getRank() const { return shape_.size(); }
+  uint32_t getDim(size_t i) const { return shape_[i]; }
+  // Element strides of each logical dimension. In NC4HW4 the channel stride
+  // is that of a block: channel c is at (c / 4) * strides[1] + c % 4.
+  const std::vector<uint32_t> &getStrides() const { return strides_; }
+  ElementType getElementType() const { return elementType_; }
+  TensorLayout getLayout() const { return layout_; }
+  size_t getElementCount() const;
+  size_t getStorageElementCount() const {
+    return getStorageElementCount(shape_, layout_);
+  }
+  VkDeviceSize getBytes() const {
+    return getStorageElementCount() * getElementSize(elementType_);
+  }
+  // Offset in elements of the element at index, one entry per dimension.
+  size_t getOffset(const std::vector<uint32_t> &index) const;
+  VkBuffer getBuffer() const { return buffer_; }
+  const std::shared_ptr<ComputeContext> &getContext() const {
+    return context_;
+  }
+
+  // Host data is float in logical (row major) order whatever the element
+  // type and layout; it is converted and reordered on the way. Work
+  // submitted to the context queue after upload() returns sees the data.
+  VkResult upload(const float *data);
+  // Waits for the copy, so work writing the tensor must have been submitted.
+  VkResult download(float *data);
+
+private:
+  Tensor(const Tensor &) = delete;
+  Tensor &operator=(const Tensor &) = delete;
+
+  // Visits every logical element with its row major index and offset.
+  template <typename F> void forEachElement(F f) const;
+
+  std::shared_ptr<ComputeContext> context_;
+  std::vector<uint32_t> shape_;
+  std::vector<uint32_t> strides_;
+  ElementType elementType_ = ELEMENT_TYPE_FLOAT32;
+  TensorLayout layout_ = TENSOR_LAYOUT_NCHW;
+  VkBuffer buffer_ = VK_NULL_HANDLE;
+  MemoryAllocator::Allocation memory_;
+};
+
+#endif
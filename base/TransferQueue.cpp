@@ -0,0 +1,294 @@
+/*
+ * Copyright (C) 2020 by Xu Xing (xu.xing@outlook.com)
+ *
+ * This code is licensed under the MIT license (MIT)
+ * (http://opensource.org/licenses/MIT)
+ */
+#include "TransferQueue.h"
+#include "ComputeOp.h"
+
+void TransferQueue::Ownership::addBuffer(VkBuffer buffer,
+                                         VkAccessFlags srcAccessMask,
+                                         VkAccessFlags dstAccessMask,
+                                         VkDeviceSize offset,
+                                         VkDeviceSize size) {
+  VkBufferMemoryBarrier bufferBarrier =
+      vks::initializers::bufferMemoryBarrier();
+  bufferBarrier.srcAccessMask = srcAccessMask;
+  bufferBarrier.dstAccessMask = dstAccessMask;
+  bufferBarrier.buffer = buffer;
+  bufferBarrier.offset = offset;
+  bufferBarrier.size = size;
+  buffers.push_back(bufferBarrier);
+}
+
+void TransferQueue::Ownership::addImage(VkImage image,
+                                        VkAccessFlags srcAccessMask,
+                                        VkAccessFlags dstAccessMask,
+                                        VkImageLayout oldLayout,
+                                        VkImageLayout newLayout) {
+  VkImageMemoryBarrier imageMemoryBarrier =
+      vks::initializers::imageMemoryBarrier();
+  imageMemoryBarrier.srcAccessMask = srcAccessMask;
+  imageMemoryBarrier.dstAccessMask = dstAccessMask;
+  imageMemoryBarrier.oldLayout = oldLayout;
+  imageMemoryBarrier.newLayout = newLayout;
+  imageMemoryBarrier.image = image;
+  imageMemoryBarrier.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0,
+                                         1};
+  images.push_back(imageMemoryBarrier);
+}
+
+TransferQueue::TransferQueue(VkDevice device, QueueTimeline &computeTimeline,
+                             uint32_t computeFamilyIndex,
+                             QueueTimeline *transferTimeline,
+                             uint32_t transferFamilyIndex)
+    : device_(device), computeTimeline_(computeTimeline),
+      transferTimeline_(transferTimeline ? transferTimeline
+                                         : &computeTimeline),
+      computeFamilyIndex_(computeFamilyIndex),
+      transferFamilyIndex_(transferTimeline ? transferFamilyIndex
+                                            : computeFamilyIndex) {
+  VkCommandPoolCreateInfo cmdPoolInfo = {};
+  cmdPoolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+  cmdPoolInfo.queueFamilyIndex = transferFamilyIndex_;
+  cmdPoolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+  VK_CHECK_RESULT(vkCreateCommandPool(device_, &cmdPoolInfo, nullptr,
+                                      &transferCommandPool_));
+  if (isDedicated()) {
+    cmdPoolInfo.queueFamilyIndex = computeFamilyIndex_;
+    VK_CHECK_RESULT(vkCreateCommandPool(device_, &cmdPoolInfo, nullptr,
+                                        &computeCommandPool_));
+  }
+}
+
+TransferQueue::~TransferQueue() {
+  finish();
+  assert(open_.empty());
+  for (auto semaphore : freeSemaphores_)
+    vkDestroySemaphore(device_, semaphore, nullptr);
+  // Command buffers are freed with the pools.
+  vkDestroyCommandPool(device_, transferCommandPool_, nullptr);
+  if (computeCommandPool_ != VK_NULL_HANDLE)
+    vkDestroyCommandPool(device_, computeCommandPool_, nullptr);
+}
+
+VkCommandBuffer
+TransferQueue::acquireCommandBuffer(VkCommandPool commandPool,
+                                    std::vector<VkCommandBuffer> &freeList) {
+  VkCommandBuffer commandBuffer;
+  if (!freeList.empty()) {
+    commandBuffer = freeList.back();
+    freeList.pop_back();
+  } else {
+    VkCommandBufferAllocateInfo cmdBufAllocateInfo =
+        vks::initializers::commandBufferAllocateInfo(
+            commandPool, VK_COMMAND_BUFFER_LEVEL_PRIMARY, 1);
+    VK_CHECK_RESULT(vkAllocateCommandBuffers(device_, &cmdBufAllocateInfo,
+                                             &commandBuffer));
+  }
+  VkCommandBufferBeginInfo cmdBufInfo =
+      vks::initializers::commandBufferBeginInfo();
+  cmdBufInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+  VK_CHECK_RESULT(vkBeginCommandBuffer(commandBuffer, &cmdBufInfo));
+  return commandBuffer;
+}
+
+VkSemaphore TransferQueue::acquireSemaphore() {
+  if (!freeSemaphores_.empty()) {
+    VkSemaphore semaphore = freeSemaphores_.back();
+    freeSemaphores_.pop_back();
+    return semaphore;
+  }
+  VkSemaphoreCreateInfo semaphoreInfo =
+      vks::initializers::semaphoreCreateInfo();
+  VkSemaphore semaphore;
+  VK_CHECK_RESULT(
+      vkCreateSemaphore(device_, &semaphoreInfo, nullptr, &semaphore));
+  return semaphore;
+}
+
+// The release and the acquire of one ownership transfer must use the same
+// ranges and layouts. The release only makes writes available and the
+// acquire only makes them visible, so each side drops the other access mask.
+void TransferQueue::recordBarriers(VkCommandBuffer commandBuffer,
+                                   VkPipelineStageFlags srcStageMask,
+                                   VkPipelineStageFlags dstStageMask,
+                                   const Ownership &ownership,
+                                   uint32_t srcFamilyIndex,
+                                   uint32_t dstFamilyIndex, bool release) {
+  std::vector<VkBufferMemoryBarrier> buffers = ownership.buffers;
+  std::vector<VkImageMemoryBarrier> images = ownership.images;
+  // Within one family this is an ordinary barrier.
+  const bool local = srcFamilyIndex == dstFamilyIndex;
+  if (local)
+    srcFamilyIndex = dstFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  for (auto &barrier : buffers) {
+    barrier.srcQueueFamilyIndex = srcFamilyIndex;
+    barrier.dstQueueFamilyIndex = dstFamilyIndex;
+    if (!local && release)
+      barrier.dstAccessMask = 0;
+    else if (!local)
+      barrier.srcAccessMask = 0;
+  }
+  for (auto &barrier : images) {
+    barrier.srcQueueFamilyIndex = srcFamilyIndex;
+    barrier.dstQueueFamilyIndex = dstFamilyIndex;
+    if (!local && release)
+      barrier.dstAccessMask = 0;
+    else if (!local)
+      barrier.srcAccessMask = 0;
+  }
+  vkCmdPipelineBarrier(commandBuffer, srcStageMask, dstStageMask,
+                       VK_FLAGS_NONE, 0, nullptr,
+                       static_cast<uint32_t>(buffers.size()), buffers.data(),
+                       static_cast<uint32_t>(images.size()), images.data());
+}
+
+VkCommandBuffer TransferQueue::begin(const Ownership &fromCompute) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  retire(false);
+  Record record;
+  record.transferCommandBuffer =
+      acquireCommandBuffer(transferCommandPool_, freeTransferCommandBuffers_);
+  if (!isDedicated()) {
+    // Same queue: an execution dependency on earlier dispatches covers
+    // write after read, and the barriers make compute writes visible.
+    recordBarriers(record.transferCommandBuffer,
+                   VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
+                   VK_PIPELINE_STAGE_TRANSFER_BIT, fromCompute,
+                   computeFamilyIndex_, computeFamilyIndex_, false);
+  } else if (!fromCompute.empty()) {
+    record.releaseCommandBuffer =
+        acquireCommandBuffer(computeCommandPool_, freeComputeCommandBuffers_);
+    recordBarriers(record.releaseCommandBuffer,
+                   VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
+                   VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, fromCompute,
+                   computeFamilyIndex_, transferFamilyIndex_, true);
+    VK_CHECK_RESULT(vkEndCommandBuffer(record.releaseCommandBuffer));
+    record.releaseSemaphore = acquireSemaphore();
+    recordBarriers(record.transferCommandBuffer,
+                   VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+                   VK_PIPELINE_STAGE_TRANSFER_BIT, fromCompute,
+                   computeFamilyIndex_, transferFamilyIndex_, false);
+    ownershipTransferCount_ += static_cast<uint32_t>(
+        fromCompute.buffers.size() + fromCompute.images.size());
+  }
+  open_[record.transferCommandBuffer] = record;
+  return record.transferCommandBuffer;
+}
+
+VkResult TransferQueue::submit(VkCommandBuffer commandBuffer,
+                               const Ownership &toCompute, uint64_t *value) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto it = open_.find(commandBuffer);
+  assert(it != open_.end());
+  Record record = it->second;
+  open_.erase(it);
+
+  if (!isDedicated()) {
+    recordBarriers(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                   VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, toCompute,
+                   computeFamilyIndex_, computeFamilyIndex_, true);
+    VK_CHECK_RESULT(vkEndCommandBuffer(commandBuffer));
+    VkSubmitInfo submitInfo = vks::initializers::submitInfo();
+    submitInfo.commandBufferCount = 1;
+    submitInfo.pCommandBuffers = &commandBuffer;
+    VK_CHECK_RESULT(
+        computeTimeline_.submit(1, &submitInfo, &record.transferValue));
+  } else {
+    if (!toCompute.empty()) {
+      recordBarriers(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                     VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, toCompute,
+                     transferFamilyIndex_, computeFamilyIndex_, true);
+      record.acquireSemaphore = acquireSemaphore();
+      record.acquireCommandBuffer = acquireCommandBuffer(
+          computeCommandPool_, freeComputeCommandBuffers_);
+      recordBarriers(record.acquireCommandBuffer,
+                     VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+                     VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, toCompute,
+                     transferFamilyIndex_, computeFamilyIndex_, false);
+      VK_CHECK_RESULT(vkEndCommandBuffer(record.acquireCommandBuffer));
+      ownershipTransferCount_ += static_cast<uint32_t>(
+          toCompute.buffers.size() + toCompute.images.size());
+    }
+    VK_CHECK_RESULT(vkEndCommandBuffer(commandBuffer));
+
+    // Signals are always submitted before the waits on them.
+    if (record.releaseCommandBuffer != VK_NULL_HANDLE) {
+      VkSubmitInfo submitInfo = vks::initializers::submitInfo();
+      submitInfo.commandBufferCount = 1;
+      submitInfo.pCommandBuffers = &record.releaseCommandBuffer;
+      submitInfo.signalSemaphoreCount = 1;
+      submitInfo.pSignalSemaphores = &record.releaseSemaphore;
+      VK_CHECK_RESULT(
+          computeTimeline_.submit(1, &submitInfo, &record.computeValue));
+    }
+
+    const VkPipelineStageFlags transferWaitStage =
+        VK_PIPELINE_STAGE_TRANSFER_BIT;
+    VkSubmitInfo submitInfo = vks::initializers::submitInfo();
+    submitInfo.commandBufferCount = 1;
+    submitInfo.pCommandBuffers = &commandBuffer;
+    if (record.releaseSemaphore != VK_NULL_HANDLE) {
+      submitInfo.waitSemaphoreCount = 1;
+      submitInfo.pWaitSemaphores = &record.releaseSemaphore;
+      submitInfo.pWaitDstStageMask = &transferWaitStage;
+    }
+    if (record.acquireSemaphore != VK_NULL_HANDLE) {
+      submitInfo.signalSemaphoreCount = 1;
+      submitInfo.pSignalSemaphores = &record.acquireSemaphore;
+    }
+    VK_CHECK_RESULT(
+        transferTimeline_->submit(1, &submitInfo, &record.transferValue));
+
+    if (record.acquireCommandBuffer != VK_NULL_HANDLE) {
+      const VkPipelineStageFlags computeWaitStage =
+          VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
+      VkSubmitInfo acquireSubmitInfo = vks::initializers::submitInfo();
+      acquireSubmitInfo.commandBufferCount = 1;
+      acquireSubmitInfo.pCommandBuffers = &record.acquireCommandBuffer;
+      acquireSubmitInfo.waitSemaphoreCount = 1;
+      acquireSubmitInfo.pWaitSemaphores = &record.acquireSemaphore;
+      acquireSubmitInfo.pWaitDstStageMask = &computeWaitStage;
+      VK_CHECK_RESULT(computeTimeline_.submit(1, &acquireSubmitInfo,
+                                              &record.computeValue));
+    }
+  }
+  if (value)
+    *value = record.transferValue;
+  inFlight_.push_back(record);
+  submitCount_++;
+  return VK_SUCCESS;
+}
+
+// Recycles command buffers and semaphores of completed transfers. Called with
+// mutex_ held.
+void TransferQueue::retire(bool wait) {
+  while (!inFlight_.empty()) {
+    Record &record = inFlight_.front();
+    if (wait) {
+      VK_CHECK_RESULT(transferTimeline_->wait(record.transferValue));
+      VK_CHECK_RESULT(computeTimeline_.wait(record.computeValue));
+    } else if (!transferTimeline_->isComplete(record.transferValue) ||
+               !computeTimeline_.isComplete(record.computeValue)) {
+      break;
+    }
+    freeTransferCommandBuffers_.push_back(record.transferCommandBuffer);
+    if (record.releaseCommandBuffer != VK_NULL_HANDLE)
+      freeComputeCommandBuffers_.push_back(record.releaseCommandBuffer);
+    if (record.acquireCommandBuffer != VK_NULL_HANDLE)
+      freeComputeCommandBuffers_.push_back(record.acquireCommandBuffer);
+    if (record.releaseSemaphore != VK_NULL_HANDLE)
+      freeSemaphores_.push_back(record.releaseSemaphore);
+    if (record.acquireSemaphore != VK_NULL_HANDLE)
+      freeSemaphores_.push_back(record.acquireSemaphore);
+    inFlight_.pop_front();
+  }
+}
+
+VkResult TransferQueue::finish() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  retire(true);
+  return VK_SUCCESS;
+}
@@ -0,0 +1,138 @@
+/*
+ * Copyright (C) 2020 by Xu Xing (xu.xing@outlook.com)
+ *
+ * This code is licensed under the MIT license (MIT)
+ * (http://opensource.org/licenses/MIT)
+ */
+#ifndef TRANSFER_QUEUE_H_
+#define TRANSFER_QUEUE_H_
+
+#include <deque>
+#include <map>
+#include <mutex>
+#include <vector>
+
+#include "QueueTimeline.h"
+#include "VulkanTools.h"
+#include <vulkan/vulkan.h>
+
+// Runs copies between host visible buffers and compute resources on a
+// transfer-only queue family when the device has one, so uploads and
+// readbacks overlap dispatches instead of queuing behind them.
+//
+// Resources are created VK_SHARING_MODE_EXCLUSIVE, so each handoff between
+// the compute and the transfer family is a queue family ownership transfer:
+// a release barrier on the queue giving the resource up, a semaphore, and a
+// matching acquire barrier on the queue taking it. One transfer is up to
+// three submissions:
+//
+//   compute:  release fromCompute, signal A
+//   transfer: wait A, acquire fromCompute, copies, release toCompute, signal B
+//   compute:  wait B, acquire toCompute
+//
+// Work submitted to the compute queue after submit() sees the acquired
+// resources. Transfers are not ordered against compute work on resources
+// outside fromCompute, so callers must not overwrite a resource a pending
+// dispatch still reads. Writes that replace a resource's contents need no
+// fromCompute entry: its old contents do not have to survive the handoff.
+//
+// On devices with a single queue family (e.g. lavapipe) there is no transfer
+// queue: the same calls record plain barriers and submit once to the compute
+// queue.
+class TransferQueue {
+public:
+  // Resources handed between the families. Callers fill in the resource,
+  // range or layouts and the access masks on the side they own; family
+  // indices are filled in here.
+  struct Ownership {
+    std::vector<VkBufferMemoryBarrier> buffers;
+    std::vector<VkImageMemoryBarrier> images;
+    bool empty() const { return buffers.empty() && images.empty(); }
+    // The defaults cover the whole buffer or image with no layout change.
+    void addBuffer(VkBuffer buffer, VkAccessFlags srcAccessMask,
+                   VkAccessFlags dstAccessMask, VkDeviceSize offset = 0,
+                   VkDeviceSize size = VK_WHOLE_SIZE);
+    void addImage(VkImage image, VkAccessFlags srcAccessMask,
+                  VkAccessFlags dstAccessMask,
+                  VkImageLayout oldLayout = VK_IMAGE_LAYOUT_GENERAL,
+                  VkImageLayout newLayout = VK_IMAGE_LAYOUT_GENERAL);
+  };
+
+  // transferTimeline is null when the device has no transfer-only family.
+  TransferQueue(VkDevice device, QueueTimeline &computeTimeline,
+                uint32_t computeFamilyIndex, QueueTimeline *transferTimeline,
+                uint32_t transferFamilyIndex);
+  ~TransferQueue();
+
+  bool isDedicated() const { return transferTimeline_ != &computeTimeline_; }
+  uint32_t getFamilyIndex() const { return transferFamilyIndex_; }
+  // Values returned by submit() are on this timeline.
+  QueueTimeline &getTimeline() { return *transferTimeline_; }
+
+  // Starts a command buffer for the transfer queue. Resources in fromCompute
+  // were last written on the compute queue and are readable by transfers in
+  // the returned command buffer.
+  VkCommandBuffer begin(const Ownership &fromCompute = Ownership());
+  // Ends and submits a command buffer from begin(). Resources in toCompute
+  // were written by it and are handed back to the compute queue. value, if
+  // not null, is the transfer timeline value after which the copies are
+  // complete.
+  VkResult submit(VkCommandBuffer commandBuffer,
+                  const Ownership &toCompute = Ownership(),
+                  uint64_t *value = nullptr);
+  // Waits for all submitted transfers and their compute side handoffs.
+  VkResult finish();
+
+  uint32_t getSubmitCount() const { return submitCount_; }
+  // Ownership transfers (release/acquire pairs) recorded so far.
+  uint32_t getOwnershipTransferCount() const {
+    return ownershipTransferCount_;
+  }
+
+private:
+  // One transfer and the compute side command buffers and semaphores it
+  // used, recycled once all of its submissions have completed.
+  struct Record {
+    VkCommandBuffer transferCommandBuffer = VK_NULL_HANDLE;
+    VkCommandBuffer releaseCommandBuffer = VK_NULL_HANDLE;
+    VkCommandBuffer acquireCommandBuffer = VK_NULL_HANDLE;
+    VkSemaphore releaseSemaphore = VK_NULL_HANDLE;
+    VkSemaphore acquireSemaphore = VK_NULL_HANDLE;
+    uint64_t transferValue = 0;
+    uint64_t computeValue = 0;
+  };
+
+  TransferQueue(const TransferQueue &) = delete;
+  TransferQueue &operator=(const TransferQueue &) = delete;
+
+  VkCommandBuffer acquireCommandBuffer(VkCommandPool commandPool,
+                                       std::vector<VkCommandBuffer> &freeList);
+  VkSemaphore acquireSemaphore();
+  void recordBarriers(VkCommandBuffer commandBuffer,
+                      VkPipelineStageFlags srcStageMask,
+                      VkPipelineStageFlags dstStageMask,
+                      const Ownership &ownership, uint32_t srcFamilyIndex,
+                      uint32_t dstFamilyIndex, bool release);
+  void retire(bool wait);
+
+  VkDevice device_ = VK_NULL_HANDLE;
+  QueueTimeline &computeTimeline_;
+  QueueTimeline *transferTimeline_ = nullptr;
+  uint32_t computeFamilyIndex_ = 0;
+  uint32_t transferFamilyIndex_ = 0;
+  // Command pools are not thread safe, so the transfer queue has its own for
+  // both families rather than borrowing the context one.
+  VkCommandPool transferCommandPool_ = VK_NULL_HANDLE;
+  VkCommandPool computeCommandPool_ = VK_NULL_HANDLE;
+  std::vector<VkCommandBuffer> freeTransferCommandBuffers_;
+  std::vector<VkCommandBuffer> freeComputeCommandBuffers_;
+  std::vector<VkSemaphore> freeSemaphores_;
+  // Records between begin() and submit(), by transfer command buffer.
+  std::map<VkCommandBuffer, Record> open_;
+  std::deque<Record> inFlight_;
+  uint32_t submitCount_ = 0;
+  uint32_t ownershipTransferCount_ = 0;
+  std::mutex mutex_;
+};
+
+#endif
@@ -0,0 +1,142 @@
+/*
+ * Copyright (C) 2020 by Xu Xing (xu.xing@outlook.com)
+ *
+ * This code is licensed under the MIT license (MIT)
+ * (http://opensource.org/licenses/MIT)
+ */
+#include "TuningDatabase.h"
+#include "ComputeOp.h"
+
+#include <fstream>
+#include <sstream>
+#include <sys/stat.h>
+#if defined(_WIN32)
+#include <direct.h>
+#include <process.h>
+#define getpid _getpid
+#else
+#include <unistd.h>
+#endif
+
+namespace {
+
+const char *FILE_MAGIC = "vulkan_compute_tuning";
+const uint32_t FILE_VERSION = 1;
+
+std::string hex(uint32_t value) {
+  char text[9];
+  snprintf(text, sizeof(text), "%08x", value);
+  return text;
+}
+
+} // namespace
+
+TuningDatabase::TuningDatabase(const VkPhysicalDeviceProperties &properties,
+                               const std::string &directory)
+    : properties_(properties) {
+  if (!directory.empty()) {
+#if defined(_WIN32)
+    _mkdir(directory.c_str());
+#else
+    mkdir(directory.c_str(), 0755);
+#endif
+    path_ = directory + "/tuning_" + hex(properties_.vendorID) + "_" +
+            hex(properties_.deviceID) + "_" +
+            hex(properties_.driverVersion) + ".txt";
+    entries_ = readFile();
+  }
+  LOG("Tuning database: %s, %zu entries\n",
+      path_.empty() ? "in memory" : path_.c_str(), entries_.size());
+}
+
+TuningDatabase::~TuningDatabase() { save(); }
+
+bool TuningDatabase::find(const std::string &key, Entry *entry) const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto it = entries_.find(key);
+  if (it == entries_.end())
+    return false;
+  *entry = it->second;
+  return true;
+}
+
+void TuningDatabase::store(const std::string &key, const Entry &entry) {
+  assert(!key.empty() && key.find_first_of(" \n") == std::string::npos);
+  std::lock_guard<std::mutex> lock(mutex_);
+  entries_[key] = entry;
+  stored_.insert(key);
+}
+
+size_t TuningDatabase::size() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return entries_.size();
+}
+
+std::map<std::string, TuningDatabase::Entry>
+TuningDatabase::readFile() const {
+  std::map<std::string, Entry> entries;
+  std::ifstream file(path_);
+  std::string magic;
+  uint32_t version = 0, driverVersion = 0;
+  if (!(file >> magic >> version >> std::hex >> driverVersion >> std::dec))
+    return entries;
+  if (magic != FILE_MAGIC || version != FILE_VERSION ||
+      driverVersion != properties_.driverVersion) {
+    LOG("Tuning database: ignoring invalid %s\n", path_.c_str());
+    return entries;
+  }
+  std::string line;
+  std::getline(file, line);
+  while (std::getline(file, line)) {
+    std::istringstream fields(line);
+    std::string key;
+    Entry entry;
+    // Skips malformed lines rather than dropping the whole file.
+    if (fields >> key >> entry.workgroupSizeX >> entry.workgroupSizeY >>
+            entry.workgroupSizeZ >> entry.ms &&
+        entry.workgroupSizeX && entry.workgroupSizeY && entry.workgroupSizeZ)
+      entries[key] = entry;
+  }
+  return entries;
+}
+
+VkResult TuningDatabase::save() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (path_.empty() || stored_.empty())
+    return VK_SUCCESS;
+
+  // Take in what other processes saved since we loaded or last saved.
+  std::map<std::string, Entry> merged = readFile();
+  for (const std::string &key : stored_)
+    merged[key] = entries_[key];
+
+  // Write a file of our own, then rename it over the shared one.
+  const std::string tempPath = path_ + "." + std::to_string(getpid());
+  {
+    std::ofstream file(tempPath, std::ios::trunc);
+    file << FILE_MAGIC << " " << FILE_VERSION << " "
+         << hex(properties_.driverVersion) << "\n";
+    for (const auto &it : merged) {
+      const Entry &entry = it.second;
+      file << it.first << " " << entry.workgroupSizeX << " "
+           << entry.workgroupSizeY << " " << entry.workgroupSizeZ << " "
+           << entry.ms << "\n";
+    }
+    if (!file) {
+      LOG("Tuning database: cannot write %s\n", tempPath.c_str());
+      return VK_ERROR_INITIALIZATION_FAILED;
+    }
+  }
+#if defined(_WIN32)
+  // rename() does not replace existing files on Windows.
+  remove(path_.c_str());
+#endif
+  if (rename(tempPath.c_str(), path_.c_str()) != 0) {
+    LOG("Tuning database: cannot replace %s\n", path_.c_str());
+    remove(tempPath.c_str());
+    return VK_ERROR_INITIALIZATION_FAILED;
+  }
+  entries_ = merged;
+  stored_.clear();
+  return VK_SUCCESS;
+}
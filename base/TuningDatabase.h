@@ -0,0 +1,65 @@
+/*
+ * Copyright (C) 2020 by Xu Xing (xu.xing@outlook.com)
+ *
+ * This code is licensed under the MIT license (MIT)
+ * (http://opensource.org/licenses/MIT)
+ */
+#ifndef TUNING_DATABASE_H_
+#define TUNING_DATABASE_H_
+
+#include <map>
+#include <mutex>
+#include <set>
+#include <string>
+
+#include <vulkan/vulkan.h>
+
+// The fastest workgroup size WorkgroupTuner found for each op configuration
+// (see InitParams::getTuningKey) on one device and driver. Ops look their
+// configuration up at prepare time.
+//
+// Like the pipeline cache it is persisted in the cache directory, in a text
+// file named after the vendor, device and driver version, so each device
+// has its own and a driver update starts from scratch. Lines are
+// "<key> <x> <y> <z> <ms>" after a header line. save() merges what other
+// processes wrote since, keeping our entries where both have one, and
+// replaces the file by a rename.
+class TuningDatabase {
+public:
+  struct Entry {
+    uint32_t workgroupSizeX = 1;
+    uint32_t workgroupSizeY = 1;
+    uint32_t workgroupSizeZ = 1;
+    // GPU time of the dispatch with this size when it was tuned.
+    double ms = 0.0;
+  };
+
+  // An empty directory keeps the database in memory only.
+  TuningDatabase(const VkPhysicalDeviceProperties &properties,
+                 const std::string &directory);
+  // Saves the entries stored since loading, if any.
+  ~TuningDatabase();
+
+  bool find(const std::string &key, Entry *entry) const;
+  void store(const std::string &key, const Entry &entry);
+  size_t size() const;
+  // Returns VK_ERROR_INITIALIZATION_FAILED if the file cannot be written.
+  VkResult save();
+  const std::string &getPath() const { return path_; }
+
+private:
+  TuningDatabase(const TuningDatabase &) = delete;
+  TuningDatabase &operator=(const TuningDatabase &) = delete;
+
+  // Entries of the file, or none if it is missing or for another driver.
+  std::map<std::string, Entry> readFile() const;
+
+  VkPhysicalDeviceProperties properties_ = {};
+  std::string path_;
+  std::map<std::string, Entry> entries_;
+  // Keys stored since loading, which save() writes over the file's.
+  std::set<std::string> stored_;
+  mutable std::mutex mutex_;
+};
+
+#endif
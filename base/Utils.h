@@ -6,6 +6,9 @@
  */
 #ifndef UTILS_H_
 #define UTILS_H_
+#include <algorithm>
+#include <vector>
+
 #define USE_HIGH_RESOLUTION_CLOCK
 #ifdef USE_HIGH_RESOLUTION_CLOCK
 // https://stackoverflow.com/questions/16299029/resolution-of-stdchronohigh-resolution-clock-doesnt-correspond-to-measureme
@@ -43,7 +46,7 @@ typedef std::chrono::steady_clock Clock;
                                                                       begin)   \
                      .count()) /                                               \
         NS2MS;                                                                 \
-    printf("Time for %s %d = %fms\n", funcname, size, time_spent);             \
+    printf("Time for %s %zu = %fms\n", funcname, (size_t)(size), time_spent);  \
   }
 #else
 {
@@ -60,7 +63,15 @@ typedef std::chrono::steady_clock Clock;
     func;                                                                      \
     clock_t end = clock();                                                     \
     double time_spent = (double)(end - begin) / (CLOCKS_PER_SEC / 1000);       \
-    printf("Time for %s %d = %fms\n", funcname, size, time_spent);             \
+    printf("Time for %s %zu = %fms\n", funcname, (size_t)(size), time_spent);  \
   }
 #endif
-#endif
\ No newline at end of file
+
+// Median of run times in ms, for example timing loops. Sorts a copy, so the
+// runs keep their order. runMs must not be empty.
+inline double medianMs(std::vector<double> runMs) {
+  std::sort(runMs.begin(), runMs.end());
+  return runMs[runMs.size() / 2];
+}
+
+#endif
@@ -57,8 +57,9 @@ inline VkSamplerCreateInfo samplerCreateInfo() {
   return samplerCreateInfo;
 }
 
+// Submits commandBuffer and waits for that submission only.
 void flushCommandBuffer(VkDevice device, VkCommandPool commandPool,
-                        VkCommandBuffer commandBuffer, VkQueue queue,
+                        VkCommandBuffer commandBuffer, QueueTimeline &timeline,
                         bool free) {
   if (commandBuffer == VK_NULL_HANDLE) {
     return;
@@ -70,17 +71,10 @@ void flushCommandBuffer(VkDevice device, VkCommandPool commandPool,
   submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
   submitInfo.commandBufferCount = 1;
   submitInfo.pCommandBuffers = &commandBuffer;
-  VkFenceCreateInfo fenceInfo =
-      vks::initializers::fenceCreateInfo(VK_FLAGS_NONE);
-  VkFence fence;
-  VK_CHECK_RESULT(vkCreateFence(device, &fenceInfo, nullptr, &fence));
   // Submit to the queue
-  VK_CHECK_RESULT(vkQueueSubmit(queue, 1, &submitInfo, fence));
-  VK_CHECK_RESULT(vkWaitForFences(device, 1, &fence, VK_TRUE, UINT64_MAX));
-
-  vkDestroyFence(device, fence, nullptr);
-
-  VK_CHECK_RESULT(vkQueueWaitIdle(queue));
+  uint64_t value;
+  VK_CHECK_RESULT(timeline.submit(1, &submitInfo, &value));
+  VK_CHECK_RESULT(timeline.wait(value));
 
   if (free) {
     vkFreeCommandBuffers(device, commandPool, 1, &commandBuffer);
@@ -146,22 +140,4 @@ getMemoryType(const VkPhysicalDeviceMemoryProperties &deviceMemoryProperties,
     throw std::runtime_error("Could not find a matching memory type");
   }
 }
-
-void timeOfDispatch(const VkDevice device, const VkQueryPool &queryPool,
-                    float timestampPeriod, uint32_t timestampValidBits) {
-  uint64_t rawDeviceTimestamps[2] = {0, 0};
-  VK_CHECK_RESULT(vkGetQueryPoolResults(
-      device, queryPool, 0, 2, sizeof(rawDeviceTimestamps), rawDeviceTimestamps,
-      sizeof(uint64_t), VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WAIT_BIT));
-  // https://gist.github.com/cdwfs/4222ca09cb259f8dd50f7f2cf7d09179
-  const uint64_t timestampMask = (timestampValidBits == 64)
-                                     ? UINT64_MAX
-                                     : ((1ULL << timestampValidBits) - 1);
-  const double secondsPerTick = static_cast<double>(timestampPeriod) / 1e6;
-  double deviceMs[2] = {0.0, 0.0};
-  deviceMs[0] = static_cast<double>(rawDeviceTimestamps[0]) * secondsPerTick;
-  deviceMs[1] = static_cast<double>(rawDeviceTimestamps[1]) * secondsPerTick;
-  double deviceDiffMs = deviceMs[1] - deviceMs[0];
-  LOG("Time for dispatch = %fms\n", deviceDiffMs);
-}
 #endif
\ No newline at end of file
@@ -0,0 +1,153 @@
+/*
+ * Copyright (C) 2020 by Xu Xing (xu.xing@outlook.com)
+ *
+ * This code is licensed under the MIT license (MIT)
+ * (http://opensource.org/licenses/MIT)
+ */
+#include "WorkgroupTuner.h"
+#include "ComputeBufferOp.h"
+#include "Utils.h"
+
+namespace {
+
+// Powers of two up to limit that divide invocations, and current if valid.
+std::vector<uint32_t> getAxisSizes(uint32_t invocations, uint32_t limit,
+                                   uint32_t current) {
+  std::vector<uint32_t> sizes;
+  for (uint32_t size = 1; size <= limit && size <= invocations; size *= 2) {
+    if (invocations % size == 0)
+      sizes.push_back(size);
+  }
+  if (current <= limit && invocations % current == 0 &&
+      std::find(sizes.begin(), sizes.end(), current) == sizes.end())
+    sizes.push_back(current);
+  return sizes;
+}
+
+} // namespace
+
+WorkgroupTuner::WorkgroupTuner(std::shared_ptr<ComputeContext> context)
+    : context_(context) {}
+
+std::vector<TuningDatabase::Entry>
+WorkgroupTuner::getCandidates(const ComputeOp::InitParams &params) const {
+  const VkPhysicalDeviceLimits &limits =
+      context_->getDeviceProperties().limits;
+  const uint32_t invocations[3] = {
+      (uint32_t)(params.DISPATCH_X * params.WORKGROUPSIZE_X),
+      (uint32_t)(params.DISPATCH_Y * params.WORKGROUPSIZE_Y),
+      (uint32_t)(params.DISPATCH_Z * params.WORKGROUPSIZE_Z)};
+  const uint32_t current[3] = {(uint32_t)params.WORKGROUPSIZE_X,
+                               (uint32_t)params.WORKGROUPSIZE_Y,
+                               (uint32_t)params.WORKGROUPSIZE_Z};
+  std::vector<uint32_t> sizes[3];
+  for (int i = 0; i < 3; i++)
+    sizes[i] = getAxisSizes(invocations[i], limits.maxComputeWorkGroupSize[i],
+                            current[i]);
+
+  std::vector<TuningDatabase::Entry> candidates;
+  for (uint32_t x : sizes[0]) {
+    for (uint32_t y : sizes[1]) {
+      for (uint32_t z : sizes[2]) {
+        if ((uint64_t)x * y * z > limits.maxComputeWorkGroupInvocations)
+          continue;
+        TuningDatabase::Entry entry;
+        entry.workgroupSizeX = x;
+        entry.workgroupSizeY = y;
+        entry.workgroupSizeZ = z;
+        candidates.push_back(entry);
+      }
+    }
+  }
+  return candidates;
+}
+
+TuningDatabase::Entry
+WorkgroupTuner::tune(const ComputeOp::InitParams &params) {
+  return tune(params, Options());
+}
+
+TuningDatabase::Entry
+WorkgroupTuner::tune(const ComputeOp::InitParams &params,
+                     const Options &options, OpFactory factory) {
+  const std::string key = params.getTuningKey();
+  TuningDatabase &database = context_->getTuningDatabase();
+  TuningDatabase::Entry best;
+  candidates_.clear();
+  if (!options.retune && database.find(key, &best))
+    return best;
+  if (!factory) {
+    factory = [](const ComputeOp::InitParams &params,
+                 std::shared_ptr<ComputeContext> context) -> ComputeOp * {
+      return new ComputeBufferOp(params, context);
+    };
+  }
+
+  std::vector<TuningDatabase::Entry> entries = getCandidates(params);
+  // Drop workgroups below minInvocations unless nothing else fits.
+  std::vector<TuningDatabase::Entry> large;
+  for (const TuningDatabase::Entry &entry : entries) {
+    if (entry.workgroupSizeX * entry.workgroupSizeY * entry.workgroupSizeZ >=
+        options.minInvocations)
+      large.push_back(entry);
+  }
+  if (!large.empty())
+    entries.swap(large);
+  assert(!entries.empty());
+
+  // Resized by run(), which moves the input as is when it is already of the
+  // element type.
+  ElementVector output;
+  bool timestamps = true;
+  for (const TuningDatabase::Entry &entry : entries) {
+    ComputeOp::InitParams candidateParams = params;
+    candidateParams.useTunedWorkgroupSize = false;
+    candidateParams.DISPATCH_X = params.DISPATCH_X * params.WORKGROUPSIZE_X /
+                                 entry.workgroupSizeX;
+    candidateParams.DISPATCH_Y = params.DISPATCH_Y * params.WORKGROUPSIZE_Y /
+                                 entry.workgroupSizeY;
+    candidateParams.DISPATCH_Z = params.DISPATCH_Z * params.WORKGROUPSIZE_Z /
+                                 entry.workgroupSizeZ;
+    candidateParams.WORKGROUPSIZE_X = entry.workgroupSizeX;
+    candidateParams.WORKGROUPSIZE_Y = entry.workgroupSizeY;
+    candidateParams.WORKGROUPSIZE_Z = entry.workgroupSizeZ;
+    std::unique_ptr<ComputeOp> op(factory(candidateParams, context_));
+    op->prepare();
+    op->run(params.computeInput, output);
+
+    std::vector<double> dispatchMs(options.iterations);
+    std::vector<double> runMs(options.iterations);
+    for (uint32_t i = 0; i < options.iterations; i++) {
+      auto begin = Clock::now();
+      op->run(params.computeInput, output);
+      runMs[i] =
+          (double)std::chrono::duration_cast<std::chrono::nanoseconds>(
+              Clock::now() - begin)
+              .count() /
+          NS2MS;
+      dispatchMs[i] = op->getDispatchMs();
+    }
+    Candidate candidate;
+    candidate.entry = entry;
+    candidate.entry.ms = medianMs(dispatchMs);
+    candidate.runMs = medianMs(runMs);
+    timestamps = timestamps && candidate.entry.ms > 0.0;
+    candidates_.push_back(candidate);
+  }
+
+  const Candidate *fastest = &candidates_[0];
+  for (const Candidate &candidate : candidates_) {
+    const bool faster = timestamps ? candidate.entry.ms < fastest->entry.ms
+                                   : candidate.runMs < fastest->runMs;
+    if (faster)
+      fastest = &candidate;
+  }
+  best = fastest->entry;
+  if (!timestamps)
+    best.ms = fastest->runMs;
+  database.store(key, best);
+  LOG("Tuned %s: %ux%ux%u, %fms (%s) of %zu candidates\n", key.c_str(),
+      best.workgroupSizeX, best.workgroupSizeY, best.workgroupSizeZ, best.ms,
+      timestamps ? "GPU" : "wall clock", candidates_.size());
+  return best;
+}
@@ -0,0 +1,70 @@
+/*
+ * Copyright (C) 2020 by Xu Xing (xu.xing@outlook.com)
+ *
+ * This code is licensed under the MIT license (MIT)
+ * (http://opensource.org/licenses/MIT)
+ */
+#ifndef WORKGROUP_TUNER_H_
+#define WORKGROUP_TUNER_H_
+
+#include <functional>
+#include <memory>
+#include <vector>
+
+#include "ComputeOp.h"
+
+// Finds the fastest workgroup size for an op configuration by running the
+// op with each candidate and comparing the GPU time of its dispatch. The
+// winner goes into the context's TuningDatabase, from which ops with the
+// same InitParams::getTuningKey() take it when they are prepared.
+//
+// Candidates are powers of two along each axis, plus the size in params,
+// within maxComputeWorkGroupSize and maxComputeWorkGroupInvocations. Only
+// sizes that divide the invocation count (DISPATCH_* x WORKGROUPSIZE_*)
+// along every axis are tried, so each covers exactly the same invocations
+// and shaders without bounds checks stay in bounds.
+class WorkgroupTuner {
+public:
+  // Creates the op to time; ComputeBufferOp by default.
+  typedef std::function<ComputeOp *(const ComputeOp::InitParams &,
+                                    std::shared_ptr<ComputeContext>)>
+      OpFactory;
+
+  struct Options {
+    // Timed runs per candidate, after one warmup run. The median counts.
+    uint32_t iterations = 5;
+    // Smallest workgroup tried, unless the whole dispatch is smaller.
+    // Workgroups under a SIMD width leave lanes idle.
+    uint32_t minInvocations = 32;
+    // Tune again even when the database already has the configuration.
+    bool retune = false;
+  };
+
+  struct Candidate {
+    TuningDatabase::Entry entry;
+    // Wall clock time of a run, used when the op records no timestamps.
+    double runMs = 0.0;
+  };
+
+  explicit WorkgroupTuner(std::shared_ptr<ComputeContext> context);
+
+  std::vector<TuningDatabase::Entry>
+  getCandidates(const ComputeOp::InitParams &params) const;
+  // Tunes params and stores the fastest size. Returns it, or the stored
+  // entry when there is one and options.retune is off. params must hold
+  // input and filter data for run().
+  TuningDatabase::Entry tune(const ComputeOp::InitParams &params,
+                             const Options &options,
+                             OpFactory factory = OpFactory());
+  TuningDatabase::Entry tune(const ComputeOp::InitParams &params);
+  // Every candidate timed by the last tune(), in the order tried.
+  const std::vector<Candidate> &getLastCandidates() const {
+    return candidates_;
+  }
+
+private:
+  std::shared_ptr<ComputeContext> context_;
+  std::vector<Candidate> candidates_;
+};
+
+#endif
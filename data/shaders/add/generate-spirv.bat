@@ -1,2 +1,9 @@
 glslangvalidator -V add.comp -o add.comp.spv
 glslangvalidator -V add_float.comp -o add_float.comp.spv
+glslangvalidator -V add_float_dynamic.comp -o add_float_dynamic.comp.spv
+glslangvalidator -V add_int.comp -o add_int.comp.spv
+glslangvalidator -V add_uint.comp -o add_uint.comp.spv
+glslangvalidator -V add_half.comp -o add_half.comp.spv
+glslangvalidator -V add_int8.comp -o add_int8.comp.spv
+glslangvalidator -V add_half_native.comp -o add_half_native.comp.spv
+glslangvalidator -V add_uint8.comp -o add_uint8.comp.spv
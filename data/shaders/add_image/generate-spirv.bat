@@ -1 +1,4 @@
 glslangvalidator -V add_image.comp -o add_image.comp.spv
+glslangvalidator -V add_image_dynamic.comp -o add_image_dynamic.comp.spv
+glslangvalidator -V add_image_uint8.comp -o add_image_uint8.comp.spv
+glslangvalidator -V add_image_uint8_dynamic.comp -o add_image_uint8_dynamic.comp.spv
@@ -1 +1,3 @@
 glslangvalidator -V add_vec4.comp -o add_vec4.comp.spv
+glslangvalidator -V add_vec4_half.comp -o add_vec4_half.comp.spv
+glslangvalidator -V add_vec4_half_native.comp -o add_vec4_half_native.comp.spv
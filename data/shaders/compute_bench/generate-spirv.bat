@@ -0,0 +1 @@
+glslangvalidator -V peak_fma.comp -o peak_fma.comp.spv
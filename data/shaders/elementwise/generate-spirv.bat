@@ -0,0 +1 @@
+glslangvalidator -V elementwise.comp -o elementwise.comp.spv
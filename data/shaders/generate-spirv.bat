@@ -1,2 +1,6 @@
 glslangvalidator -V conv2d_buffer.comp -o conv2d_buffer.comp.spv
 glslangvalidator -V conv2d_image.comp -o conv2d_image.comp.spv
+glslangvalidator -V conv2d_buffer_half.comp -o conv2d_buffer_half.comp.spv
+glslangvalidator -V conv2d_buffer_half_native.comp -o conv2d_buffer_half_native.comp.spv
+glslangvalidator -V conv2d_tensor.comp -o conv2d_tensor.comp.spv
+glslangvalidator -V add_tensor.comp -o add_tensor.comp.spv
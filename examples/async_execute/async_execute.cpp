@@ -0,0 +1,121 @@
+#if defined(_WIN32)
+#pragma comment(linker, "/subsystem:console")
+#elif defined(VK_USE_PLATFORM_ANDROID_KHR)
+#include "VulkanAndroid.h"
+#include <android/asset_manager.h>
+#include <android/log.h>
+#include <android/native_activity.h>
+#include <android_native_app_glue.h>
+#endif
+
+#include <algorithm>
+#include <future>
+#include <iostream>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+#include "CommandLineParser.h"
+#include "ComputeBufferOp.h"
+#include "Utils.h"
+
+#define DEBUG (!NDEBUG)
+
+// Keeps several add ops in flight on the queue with executeAsync() and
+// compares the time for a round of them against running the same ops one
+// after another with the blocking run().
+// Usage: async_execute -w 128 -h 128 -n 20
+const int OP_COUNT = 4;
+
+static double elapsedMs(const Clock::time_point &begin,
+                        const Clock::time_point &end) {
+  return (double)(std::chrono::duration_cast<std::chrono::nanoseconds>(end -
+                                                                       begin)
+                      .count()) /
+         NS2MS;
+}
+
+#if defined(VK_USE_PLATFORM_ANDROID_KHR)
+void android_main(android_app *state) { android_realmain(state); }
+#else
+int main(int argc, char **argv) {
+  CommandLineParser cmdLine(argc, argv);
+  const int width = cmdLine.getWidth();
+  const int height = cmdLine.getHeight();
+  const uint32_t iterations = std::max(1u, cmdLine.getIterations());
+  const int WORKGROUPSIZE_X = cmdLine.getWorkgroupSizeX();
+  const int WORKGROUPSIZE_Y = cmdLine.getWorkgroupSizeY();
+  const int WORKGROUPSIZE_Z = cmdLine.getWorkgroupSizeZ();
+
+  ComputeOp::InitParams params;
+  params.inputWidth = width;
+  params.inputHeight = height;
+  params.filterWidth = width;
+  params.filterHeight = height;
+  params.outputWidth = width;
+  params.outputHeight = height;
+  params.DISPATCH_X = ceil((float)width / WORKGROUPSIZE_X);
+  params.DISPATCH_Y = ceil((float)height / WORKGROUPSIZE_Y);
+  params.DISPATCH_Z = 1;
+  params.WORKGROUPSIZE_X = WORKGROUPSIZE_X;
+  params.WORKGROUPSIZE_Y = WORKGROUPSIZE_Y;
+  params.WORKGROUPSIZE_Z = WORKGROUPSIZE_Z;
+  params.computeFilter.assign(width * height, 1.0f);
+  params.computeOutput.resize(width * height);
+  params.shader_path = "shaders/add/add_float.comp.spv";
+  params.executionMode = ComputeOp::EXECUTION_MODE_SINGLE_SUBMIT;
+
+  // Each op gets its own input so results can be told apart.
+  std::vector<ComputeOp *> computeOps;
+  for (int i = 0; i < OP_COUNT; i++) {
+    params.computeInput.assign(width * height, (DATA_TYPE)(i * 100));
+    computeOps.push_back(new ComputeBufferOp(params));
+    computeOps.back()->prepare();
+  }
+
+  std::vector<DATA_TYPE> input(width * height);
+  std::vector<DATA_TYPE> output(width * height);
+  double blockingMs = 0.0;
+  for (uint32_t i = 0; i < iterations; i++) {
+    auto begin = Clock::now();
+    for (int j = 0; j < OP_COUNT; j++) {
+      std::fill(input.begin(), input.end(), (DATA_TYPE)(j * 100));
+      computeOps[j]->run(input, output);
+    }
+    blockingMs += elapsedMs(begin, Clock::now());
+  }
+
+  double asyncMs = 0.0;
+  std::vector<std::shared_future<void>> futures(OP_COUNT);
+  for (uint32_t i = 0; i < iterations; i++) {
+    auto begin = Clock::now();
+    for (int j = 0; j < OP_COUNT; j++)
+      futures[j] = computeOps[j]->executeAsync();
+    for (int j = 0; j < OP_COUNT; j++)
+      futures[j].wait();
+    asyncMs += elapsedMs(begin, Clock::now());
+  }
+  // Every op was submitted with its own input and a filter of 1.
+  int mismatches = 0;
+  for (int j = 0; j < OP_COUNT; j++) {
+    if (computeOps[j]->getOutput().getFloat(0) != (DATA_TYPE)(j * 100) + 1.0f)
+      mismatches++;
+  }
+  std::shared_ptr<ComputeContext> context = ComputeContext::getShared();
+  for (int j = 0; j < OP_COUNT; j++)
+    delete (computeOps[j]);
+
+  if (mismatches)
+    LOG("%d ops returned unexpected output\n", mismatches);
+  LOG("Queue timeline: %llu submits using %d fences\n",
+      (unsigned long long)context->getQueueTimeline().getLastSubmitted(),
+      context->getQueueTimeline().getFenceCount());
+  LOG("%d ops x%d: blocking run() avg %fms per round\n", OP_COUNT, iterations,
+      blockingMs / iterations);
+  LOG("%d ops x%d: executeAsync() avg %fms per round\n", OP_COUNT, iterations,
+      asyncMs / iterations);
+  return 0;
+}
+#endif
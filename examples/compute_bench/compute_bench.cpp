@@ -0,0 +1,602 @@
+#if defined(_WIN32)
+#pragma comment(linker, "/subsystem:console")
+#elif defined(VK_USE_PLATFORM_ANDROID_KHR)
+#include "VulkanAndroid.h"
+#include <android/asset_manager.h>
+#include <android/log.h>
+#include <android/native_activity.h>
+#include <android_native_app_glue.h>
+#endif
+
+#include <algorithm>
+#include <iostream>
+#include <iterator>
+#include <math.h>
+#include <memory>
+#include <set>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+#include "ChromeTracer.h"
+#include "CommandLineParser.h"
+#include "ComputeBufferOp.h"
+#include "ComputeImageOp.h"
+#include "SkTraceEvent.h"
+#include "Utils.h"
+
+#define DEBUG (!NDEBUG)
+
+// Benchmarks the add, add_vec4, add_image, add_imager32f, conv2d_buffer and
+// conv2d_image kernels over every combination of the given sizes, workgroup
+// sizes and element types in one process, replacing the add1_batch.bat and
+// add16_batch.bat scripts that ran one example process per iteration.
+//
+// Each case is prepared once, warmed up for -warmup ms (and at least
+// WARMUP_ITERATIONS runs) like vks::Benchmark, then run -n times, and on
+// until -t ms have passed. The median and p99 of the run() wall clock time
+// and of the dispatch GPU time are reported, as a table on the log and as
+// CSV and JSON to the files given with -csv and -json ("-" for stdout).
+//
+// Each case also reports its bandwidth and arithmetic throughput, from the
+// bytes and FLOPs the op declares (ComputeOp::getBytesMoved, getFlops) over
+// its median GPU time, as a percentage of peaks measured at startup: the
+// fill bandwidth of ComputeContext::measureThroughput() and the FLOP rate of
+// the peak_fma kernel. The roofline percentage compares the FLOP rate with
+// the lower of the compute peak and arithmetic intensity x bandwidth peak,
+// so kernels far from 100% have room left whichever bound they hit.
+//
+// None of the buffer shaders check bounds, so combinations whose workgroup
+// does not divide the invocation grid are skipped rather than rounded up.
+// Kernels with a fixed workgroup (add_imager32f, conv2d_image) run once per
+// size and type. Types are element type names (float, half, int, uint,
+// int8, uint8); add_image also runs uint8, the other image kernels float
+// only. Host data is made in the element type, so runs upload it as is.
+//
+// -trace writes a Chrome trace of the whole run, with the GPU ranges of each
+// case (the last GpuProfiler::MAX_RESULTS of them) on a track of their own.
+// Usage: compute_bench -ops add,conv2d_buffer -sizes 1024x1024,4096x256
+//        -wgs 1x1x1,16x16x1 -formats float,half -n 20 -csv bench.csv
+//        -trace bench_trace.json
+const int WARMUP_ITERATIONS = 3;
+
+struct Kernel {
+  const char *name;
+  bool image;
+  // Shader of the float kernel; other types append "_<type name>" to the
+  // part before ".comp.spv" unless floatSuffix, in which case float does too
+  // (shaders/add/add_float.comp.spv).
+  const char *shaderPrefix;
+  bool floatSuffix;
+  std::vector<ElementType> types;
+  // Texel components of the image kernels, in which elements go.
+  uint32_t components;
+  // Whether the shader takes its workgroup size from constants 0-2.
+  bool specializedWorkgroup;
+  // Elements each invocation computes along x.
+  int elementsPerInvocationX;
+  // 3x3 filter with no padding instead of an elementwise filter.
+  bool conv;
+};
+
+static const Kernel KERNELS[] = {
+    {"add", false, "shaders/add/add", true,
+     {ELEMENT_TYPE_FLOAT32, ELEMENT_TYPE_FLOAT16, ELEMENT_TYPE_INT32,
+      ELEMENT_TYPE_UINT32, ELEMENT_TYPE_INT8, ELEMENT_TYPE_UINT8},
+     1, true, 1, false},
+    {"add_vec4", false, "shaders/add_vec4/add_vec4", false,
+     {ELEMENT_TYPE_FLOAT32, ELEMENT_TYPE_FLOAT16}, 1, true, 4, false},
+    {"add_image", true, "shaders/add_image/add_image", false,
+     {ELEMENT_TYPE_FLOAT32, ELEMENT_TYPE_UINT8}, 4, true, 1, false},
+    {"add_imager32f", true, "shaders/add_imager32f/add_imager32f", false,
+     {ELEMENT_TYPE_FLOAT32}, 1, false, 1, false},
+    {"conv2d_buffer", false, "shaders/conv2d_buffer", false,
+     {ELEMENT_TYPE_FLOAT32, ELEMENT_TYPE_FLOAT16}, 1, true, 1, true},
+    {"conv2d_image", true, "shaders/conv2d_image", false,
+     {ELEMENT_TYPE_FLOAT32}, 4, false, 1, true},
+};
+
+struct Options {
+  std::vector<const Kernel *> kernels;
+  std::vector<std::pair<int, int>> sizes;
+  std::vector<TuningDatabase::Entry> workgroupSizes;
+  std::vector<ElementType> types;
+  ComputeOp::ExecutionMode executionMode =
+      ComputeOp::EXECUTION_MODE_SINGLE_SUBMIT;
+  uint32_t repetitions = 10;
+  double warmupMs = 100.0;
+  double durationMs = 0.0;
+};
+
+struct Result {
+  const Kernel *kernel = nullptr;
+  int width = 0;
+  int height = 0;
+  TuningDatabase::Entry workgroupSize;
+  ElementType type = ELEMENT_TYPE_FLOAT32;
+  size_t repetitions = 0;
+  double runMedianMs = 0.0;
+  double runP99Ms = 0.0;
+  double gpuMedianMs = 0.0;
+  double gpuP99Ms = 0.0;
+  double pipelineMs = 0.0;
+  uint64_t bytes = 0;
+  uint64_t flops = 0;
+  double gbPerS = 0.0;
+  double gflopPerS = 0.0;
+  double bandwidthPercent = 0.0;
+  double computePercent = 0.0;
+  double rooflinePercent = 0.0;
+};
+
+// Measured device peaks the results are compared with.
+struct Peaks {
+  double gbPerS = 0.0;
+  double gflopPerS = 0.0;
+};
+
+// Shape and loop count of the peak_fma kernel.
+const int PEAK_WIDTH = 1024;
+const int PEAK_HEIGHT = 1024;
+const int PEAK_WORKGROUP_SIZE = 64;
+const uint32_t PEAK_ITERATIONS = 256;
+const int PEAK_REPETITIONS = 5;
+
+static const char *EXECUTION_MODE_NAMES[] = {"staged", "single_submit",
+                                             "zero_staging"};
+
+static double elapsedMs(const Clock::time_point &begin,
+                        const Clock::time_point &end) {
+  return (double)(std::chrono::duration_cast<std::chrono::nanoseconds>(end -
+                                                                       begin)
+                      .count()) /
+         NS2MS;
+}
+
+// Nearest rank percentile of values, which must not be empty.
+static double percentile(std::vector<double> values, double percent) {
+  std::sort(values.begin(), values.end());
+  size_t rank = (size_t)ceil(percent / 100.0 * values.size());
+  return values[std::max((size_t)1, rank) - 1];
+}
+
+static std::vector<std::string> split(const std::string &text) {
+  std::vector<std::string> items;
+  size_t begin = 0;
+  while (begin <= text.size()) {
+    size_t end = text.find(',', begin);
+    if (end == std::string::npos)
+      end = text.size();
+    if (end > begin)
+      items.push_back(text.substr(begin, end - begin));
+    begin = end + 1;
+  }
+  return items;
+}
+
+static std::string getShaderPath(const Kernel &kernel, ElementType type) {
+  std::string path = kernel.shaderPrefix;
+  if (type != ELEMENT_TYPE_FLOAT32 || kernel.floatSuffix)
+    path += std::string("_") + getElementTypeName(type);
+  return path + ".comp.spv";
+}
+
+static bool parseOptions(CommandLineParser &cmdLine, Options *options) {
+  std::string text = cmdLine.getCmdOption("-ops");
+  if (text.empty()) {
+    for (const Kernel &kernel : KERNELS)
+      options->kernels.push_back(&kernel);
+  }
+  for (const std::string &name : split(text)) {
+    const Kernel *kernel =
+        std::find_if(std::begin(KERNELS), std::end(KERNELS),
+                     [&](const Kernel &k) { return name == k.name; });
+    if (kernel == std::end(KERNELS)) {
+      LOG("Invalid op %s\n", name.c_str());
+      return false;
+    }
+    options->kernels.push_back(kernel);
+  }
+
+  text = cmdLine.getCmdOption("-sizes");
+  for (const std::string &size :
+       split(text.empty() ? "256x256,1024x1024,4096x256" : text)) {
+    int width = 0, height = 0;
+    if (sscanf(size.c_str(), "%dx%d", &width, &height) != 2 || width <= 0 ||
+        height <= 0) {
+      LOG("Invalid size %s, expected <width>x<height>\n", size.c_str());
+      return false;
+    }
+    options->sizes.push_back(std::make_pair(width, height));
+  }
+
+  text = cmdLine.getCmdOption("-wgs");
+  for (const std::string &size : split(text.empty() ? "1x1x1,16x16x1" : text)) {
+    TuningDatabase::Entry entry;
+    if (sscanf(size.c_str(), "%ux%ux%u", &entry.workgroupSizeX,
+               &entry.workgroupSizeY, &entry.workgroupSizeZ) != 3 ||
+        !entry.workgroupSizeX || !entry.workgroupSizeY ||
+        !entry.workgroupSizeZ) {
+      LOG("Invalid workgroup size %s, expected <x>x<y>x<z>\n", size.c_str());
+      return false;
+    }
+    options->workgroupSizes.push_back(entry);
+  }
+
+  text = cmdLine.getCmdOption("-formats");
+  for (const std::string &name : split(text.empty() ? "float" : text)) {
+    const ElementType types[] = {ELEMENT_TYPE_FLOAT32, ELEMENT_TYPE_INT32,
+                                 ELEMENT_TYPE_UINT32, ELEMENT_TYPE_FLOAT16,
+                                 ELEMENT_TYPE_INT8, ELEMENT_TYPE_UINT8};
+    const ElementType *type =
+        std::find_if(std::begin(types), std::end(types), [&](ElementType t) {
+          return name == getElementTypeName(t);
+        });
+    if (type == std::end(types)) {
+      LOG("Invalid format %s, expected an element type name\n", name.c_str());
+      return false;
+    }
+    options->types.push_back(*type);
+  }
+
+  text = cmdLine.getCmdOption("-mode");
+  if (!text.empty()) {
+    const char **mode = std::find(std::begin(EXECUTION_MODE_NAMES),
+                                  std::end(EXECUTION_MODE_NAMES), text);
+    if (mode == std::end(EXECUTION_MODE_NAMES)) {
+      LOG("Invalid mode %s\n", text.c_str());
+      return false;
+    }
+    options->executionMode = (ComputeOp::ExecutionMode)(
+        mode - std::begin(EXECUTION_MODE_NAMES));
+  }
+  options->repetitions = std::max(1u, cmdLine.getIterations());
+  if (!cmdLine.getCmdOption("-warmup").empty())
+    options->warmupMs = atof(cmdLine.getCmdOption("-warmup").c_str());
+  if (!cmdLine.getCmdOption("-t").empty())
+    options->durationMs = atof(cmdLine.getCmdOption("-t").c_str());
+  return true;
+}
+
+// Fills params for kernel on a width x height input, in the shapes and
+// dispatch of its example. Returns false when the workgroup does not divide
+// the invocation grid.
+static bool getParams(const Kernel &kernel, int width, int height,
+                      TuningDatabase::Entry workgroupSize, ElementType type,
+                      ComputeOp::InitParams *params) {
+  if (!kernel.specializedWorkgroup)
+    workgroupSize = TuningDatabase::Entry();
+  params->inputWidth = width;
+  params->inputHeight = height;
+  params->filterWidth = kernel.conv ? 3 : width;
+  params->filterHeight = kernel.conv ? 3 : height;
+  params->outputWidth = kernel.conv ? width - params->filterWidth + 1 : width;
+  params->outputHeight =
+      kernel.conv ? height - params->filterHeight + 1 : height;
+  if (params->outputWidth <= 0 || params->outputHeight <= 0)
+    return false;
+  if (params->outputWidth % kernel.elementsPerInvocationX != 0)
+    return false;
+  const uint32_t gridX = params->outputWidth / kernel.elementsPerInvocationX;
+  const uint32_t gridY = params->outputHeight;
+  if (gridX % workgroupSize.workgroupSizeX != 0 ||
+      gridY % workgroupSize.workgroupSizeY != 0 ||
+      workgroupSize.workgroupSizeZ != 1)
+    return false;
+  params->WORKGROUPSIZE_X = workgroupSize.workgroupSizeX;
+  params->WORKGROUPSIZE_Y = workgroupSize.workgroupSizeY;
+  params->WORKGROUPSIZE_Z = workgroupSize.workgroupSizeZ;
+  params->DISPATCH_X = gridX / workgroupSize.workgroupSizeX;
+  params->DISPATCH_Y = gridY / workgroupSize.workgroupSizeY;
+  params->DISPATCH_Z = 1;
+  params->shader_path = getShaderPath(kernel, type);
+  params->elementType = type;
+  if (kernel.image)
+    params->format = getElementFormat(type, kernel.components);
+  // Measure the workgroup size asked for, not one the tuner stored.
+  params->useTunedWorkgroupSize = false;
+
+  params->computeInput.reset(type, width * height);
+  for (int i = 0; i < width * height; i++)
+    params->computeInput.setFloat(i, (float)(i % 100));
+  params->computeFilter.reset(type,
+                              params->filterWidth * params->filterHeight);
+  for (size_t i = 0; i < params->computeFilter.size(); i++)
+    params->computeFilter.setFloat(i, (float)(i % 7));
+  return true;
+}
+
+static Result runCase(const ComputeOp::InitParams &params,
+                      std::shared_ptr<ComputeContext> context,
+                      const Kernel &kernel, const Options &options) {
+  TRACE_EVENT1("bench", "runCase", "kernel", kernel.name);
+  std::unique_ptr<ComputeOp> op(
+      kernel.image ? (ComputeOp *)new ComputeImageOp(params, context)
+                   : (ComputeOp *)new ComputeBufferOp(params, context));
+  op->prepare();
+  ElementVector output;
+
+  double warmedMs = 0.0;
+  for (int i = 0; i < WARMUP_ITERATIONS || warmedMs < options.warmupMs; i++) {
+    auto begin = Clock::now();
+    op->run(params.computeInput, output);
+    warmedMs += elapsedMs(begin, Clock::now());
+  }
+
+  std::vector<double> runMs;
+  std::vector<double> gpuMs;
+  double totalMs = 0.0;
+  while (runMs.size() < options.repetitions || totalMs < options.durationMs) {
+    auto begin = Clock::now();
+    op->run(params.computeInput, output);
+    runMs.push_back(elapsedMs(begin, Clock::now()));
+    gpuMs.push_back(op->getDispatchMs());
+    totalMs += runMs.back();
+  }
+
+  Result result;
+  result.kernel = &kernel;
+  result.width = params.inputWidth;
+  result.height = params.inputHeight;
+  result.workgroupSize.workgroupSizeX = params.WORKGROUPSIZE_X;
+  result.workgroupSize.workgroupSizeY = params.WORKGROUPSIZE_Y;
+  result.workgroupSize.workgroupSizeZ = params.WORKGROUPSIZE_Z;
+  result.type = params.elementType;
+  result.repetitions = runMs.size();
+  result.runMedianMs = percentile(runMs, 50.0);
+  result.runP99Ms = percentile(runMs, 99.0);
+  result.gpuMedianMs = percentile(gpuMs, 50.0);
+  result.gpuP99Ms = percentile(gpuMs, 99.0);
+  result.pipelineMs = op->getPipelineCreationMs();
+  result.bytes = op->getBytesMoved();
+  result.flops = op->getFlops();
+  return result;
+}
+
+// The fastest of a few runs of the peak_fma kernel, and the fill bandwidth
+// of the context.
+static Peaks measurePeaks(std::shared_ptr<ComputeContext> context) {
+  Peaks peaks;
+  peaks.gbPerS = context->measureThroughput();
+
+  ComputeOp::InitParams params;
+  params.inputWidth = params.filterWidth = params.outputWidth = PEAK_WIDTH;
+  params.inputHeight = params.filterHeight = params.outputHeight =
+      PEAK_HEIGHT;
+  params.WORKGROUPSIZE_X = PEAK_WORKGROUP_SIZE;
+  params.DISPATCH_X = PEAK_WIDTH / PEAK_WORKGROUP_SIZE;
+  params.DISPATCH_Y = PEAK_HEIGHT;
+  params.shader_path = "shaders/compute_bench/peak_fma.comp.spv";
+  params.executionMode = ComputeOp::EXECUTION_MODE_SINGLE_SUBMIT;
+  params.useTunedWorkgroupSize = false;
+  params.specializationConstants.push_back(PEAK_ITERATIONS);
+  // 8 fmas on vec4 per iteration.
+  params.flopsPerOutput = PEAK_ITERATIONS * 8 * 4 * 2;
+  // Chains converge to 1 rather than overflow.
+  params.computeInput.assign(PEAK_WIDTH * PEAK_HEIGHT, 0.5f);
+  params.computeFilter.assign(PEAK_WIDTH * PEAK_HEIGHT, 0.5f);
+
+  ComputeBufferOp op(params, context);
+  op.prepare();
+  ElementVector output;
+  op.run(params.computeInput, output);
+  double fastestMs = 0.0;
+  for (int i = 0; i < PEAK_REPETITIONS; i++) {
+    auto begin = Clock::now();
+    op.run(params.computeInput, output);
+    double ms = op.getDispatchMs();
+    if (ms <= 0.0)
+      ms = elapsedMs(begin, Clock::now());
+    if (i == 0 || ms < fastestMs)
+      fastestMs = ms;
+  }
+  if (fastestMs > 0.0)
+    peaks.gflopPerS = (double)op.getFlops() / fastestMs / 1e6;
+  return peaks;
+}
+
+// Fills the achieved rates of result and how close they are to peaks. Runs
+// without GPU timestamps use the run() wall clock time.
+static void setRoofline(const Peaks &peaks, Result *result) {
+  const double ms =
+      result->gpuMedianMs > 0.0 ? result->gpuMedianMs : result->runMedianMs;
+  if (ms <= 0.0)
+    return;
+  result->gbPerS = (double)result->bytes / ms / 1e6;
+  result->gflopPerS = (double)result->flops / ms / 1e6;
+  if (peaks.gbPerS > 0.0)
+    result->bandwidthPercent = 100.0 * result->gbPerS / peaks.gbPerS;
+  if (peaks.gflopPerS > 0.0)
+    result->computePercent = 100.0 * result->gflopPerS / peaks.gflopPerS;
+  // FLOPs per byte times GB/s is GFLOP/s.
+  const double intensity = (double)result->flops / result->bytes;
+  const double attainable =
+      std::min(peaks.gflopPerS, intensity * peaks.gbPerS);
+  if (attainable > 0.0)
+    result->rooflinePercent = 100.0 * result->gflopPerS / attainable;
+}
+
+// Opens path for writing; "-" is stdout.
+static FILE *openOutput(const std::string &path) {
+  if (path == "-")
+    return stdout;
+  FILE *file = fopen(path.c_str(), "w");
+  if (!file)
+    LOG("Cannot write %s\n", path.c_str());
+  return file;
+}
+
+static void closeOutput(FILE *file) {
+  if (file && file != stdout)
+    fclose(file);
+}
+
+static void writeCsv(FILE *file, const std::vector<Result> &results,
+                     const Options &options) {
+  fprintf(file, "op,format,width,height,workgroup_x,workgroup_y,workgroup_z,"
+                "mode,repetitions,run_median_ms,run_p99_ms,gpu_median_ms,"
+                "gpu_p99_ms,pipeline_ms,bytes,flops,gb_per_s,gflop_per_s,"
+                "bandwidth_percent,compute_percent,roofline_percent\n");
+  for (const Result &result : results) {
+    fprintf(file,
+            "%s,%s,%d,%d,%u,%u,%u,%s,%zu,%f,%f,%f,%f,%f,%llu,%llu,%f,%f,%f,"
+            "%f,%f\n",
+            result.kernel->name, getElementTypeName(result.type),
+            result.width, result.height, result.workgroupSize.workgroupSizeX,
+            result.workgroupSize.workgroupSizeY,
+            result.workgroupSize.workgroupSizeZ,
+            EXECUTION_MODE_NAMES[options.executionMode], result.repetitions,
+            result.runMedianMs, result.runP99Ms, result.gpuMedianMs,
+            result.gpuP99Ms, result.pipelineMs,
+            (unsigned long long)result.bytes,
+            (unsigned long long)result.flops, result.gbPerS,
+            result.gflopPerS, result.bandwidthPercent, result.computePercent,
+            result.rooflinePercent);
+  }
+}
+
+static void writeJson(FILE *file, const std::vector<Result> &results,
+                      const Options &options, const Peaks &peaks,
+                      const VkPhysicalDeviceProperties &properties) {
+  std::string device;
+  for (const char *c = properties.deviceName; *c; c++) {
+    if (*c == '"' || *c == '\\')
+      device += '\\';
+    device += *c;
+  }
+  fprintf(file,
+          "{\n  \"device\": \"%s\",\n  \"driverVersion\": %u,\n"
+          "  \"mode\": \"%s\",\n  \"peakGBPerS\": %f,\n"
+          "  \"peakGFLOPPerS\": %f,\n  \"results\": [",
+          device.c_str(), properties.driverVersion,
+          EXECUTION_MODE_NAMES[options.executionMode], peaks.gbPerS,
+          peaks.gflopPerS);
+  for (size_t i = 0; i < results.size(); i++) {
+    const Result &result = results[i];
+    fprintf(file,
+            "%s\n    {\"op\": \"%s\", \"format\": \"%s\", \"width\": %d, "
+            "\"height\": %d, \"workgroup\": [%u, %u, %u], "
+            "\"repetitions\": %zu, \"runMedianMs\": %f, \"runP99Ms\": %f, "
+            "\"gpuMedianMs\": %f, \"gpuP99Ms\": %f, \"pipelineMs\": %f, "
+            "\"bytes\": %llu, \"flops\": %llu, \"gbPerS\": %f, "
+            "\"gflopPerS\": %f, \"bandwidthPercent\": %f, "
+            "\"computePercent\": %f, \"rooflinePercent\": %f}",
+            i ? "," : "", result.kernel->name,
+            getElementTypeName(result.type), result.width, result.height,
+            result.workgroupSize.workgroupSizeX,
+            result.workgroupSize.workgroupSizeY,
+            result.workgroupSize.workgroupSizeZ, result.repetitions,
+            result.runMedianMs, result.runP99Ms, result.gpuMedianMs,
+            result.gpuP99Ms, result.pipelineMs,
+            (unsigned long long)result.bytes,
+            (unsigned long long)result.flops, result.gbPerS,
+            result.gflopPerS, result.bandwidthPercent, result.computePercent,
+            result.rooflinePercent);
+  }
+  fprintf(file, "\n  ]\n}\n");
+}
+
+#if defined(VK_USE_PLATFORM_ANDROID_KHR)
+void android_main(android_app *state) { android_realmain(state); }
+#else
+int main(int argc, char **argv) {
+  CommandLineParser cmdLine(argc, argv);
+  Options options;
+  if (!parseOptions(cmdLine, &options))
+    return 1;
+  // The tracer has to be installed before any op runs.
+  const std::string tracePath = cmdLine.getCmdOption("-trace");
+  ChromeTracer *tracer =
+      tracePath.empty() ? nullptr : ChromeTracer::install();
+  if (tracer)
+    tracer->setEnabled(true);
+  std::shared_ptr<ComputeContext> context = ComputeContext::create();
+  const double gpuOffsetMs = tracer ? context->calibrateTimestamps() : 0.0;
+  const Peaks peaks = measurePeaks(context);
+  LOG("Peaks: %f GB/s fill bandwidth, %f GFLOP/s fp32 fma\n", peaks.gbPerS,
+      peaks.gflopPerS);
+  const VkPhysicalDeviceLimits &limits =
+      context->getDeviceProperties().limits;
+
+  std::vector<Result> results;
+  // Configurations already run, by tuning key and workgroup size, as kernels
+  // with a fixed workgroup give the same one for every -wgs entry.
+  std::set<std::string> done;
+  for (const Kernel *kernel : options.kernels) {
+    for (ElementType type : options.types) {
+      if (std::find(kernel->types.begin(), kernel->types.end(), type) ==
+          kernel->types.end())
+        continue;
+      // Images of the types need no storage buffer features.
+      if (!kernel->image && !context->supportsElementType(type)) {
+        LOG("%s %s: not supported by the device, skipped\n", kernel->name,
+            getElementTypeName(type));
+        continue;
+      }
+      for (const std::pair<int, int> &size : options.sizes) {
+        for (const TuningDatabase::Entry &workgroupSize :
+             options.workgroupSizes) {
+          ComputeOp::InitParams params;
+          params.executionMode = options.executionMode;
+          if (!getParams(*kernel, size.first, size.second, workgroupSize,
+                         type, &params)) {
+            LOG("%s %s %dx%d: workgroup %ux%ux%u does not divide the grid, "
+                "skipped\n",
+                kernel->name, getElementTypeName(type), size.first,
+                size.second, workgroupSize.workgroupSizeX,
+                workgroupSize.workgroupSizeY, workgroupSize.workgroupSizeZ);
+            continue;
+          }
+          if (params.WORKGROUPSIZE_X <= 0 || params.WORKGROUPSIZE_Y <= 0)
+            continue;
+          const uint32_t workgroupSizeX = (uint32_t)params.WORKGROUPSIZE_X;
+          const uint32_t workgroupSizeY = (uint32_t)params.WORKGROUPSIZE_Y;
+          if (workgroupSizeX > limits.maxComputeWorkGroupSize[0] ||
+              workgroupSizeY > limits.maxComputeWorkGroupSize[1] ||
+              workgroupSizeX * workgroupSizeY >
+                  limits.maxComputeWorkGroupInvocations)
+            continue;
+          const std::string key =
+              params.getTuningKey() + " " +
+              std::to_string(params.WORKGROUPSIZE_X) + "x" +
+              std::to_string(params.WORKGROUPSIZE_Y);
+          if (!done.insert(key).second)
+            continue;
+
+          Result result = runCase(params, context, *kernel, options);
+          setRoofline(peaks, &result);
+          if (tracer)
+            tracer->addGpuResults(context->getProfiler().takeResults(),
+                                  gpuOffsetMs);
+          LOG("%s %s %dx%d wg %dx%dx%d: run median %fms p99 %fms, GPU "
+              "median %fms p99 %fms (%zu runs)\n",
+              kernel->name, getElementTypeName(type), size.first,
+              size.second, params.WORKGROUPSIZE_X, params.WORKGROUPSIZE_Y,
+              params.WORKGROUPSIZE_Z, result.runMedianMs, result.runP99Ms,
+              result.gpuMedianMs, result.gpuP99Ms, result.repetitions);
+          LOG("  %f GB/s (%.1f%% of peak), %f GFLOP/s (%.1f%% of peak), "
+              "%.1f%% of roofline\n",
+              result.gbPerS, result.bandwidthPercent, result.gflopPerS,
+              result.computePercent, result.rooflinePercent);
+          results.push_back(result);
+        }
+      }
+    }
+  }
+
+  const std::string csvPath = cmdLine.getCmdOption("-csv");
+  if (FILE *file = csvPath.empty() ? nullptr : openOutput(csvPath)) {
+    writeCsv(file, results, options);
+    closeOutput(file);
+  }
+  const std::string jsonPath = cmdLine.getCmdOption("-json");
+  if (FILE *file = jsonPath.empty() ? nullptr : openOutput(jsonPath)) {
+    writeJson(file, results, options, peaks, context->getDeviceProperties());
+    closeOutput(file);
+  }
+  if (tracer && !tracer->write(tracePath))
+    LOG("Failed to write %s\n", tracePath.c_str());
+  return 0;
+}
+#endif
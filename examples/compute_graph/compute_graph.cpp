@@ -0,0 +1,254 @@
+#if defined(_WIN32)
+#pragma comment(linker, "/subsystem:console")
+#elif defined(VK_USE_PLATFORM_ANDROID_KHR)
+#include "VulkanAndroid.h"
+#include <android/asset_manager.h>
+#include <android/log.h>
+#include <android/native_activity.h>
+#include <android_native_app_glue.h>
+#endif
+
+#include <algorithm>
+#include <iostream>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+#include "CommandLineParser.h"
+#include "ComputeGraph.h"
+#include "Utils.h"
+
+#define DEBUG (!NDEBUG)
+
+// Runs conv2d -> add -> conv2d on -b batches of -c channels two ways: as
+// separate ops whose outputs go back to the host and are uploaded again for
+// the next op, and as a ComputeGraph that records all three into one
+// command buffer and only downloads the final output. Reports the median
+// time and the bytes copied between host and device per run of each, and
+// checks both against the CPU.
+// Usage: compute_graph -w 256 -h 256 -b 2 -c 16 -n 20
+const int WARMUP_ITERATIONS = 3;
+const uint32_t FILTER_SIZE = 3;
+
+static double elapsedMs(const Clock::time_point &begin,
+                        const Clock::time_point &end) {
+  return (double)(std::chrono::duration_cast<std::chrono::nanoseconds>(end -
+                                                                       begin)
+                      .count()) /
+         NS2MS;
+}
+
+static int getOption(const CommandLineParser &cmdLine, const char *option,
+                     int defaultValue) {
+  const std::string &value = cmdLine.getCmdOption(option);
+  return value.empty() ? defaultValue : std::max(1, atoi(value.c_str()));
+}
+
+// The same convolution as shaders/conv2d_tensor.comp on NCHW data.
+static std::vector<float> conv2d(const std::vector<float> &input,
+                                 const std::vector<uint32_t> &shape,
+                                 const std::vector<float> &filter) {
+  const uint32_t n = shape[0], c = shape[1], h = shape[2], w = shape[3];
+  const uint32_t oh = h - FILTER_SIZE + 1, ow = w - FILTER_SIZE + 1;
+  std::vector<float> output((size_t)n * c * oh * ow);
+  for (uint32_t b = 0; b < n; b++)
+    for (uint32_t oc = 0; oc < c; oc++)
+      for (uint32_t y = 0; y < oh; y++)
+        for (uint32_t x = 0; x < ow; x++) {
+          float acc = 0.0f;
+          for (uint32_t ic = 0; ic < c; ic++)
+            for (uint32_t fy = 0; fy < FILTER_SIZE; fy++)
+              for (uint32_t fx = 0; fx < FILTER_SIZE; fx++)
+                acc += input[((b * c + ic) * h + y + fy) * w + x + fx] *
+                       filter[((oc * c + ic) * FILTER_SIZE + fy) *
+                                  FILTER_SIZE +
+                              fx];
+          output[((b * c + oc) * oh + y) * ow + x] = acc;
+        }
+  return output;
+}
+
+static ComputeOp::InitParams getConvParams(const std::vector<float> &filter,
+                                           const std::vector<uint32_t> &shape,
+                                           int workgroupSizeX,
+                                           int workgroupSizeY) {
+  ComputeOp::InitParams params;
+  params.filterWidth = FILTER_SIZE;
+  params.filterHeight = FILTER_SIZE;
+  params.computeFilter = filter;
+  params.WORKGROUPSIZE_X = workgroupSizeX;
+  params.WORKGROUPSIZE_Y = workgroupSizeY;
+  params.WORKGROUPSIZE_Z = 1;
+  params.DISPATCH_X = ceil((float)(shape[3] - FILTER_SIZE + 1) /
+                           workgroupSizeX);
+  params.DISPATCH_Y = ceil((float)(shape[2] - FILTER_SIZE + 1) /
+                           workgroupSizeY);
+  params.DISPATCH_Z = shape[0] * shape[1];
+  params.shader_path = "shaders/conv2d_tensor.comp.spv";
+  return params;
+}
+
+// One invocation per stored element, the groups spread over x and y.
+static ComputeOp::InitParams getAddParams(size_t count, int workgroupSizeX) {
+  ComputeOp::InitParams params;
+  params.WORKGROUPSIZE_X = workgroupSizeX;
+  params.WORKGROUPSIZE_Y = 1;
+  params.WORKGROUPSIZE_Z = 1;
+  const uint32_t groups =
+      (uint32_t)((count + workgroupSizeX - 1) / workgroupSizeX);
+  params.DISPATCH_X = std::min(groups, 65535u);
+  params.DISPATCH_Y = (groups + params.DISPATCH_X - 1) / params.DISPATCH_X;
+  params.DISPATCH_Z = 1;
+  params.shader_path = "shaders/add_tensor.comp.spv";
+  return params;
+}
+
+static int countMismatches(const std::vector<float> &output,
+                           const std::vector<float> &expected) {
+  int mismatches = 0;
+  for (size_t i = 0; i < output.size(); i++) {
+    const float tolerance = 1e-3f * std::max(1.0f, fabsf(expected[i]));
+    if (fabsf(output[i] - expected[i]) > tolerance)
+      mismatches++;
+  }
+  return mismatches;
+}
+
+static void logResult(const char *name, const std::vector<double> &runMs,
+                      double bytes, int mismatches) {
+  LOG("%s: median %fms, %.2f MB host<->device per run\n", name,
+      medianMs(runMs), bytes / (1024.0 * 1024.0));
+  if (mismatches)
+    LOG("%s: %d outputs differ from the CPU\n", name, mismatches);
+}
+
+#if defined(VK_USE_PLATFORM_ANDROID_KHR)
+void android_main(android_app *state) { android_realmain(state); }
+#else
+int main(int argc, char **argv) {
+  CommandLineParser cmdLine(argc, argv);
+  const uint32_t width = cmdLine.getWidth();
+  const uint32_t height = cmdLine.getHeight();
+  const uint32_t iterations = std::max(1u, cmdLine.getIterations());
+  const int WORKGROUPSIZE_X = cmdLine.getWorkgroupSizeX();
+  const int WORKGROUPSIZE_Y = cmdLine.getWorkgroupSizeY();
+  const uint32_t batch = getOption(cmdLine, "-b", 2);
+  const uint32_t channels = getOption(cmdLine, "-c", 16);
+  const uint32_t border = FILTER_SIZE - 1;
+  assert(width > 2 * border && height > 2 * border);
+
+  const std::vector<uint32_t> inputShape = {batch, channels, height, width};
+  const std::vector<uint32_t> middleShape = {batch, channels, height - border,
+                                             width - border};
+  const std::vector<uint32_t> outputShape = {
+      batch, channels, height - 2 * border, width - 2 * border};
+  std::vector<float> input((size_t)batch * channels * height * width);
+  for (size_t i = 0; i < input.size(); i++)
+    input[i] = (float)(i % 17) / 16.0f - 0.5f;
+  // Scaled so the sums stay near 1 whatever the channel count.
+  std::vector<float> filter(channels * channels * FILTER_SIZE * FILTER_SIZE);
+  for (size_t i = 0; i < filter.size(); i++)
+    filter[i] = (float)(i % 5 + 1) / (5.0f * channels * FILTER_SIZE);
+  std::vector<float> bias((size_t)batch * channels * middleShape[2] *
+                          middleShape[3]);
+  for (size_t i = 0; i < bias.size(); i++)
+    bias[i] = (float)(i % 7) / 7.0f;
+
+  std::vector<float> middle = conv2d(input, inputShape, filter);
+  for (size_t i = 0; i < middle.size(); i++)
+    middle[i] += bias[i];
+  const std::vector<float> expected = conv2d(middle, middleShape, filter);
+
+  std::shared_ptr<ComputeContext> context = ComputeContext::create();
+  const ComputeOp::InitParams convParams =
+      getConvParams(filter, inputShape, WORKGROUPSIZE_X, WORKGROUPSIZE_Y);
+  const ComputeOp::InitParams secondConvParams =
+      getConvParams(filter, middleShape, WORKGROUPSIZE_X, WORKGROUPSIZE_Y);
+  const ComputeOp::InitParams addParams =
+      getAddParams(Tensor::getStorageElementCount(middleShape,
+                                                  TENSOR_LAYOUT_NCHW),
+                   WORKGROUPSIZE_X);
+  std::vector<float> output(expected.size());
+
+  {
+    // Every op output makes a round trip through the host, as separate
+    // execute() calls do.
+    Tensor inputTensor(context, inputShape);
+    Tensor biasTensor(context, middleShape);
+    Tensor convTensor(context, middleShape);
+    Tensor sumTensor(context, middleShape);
+    Tensor outputTensor(context, outputShape);
+    ComputeOp::InitParams params = convParams;
+    params.setTensorShapes(inputTensor, convTensor);
+    ComputeBufferOp first(params, context);
+    params = addParams;
+    params.setTensorShapes(convTensor, sumTensor);
+    ComputeBufferOp add(params, context);
+    add.prepare(convTensor, sumTensor, &biasTensor);
+    params = secondConvParams;
+    params.setTensorShapes(sumTensor, outputTensor);
+    ComputeBufferOp second(params, context);
+    biasTensor.upload(bias.data());
+
+    std::vector<float> hostMiddle(middle.size());
+    auto runOps = [&]() {
+      inputTensor.upload(input.data());
+      first.run(inputTensor, convTensor);
+      convTensor.download(hostMiddle.data());
+      convTensor.upload(hostMiddle.data());
+      add.run(convTensor, sumTensor);
+      sumTensor.download(hostMiddle.data());
+      sumTensor.upload(hostMiddle.data());
+      second.run(sumTensor, outputTensor);
+      outputTensor.download(output.data());
+    };
+    for (int i = 0; i < WARMUP_ITERATIONS; i++)
+      runOps();
+    std::vector<double> runMs(iterations);
+    for (uint32_t i = 0; i < iterations; i++) {
+      auto begin = Clock::now();
+      runOps();
+      runMs[i] = elapsedMs(begin, Clock::now());
+    }
+    logResult("separate ops", runMs,
+              inputTensor.getBytes() + 2.0 * convTensor.getBytes() +
+                  2.0 * sumTensor.getBytes() + outputTensor.getBytes(),
+              countMismatches(output, expected));
+  }
+
+  {
+    ComputeGraph graph(context);
+    Tensor *inputTensor = graph.addTensor(inputShape);
+    Tensor *biasTensor = graph.addTensor(middleShape);
+    Tensor *convTensor = graph.addTensor(middleShape);
+    Tensor *sumTensor = graph.addTensor(middleShape);
+    Tensor *outputTensor = graph.addTensor(outputShape);
+    graph.addNode(convParams, inputTensor, convTensor);
+    graph.addNode(addParams, convTensor, sumTensor, biasTensor);
+    graph.addNode(secondConvParams, sumTensor, outputTensor);
+    assert(graph.getInputs().size() == 2 && graph.getOutputs().size() == 1);
+    graph.prepare();
+    biasTensor->upload(bias.data());
+
+    auto runGraph = [&]() {
+      inputTensor->upload(input.data());
+      graph.run();
+      outputTensor->download(output.data());
+    };
+    for (int i = 0; i < WARMUP_ITERATIONS; i++)
+      runGraph();
+    std::vector<double> runMs(iterations);
+    for (uint32_t i = 0; i < iterations; i++) {
+      auto begin = Clock::now();
+      runGraph();
+      runMs[i] = elapsedMs(begin, Clock::now());
+    }
+    logResult("graph", runMs,
+              (double)inputTensor->getBytes() + outputTensor->getBytes(),
+              countMismatches(output, expected));
+  }
+  return 0;
+}
+#endif
@@ -0,0 +1,180 @@
+#if defined(_WIN32)
+#pragma comment(linker, "/subsystem:console")
+#elif defined(VK_USE_PLATFORM_ANDROID_KHR)
+#include "VulkanAndroid.h"
+#include <android/asset_manager.h>
+#include <android/log.h>
+#include <android/native_activity.h>
+#include <android_native_app_glue.h>
+#endif
+
+#include <algorithm>
+#include <iostream>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+#include "CommandLineParser.h"
+#include "ComputeBufferOp.h"
+#include "Tensor.h"
+#include "Utils.h"
+
+#define DEBUG (!NDEBUG)
+
+// Chains two 3x3 convolutions over -b batches of -c channels on Tensors in
+// each layout. The intermediate tensor never leaves the device. Reports the
+// median time of the chain and checks the result against the CPU.
+// Usage: conv2d_tensor -w 256 -h 256 -b 2 -c 16 -n 20
+const int WARMUP_ITERATIONS = 3;
+const uint32_t FILTER_SIZE = 3;
+
+static double elapsedMs(const Clock::time_point &begin,
+                        const Clock::time_point &end) {
+  return (double)(std::chrono::duration_cast<std::chrono::nanoseconds>(end -
+                                                                       begin)
+                      .count()) /
+         NS2MS;
+}
+
+static int getOption(const CommandLineParser &cmdLine, const char *option,
+                     int defaultValue) {
+  const std::string &value = cmdLine.getCmdOption(option);
+  return value.empty() ? defaultValue : std::max(1, atoi(value.c_str()));
+}
+
+// The same convolution as shaders/conv2d_tensor.comp on NCHW data.
+static std::vector<float> conv2d(const std::vector<float> &input,
+                                 const std::vector<uint32_t> &shape,
+                                 const std::vector<float> &filter,
+                                 uint32_t outChannels) {
+  const uint32_t n = shape[0], c = shape[1], h = shape[2], w = shape[3];
+  const uint32_t oh = h - FILTER_SIZE + 1, ow = w - FILTER_SIZE + 1;
+  std::vector<float> output((size_t)n * outChannels * oh * ow);
+  for (uint32_t b = 0; b < n; b++)
+    for (uint32_t oc = 0; oc < outChannels; oc++)
+      for (uint32_t y = 0; y < oh; y++)
+        for (uint32_t x = 0; x < ow; x++) {
+          float acc = 0.0f;
+          for (uint32_t ic = 0; ic < c; ic++)
+            for (uint32_t fy = 0; fy < FILTER_SIZE; fy++)
+              for (uint32_t fx = 0; fx < FILTER_SIZE; fx++)
+                acc += input[((b * c + ic) * h + y + fy) * w + x + fx] *
+                       filter[((oc * c + ic) * FILTER_SIZE + fy) *
+                                  FILTER_SIZE +
+                              fx];
+          output[((b * outChannels + oc) * oh + y) * ow + x] = acc;
+        }
+  return output;
+}
+
+static ComputeOp::InitParams getParams(const Tensor &input,
+                                       const Tensor &output,
+                                       const std::vector<float> &filter,
+                                       int workgroupSizeX,
+                                       int workgroupSizeY) {
+  ComputeOp::InitParams params;
+  params.setTensorShapes(input, output);
+  params.filterWidth = FILTER_SIZE;
+  params.filterHeight = FILTER_SIZE;
+  params.computeFilter = filter;
+  params.WORKGROUPSIZE_X = workgroupSizeX;
+  params.WORKGROUPSIZE_Y = workgroupSizeY;
+  params.WORKGROUPSIZE_Z = 1;
+  params.DISPATCH_X = ceil((float)params.outputWidth / workgroupSizeX);
+  params.DISPATCH_Y = ceil((float)params.outputHeight / workgroupSizeY);
+  params.DISPATCH_Z = params.batch * params.outputChannels;
+  params.shader_path = "shaders/conv2d_tensor.comp.spv";
+  return params;
+}
+
+static void runLayout(TensorLayout layout,
+                      std::shared_ptr<ComputeContext> context,
+                      const std::vector<uint32_t> &shape,
+                      const std::vector<float> &input,
+                      const std::vector<float> &filter, int workgroupSizeX,
+                      int workgroupSizeY, uint32_t iterations,
+                      const std::vector<float> &expected) {
+  const uint32_t n = shape[0], c = shape[1], h = shape[2], w = shape[3];
+  const uint32_t border = FILTER_SIZE - 1;
+  Tensor inputTensor(context, shape, ELEMENT_TYPE_FLOAT32, layout);
+  Tensor middleTensor(context, {n, c, h - border, w - border},
+                      ELEMENT_TYPE_FLOAT32, layout);
+  Tensor outputTensor(context, {n, c, h - 2 * border, w - 2 * border},
+                      ELEMENT_TYPE_FLOAT32, layout);
+  ComputeBufferOp first(getParams(inputTensor, middleTensor, filter,
+                                  workgroupSizeX, workgroupSizeY),
+                        context);
+  ComputeBufferOp second(getParams(middleTensor, outputTensor, filter,
+                                   workgroupSizeX, workgroupSizeY),
+                         context);
+
+  inputTensor.upload(input.data());
+  for (int i = 0; i < WARMUP_ITERATIONS; i++) {
+    first.run(inputTensor, middleTensor);
+    second.run(middleTensor, outputTensor);
+  }
+  std::vector<double> runMs(iterations);
+  for (uint32_t i = 0; i < iterations; i++) {
+    auto begin = Clock::now();
+    first.run(inputTensor, middleTensor);
+    second.run(middleTensor, outputTensor);
+    runMs[i] = elapsedMs(begin, Clock::now());
+  }
+  std::vector<float> output(outputTensor.getElementCount());
+  outputTensor.download(output.data());
+
+  int mismatches = 0;
+  for (size_t i = 0; i < output.size(); i++) {
+    const float tolerance = 1e-3f * std::max(1.0f, fabsf(expected[i]));
+    if (fabsf(output[i] - expected[i]) > tolerance)
+      mismatches++;
+  }
+  if (mismatches)
+    LOG("%s: %d outputs differ from the CPU\n", getTensorLayoutName(layout),
+        mismatches);
+  LOG("%s %ux%ux%ux%u x%d: two convs median %fms, %.1f MB on device\n",
+      getTensorLayoutName(layout), n, c, h, w, iterations, medianMs(runMs),
+      (inputTensor.getBytes() + middleTensor.getBytes() +
+       outputTensor.getBytes()) /
+          (1024.0 * 1024.0));
+}
+
+#if defined(VK_USE_PLATFORM_ANDROID_KHR)
+void android_main(android_app *state) { android_realmain(state); }
+#else
+int main(int argc, char **argv) {
+  CommandLineParser cmdLine(argc, argv);
+  const uint32_t width = cmdLine.getWidth();
+  const uint32_t height = cmdLine.getHeight();
+  const uint32_t iterations = std::max(1u, cmdLine.getIterations());
+  const int WORKGROUPSIZE_X = cmdLine.getWorkgroupSizeX();
+  const int WORKGROUPSIZE_Y = cmdLine.getWorkgroupSizeY();
+  const uint32_t batch = getOption(cmdLine, "-b", 2);
+  const uint32_t channels = getOption(cmdLine, "-c", 16);
+  assert(width > 2 * (FILTER_SIZE - 1) && height > 2 * (FILTER_SIZE - 1));
+
+  const std::vector<uint32_t> shape = {batch, channels, height, width};
+  std::vector<float> input((size_t)batch * channels * height * width);
+  for (size_t i = 0; i < input.size(); i++)
+    input[i] = (float)(i % 17) / 16.0f - 0.5f;
+  // Scaled so the sums stay near 1 whatever the channel count.
+  std::vector<float> filter(channels * channels * FILTER_SIZE * FILTER_SIZE);
+  for (size_t i = 0; i < filter.size(); i++)
+    filter[i] = (float)(i % 5 + 1) / (5.0f * channels * FILTER_SIZE);
+
+  const uint32_t border = FILTER_SIZE - 1;
+  const std::vector<float> middle = conv2d(input, shape, filter, channels);
+  const std::vector<float> expected = conv2d(
+      middle, {batch, channels, height - border, width - border}, filter,
+      channels);
+
+  std::shared_ptr<ComputeContext> context = ComputeContext::create();
+  for (TensorLayout layout : {TENSOR_LAYOUT_NCHW, TENSOR_LAYOUT_NHWC,
+                              TENSOR_LAYOUT_NC4HW4})
+    runLayout(layout, context, shape, input, filter, WORKGROUPSIZE_X,
+              WORKGROUPSIZE_Y, iterations, expected);
+  return 0;
+}
+#endif
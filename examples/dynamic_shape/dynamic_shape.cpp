@@ -0,0 +1,160 @@
+#if defined(_WIN32)
+#pragma comment(linker, "/subsystem:console")
+#elif defined(VK_USE_PLATFORM_ANDROID_KHR)
+#include "VulkanAndroid.h"
+#include <android/asset_manager.h>
+#include <android/log.h>
+#include <android/native_activity.h>
+#include <android_native_app_glue.h>
+#endif
+
+#include <algorithm>
+#include <iostream>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+#include "CommandLineParser.h"
+#include "ComputeBufferOp.h"
+#include "Utils.h"
+
+#define DEBUG (!NDEBUG)
+
+// Sweeps the add op over -s sizes up to -w x -h, building a new op for each
+// size with specialized shapes (a pipeline per size) and with dynamic shapes
+// (push constants, one pipeline for all sizes). For each it reports the
+// prepare() time, the part of it spent getting the pipeline, and the median
+// run() latency. Set VULKAN_COMPUTE_PIPELINE_CACHE_DIR= (empty) to keep the
+// on-disk pipeline cache from hiding the specialized compiles.
+// Usage: dynamic_shape -w 1024 -h 1024 -n 20 -s 8
+const int WARMUP_ITERATIONS = 3;
+
+struct Timing {
+  double prepareMs;
+  double pipelineMs;
+  double runMedianMs;
+};
+
+static double elapsedMs(const Clock::time_point &begin,
+                        const Clock::time_point &end) {
+  return (double)(std::chrono::duration_cast<std::chrono::nanoseconds>(end -
+                                                                       begin)
+                      .count()) /
+         NS2MS;
+}
+
+// step/steps of size, in whole workgroups: the specialized shader has no
+// bounds check.
+static int getStepSize(int size, int step, int steps, int workgroupSize) {
+  return std::max(workgroupSize,
+                  size * step / steps / workgroupSize * workgroupSize);
+}
+
+static Timing runSize(const ComputeOp::InitParams &params,
+                      std::shared_ptr<ComputeContext> context,
+                      uint32_t iterations, std::vector<DATA_TYPE> &output) {
+  const int size = params.inputWidth * params.inputHeight;
+  std::vector<DATA_TYPE> input(size);
+  for (int i = 0; i < size; i++)
+    input[i] = (DATA_TYPE)i;
+  output.resize(params.outputWidth * params.outputHeight);
+
+  Timing timing;
+  auto begin = Clock::now();
+  ComputeOp *computeOp = new ComputeBufferOp(params, context);
+  computeOp->prepare();
+  timing.prepareMs = elapsedMs(begin, Clock::now());
+  timing.pipelineMs = computeOp->getPipelineCreationMs();
+
+  for (int i = 0; i < WARMUP_ITERATIONS; i++)
+    computeOp->run(input, output);
+  std::vector<double> runMs(iterations);
+  for (uint32_t i = 0; i < iterations; i++) {
+    begin = Clock::now();
+    computeOp->run(input, output);
+    runMs[i] = elapsedMs(begin, Clock::now());
+  }
+  timing.runMedianMs = medianMs(runMs);
+  delete (computeOp);
+  return timing;
+}
+
+#if defined(VK_USE_PLATFORM_ANDROID_KHR)
+void android_main(android_app *state) { android_realmain(state); }
+#else
+int main(int argc, char **argv) {
+  CommandLineParser cmdLine(argc, argv);
+  const int width = cmdLine.getWidth();
+  const int height = cmdLine.getHeight();
+  const uint32_t iterations = std::max(1u, cmdLine.getIterations());
+  const int WORKGROUPSIZE_X = cmdLine.getWorkgroupSizeX();
+  const int WORKGROUPSIZE_Y = cmdLine.getWorkgroupSizeY();
+  const int WORKGROUPSIZE_Z = cmdLine.getWorkgroupSizeZ();
+  const std::string &stepOption = cmdLine.getCmdOption("-s");
+  const int steps =
+      stepOption.empty() ? 8 : std::max(1, atoi(stepOption.c_str()));
+
+  std::shared_ptr<ComputeContext> context = ComputeContext::create();
+  Timing specializedTotal = {};
+  Timing dynamicTotal = {};
+  int mismatches = 0;
+  for (int step = 1; step <= steps; step++) {
+    const int stepWidth = getStepSize(width, step, steps, WORKGROUPSIZE_X);
+    const int stepHeight = getStepSize(height, step, steps, WORKGROUPSIZE_Y);
+    ComputeOp::InitParams params;
+    params.inputWidth = stepWidth;
+    params.inputHeight = stepHeight;
+    params.filterWidth = stepWidth;
+    params.filterHeight = stepHeight;
+    params.outputWidth = stepWidth;
+    params.outputHeight = stepHeight;
+    params.DISPATCH_X = ceil((float)stepWidth / WORKGROUPSIZE_X);
+    params.DISPATCH_Y = ceil((float)stepHeight / WORKGROUPSIZE_Y);
+    params.DISPATCH_Z = 1;
+    params.WORKGROUPSIZE_X = WORKGROUPSIZE_X;
+    params.WORKGROUPSIZE_Y = WORKGROUPSIZE_Y;
+    params.WORKGROUPSIZE_Z = WORKGROUPSIZE_Z;
+    params.computeFilter.assign(stepWidth * stepHeight, 1.0f);
+    params.shader_path = "shaders/add/add_float.comp.spv";
+    params.executionMode = ComputeOp::EXECUTION_MODE_SINGLE_SUBMIT;
+
+    std::vector<DATA_TYPE> specializedOutput;
+    params.shapeMode = ComputeOp::SHAPE_MODE_SPECIALIZED;
+    const Timing specialized =
+        runSize(params, context, iterations, specializedOutput);
+    std::vector<DATA_TYPE> dynamicOutput;
+    params.shapeMode = ComputeOp::SHAPE_MODE_DYNAMIC;
+    const Timing dynamic = runSize(params, context, iterations, dynamicOutput);
+    if (specializedOutput != dynamicOutput)
+      mismatches++;
+
+    LOG("%dx%d specialized: prepare %fms (pipeline %fms), run median %fms\n",
+        stepWidth, stepHeight, specialized.prepareMs, specialized.pipelineMs,
+        specialized.runMedianMs);
+    LOG("%dx%d dynamic: prepare %fms (pipeline %fms), run median %fms\n",
+        stepWidth, stepHeight, dynamic.prepareMs, dynamic.pipelineMs,
+        dynamic.runMedianMs);
+    specializedTotal.prepareMs += specialized.prepareMs;
+    specializedTotal.pipelineMs += specialized.pipelineMs;
+    specializedTotal.runMedianMs += specialized.runMedianMs;
+    dynamicTotal.prepareMs += dynamic.prepareMs;
+    dynamicTotal.pipelineMs += dynamic.pipelineMs;
+    dynamicTotal.runMedianMs += dynamic.runMedianMs;
+  }
+
+  if (mismatches)
+    LOG("%d sizes differ between specialized and dynamic shapes\n",
+        mismatches);
+  LOG("%d sizes specialized: prepare %fms (pipeline %fms), run medians "
+      "%fms\n",
+      steps, specializedTotal.prepareMs, specializedTotal.pipelineMs,
+      specializedTotal.runMedianMs);
+  LOG("%d sizes dynamic: prepare %fms (pipeline %fms), run medians %fms\n",
+      steps, dynamicTotal.prepareMs, dynamicTotal.pipelineMs,
+      dynamicTotal.runMedianMs);
+  context->getPipelineObjectCache().logStats();
+  return 0;
+}
+#endif
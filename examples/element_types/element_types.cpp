@@ -0,0 +1,143 @@
+#if defined(_WIN32)
+#pragma comment(linker, "/subsystem:console")
+#elif defined(VK_USE_PLATFORM_ANDROID_KHR)
+#include "VulkanAndroid.h"
+#include <android/asset_manager.h>
+#include <android/log.h>
+#include <android/native_activity.h>
+#include <android_native_app_glue.h>
+#endif
+
+#include <algorithm>
+#include <iostream>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+#include "CommandLineParser.h"
+#include "ComputeBufferOp.h"
+#include "ComputeImageOp.h"
+#include "Utils.h"
+
+#define DEBUG (!NDEBUG)
+
+// Runs the buffer add op once per element type the device supports, then the
+// image add op on float and uint8 texels, with runTyped() so no time goes to
+// converting on the host, and reports the median run() latency and the bytes
+// moved per run. Inputs stay below 100 so every type holds them exactly.
+// Image texels hold four elements of a column, so the height should be a
+// multiple of 4.
+// Usage: element_types -w 1024 -h 1024 -n 20
+const int WARMUP_ITERATIONS = 3;
+
+static double elapsedMs(const Clock::time_point &begin,
+                        const Clock::time_point &end) {
+  return (double)(std::chrono::duration_cast<std::chrono::nanoseconds>(end -
+                                                                       begin)
+                      .count()) /
+         NS2MS;
+}
+
+template <typename T>
+static void runType(ComputeOp::InitParams params,
+                    std::shared_ptr<ComputeContext> context,
+                    uint32_t iterations, bool image = false) {
+  const ElementType type = ElementTraits<T>::type;
+  const char *name = image ? "add_image" : "add";
+  // Images of the types need no storage buffer features.
+  if (!image && !context->supportsElementType(type)) {
+    LOG("%s %s: not supported by the device, skipped\n", name,
+        getElementTypeName(type));
+    return;
+  }
+  params.elementType = type;
+  if (image) {
+    // add_image.comp is the float variant.
+    params.shader_path =
+        type == ELEMENT_TYPE_FLOAT32
+            ? "shaders/add_image/add_image.comp.spv"
+            : ElementTraits<T>::shaderPath("shaders/add_image/add_image");
+    params.format = ElementTraits<T>::format(4);
+  } else {
+    params.shader_path = ElementTraits<T>::shaderPath("shaders/add/add");
+  }
+  const int size = params.inputWidth * params.inputHeight;
+  // A filter of 1, already of the element type so it is uploaded as is.
+  params.computeFilter.reset(type, size);
+  params.computeFilter.assign(size, 1.0f);
+  std::vector<T> input(size);
+  for (int i = 0; i < size; i++)
+    input[i] = T((float)(i % 100));
+  std::vector<T> output(size);
+
+  ComputeOp *computeOp =
+      image ? (ComputeOp *)new ComputeImageOp(params, context)
+            : (ComputeOp *)new ComputeBufferOp(params, context);
+  computeOp->prepare();
+  for (int i = 0; i < WARMUP_ITERATIONS; i++)
+    computeOp->runTyped(input, output);
+  std::vector<double> runMs(iterations);
+  for (uint32_t i = 0; i < iterations; i++) {
+    auto begin = Clock::now();
+    computeOp->runTyped(input, output);
+    runMs[i] = elapsedMs(begin, Clock::now());
+  }
+  delete (computeOp);
+
+  // The filter is all 1.
+  int mismatches = 0;
+  for (int i = 0; i < size; i++) {
+    if ((float)output[i] != (float)(i % 100) + 1.0f)
+      mismatches++;
+  }
+  if (mismatches)
+    LOG("%s %s: %d outputs differ from the expected sum\n", name,
+        getElementTypeName(type), mismatches);
+  // Input and filter in, output out.
+  const double bytes = 3.0 * size * getElementSize(type);
+  LOG("%s %s x%d: run median %fms, %.1f MB per run\n", name,
+      getElementTypeName(type), iterations, medianMs(runMs),
+      bytes / (1024.0 * 1024.0));
+}
+
+#if defined(VK_USE_PLATFORM_ANDROID_KHR)
+void android_main(android_app *state) { android_realmain(state); }
+#else
+int main(int argc, char **argv) {
+  CommandLineParser cmdLine(argc, argv);
+  const int width = cmdLine.getWidth();
+  const int height = cmdLine.getHeight();
+  const uint32_t iterations = std::max(1u, cmdLine.getIterations());
+  const int WORKGROUPSIZE_X = cmdLine.getWorkgroupSizeX();
+  const int WORKGROUPSIZE_Y = cmdLine.getWorkgroupSizeY();
+  const int WORKGROUPSIZE_Z = cmdLine.getWorkgroupSizeZ();
+
+  ComputeOp::InitParams params;
+  params.inputWidth = width;
+  params.inputHeight = height;
+  params.filterWidth = width;
+  params.filterHeight = height;
+  params.outputWidth = width;
+  params.outputHeight = height;
+  params.DISPATCH_X = ceil((float)width / WORKGROUPSIZE_X);
+  params.DISPATCH_Y = ceil((float)height / WORKGROUPSIZE_Y);
+  params.DISPATCH_Z = 1;
+  params.WORKGROUPSIZE_X = WORKGROUPSIZE_X;
+  params.WORKGROUPSIZE_Y = WORKGROUPSIZE_Y;
+  params.WORKGROUPSIZE_Z = WORKGROUPSIZE_Z;
+  params.executionMode = ComputeOp::EXECUTION_MODE_SINGLE_SUBMIT;
+
+  std::shared_ptr<ComputeContext> context = ComputeContext::create();
+  runType<float>(params, context, iterations);
+  runType<int32_t>(params, context, iterations);
+  runType<uint32_t>(params, context, iterations);
+  runType<Half>(params, context, iterations);
+  runType<int8_t>(params, context, iterations);
+  runType<uint8_t>(params, context, iterations);
+  runType<float>(params, context, iterations, true);
+  runType<uint8_t>(params, context, iterations, true);
+  return 0;
+}
+#endif
@@ -0,0 +1,176 @@
+#if defined(_WIN32)
+#pragma comment(linker, "/subsystem:console")
+#elif defined(VK_USE_PLATFORM_ANDROID_KHR)
+#include "VulkanAndroid.h"
+#include <android/asset_manager.h>
+#include <android/log.h>
+#include <android/native_activity.h>
+#include <android_native_app_glue.h>
+#endif
+
+#include <algorithm>
+#include <iostream>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+#include "CommandLineParser.h"
+#include "ComputeGraph.h"
+#include "ElementwiseChain.h"
+#include "Utils.h"
+
+#define DEBUG (!NDEBUG)
+
+// Runs elementwise chains on a width x height buffer, first with one
+// ComputeBufferOp per step (add steps on shaders/add/add_float.comp, the
+// others on single step elementwise kernels), then fused into one
+// dispatch. Both run as a ComputeGraph, so only device memory traffic
+// differs. Reports the median time, the bytes each variant reads and
+// writes and the effective bandwidth, and checks both against the CPU.
+// Usage: elementwise_fusion -w 1024 -h 1024 -wx 16 -wy 16 -n 20
+const int WARMUP_ITERATIONS = 3;
+
+static double elapsedMs(const Clock::time_point &begin,
+                        const Clock::time_point &end) {
+  return (double)(std::chrono::duration_cast<std::chrono::nanoseconds>(end -
+                                                                       begin)
+                      .count()) /
+         NS2MS;
+}
+
+// Runs graph and returns its median time, leaving the result in output.
+static double runGraph(ComputeGraph &graph, Tensor *inputTensor,
+                       const std::vector<float> &input, Tensor *outputTensor,
+                       std::vector<float> &output, uint32_t iterations) {
+  graph.prepare();
+  inputTensor->upload(input.data());
+  for (int i = 0; i < WARMUP_ITERATIONS; i++)
+    graph.run();
+  std::vector<double> runMs(iterations);
+  for (uint32_t i = 0; i < iterations; i++) {
+    auto begin = Clock::now();
+    graph.run();
+    runMs[i] = elapsedMs(begin, Clock::now());
+  }
+  outputTensor->download(output.data());
+  return medianMs(runMs);
+}
+
+static void logResult(const char *name, const char *variant, double ms,
+                      double bytes, const std::vector<float> &output,
+                      const std::vector<float> &expected) {
+  int mismatches = 0;
+  for (size_t i = 0; i < output.size(); i++) {
+    if (fabsf(output[i] - expected[i]) >
+        1e-4f * std::max(1.0f, fabsf(expected[i])))
+      mismatches++;
+  }
+  LOG("%s %s: median %fms, %.2f MB moved, %.2f GB/s\n", name, variant, ms,
+      bytes / (1024.0 * 1024.0), bytes / (ms * 1e6));
+  if (mismatches)
+    LOG("%s %s: %d outputs differ from the CPU\n", name, variant,
+        mismatches);
+}
+
+static void compareChain(const char *name, const ElementwiseChain &chain,
+                         const ComputeOp::InitParams &params,
+                         std::shared_ptr<ComputeContext> context,
+                         uint32_t iterations) {
+  const std::vector<uint32_t> shape = {1, 1, (uint32_t)params.inputHeight,
+                                       (uint32_t)params.inputWidth};
+  const size_t count = (size_t)params.inputWidth * params.inputHeight;
+  std::vector<float> input(count), operand(count), expected(count);
+  for (size_t i = 0; i < count; i++) {
+    input[i] = (float)(i % 200) / 100.0f - 1.0f;
+    operand[i] = (float)((i * 7) % 100) / 100.0f - 0.5f;
+    expected[i] = chain.evaluate(input[i], operand[i]);
+  }
+  std::vector<float> output(count);
+  const double elementBytes = (double)count * sizeof(float);
+
+  {
+    ComputeGraph graph(context);
+    Tensor *inputTensor = graph.addTensor(shape);
+    Tensor *operandTensor = graph.addTensor(shape);
+    Tensor *tensor = inputTensor;
+    for (const ElementwiseChain::Stage &stage : chain.getStages()) {
+      Tensor *next = graph.addTensor(shape);
+      ComputeOp::InitParams stageParams = params;
+      if (stage.type == ELEMENTWISE_ADD) {
+        stageParams.shader_path = "shaders/add/add_float.comp.spv";
+        graph.addNode(stageParams, tensor, next, operandTensor);
+      } else {
+        ElementwiseChain single;
+        if (stage.type == ELEMENTWISE_BIAS)
+          single.bias(stage.value);
+        else if (stage.type == ELEMENTWISE_SCALE)
+          single.scale(stage.value);
+        else
+          single.relu();
+        single.apply(stageParams);
+        graph.addNode(stageParams, tensor, next);
+      }
+      tensor = next;
+    }
+    operandTensor->upload(operand.data());
+    const double ms =
+        runGraph(graph, inputTensor, input, tensor, output, iterations);
+    logResult(name, "separate", ms, chain.getUnfusedAccesses() * elementBytes,
+              output, expected);
+  }
+
+  {
+    ComputeGraph graph(context);
+    Tensor *inputTensor = graph.addTensor(shape);
+    Tensor *operandTensor = graph.addTensor(shape);
+    Tensor *outputTensor = graph.addTensor(shape);
+    ComputeOp::InitParams fusedParams = params;
+    chain.apply(fusedParams);
+    graph.addNode(fusedParams, inputTensor, outputTensor,
+                  chain.readsOperand() ? operandTensor : nullptr);
+    operandTensor->upload(operand.data());
+    const double ms = runGraph(graph, inputTensor, input, outputTensor,
+                               output, iterations);
+    logResult(name, "fused", ms, chain.getFusedAccesses() * elementBytes,
+              output, expected);
+  }
+}
+
+#if defined(VK_USE_PLATFORM_ANDROID_KHR)
+void android_main(android_app *state) { android_realmain(state); }
+#else
+int main(int argc, char **argv) {
+  CommandLineParser cmdLine(argc, argv);
+  const int width = cmdLine.getWidth();
+  const int height = cmdLine.getHeight();
+  const uint32_t iterations = std::max(1u, cmdLine.getIterations());
+  const int WORKGROUPSIZE_X = cmdLine.getWorkgroupSizeX();
+  const int WORKGROUPSIZE_Y = cmdLine.getWorkgroupSizeY();
+  // add_float.comp has no bounds check.
+  assert(width % WORKGROUPSIZE_X == 0 && height % WORKGROUPSIZE_Y == 0);
+  std::shared_ptr<ComputeContext> context = ComputeContext::create();
+
+  ComputeOp::InitParams params;
+  params.inputWidth = width;
+  params.inputHeight = height;
+  params.filterWidth = width;
+  params.filterHeight = height;
+  params.outputWidth = width;
+  params.outputHeight = height;
+  params.WORKGROUPSIZE_X = WORKGROUPSIZE_X;
+  params.WORKGROUPSIZE_Y = WORKGROUPSIZE_Y;
+  params.WORKGROUPSIZE_Z = 1;
+  params.DISPATCH_X = width / WORKGROUPSIZE_X;
+  params.DISPATCH_Y = height / WORKGROUPSIZE_Y;
+  params.DISPATCH_Z = 1;
+
+  compareChain("add x4", ElementwiseChain().add().add().add().add(), params,
+               context, iterations);
+  compareChain("add bias relu scale",
+               ElementwiseChain().add().bias(0.25f).relu().scale(0.5f), params,
+               context, iterations);
+  return 0;
+}
+#endif
@@ -0,0 +1,183 @@
+#if defined(_WIN32)
+#pragma comment(linker, "/subsystem:console")
+#elif defined(VK_USE_PLATFORM_ANDROID_KHR)
+#include "VulkanAndroid.h"
+#include <android/asset_manager.h>
+#include <android/log.h>
+#include <android/native_activity.h>
+#include <android_native_app_glue.h>
+#endif
+
+#include <algorithm>
+#include <iostream>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+#include "CommandLineParser.h"
+#include "ComputeBufferOp.h"
+#include "Utils.h"
+
+#define DEBUG (!NDEBUG)
+
+// Runs the add, add_vec4 and conv2d_buffer kernels on fp32 and on fp16
+// storage, the latter both accumulating in fp32 and computing in float16
+// where the device has shaderFloat16. For each it reports the median run()
+// latency, the effective bandwidth and speedup over fp32, and the largest
+// absolute and relative error against the fp32 output. Data is passed with
+// runTyped() so host conversion is not part of the timing.
+// Usage: fp16_kernels -w 1024 -h 1024 -n 20
+const int WARMUP_ITERATIONS = 3;
+
+struct Report {
+  double runMedianMs = 0.0;
+  double bytes = 0.0;
+  std::vector<float> output;
+};
+
+static double elapsedMs(const Clock::time_point &begin,
+                        const Clock::time_point &end) {
+  return (double)(std::chrono::duration_cast<std::chrono::nanoseconds>(end -
+                                                                       begin)
+                      .count()) /
+         NS2MS;
+}
+
+template <typename T>
+static Report runKernel(ComputeOp::InitParams params,
+                        std::shared_ptr<ComputeContext> context,
+                        uint32_t iterations) {
+  params.elementType = ElementTraits<T>::type;
+  const int inputSize = params.inputWidth * params.inputHeight;
+  const int outputSize = params.outputWidth * params.outputHeight;
+  std::vector<T> input(inputSize);
+  for (int i = 0; i < inputSize; i++)
+    input[i] = T(params.computeInput.getFloat(i));
+  std::vector<T> output(outputSize);
+
+  ComputeOp *computeOp = new ComputeBufferOp(params, context);
+  computeOp->prepare();
+  for (int i = 0; i < WARMUP_ITERATIONS; i++)
+    computeOp->runTyped(input, output);
+  std::vector<double> runMs(iterations);
+  for (uint32_t i = 0; i < iterations; i++) {
+    auto begin = Clock::now();
+    computeOp->runTyped(input, output);
+    runMs[i] = elapsedMs(begin, Clock::now());
+  }
+  delete (computeOp);
+
+  Report report;
+  report.runMedianMs = medianMs(runMs);
+  report.bytes = (double)(inputSize + params.computeFilter.size() +
+                          outputSize) *
+                 sizeof(T);
+  report.output.assign(output.begin(), output.end());
+  return report;
+}
+
+static void logReport(const char *kernel, const char *variant,
+                      const Report &report, const Report &reference) {
+  double maxAbsError = 0.0, maxRelError = 0.0;
+  for (size_t i = 0; i < report.output.size(); i++) {
+    const double error = fabs(report.output[i] - reference.output[i]);
+    maxAbsError = std::max(maxAbsError, error);
+    // Near zero outputs would make the relative error meaningless.
+    if (fabs(reference.output[i]) > 1e-3)
+      maxRelError = std::max(maxRelError, error / fabs(reference.output[i]));
+  }
+  LOG("%s %s: run median %fms, %.2f GB/s, %.2fx of fp32, max abs error %g, "
+      "max rel error %g\n",
+      kernel, variant, report.runMedianMs,
+      report.bytes / (report.runMedianMs * 1e6),
+      reference.runMedianMs / report.runMedianMs, maxAbsError, maxRelError);
+}
+
+static void compareKernel(const char *kernel, const std::string &prefix,
+                          ComputeOp::InitParams params,
+                          std::shared_ptr<ComputeContext> context,
+                          uint32_t iterations) {
+  params.shader_path = prefix + ".comp.spv";
+  const Report fp32 = runKernel<float>(params, context, iterations);
+  logReport(kernel, "fp32", fp32, fp32);
+  if (!context->supportsElementType(ELEMENT_TYPE_FLOAT16)) {
+    LOG("%s fp16: no 16 bit storage, skipped\n", kernel);
+    return;
+  }
+
+  params.shader_path = ElementTraits<Half>::shaderPath(prefix);
+  params.float16Mode = ComputeOp::FLOAT16_MODE_FP32_ACCUMULATE;
+  logReport(kernel, "fp16 (fp32 accumulate)",
+            runKernel<Half>(params, context, iterations), fp32);
+  if (!context->supportsFloat16Arithmetic()) {
+    LOG("%s fp16 (native): no shaderFloat16, skipped\n", kernel);
+    return;
+  }
+  params.float16Mode = ComputeOp::FLOAT16_MODE_NATIVE;
+  logReport(kernel, "fp16 (native)",
+            runKernel<Half>(params, context, iterations), fp32);
+}
+
+// Values in [-1, 1), where float16 has about three decimal digits.
+static std::vector<DATA_TYPE> getData(int size, int seed) {
+  std::vector<DATA_TYPE> data(size);
+  for (int i = 0; i < size; i++)
+    data[i] = (DATA_TYPE)((i * 37 + seed) % 200) / 100.0f - 1.0f;
+  return data;
+}
+
+#if defined(VK_USE_PLATFORM_ANDROID_KHR)
+void android_main(android_app *state) { android_realmain(state); }
+#else
+int main(int argc, char **argv) {
+  CommandLineParser cmdLine(argc, argv);
+  const int width = cmdLine.getWidth();
+  const int height = cmdLine.getHeight();
+  const uint32_t iterations = std::max(1u, cmdLine.getIterations());
+  const int WORKGROUPSIZE_X = cmdLine.getWorkgroupSizeX();
+  const int WORKGROUPSIZE_Y = cmdLine.getWorkgroupSizeY();
+  const int WORKGROUPSIZE_Z = cmdLine.getWorkgroupSizeZ();
+  std::shared_ptr<ComputeContext> context = ComputeContext::create();
+
+  ComputeOp::InitParams params;
+  params.inputWidth = width;
+  params.inputHeight = height;
+  params.filterWidth = width;
+  params.filterHeight = height;
+  params.outputWidth = width;
+  params.outputHeight = height;
+  params.DISPATCH_X = ceil((float)width / WORKGROUPSIZE_X);
+  params.DISPATCH_Y = ceil((float)height / WORKGROUPSIZE_Y);
+  params.DISPATCH_Z = 1;
+  params.WORKGROUPSIZE_X = WORKGROUPSIZE_X;
+  params.WORKGROUPSIZE_Y = WORKGROUPSIZE_Y;
+  params.WORKGROUPSIZE_Z = WORKGROUPSIZE_Z;
+  params.computeInput = getData(width * height, 0);
+  params.computeFilter = getData(width * height, 11);
+  params.executionMode = ComputeOp::EXECUTION_MODE_SINGLE_SUBMIT;
+  compareKernel("add", "shaders/add/add", params, context, iterations);
+
+  // Four elements per invocation, dispatched as in the add_vec4 example.
+  params.DISPATCH_X = ceil((float)width / (WORKGROUPSIZE_X * 4));
+  params.DISPATCH_Y = ceil((float)height / (WORKGROUPSIZE_X));
+  compareKernel("add_vec4", "shaders/add_vec4/add_vec4", params, context,
+                iterations);
+
+  // A 3x3 filter with no padding, as in the conv2d_buffer example.
+  params.filterWidth = 3;
+  params.filterHeight = 3;
+  params.outputWidth = width - params.filterWidth + 1;
+  params.outputHeight = height - params.filterHeight + 1;
+  params.DISPATCH_X = params.outputWidth;
+  params.DISPATCH_Y = params.outputHeight;
+  params.WORKGROUPSIZE_X = 1;
+  params.WORKGROUPSIZE_Y = 1;
+  params.WORKGROUPSIZE_Z = 1;
+  params.computeFilter = getData(params.filterWidth * params.filterHeight, 11);
+  compareKernel("conv2d_buffer", "shaders/conv2d_buffer", params, context,
+                iterations);
+  return 0;
+}
+#endif
@@ -0,0 +1,99 @@
+#if defined(_WIN32)
+#pragma comment(linker, "/subsystem:console")
+#elif defined(VK_USE_PLATFORM_ANDROID_KHR)
+#include "VulkanAndroid.h"
+#include <android/asset_manager.h>
+#include <android/log.h>
+#include <android/native_activity.h>
+#include <android_native_app_glue.h>
+#endif
+
+#include <algorithm>
+#include <iostream>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+#include "CommandLineParser.h"
+#include "ComputeBufferOp.h"
+#include "Utils.h"
+
+#define DEBUG (!NDEBUG)
+
+// Compares staged run() latency for input in a std::vector, which is copied
+// through the staging ring, against input in an AlignedVector, which is
+// imported with VK_EXT_external_memory_host when the device supports it.
+// Usage: host_import -w 1024 -h 1024 -n 50
+static double runTimed(ComputeOp *computeOp, uint32_t iterations,
+                       const DATA_TYPE *input, DATA_TYPE *output) {
+  computeOp->run(input, output);
+  auto begin = Clock::now();
+  for (uint32_t i = 0; i < iterations; i++)
+    computeOp->run(input, output);
+  auto end = Clock::now();
+  return (double)(std::chrono::duration_cast<std::chrono::nanoseconds>(end -
+                                                                       begin)
+                      .count()) /
+         NS2MS / iterations;
+}
+
+#if defined(VK_USE_PLATFORM_ANDROID_KHR)
+void android_main(android_app *state) { android_realmain(state); }
+#else
+int main(int argc, char **argv) {
+  CommandLineParser cmdLine(argc, argv);
+  const int width = cmdLine.getWidth();
+  const int height = cmdLine.getHeight();
+  const uint32_t iterations = std::max(1u, cmdLine.getIterations());
+  const int WORKGROUPSIZE_X = cmdLine.getWorkgroupSizeX();
+  const int WORKGROUPSIZE_Y = cmdLine.getWorkgroupSizeY();
+  const int WORKGROUPSIZE_Z = cmdLine.getWorkgroupSizeZ();
+
+  ComputeOp::InitParams params;
+  params.inputWidth = width;
+  params.inputHeight = height;
+  params.filterWidth = width;
+  params.filterHeight = height;
+  params.outputWidth = width;
+  params.outputHeight = height;
+  params.DISPATCH_X = ceil((float)width / WORKGROUPSIZE_X);
+  params.DISPATCH_Y = ceil((float)height / WORKGROUPSIZE_Y);
+  params.DISPATCH_Z = 1;
+  params.WORKGROUPSIZE_X = WORKGROUPSIZE_X;
+  params.WORKGROUPSIZE_Y = WORKGROUPSIZE_Y;
+  params.WORKGROUPSIZE_Z = WORKGROUPSIZE_Z;
+  params.computeFilter.assign(width * height, 1.0f);
+  params.shader_path = "shaders/add/add_float.comp.spv";
+
+  std::shared_ptr<ComputeContext> context = ComputeContext::getShared();
+  LOG("minImportedHostPointerAlignment: %llu\n",
+      (unsigned long long)context->getMinImportedHostPointerAlignment());
+
+  std::vector<DATA_TYPE> input(width * height);
+  AlignedVector alignedInput(width * height);
+  for (int i = 0; i < width * height; i++)
+    input[i] = alignedInput[i] = (DATA_TYPE)i;
+  std::vector<DATA_TYPE> copiedOutput(width * height);
+  std::vector<DATA_TYPE> importedOutput(width * height);
+
+  ComputeOp *computeOp = new ComputeBufferOp(params, context);
+  computeOp->prepare();
+  const double copiedMs =
+      runTimed(computeOp, iterations, input.data(), copiedOutput.data());
+  const uint32_t importsBefore = computeOp->getImportedUploadCount();
+  const double importedMs = runTimed(
+      computeOp, iterations, alignedInput.data(), importedOutput.data());
+  const uint32_t imports = computeOp->getImportedUploadCount() - importsBefore;
+  delete (computeOp);
+
+  if (copiedOutput != importedOutput)
+    LOG("Imported and copied input give different output\n");
+  LOG("%dx%d std::vector x%d: avg %fms\n", width, height, iterations,
+      copiedMs);
+  LOG("%dx%d AlignedVector x%d: avg %fms, %d of %d uploads imported\n", width,
+      height, iterations, importedMs, imports, iterations + 1);
+  return 0;
+}
+#endif
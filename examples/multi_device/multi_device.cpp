@@ -0,0 +1,129 @@
+#if defined(_WIN32)
+#pragma comment(linker, "/subsystem:console")
+#elif defined(VK_USE_PLATFORM_ANDROID_KHR)
+#include "VulkanAndroid.h"
+#include <android/asset_manager.h>
+#include <android/log.h>
+#include <android/native_activity.h>
+#include <android_native_app_glue.h>
+#endif
+
+#include <algorithm>
+#include <iostream>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+#include "CommandLineParser.h"
+#include "ComputeBufferOp.h"
+#include "ShardedBufferOp.h"
+#include "Utils.h"
+
+#define DEBUG (!NDEBUG)
+
+// Splits an add op along the height across -d contexts and compares it with
+// the same op on one context. Context i opens device i modulo the device
+// count, so with a single (e.g. software) device every shard still gets its
+// own logical device. -t weights the shards by measured device throughput.
+// Usage: multi_device -w 512 -h 512 -n 20 -d 2
+static double elapsedMs(const Clock::time_point &begin,
+                        const Clock::time_point &end) {
+  return (double)(std::chrono::duration_cast<std::chrono::nanoseconds>(end -
+                                                                       begin)
+                      .count()) /
+         NS2MS;
+}
+
+#if defined(VK_USE_PLATFORM_ANDROID_KHR)
+void android_main(android_app *state) { android_realmain(state); }
+#else
+int main(int argc, char **argv) {
+  CommandLineParser cmdLine(argc, argv);
+  const int width = cmdLine.getWidth();
+  const int height = cmdLine.getHeight();
+  const uint32_t iterations = std::max(1u, cmdLine.getIterations());
+  const int WORKGROUPSIZE_X = cmdLine.getWorkgroupSizeX();
+  const int WORKGROUPSIZE_Y = cmdLine.getWorkgroupSizeY();
+  const int WORKGROUPSIZE_Z = cmdLine.getWorkgroupSizeZ();
+  const std::string &deviceOption = cmdLine.getCmdOption("-d");
+  const int deviceCount =
+      deviceOption.empty() ? 2 : std::max(1, atoi(deviceOption.c_str()));
+  const bool weighted = cmdLine.cmdOptionExists("-t");
+
+  ComputeOp::InitParams params;
+  params.inputWidth = width;
+  params.inputHeight = height;
+  params.filterWidth = width;
+  params.filterHeight = height;
+  params.outputWidth = width;
+  params.outputHeight = height;
+  params.DISPATCH_X = ceil((float)width / WORKGROUPSIZE_X);
+  params.DISPATCH_Y = ceil((float)height / WORKGROUPSIZE_Y);
+  params.DISPATCH_Z = 1;
+  params.WORKGROUPSIZE_X = WORKGROUPSIZE_X;
+  params.WORKGROUPSIZE_Y = WORKGROUPSIZE_Y;
+  params.WORKGROUPSIZE_Z = WORKGROUPSIZE_Z;
+  std::vector<DATA_TYPE> filter(width * height);
+  for (int i = 0; i < width * height; i++)
+    filter[i] = (DATA_TYPE)(i % 7);
+  params.computeFilter = filter;
+  params.shader_path = "shaders/add/add_float.comp.spv";
+
+  std::vector<DATA_TYPE> input(width * height);
+  for (int i = 0; i < width * height; i++)
+    input[i] = (DATA_TYPE)i;
+
+  std::vector<std::shared_ptr<ComputeContext>> contexts;
+  std::vector<double> weights;
+  ComputeContext::DeviceSelection selection;
+  selection.policy = ComputeContext::DeviceSelection::POLICY_INDEX;
+  for (int i = 0; i < deviceCount; i++) {
+    selection.index = i;
+    contexts.push_back(ComputeContext::create(selection));
+    if (weighted)
+      weights.push_back(contexts.back()->measureThroughput());
+  }
+
+  std::vector<DATA_TYPE> singleOutput(width * height);
+  ComputeOp *singleOp = new ComputeBufferOp(params, contexts[0]);
+  singleOp->prepare();
+  singleOp->run(input, singleOutput);
+  auto begin = Clock::now();
+  for (uint32_t i = 0; i < iterations; i++)
+    singleOp->run(input, singleOutput);
+  const double singleMs = elapsedMs(begin, Clock::now()) / iterations;
+  delete (singleOp);
+
+  std::vector<DATA_TYPE> shardedOutput(width * height);
+  ShardedBufferOp *shardedOp = new ShardedBufferOp(params, contexts, weights);
+  shardedOp->prepare();
+  shardedOp->run(input, shardedOutput);
+  begin = Clock::now();
+  for (uint32_t i = 0; i < iterations; i++)
+    shardedOp->run(input, shardedOutput);
+  const double shardedMs = elapsedMs(begin, Clock::now()) / iterations;
+  for (uint32_t i = 0; i < shardedOp->getShardCount(); i++) {
+    std::shared_ptr<ComputeContext> context = shardedOp->getShardContext(i);
+    LOG("Shard %d: rows %d..%d on %s (device %d)\n", i,
+        shardedOp->getShardY(i),
+        shardedOp->getShardY(i) + shardedOp->getShardHeight(i) - 1,
+        context->getDeviceProperties().deviceName,
+        context->getPhysicalDeviceIndex());
+  }
+  delete (shardedOp);
+
+  int mismatches = 0;
+  for (int i = 0; i < width * height; i++) {
+    if (singleOutput[i] != shardedOutput[i])
+      mismatches++;
+  }
+  if (mismatches)
+    LOG("%d outputs differ between one and %d contexts\n", mismatches,
+        deviceCount);
+  LOG("1 context x%d: avg %fms\n", iterations, singleMs);
+  LOG("%d contexts x%d: avg %fms\n", deviceCount, iterations, shardedMs);
+  return 0;
+}
+#endif
@@ -0,0 +1,103 @@
+#if defined(_WIN32)
+#pragma comment(linker, "/subsystem:console")
+#elif defined(VK_USE_PLATFORM_ANDROID_KHR)
+#include "VulkanAndroid.h"
+#include <android/asset_manager.h>
+#include <android/log.h>
+#include <android/native_activity.h>
+#include <android_native_app_glue.h>
+#endif
+
+#include <algorithm>
+#include <iostream>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+#include "CommandLineParser.h"
+#include "ComputeBufferOp.h"
+#include "ComputeImageOp.h"
+#include "Utils.h"
+
+#define DEBUG (!NDEBUG)
+
+// Times pipeline creation on a fresh context twice: once with whatever is on
+// disk (empty after -c), and once more after the first context has saved its
+// pipeline cache. Run it again to see a warm start from a previous process.
+// Drivers with a shader cache of their own make cold starts faster too. A
+// second buffer op with the same shape shares the first one's pipeline.
+// Usage: pipeline_cache -w 128 -h 128 [-c]
+static void timePipelines(const ComputeOp::InitParams &bufferParams,
+                          const ComputeOp::InitParams &imageParams) {
+  std::shared_ptr<ComputeContext> context = ComputeContext::create();
+  const bool warm = context->getPipelineCache().isWarm();
+  ComputeOp *bufferOp = new ComputeBufferOp(bufferParams, context);
+  bufferOp->prepare();
+  ComputeOp *imageOp = new ComputeImageOp(imageParams, context);
+  imageOp->prepare();
+  LOG("%s start: buffer pipeline %fms, image pipeline %fms\n",
+      warm ? "Warm" : "Cold", bufferOp->getPipelineCreationMs(),
+      imageOp->getPipelineCreationMs());
+  ComputeOp *sameShapeOp = new ComputeBufferOp(bufferParams, context);
+  sameShapeOp->prepare();
+  LOG("Same shape buffer pipeline %fms\n",
+      sameShapeOp->getPipelineCreationMs());
+  context->getPipelineObjectCache().logStats();
+  delete (bufferOp);
+  delete (imageOp);
+  delete (sameShapeOp);
+  // Another op with the same bindings takes a descriptor set given back by
+  // the ones above, unless the device has push descriptors.
+  ComputeOp *rebuiltOp = new ComputeBufferOp(bufferParams, context);
+  rebuiltOp->prepare();
+  delete (rebuiltOp);
+  context->getDescriptorAllocator().logStats();
+  // The cache is saved as the context goes away.
+}
+
+#if defined(VK_USE_PLATFORM_ANDROID_KHR)
+void android_main(android_app *state) { android_realmain(state); }
+#else
+int main(int argc, char **argv) {
+  CommandLineParser cmdLine(argc, argv);
+  const int width = cmdLine.getWidth();
+  const int height = cmdLine.getHeight();
+  const int WORKGROUPSIZE_X = cmdLine.getWorkgroupSizeX();
+  const int WORKGROUPSIZE_Y = cmdLine.getWorkgroupSizeY();
+  const int WORKGROUPSIZE_Z = cmdLine.getWorkgroupSizeZ();
+
+  ComputeOp::InitParams params;
+  params.inputWidth = width;
+  params.inputHeight = height;
+  params.filterWidth = width;
+  params.filterHeight = height;
+  params.outputWidth = width;
+  params.outputHeight = height;
+  params.DISPATCH_X = ceil((float)width / WORKGROUPSIZE_X);
+  params.DISPATCH_Y = ceil((float)height / WORKGROUPSIZE_Y);
+  params.DISPATCH_Z = 1;
+  params.WORKGROUPSIZE_X = WORKGROUPSIZE_X;
+  params.WORKGROUPSIZE_Y = WORKGROUPSIZE_Y;
+  params.WORKGROUPSIZE_Z = WORKGROUPSIZE_Z;
+  params.computeFilter.assign(width * height, 1.0f);
+  ComputeOp::InitParams imageParams = params;
+  params.shader_path = "shaders/add/add_float.comp.spv";
+  imageParams.shader_path = "shaders/add_image/add_image.comp.spv";
+  imageParams.format = VK_FORMAT_R32G32B32A32_SFLOAT;
+
+  if (cmdLine.cmdOptionExists("-c")) {
+    std::string path;
+    {
+      std::shared_ptr<ComputeContext> context = ComputeContext::create();
+      path = context->getPipelineCache().getPath();
+    }
+    if (!path.empty() && remove(path.c_str()) == 0)
+      LOG("Removed %s\n", path.c_str());
+  }
+  timePipelines(params, imageParams);
+  timePipelines(params, imageParams);
+  return 0;
+}
+#endif
@@ -0,0 +1,113 @@
+#if defined(_WIN32)
+#pragma comment(linker, "/subsystem:console")
+#elif defined(VK_USE_PLATFORM_ANDROID_KHR)
+#include "VulkanAndroid.h"
+#include <android/asset_manager.h>
+#include <android/log.h>
+#include <android/native_activity.h>
+#include <android_native_app_glue.h>
+#endif
+
+#include <algorithm>
+#include <iostream>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+#include "CommandLineParser.h"
+#include "ComputeBufferOp.h"
+#include "Utils.h"
+
+#define DEBUG (!NDEBUG)
+
+// Prepares one add op, then runs it repeatedly with fresh input to report the
+// steady-state latency that remains once setup is paid for.
+// Usage: repeated_run -w 128 -h 128 -n 100
+const int WARMUP_ITERATIONS = 3;
+
+#if defined(VK_USE_PLATFORM_ANDROID_KHR)
+void android_main(android_app *state) { android_realmain(state); }
+#else
+int main(int argc, char **argv) {
+  CommandLineParser cmdLine(argc, argv);
+  const int width = cmdLine.getWidth();
+  const int height = cmdLine.getHeight();
+  const uint32_t iterations = std::max(1u, cmdLine.getIterations());
+  const int WORKGROUPSIZE_X = cmdLine.getWorkgroupSizeX();
+  const int WORKGROUPSIZE_Y = cmdLine.getWorkgroupSizeY();
+  const int WORKGROUPSIZE_Z = cmdLine.getWorkgroupSizeZ();
+
+  ComputeOp::InitParams params;
+  params.inputWidth = width;
+  params.inputHeight = height;
+  params.filterWidth = width;
+  params.filterHeight = height;
+  params.outputWidth = width;
+  params.outputHeight = height;
+  params.DISPATCH_X = ceil((float)width / WORKGROUPSIZE_X);
+  params.DISPATCH_Y = ceil((float)height / WORKGROUPSIZE_Y);
+  params.DISPATCH_Z = 1;
+  params.WORKGROUPSIZE_X = WORKGROUPSIZE_X;
+  params.WORKGROUPSIZE_Y = WORKGROUPSIZE_Y;
+  params.WORKGROUPSIZE_Z = WORKGROUPSIZE_Z;
+  params.computeFilter.assign(width * height, 1.0f);
+  params.shader_path = "shaders/add/add_float.comp.spv";
+
+  std::vector<DATA_TYPE> input(width * height);
+  std::vector<DATA_TYPE> output(width * height);
+
+  ComputeOp *computeOp = new ComputeBufferOp(params);
+  auto begin = Clock::now();
+  computeOp->prepare();
+  auto end = Clock::now();
+  const double prepareMs =
+      (double)(std::chrono::duration_cast<std::chrono::nanoseconds>(end - begin)
+                   .count()) /
+      NS2MS;
+
+  for (int i = 0; i < WARMUP_ITERATIONS; i++)
+    computeOp->run(input, output);
+
+  std::vector<double> runMs(iterations);
+  for (uint32_t i = 0; i < iterations; i++) {
+    for (int j = 0; j < width * height; j++)
+      input[j] = (DATA_TYPE)(i + j);
+    begin = Clock::now();
+    computeOp->run(input, output);
+    end = Clock::now();
+    runMs[i] = (double)(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                            end - begin)
+                            .count()) /
+               NS2MS;
+    if (output[0] != input[0] + 1.0f)
+      LOG("Run %d: unexpected output %f\n", i, output[0]);
+  }
+  // Memory held by the prepared op, sub-allocated from the context blocks.
+  std::shared_ptr<ComputeContext> context = ComputeContext::getShared();
+  context->getAllocator().logStats();
+  StagingRing &stagingRing = context->getStagingRing();
+  LOG("Staging ring: %llu bytes uploaded in %d submits, %d stalls\n",
+      (unsigned long long)stagingRing.getUploadedBytes(),
+      stagingRing.getSubmitCount(), stagingRing.getStallCount());
+  LOG("Queue timeline: %llu submits using %d fences\n",
+      (unsigned long long)context->getQueueTimeline().getLastSubmitted(),
+      context->getQueueTimeline().getFenceCount());
+  TransferQueue &transferQueue = context->getTransferQueue();
+  LOG("Transfer queue: %s, %d submits, %d ownership transfers\n",
+      transferQueue.isDedicated() ? "dedicated" : "shared with compute",
+      transferQueue.getSubmitCount(),
+      transferQueue.getOwnershipTransferCount());
+  delete (computeOp);
+
+  double total = 0.0;
+  for (uint32_t i = 0; i < iterations; i++)
+    total += runMs[i];
+  LOG("Prepare: %fms\n", prepareMs);
+  LOG("Run x%d: avg %fms, min %fms, median %fms, max %fms\n", iterations,
+      total / iterations, *std::min_element(runMs.begin(), runMs.end()),
+      medianMs(runMs), *std::max_element(runMs.begin(), runMs.end()));
+  return 0;
+}
+#endif
@@ -0,0 +1,74 @@
+#if defined(_WIN32)
+#pragma comment(linker, "/subsystem:console")
+#elif defined(VK_USE_PLATFORM_ANDROID_KHR)
+#include "VulkanAndroid.h"
+#include <android/asset_manager.h>
+#include <android/log.h>
+#include <android/native_activity.h>
+#include <android_native_app_glue.h>
+#endif
+
+#include <algorithm>
+#include <iostream>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+#include "CommandLineParser.h"
+#include "ComputeBufferOp.h"
+#include "Utils.h"
+
+#define DEBUG (!NDEBUG)
+
+// Measures the per-op setup cost (constructor + destructor) when every op
+// creates its own instance and device, versus ops sharing one ComputeContext.
+// Usage: shared_context -w 128 -h 128 -n 20
+static double timeOpSetup(const ComputeOp::InitParams &params,
+                          const uint32_t iterations, bool shareContext) {
+  std::shared_ptr<ComputeContext> context;
+  if (shareContext)
+    context = ComputeContext::create();
+
+  double total = 0.0;
+  for (uint32_t i = 0; i < iterations; i++) {
+    auto begin = Clock::now();
+    ComputeOp *computeOp = new ComputeBufferOp(
+        params, shareContext ? context : ComputeContext::create());
+    delete (computeOp);
+    auto end = Clock::now();
+    total +=
+        (double)(std::chrono::duration_cast<std::chrono::nanoseconds>(end -
+                                                                      begin)
+                     .count()) /
+        NS2MS;
+  }
+  return total / iterations;
+}
+
+#if defined(VK_USE_PLATFORM_ANDROID_KHR)
+void android_main(android_app *state) { android_realmain(state); }
+#else
+int main(int argc, char **argv) {
+  CommandLineParser cmdLine(argc, argv);
+  const int width = cmdLine.getWidth();
+  const int height = cmdLine.getHeight();
+  const uint32_t iterations = cmdLine.getIterations();
+
+  ComputeOp::InitParams params;
+  params.inputWidth = width;
+  params.inputHeight = height;
+  params.filterWidth = width;
+  params.filterHeight = height;
+  params.outputWidth = width;
+  params.outputHeight = height;
+  params.shader_path = "shaders/add/add_float.comp.spv";
+
+  const double dedicatedMs = timeOpSetup(params, iterations, false);
+  const double sharedMs = timeOpSetup(params, iterations, true);
+  LOG("Per-op setup, dedicated context: %fms\n", dedicatedMs);
+  LOG("Per-op setup, shared context: %fms\n", sharedMs);
+  return 0;
+}
+#endif
@@ -0,0 +1,137 @@
+#if defined(_WIN32)
+#pragma comment(linker, "/subsystem:console")
+#elif defined(VK_USE_PLATFORM_ANDROID_KHR)
+#include "VulkanAndroid.h"
+#include <android/asset_manager.h>
+#include <android/log.h>
+#include <android/native_activity.h>
+#include <android_native_app_glue.h>
+#endif
+
+#include <algorithm>
+#include <iostream>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+#include "CommandLineParser.h"
+#include "ComputeBufferOp.h"
+#include "ComputeImageOp.h"
+#include "Utils.h"
+
+#define DEBUG (!NDEBUG)
+
+// Compares the end-to-end latency of run() (upload, dispatch, readback) in
+// the staged mode against the single submit mode, for a buffer and an image
+// add op. Both modes must produce the same output.
+// Usage: single_submit -w 128 -h 128 -n 100
+const int WARMUP_ITERATIONS = 3;
+
+struct Latency {
+  double avg;
+  double median;
+  double min;
+};
+
+static Latency runTimed(ComputeOp *computeOp, uint32_t iterations,
+                        std::vector<DATA_TYPE> &input,
+                        std::vector<DATA_TYPE> &output) {
+  for (int i = 0; i < WARMUP_ITERATIONS; i++)
+    computeOp->run(input, output);
+
+  std::vector<double> runMs(iterations);
+  for (uint32_t i = 0; i < iterations; i++) {
+    auto begin = Clock::now();
+    computeOp->run(input, output);
+    auto end = Clock::now();
+    runMs[i] = (double)(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                            end - begin)
+                            .count()) /
+               NS2MS;
+  }
+  double total = 0.0;
+  for (uint32_t i = 0; i < iterations; i++)
+    total += runMs[i];
+  Latency latency = {total / iterations, medianMs(runMs),
+                     *std::min_element(runMs.begin(), runMs.end())};
+  return latency;
+}
+
+template <typename Op>
+static void compareModes(const char *name, ComputeOp::InitParams params,
+                         uint32_t iterations) {
+  const int inputSize = params.inputWidth * params.inputHeight;
+  const int outputSize = params.outputWidth * params.outputHeight;
+  std::vector<DATA_TYPE> input(inputSize);
+  for (int i = 0; i < inputSize; i++)
+    input[i] = (DATA_TYPE)i;
+  std::vector<DATA_TYPE> stagedOutput(outputSize);
+  std::vector<DATA_TYPE> singleSubmitOutput(outputSize);
+
+  params.executionMode = ComputeOp::EXECUTION_MODE_STAGED;
+  ComputeOp *stagedOp = new Op(params);
+  stagedOp->prepare();
+  const Latency staged = runTimed(stagedOp, iterations, input, stagedOutput);
+  delete (stagedOp);
+
+  params.executionMode = ComputeOp::EXECUTION_MODE_SINGLE_SUBMIT;
+  ComputeOp *singleSubmitOp = new Op(params);
+  singleSubmitOp->prepare();
+  const Latency singleSubmit =
+      runTimed(singleSubmitOp, iterations, input, singleSubmitOutput);
+  delete (singleSubmitOp);
+
+  int mismatches = 0;
+  for (int i = 0; i < outputSize; i++) {
+    if (stagedOutput[i] != singleSubmitOutput[i])
+      mismatches++;
+  }
+  if (mismatches)
+    LOG("%s: %d outputs differ between modes\n", name, mismatches);
+
+  LOG("%s x%d: staged avg %fms, median %fms, min %fms\n", name, iterations,
+      staged.avg, staged.median, staged.min);
+  LOG("%s x%d: single submit avg %fms, median %fms, min %fms\n", name,
+      iterations, singleSubmit.avg, singleSubmit.median, singleSubmit.min);
+  LOG("%s: single submit median is %.2fx of staged\n", name,
+      singleSubmit.median / staged.median);
+}
+
+#if defined(VK_USE_PLATFORM_ANDROID_KHR)
+void android_main(android_app *state) { android_realmain(state); }
+#else
+int main(int argc, char **argv) {
+  CommandLineParser cmdLine(argc, argv);
+  const int width = cmdLine.getWidth();
+  const int height = cmdLine.getHeight();
+  const uint32_t iterations = std::max(1u, cmdLine.getIterations());
+  const int WORKGROUPSIZE_X = cmdLine.getWorkgroupSizeX();
+  const int WORKGROUPSIZE_Y = cmdLine.getWorkgroupSizeY();
+  const int WORKGROUPSIZE_Z = cmdLine.getWorkgroupSizeZ();
+
+  ComputeOp::InitParams params;
+  params.inputWidth = width;
+  params.inputHeight = height;
+  params.filterWidth = width;
+  params.filterHeight = height;
+  params.outputWidth = width;
+  params.outputHeight = height;
+  params.DISPATCH_X = ceil((float)width / WORKGROUPSIZE_X);
+  params.DISPATCH_Y = ceil((float)height / WORKGROUPSIZE_Y);
+  params.DISPATCH_Z = 1;
+  params.WORKGROUPSIZE_X = WORKGROUPSIZE_X;
+  params.WORKGROUPSIZE_Y = WORKGROUPSIZE_Y;
+  params.WORKGROUPSIZE_Z = WORKGROUPSIZE_Z;
+  params.computeFilter.assign(width * height, 1.0f);
+
+  params.shader_path = "shaders/add/add_float.comp.spv";
+  compareModes<ComputeBufferOp>("Buffer add", params, iterations);
+
+  params.shader_path = "shaders/add_image/add_image.comp.spv";
+  params.format = VK_FORMAT_R32G32B32A32_SFLOAT;
+  compareModes<ComputeImageOp>("Image add", params, iterations);
+  return 0;
+}
+#endif
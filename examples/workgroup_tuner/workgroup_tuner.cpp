@@ -0,0 +1,122 @@
+#if defined(_WIN32)
+#pragma comment(linker, "/subsystem:console")
+#elif defined(VK_USE_PLATFORM_ANDROID_KHR)
+#include "VulkanAndroid.h"
+#include <android/asset_manager.h>
+#include <android/log.h>
+#include <android/native_activity.h>
+#include <android_native_app_glue.h>
+#endif
+
+#include <algorithm>
+#include <iostream>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+#include "CommandLineParser.h"
+#include "ComputeBufferOp.h"
+#include "Utils.h"
+#include "WorkgroupTuner.h"
+
+#define DEBUG (!NDEBUG)
+
+// Tunes the workgroup size of add and conv2d_buffer for a width x height
+// input and saves the winners in the tuning database of the device. Each
+// candidate is listed with its median GPU and run() time. Then runs the op
+// as configured with -wx/-wy/-wz, once with the tuned size, which it picks
+// at prepare time, and once without, to show the difference. Pass -r 1 to
+// tune again configurations the database already has.
+// Usage: workgroup_tuner -w 1024 -h 1024 -wx 16 -wy 16 -n 5
+static double getDispatchMs(const ComputeOp::InitParams &params,
+                            std::shared_ptr<ComputeContext> context) {
+  ComputeBufferOp op(params, context);
+  op.prepare();
+  ElementVector output;
+  op.run(params.computeInput, output);
+  op.run(params.computeInput, output);
+  return op.getDispatchMs();
+}
+
+static void tuneOp(const char *name, ComputeOp::InitParams params,
+                   std::shared_ptr<ComputeContext> context,
+                   const WorkgroupTuner::Options &options) {
+  WorkgroupTuner tuner(context);
+  const TuningDatabase::Entry best = tuner.tune(params, options);
+  for (const WorkgroupTuner::Candidate &candidate :
+       tuner.getLastCandidates()) {
+    LOG("%s %ux%ux%u: GPU %fms, run %fms\n", name,
+        candidate.entry.workgroupSizeX, candidate.entry.workgroupSizeY,
+        candidate.entry.workgroupSizeZ, candidate.entry.ms, candidate.runMs);
+  }
+
+  const double tunedMs = getDispatchMs(params, context);
+  params.useTunedWorkgroupSize = false;
+  const double untunedMs = getDispatchMs(params, context);
+  LOG("%s: tuned %ux%ux%u %fms, -wx/-wy/-wz %dx%dx%d %fms\n", name,
+      best.workgroupSizeX, best.workgroupSizeY, best.workgroupSizeZ,
+      tunedMs, params.WORKGROUPSIZE_X, params.WORKGROUPSIZE_Y,
+      params.WORKGROUPSIZE_Z, untunedMs);
+}
+
+#if defined(VK_USE_PLATFORM_ANDROID_KHR)
+void android_main(android_app *state) { android_realmain(state); }
+#else
+int main(int argc, char **argv) {
+  CommandLineParser cmdLine(argc, argv);
+  const int width = cmdLine.getWidth();
+  const int height = cmdLine.getHeight();
+  const int WORKGROUPSIZE_X = cmdLine.getWorkgroupSizeX();
+  const int WORKGROUPSIZE_Y = cmdLine.getWorkgroupSizeY();
+  const int WORKGROUPSIZE_Z = cmdLine.getWorkgroupSizeZ();
+  WorkgroupTuner::Options options;
+  options.iterations = std::max(1u, cmdLine.getIterations());
+  options.retune = atoi(cmdLine.getCmdOption("-r").c_str()) != 0;
+  std::shared_ptr<ComputeContext> context = ComputeContext::create();
+
+  ComputeOp::InitParams params;
+  params.inputWidth = width;
+  params.inputHeight = height;
+  params.filterWidth = width;
+  params.filterHeight = height;
+  params.outputWidth = width;
+  params.outputHeight = height;
+  params.DISPATCH_X = ceil((float)width / WORKGROUPSIZE_X);
+  params.DISPATCH_Y = ceil((float)height / WORKGROUPSIZE_Y);
+  params.DISPATCH_Z = 1;
+  params.WORKGROUPSIZE_X = WORKGROUPSIZE_X;
+  params.WORKGROUPSIZE_Y = WORKGROUPSIZE_Y;
+  params.WORKGROUPSIZE_Z = WORKGROUPSIZE_Z;
+  std::vector<DATA_TYPE> input(width * height);
+  for (int i = 0; i < width * height; i++)
+    input[i] = (DATA_TYPE)(i % 100);
+  params.computeInput = input;
+  params.computeFilter = input;
+  params.shader_path = "shaders/add/add_float.comp.spv";
+  tuneOp("add", params, context, options);
+
+  // A 3x3 filter with no padding, one invocation per output as in the
+  // conv2d_buffer example.
+  params.filterWidth = 3;
+  params.filterHeight = 3;
+  params.outputWidth = width - params.filterWidth + 1;
+  params.outputHeight = height - params.filterHeight + 1;
+  params.DISPATCH_X = params.outputWidth;
+  params.DISPATCH_Y = params.outputHeight;
+  params.DISPATCH_Z = 1;
+  params.WORKGROUPSIZE_X = 1;
+  params.WORKGROUPSIZE_Y = 1;
+  params.WORKGROUPSIZE_Z = 1;
+  params.computeFilter.assign(params.filterWidth * params.filterHeight, 1.0f);
+  params.shader_path = "shaders/conv2d_buffer.comp.spv";
+  tuneOp("conv2d_buffer", params, context, options);
+
+  TuningDatabase &database = context->getTuningDatabase();
+  if (database.save() == VK_SUCCESS)
+    LOG("Tuning database: %zu entries in %s\n", database.size(),
+        database.getPath().empty() ? "memory" : database.getPath().c_str());
+  return 0;
+}
+#endif
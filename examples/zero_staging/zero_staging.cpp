@@ -0,0 +1,128 @@
+#if defined(_WIN32)
+#pragma comment(linker, "/subsystem:console")
+#elif defined(VK_USE_PLATFORM_ANDROID_KHR)
+#include "VulkanAndroid.h"
+#include <android/asset_manager.h>
+#include <android/log.h>
+#include <android/native_activity.h>
+#include <android_native_app_glue.h>
+#endif
+
+#include <algorithm>
+#include <iostream>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+#include "CommandLineParser.h"
+#include "ComputeBufferOp.h"
+#include "Utils.h"
+
+#define DEBUG (!NDEBUG)
+
+// Compares the run() latency of a buffer add op in the staged, single submit
+// and zero staging modes. Zero staging only differs from single submit on
+// devices with device local, host visible memory (UMA, resizable BAR).
+// Usage: zero_staging -w 1024 -h 1024 -n 50
+const int WARMUP_ITERATIONS = 3;
+
+struct Latency {
+  double avg;
+  double median;
+  double min;
+};
+
+static Latency runTimed(ComputeOp::InitParams params, uint32_t iterations,
+                        const std::vector<DATA_TYPE> &input,
+                        std::vector<DATA_TYPE> &output) {
+  ComputeOp *computeOp = new ComputeBufferOp(params);
+  computeOp->prepare();
+  for (int i = 0; i < WARMUP_ITERATIONS; i++)
+    computeOp->run(input, output);
+
+  std::vector<double> runMs(iterations);
+  double total = 0.0;
+  for (uint32_t i = 0; i < iterations; i++) {
+    auto begin = Clock::now();
+    computeOp->run(input, output);
+    auto end = Clock::now();
+    runMs[i] = (double)(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                            end - begin)
+                            .count()) /
+               NS2MS;
+    total += runMs[i];
+  }
+  delete (computeOp);
+  Latency latency = {total / iterations, medianMs(runMs),
+                     *std::min_element(runMs.begin(), runMs.end())};
+  return latency;
+}
+
+#if defined(VK_USE_PLATFORM_ANDROID_KHR)
+void android_main(android_app *state) { android_realmain(state); }
+#else
+int main(int argc, char **argv) {
+  CommandLineParser cmdLine(argc, argv);
+  const int width = cmdLine.getWidth();
+  const int height = cmdLine.getHeight();
+  const uint32_t iterations = std::max(1u, cmdLine.getIterations());
+  const int WORKGROUPSIZE_X = cmdLine.getWorkgroupSizeX();
+  const int WORKGROUPSIZE_Y = cmdLine.getWorkgroupSizeY();
+  const int WORKGROUPSIZE_Z = cmdLine.getWorkgroupSizeZ();
+
+  ComputeOp::InitParams params;
+  params.inputWidth = width;
+  params.inputHeight = height;
+  params.filterWidth = width;
+  params.filterHeight = height;
+  params.outputWidth = width;
+  params.outputHeight = height;
+  params.DISPATCH_X = ceil((float)width / WORKGROUPSIZE_X);
+  params.DISPATCH_Y = ceil((float)height / WORKGROUPSIZE_Y);
+  params.DISPATCH_Z = 1;
+  params.WORKGROUPSIZE_X = WORKGROUPSIZE_X;
+  params.WORKGROUPSIZE_Y = WORKGROUPSIZE_Y;
+  params.WORKGROUPSIZE_Z = WORKGROUPSIZE_Z;
+  params.computeFilter.assign(width * height, 1.0f);
+  params.shader_path = "shaders/add/add_float.comp.spv";
+
+  std::shared_ptr<ComputeContext> context = ComputeContext::getShared();
+  const MemoryAllocator &allocator = context->getAllocator();
+  const uint32_t mappedDeviceLocal = allocator.selectMemoryType(
+      UINT32_MAX, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT |
+                      VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT);
+  if (mappedDeviceLocal == UINT32_MAX)
+    LOG("No device local host visible memory, zero staging falls back to "
+        "single submit\n");
+  else
+    LOG("Device local host visible memory: type %d, flags %x, heap %lluMB\n",
+        mappedDeviceLocal, allocator.getMemoryTypeFlags(mappedDeviceLocal),
+        (unsigned long long)(allocator.getHeapSize(mappedDeviceLocal) >> 20));
+
+  std::vector<DATA_TYPE> input(width * height);
+  for (int i = 0; i < width * height; i++)
+    input[i] = (DATA_TYPE)i;
+  const char *names[] = {"staged", "single submit", "zero staging"};
+  const ComputeOp::ExecutionMode modes[] = {
+      ComputeOp::EXECUTION_MODE_STAGED, ComputeOp::EXECUTION_MODE_SINGLE_SUBMIT,
+      ComputeOp::EXECUTION_MODE_ZERO_STAGING};
+  std::vector<DATA_TYPE> stagedOutput(width * height);
+  std::vector<DATA_TYPE> output(width * height);
+  Latency staged = {};
+  for (int m = 0; m < 3; m++) {
+    params.executionMode = modes[m];
+    const Latency latency = runTimed(params, iterations, input,
+                                     m == 0 ? stagedOutput : output);
+    if (m == 0)
+      staged = latency;
+    else if (output != stagedOutput)
+      LOG("%s: output differs from staged\n", names[m]);
+    LOG("%dx%d %s x%d: avg %fms, median %fms, min %fms (%.2fx of staged)\n",
+        width, height, names[m], iterations, latency.avg, latency.median,
+        latency.min, latency.median / staged.median);
+  }
+  return 0;
+}
+#endif
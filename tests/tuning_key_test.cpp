@@ -0,0 +1,59 @@
+/*
+ * Copyright (C) 2020 by Xu Xing (xu.xing@outlook.com)
+ *
+ * This code is licensed under the MIT license (MIT)
+ * (http://opensource.org/licenses/MIT)
+ */
+#include "ComputeOp.h"
+
+#include <stdio.h>
+
+namespace {
+
+int failures = 0;
+
+void expectDifferent(const ComputeOp::InitParams &a,
+                     const ComputeOp::InitParams &b, const char *what) {
+  const std::string keyA = a.getTuningKey();
+  const std::string keyB = b.getTuningKey();
+  if (keyA == keyB) {
+    printf("FAIL: %s give the same key %s\n", what, keyA.c_str());
+    failures++;
+  }
+}
+
+} // namespace
+
+// Configurations that differ in any one field of the key must not share a
+// TuningDatabase entry.
+int main() {
+  ComputeOp::InitParams params;
+  params.shader_path = "shaders/add/add.comp.spv";
+  params.inputWidth = params.filterWidth = params.outputWidth = 64;
+  params.inputHeight = params.filterHeight = params.outputHeight = 64;
+  params.DISPATCH_X = params.DISPATCH_Y = 8;
+  params.WORKGROUPSIZE_X = params.WORKGROUPSIZE_Y = 8;
+
+  ComputeOp::InitParams deeper = params;
+  deeper.DISPATCH_Z = 4;
+  expectDifferent(params, deeper, "configs differing in Z dispatch");
+
+  ComputeOp::InitParams widerZ = params;
+  widerZ.WORKGROUPSIZE_Z = 2;
+  expectDifferent(params, widerZ, "configs differing in Z workgroup size");
+
+  ComputeOp::InitParams accumulate = params;
+  accumulate.float16Mode = ComputeOp::FLOAT16_MODE_FP32_ACCUMULATE;
+  expectDifferent(params, accumulate, "configs differing in float16 mode");
+
+  ComputeOp::InitParams retiled = params;
+  retiled.DISPATCH_X = 16;
+  retiled.WORKGROUPSIZE_X = 4;
+  if (params.getTuningKey() != retiled.getTuningKey()) {
+    printf("FAIL: workgroup size changes the key\n");
+    failures++;
+  }
+
+  printf("%s\n", failures ? "FAILED" : "PASSED");
+  return failures ? 1 : 0;
+}